@@ -0,0 +1,118 @@
+/*
+Bounds - bounding volumes of the meshes and of the models
+
+Each Mesh computes its bounds at loading, in object space: an axis-aligned bounding box (AABB), and a bounding sphere (the center of the
+box, with the distance of the farthest vertex, which is smaller than the half diagonal of the box). The bounds of a Model are the union
+of the bounds of its meshes.
+The sphere is the cheapest test (e.g., the SIMD frustum culling of culling.h, and the selection of the levels of detail), while the box
+is tighter on elongated objects (e.g., the plane), and it is used to refine the result of the sphere test.
+
+Transform gives the bounds of the transformed object: the box is the AABB of the transformed box (J. Arvo, "Transforming Axis-Aligned
+Bounding Boxes", Graphics Gems, 1990), and the radius of the sphere is scaled by the maximum scale factor of the matrix.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+/////////////////// BOUNDS class ///////////////////////
+class Bounds
+{
+public:
+    // axis-aligned box
+    glm::vec3 boxMin, boxMax;
+    // sphere (radius < 0 = empty bounds)
+    glm::vec3 center;
+    GLfloat radius;
+
+    Bounds() : boxMin(0.0f), boxMax(0.0f), center(0.0f), radius(-1.0f) {}
+
+    // bounds of the positions of a set of vertices
+    static Bounds FromVertices(const Vertex* vertices, size_t numVertices)
+    {
+        Bounds bounds;
+        if (numVertices == 0)
+            return bounds;
+        bounds.boxMin = bounds.boxMax = vertices[0].Position;
+        for (size_t i = 1; i < numVertices; i++)
+        {
+            bounds.boxMin = glm::min(bounds.boxMin, vertices[i].Position);
+            bounds.boxMax = glm::max(bounds.boxMax, vertices[i].Position);
+        }
+        bounds.center = 0.5f * (bounds.boxMin + bounds.boxMax);
+        GLfloat radius2 = 0.0f;
+        for (size_t i = 0; i < numVertices; i++)
+        {
+            glm::vec3 d = vertices[i].Position - bounds.center;
+            radius2 = max(radius2, glm::dot(d, d));
+        }
+        bounds.radius = sqrt(radius2);
+        return bounds;
+    }
+
+    bool IsEmpty() const { return this->radius < 0.0f; }
+
+    //////////////////////////////////////////
+    // union with other bounds: the box contains both boxes, and the sphere is the smallest one containing both spheres
+    void Merge(const Bounds& other)
+    {
+        if (other.IsEmpty())
+            return;
+        if (this->IsEmpty())
+        {
+            *this = other;
+            return;
+        }
+        this->boxMin = glm::min(this->boxMin, other.boxMin);
+        this->boxMax = glm::max(this->boxMax, other.boxMax);
+        glm::vec3 d = other.center - this->center;
+        GLfloat distance = glm::length(d);
+        if (distance + other.radius <= this->radius)
+            return;
+        if (distance + this->radius <= other.radius)
+        {
+            this->center = other.center;
+            this->radius = other.radius;
+            return;
+        }
+        GLfloat radius = 0.5f * (distance + this->radius + other.radius);
+        this->center += d * ((radius - this->radius) / distance);
+        this->radius = radius;
+    }
+
+    //////////////////////////////////////////
+    // bounds of the object transformed by an affine matrix
+    Bounds Transform(const glm::mat4& matrix) const
+    {
+        if (this->IsEmpty())
+            return *this;
+        Bounds result;
+        // Arvo: each element of the matrix moves the minimum and the maximum of the new box by its product with the old extremes
+        glm::vec3 translation = glm::vec3(matrix[3]);
+        result.boxMin = result.boxMax = translation;
+        for (int c = 0; c < 3; c++)
+            for (int r = 0; r < 3; r++)
+            {
+                GLfloat a = matrix[c][r] * this->boxMin[c];
+                GLfloat b = matrix[c][r] * this->boxMax[c];
+                result.boxMin[r] += min(a, b);
+                result.boxMax[r] += max(a, b);
+            }
+        result.center = glm::vec3(matrix * glm::vec4(this->center, 1.0f));
+        GLfloat scale = max(glm::length(glm::vec3(matrix[0])), max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+        result.radius = this->radius * scale;
+        return result;
+    }
+};
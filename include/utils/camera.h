@@ -114,6 +114,16 @@ public:
         this->updateCameraVectors();
     }
 
+    //////////////////////////////////////////
+    // it places the camera in a position, with the given orientation (e.g., to follow a predefined camera path)
+    void SetPose(glm::vec3 position, GLfloat yaw, GLfloat pitch)
+    {
+        this->Position = position;
+        this->Yaw = yaw;
+        this->Pitch = pitch;
+        this->updateCameraVectors();
+    }
+
 private:
     //////////////////////////////////////////
     // it updates the camera reference system
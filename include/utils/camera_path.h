@@ -0,0 +1,124 @@
+/*
+CameraPath class
+- a sequence of camera keyframes (position, yaw and pitch angles), used to render a predefined sequence of frames
+  without user input (e.g., in the headless rendering mode, or in the benchmarks)
+
+The keyframes are read from a text file, one keyframe for each line:
+
+    # px py pz yaw pitch
+    0.0 1.0 9.0 -90.0 0.0
+    9.0 1.0 0.0 180.0 0.0
+
+(angles in degrees, with the same conventions of the Camera class; lines starting with # are comments).
+The keyframes are placed at equal distance along the sequence of frames, and the pose of a frame is linearly interpolated
+between the two closest keyframes. If a file is not provided, an orbit around a point of the scene can be created.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// a keyframe of the camera path
+struct CameraPose
+{
+    glm::vec3 position;
+    GLfloat yaw;
+    GLfloat pitch;
+};
+
+/////////////////// CAMERAPATH class ///////////////////////
+class CameraPath
+{
+public:
+
+    vector<CameraPose> keyframes;
+
+    //////////////////////////////////////////
+    // it loads the keyframes from a text file. It returns false if the file cannot be read or if it does not contain keyframes
+    bool Load(const string& path)
+    {
+        ifstream file(path);
+        if (!file)
+        {
+            cout << "ERROR::CAMERAPATH:: unable to open " << path << endl;
+            return false;
+        }
+        this->keyframes.clear();
+        string line;
+        while (getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            istringstream values(line);
+            CameraPose pose;
+            if (values >> pose.position.x >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch)
+                this->keyframes.push_back(pose);
+        }
+        return !this->keyframes.empty();
+    }
+
+    //////////////////////////////////////////
+    // it creates a circular path around the center, at the given radius and height, with the camera always looking at the center
+    void Orbit(glm::vec3 center, GLfloat radius, GLfloat height, GLuint numKeyframes = 64)
+    {
+        this->keyframes.clear();
+        for (GLuint i = 0; i <= numKeyframes; i++)
+        {
+            GLfloat angle = glm::radians(360.0f * i / numKeyframes);
+            // we start in front of the scene (positive Z axis), as the initial position of the interactive camera
+            glm::vec3 position = center + glm::vec3(radius * sin(angle), height, radius * cos(angle));
+            this->keyframes.push_back(LookAt(position, center));
+        }
+    }
+
+    //////////////////////////////////////////
+    // pose of the camera at the frame, in a sequence of numFrames frames covering the whole path
+    CameraPose Pose(GLuint frame, GLuint numFrames) const
+    {
+        if (this->keyframes.size() < 2 || numFrames < 2)
+            return this->keyframes.empty() ? LookAt(glm::vec3(0.0f, 1.0f, 9.0f), glm::vec3(0.0f, 1.0f, 0.0f)) : this->keyframes[0];
+
+        GLfloat t = (GLfloat)frame / (numFrames - 1) * (this->keyframes.size() - 1);
+        size_t k = glm::min((size_t)t, this->keyframes.size() - 2);
+        GLfloat f = t - k;
+        const CameraPose& a = this->keyframes[k];
+        const CameraPose& b = this->keyframes[k + 1];
+
+        CameraPose pose;
+        pose.position = glm::mix(a.position, b.position, f);
+        // we interpolate yaw along the shortest arc (e.g., from 170 to -170 degrees)
+        GLfloat deltaYaw = b.yaw - a.yaw;
+        deltaYaw -= 360.0f * floor((deltaYaw + 180.0f) / 360.0f);
+        pose.yaw = a.yaw + f * deltaYaw;
+        pose.pitch = glm::mix(a.pitch, b.pitch, f);
+        return pose;
+    }
+
+    //////////////////////////////////////////
+    // yaw and pitch angles (in degrees, as in the Camera class) of a camera in position, looking at target
+    static CameraPose LookAt(glm::vec3 position, glm::vec3 target)
+    {
+        glm::vec3 direction = glm::normalize(target - position);
+        CameraPose pose;
+        pose.position = position;
+        pose.yaw = glm::degrees(atan2(direction.z, direction.x));
+        pose.pitch = glm::degrees(asin(direction.y));
+        return pose;
+    }
+};
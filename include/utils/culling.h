@@ -0,0 +1,137 @@
+/*
+FrustumCuller class - view frustum culling of many bounding spheres per frame
+
+The spheres (e.g., the world-space bounding spheres of the objects of the scene, see bounds.h) are stored as separate arrays of
+x, y, z and radius (structure of arrays), padded to a multiple of 4: with SSE, a single instruction computes the distance of 4 spheres
+from a plane, and the 6 planes of the frustum are tested on 4 spheres with 24 multiply-add sequences and no branches.
+Without SSE, the same operations are performed one sphere at a time, with the same results.
+
+The spheres are split among the threads of a ThreadPool (see parallel.h), in blocks of 4: each thread writes only the visibility flags
+of its blocks, so no synchronization is needed, and the result does not depend on the number of threads.
+
+N.B.) the test is conservative: a sphere near a corner of the frustum can be outside the frustum, but not outside any of its planes.
+The visible objects can be refined with the test of their boxes (Frustum::IntersectsBox).
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include <utils/frustum.h>
+#include <utils/parallel.h>
+
+// minimum number of blocks of 4 spheres tested by a thread
+const size_t CULLING_MIN_BLOCKS = 256;
+
+/////////////////// FRUSTUMCULLER class ///////////////////////
+class FrustumCuller
+{
+public:
+
+    FrustumCuller() : count(0) {}
+
+    // it sets the number of spheres (their values must be set again with Set)
+    void Resize(size_t count)
+    {
+        this->count = count;
+        size_t padded = (count + 3) & ~(size_t)3;
+        // the spheres of the padding have a negative infinite radius, so they are always outside
+        this->x.assign(padded, 0.0f);
+        this->y.assign(padded, 0.0f);
+        this->z.assign(padded, 0.0f);
+        this->r.assign(padded, -1e30f);
+        this->visible.assign(padded, 0);
+    }
+
+    size_t Size() const { return this->count; }
+
+    // a negative radius (e.g., empty bounds) makes the sphere always invisible
+    void Set(size_t i, const glm::vec3& center, GLfloat radius)
+    {
+        this->x[i] = center.x;
+        this->y[i] = center.y;
+        this->z[i] = center.z;
+        this->r[i] = radius < 0.0f ? -1e30f : radius;
+    }
+
+    //////////////////////////////////////////
+    // it tests all the spheres with the frustum, and it returns the number of visible ones
+    size_t Cull(const Frustum& frustum, ThreadPool* pool = nullptr)
+    {
+        size_t numBlocks = this->x.size() / 4;
+        auto test = [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t b = begin; b < end; b++)
+                this->testBlock(frustum, 4 * b);
+        };
+        if (pool)
+            pool->ParallelFor(numBlocks, test, CULLING_MIN_BLOCKS);
+        else
+            test(0, numBlocks, 0);
+
+        size_t numVisible = 0;
+        for (size_t i = 0; i < this->count; i++)
+            numVisible += this->visible[i];
+        return numVisible;
+    }
+
+    bool IsVisible(size_t i) const { return this->visible[i] != 0; }
+
+private:
+
+    size_t count;
+    // spheres (structure of arrays), and result of the last culling
+    vector<float> x, y, z, r;
+    vector<unsigned char> visible;
+
+    //////////////////////////////////////////
+    // test of the 4 spheres starting at i: a sphere is outside if its signed distance from a plane is smaller than -radius
+    void testBlock(const Frustum& frustum, size_t i)
+    {
+#ifdef CULLING_SSE
+        __m128 px = _mm_loadu_ps(&this->x[i]);
+        __m128 py = _mm_loadu_ps(&this->y[i]);
+        __m128 pz = _mm_loadu_ps(&this->z[i]);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&this->r[i]));
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const glm::vec4& plane = frustum.planes[p];
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_mul_ps(py, _mm_set1_ps(plane.y))),
+                                         _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int k = 0; k < 4; k++)
+            this->visible[i + k] = (mask & (1 << k)) ? 0 : 1;
+#else
+        for (size_t k = i; k < i + 4; k++)
+        {
+            bool outside = false;
+            for (int p = 0; p < 6; p++)
+            {
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = (this->x[k] * plane.x + this->y[k] * plane.y) + (this->z[k] * plane.z + plane.w);
+                outside = outside || (distance < -this->r[k]);
+            }
+            this->visible[k] = outside ? 0 : 1;
+        }
+#endif
+    }
+};
@@ -0,0 +1,303 @@
+/*
+Curvature - per-vertex principal curvatures, estimated at loading from the normals of the one-ring
+
+The curvature used by the Enhanced models was computed in the fragment shader from the screen-space derivatives (dFdx, dFdy) of the
+normal: the value depends on the view, it is noisy on the silhouettes, and it adds the derivatives to every fragment.
+Here, we estimate the curvature of each vertex once, as in S. Rusinkiewicz, "Estimating Curvatures and Their Derivatives on Triangle
+Meshes" (3DPVT 2004):
+1) for each face, the second fundamental form II (a 2x2 symmetric matrix in a frame of the face) is the least squares solution of
+   II * (e . t, e . b) = ((n_j - n_k) . t, (n_j - n_k) . b) for the three edges e = p_j - p_k of the face, where n are the vertex normals;
+2) each vertex has its own frame in the tangent plane, and the tensors of its faces are rotated in this frame and averaged, with the
+   Voronoi area of the corner of each face as weight;
+3) the eigenvalues of the averaged tensor are the principal curvatures k1, k2 (|k1| >= |k2|), and the mean curvature is (k1 + k2) / 2.
+The curvatures are positive on the convex parts (e.g., 1 / r on a sphere of radius r with the normals pointing outside).
+
+The same tensor is also estimated from the smoothed normals (Sm_Normal): its mean curvature is the curvature of the smoothed normal field,
+and the Enhanced models use the difference between the two to get the curvature of the enhanced normal, without derivatives in the shader.
+The smoothed normals can be read at several scales (see multiscale_normals.h): the mean curvature of the smoothed normals is estimated
+for each scale, so it always matches the normals selected with Mesh::SetSmoothingScale.
+
+The curvatures are uploaded as 4 half floats for each vertex (PackCurvatures, Mesh::SetCurvatureData), in a separate buffer read by the
+attribute at location 15. The buffer has a block of values for each scale of the smoothed normals, and the attribute reads the block
+of the current scale.
+
+Each step is a parallel loop: the faces are processed independently, and each vertex gathers the values of its faces from the CSR
+vertex-face adjacency (see smoothed_normals.h), in increasing order, so the result does not depend on the number of threads.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <utils/smoothed_normals.h>
+#include <utils/parallel.h>
+
+// frame (t, b) of a face, in which its second fundamental forms are expressed (see ComputeVertexCurvatures)
+struct FaceCurvature
+{
+    glm::vec3 t, b;
+    // Voronoi areas of the corners
+    glm::vec3 cornerAreas;
+};
+
+//////////////////////////////////////////
+// it solves the 3x3 symmetric system w x = m (LDL^T decomposition). It returns false if the matrix is singular
+inline bool SolveSymmetric3(const GLfloat w[3][3], const glm::vec3& m, glm::vec3& x)
+{
+    GLfloat d0 = w[0][0];
+    if (d0 <= 0.0f)
+        return false;
+    GLfloat l10 = w[1][0] / d0, l20 = w[2][0] / d0;
+    GLfloat d1 = w[1][1] - l10 * l10 * d0;
+    if (d1 <= 0.0f)
+        return false;
+    GLfloat l21 = (w[2][1] - l20 * l10 * d0) / d1;
+    GLfloat d2 = w[2][2] - l20 * l20 * d0 - l21 * l21 * d1;
+    if (d2 <= 0.0f)
+        return false;
+    // forward substitution, diagonal, and back substitution
+    GLfloat y0 = m[0], y1 = m[1] - l10 * y0, y2 = m[2] - l20 * y0 - l21 * y1;
+    x[2] = y2 / d2;
+    x[1] = y1 / d1 - l21 * x[2];
+    x[0] = y0 / d0 - l10 * x[1] - l20 * x[2];
+    return true;
+}
+
+//////////////////////////////////////////
+// it expresses the tensor (e, f, g) of the frame (oldU, oldV) in the frame (newU, newV): the new frame is first rotated in the plane of the old one
+inline glm::vec3 ProjectCurvatureTensor(const glm::vec3& oldU, const glm::vec3& oldV, const glm::vec3& tensor, const glm::vec3& newU, const glm::vec3& newV)
+{
+    glm::vec3 oldNormal = glm::cross(oldU, oldV);
+    glm::vec3 newNormal = glm::cross(newU, newV);
+    GLfloat ndot = glm::dot(oldNormal, newNormal);
+    glm::vec3 u = newU, v = newV;
+    if (ndot <= -1.0f)
+    {
+        u = -u;
+        v = -v;
+    }
+    else
+    {
+        // rotation around the axis perpendicular to both normals, which brings newNormal on oldNormal
+        glm::vec3 perpendicular = oldNormal - ndot * newNormal;
+        glm::vec3 dperp = (newNormal + oldNormal) / (1.0f + ndot);
+        u -= dperp * glm::dot(u, perpendicular);
+        v -= dperp * glm::dot(v, perpendicular);
+    }
+    GLfloat u1 = glm::dot(u, oldU), v1 = glm::dot(u, oldV);
+    GLfloat u2 = glm::dot(v, oldU), v2 = glm::dot(v, oldV);
+    return glm::vec3(tensor[0] * u1 * u1 + tensor[1] * 2.0f * u1 * v1 + tensor[2] * v1 * v1,
+                     tensor[0] * u1 * u2 + tensor[1] * (u1 * v2 + u2 * v1) + tensor[2] * v1 * v2,
+                     tensor[0] * u2 * u2 + tensor[1] * 2.0f * u2 * v2 + tensor[2] * v2 * v2);
+}
+
+//////////////////////////////////////////
+// Voronoi areas of the corners of a triangle (the obtuse triangles give half of the area to the obtuse corner, as in Meyer et al. 2003)
+inline glm::vec3 CornerAreas(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+    glm::vec3 e[3] = {p2 - p1, p0 - p2, p1 - p0};
+    GLfloat area = 0.5f * glm::length(glm::cross(e[0], e[1]));
+    GLfloat l2[3] = {glm::dot(e[0], e[0]), glm::dot(e[1], e[1]), glm::dot(e[2], e[2])};
+    // barycentric weights of the circumcenter (negative if the corner is obtuse)
+    GLfloat ew[3] = {l2[0] * (l2[1] + l2[2] - l2[0]), l2[1] * (l2[2] + l2[0] - l2[1]), l2[2] * (l2[0] + l2[1] - l2[2])};
+    glm::vec3 corner;
+    if (area <= 0.0f)
+        return glm::vec3(0.0f);
+    if (ew[0] <= 0.0f)
+    {
+        corner[1] = -0.25f * l2[2] * area / glm::dot(e[0], e[2]);
+        corner[2] = -0.25f * l2[1] * area / glm::dot(e[0], e[1]);
+        corner[0] = area - corner[1] - corner[2];
+    }
+    else if (ew[1] <= 0.0f)
+    {
+        corner[2] = -0.25f * l2[0] * area / glm::dot(e[1], e[0]);
+        corner[0] = -0.25f * l2[2] * area / glm::dot(e[1], e[2]);
+        corner[1] = area - corner[2] - corner[0];
+    }
+    else if (ew[2] <= 0.0f)
+    {
+        corner[0] = -0.25f * l2[1] * area / glm::dot(e[2], e[1]);
+        corner[1] = -0.25f * l2[0] * area / glm::dot(e[2], e[0]);
+        corner[2] = area - corner[0] - corner[1];
+    }
+    else
+    {
+        GLfloat scale = 0.5f * area / (ew[0] + ew[1] + ew[2]);
+        for (int j = 0; j < 3; j++)
+            corner[j] = scale * (ew[(j + 1) % 3] + ew[(j + 2) % 3]);
+    }
+    return corner;
+}
+
+//////////////////////////////////////////
+// it computes the curvatures of the vertices: for each vertex, (k1, k2, mean curvature, mean curvature of the smoothed normals).
+// smoothingStreams are the additional scales of the smoothed normals (see ComputeMultiScaleNormals, it can be empty): the result has
+// a block of numVertices values for each scale, where the block s has the mean curvature of the smoothed normals of the scale s
+// (scale 0 = Sm_Normal) and the same k1, k2 and mean curvature of the other blocks.
+// The vertices without faces (or with degenerate faces only) have zero curvature. If numThreads = 0, all the hardware threads are used
+inline void ComputeVertexCurvatures(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices,
+                                    const vector<vector<glm::vec3>>& smoothingStreams, vector<glm::vec4>& curvatures, unsigned int numThreads = 0)
+{
+    size_t numFaces = numIndices / 3;
+    size_t numScales = 1 + smoothingStreams.size();
+    curvatures.assign(numVertices * numScales, glm::vec4(0.0f));
+    if (numVertices == 0 || numFaces == 0)
+        return;
+
+    // the normal fields whose tensors are estimated: the normals, and the smoothed normals at each scale
+    size_t numFields = 1 + numScales;
+    auto fieldNormal = [&](size_t field, GLuint v) -> glm::vec3
+    {
+        if (field == 0)
+            return vertices[v].Normal;
+        if (field == 1)
+            return vertices[v].Sm_Normal;
+        return smoothingStreams[field - 2][v];
+    };
+
+    // Step 1: second fundamental form of each face for each field, as (e, f, g) of the tensor [[e, f], [f, g]] in the frame of the face
+    vector<FaceCurvature> faces(numFaces);
+    vector<glm::vec3> faceTensors(numFaces * numFields, glm::vec3(0.0f));
+    ParallelFor(numFaces, [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t f = begin; f < end; f++)
+        {
+            FaceCurvature& face = faces[f];
+            glm::vec3* tensors = faceTensors.data() + f * numFields;
+            const GLuint* v = indices + 3 * f;
+            // edge j is opposite to the corner j
+            glm::vec3 e[3] = {vertices[v[2]].Position - vertices[v[1]].Position,
+                              vertices[v[0]].Position - vertices[v[2]].Position,
+                              vertices[v[1]].Position - vertices[v[0]].Position};
+            face.cornerAreas = CornerAreas(vertices[v[0]].Position, vertices[v[1]].Position, vertices[v[2]].Position);
+            glm::vec3 normal = glm::cross(e[0], e[1]);
+            if (glm::dot(e[0], e[0]) <= 0.0f || glm::dot(normal, normal) <= 0.0f)
+            {
+                face.t = face.b = glm::vec3(0.0f);
+                continue;
+            }
+            face.t = glm::normalize(e[0]);
+            face.b = glm::normalize(glm::cross(normal, face.t));
+
+            // normal equations of the least squares problem (the unknowns are e, f, g): the matrix is the same for all the fields
+            GLfloat w[3][3] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+            GLfloat u[3], s[3];
+            for (int j = 0; j < 3; j++)
+            {
+                u[j] = glm::dot(e[j], face.t);
+                s[j] = glm::dot(e[j], face.b);
+                w[0][0] += u[j] * u[j];
+                w[0][1] += u[j] * s[j];
+                w[2][2] += s[j] * s[j];
+            }
+            w[1][1] = w[0][0] + w[2][2];
+            w[1][2] = w[0][1];
+            w[1][0] = w[0][1];
+            w[2][1] = w[1][2];
+            for (size_t field = 0; field < numFields; field++)
+            {
+                glm::vec3 m(0.0f);
+                for (int j = 0; j < 3; j++)
+                {
+                    // the edge goes from the next corner to the previous one, and so does the difference of the normals
+                    glm::vec3 dn = fieldNormal(field, v[(j + 2) % 3]) - fieldNormal(field, v[(j + 1) % 3]);
+                    m += glm::vec3(glm::dot(dn, face.t) * u[j], glm::dot(dn, face.t) * s[j] + glm::dot(dn, face.b) * u[j], glm::dot(dn, face.b) * s[j]);
+                }
+                if (!SolveSymmetric3(w, m, tensors[field]))
+                {
+                    // a singular matrix is singular for all the fields
+                    fill(tensors, tensors + numFields, glm::vec3(0.0f));
+                    break;
+                }
+            }
+        }
+    }, ParallelChunks(numFaces, numThreads));
+
+    // Step 2: each vertex gathers the tensors of its faces in its own frame, weighted by the areas of its corners
+    VertexFaceAdjacency adjacency;
+    adjacency.Build(numVertices, indices, numIndices, numThreads);
+    ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+    {
+        vector<glm::vec3> tensors(numFields);
+        for (size_t v = begin; v < end; v++)
+        {
+            GLuint first = adjacency.offsets[v], last = adjacency.offsets[v + 1];
+            glm::vec3 normal = vertices[v].Normal;
+            if (first == last || glm::dot(normal, normal) <= 0.0f)
+                continue;
+            normal = glm::normalize(normal);
+            // frame of the vertex: an edge of its first face, projected on the tangent plane
+            const GLuint* face = indices + 3 * adjacency.faces[first];
+            GLuint other = face[0] == v ? face[1] : face[0];
+            glm::vec3 u = glm::cross(vertices[other].Position - vertices[v].Position, normal);
+            if (glm::dot(u, u) <= 0.0f)
+                u = glm::cross(fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f), normal);
+            u = glm::normalize(u);
+            glm::vec3 w = glm::cross(normal, u);
+
+            GLfloat area = 0.0f;
+            fill(tensors.begin(), tensors.end(), glm::vec3(0.0f));
+            for (GLuint k = first; k < last; k++)
+            {
+                GLuint f = adjacency.faces[k];
+                const FaceCurvature& fc = faces[f];
+                if (glm::dot(fc.t, fc.t) <= 0.0f)
+                    continue;
+                for (int j = 0; j < 3; j++)
+                {
+                    if (indices[3 * f + j] != v)
+                        continue;
+                    GLfloat weight = fc.cornerAreas[j];
+                    area += weight;
+                    for (size_t field = 0; field < numFields; field++)
+                        tensors[field] += weight * ProjectCurvatureTensor(fc.t, fc.b, faceTensors[f * numFields + field], u, w);
+                }
+            }
+            if (area <= 0.0f)
+                continue;
+            for (size_t field = 0; field < numFields; field++)
+                tensors[field] /= area;
+            const glm::vec3& tensor = tensors[0];
+
+            // Step 3: principal curvatures = eigenvalues of [[e, f], [f, g]] (Jacobi rotation)
+            GLfloat k1 = tensor[0], k2 = tensor[2];
+            if (tensor[1] != 0.0f)
+            {
+                GLfloat h = 0.5f * (tensor[2] - tensor[0]) / tensor[1];
+                GLfloat tt = h < 0.0f ? 1.0f / (h - sqrt(1.0f + h * h)) : 1.0f / (h + sqrt(1.0f + h * h));
+                k1 = tensor[0] - tt * tensor[1];
+                k2 = tensor[2] + tt * tensor[1];
+            }
+            if (fabs(k1) < fabs(k2))
+                swap(k1, k2);
+            for (size_t scale = 0; scale < numScales; scale++)
+                curvatures[scale * numVertices + v] = glm::vec4(k1, k2, 0.5f * (tensor[0] + tensor[2]),
+                                                                0.5f * (tensors[1 + scale][0] + tensors[1 + scale][2]));
+        }
+    }, ParallelChunks(numVertices, numThreads));
+}
+
+//////////////////////////////////////////
+// it converts the curvatures in half floats, for the attribute of the mesh (see Mesh::SetCurvatureData)
+inline void PackCurvatures(const vector<glm::vec4>& curvatures, vector<GLushort>& data)
+{
+    data.resize(curvatures.size() * 4);
+    for (size_t i = 0; i < curvatures.size(); i++)
+        for (int c = 0; c < 4; c++)
+            data[4 * i + c] = glm::packHalf1x16(curvatures[i][c]);
+}
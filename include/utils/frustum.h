@@ -0,0 +1,78 @@
+/*
+Frustum - the six planes of a view frustum, and the intersection tests with bounding volumes
+
+The planes are extracted from a projection (or projection * view * model) matrix, as in G. Gribb, K. Hartmann, "Fast Extraction of
+Viewing Frustum Planes from the World-View-Projection Matrix" (2001): a point p is inside the frustum if -w <= x, y, z <= w in clip
+coordinates, and each of the six inequalities is a plane in the space of p (e.g. w + x >= 0 is (row3 + row0) . p >= 0).
+The planes are normalized, so plane . (p, 1) is the signed distance of p from the plane (positive inside).
+
+The space of the planes is the space in which the matrix starts: with projection * view the planes are in world space, with
+projection * view * model they are in the object space of a model, so the bounds of the meshes can be tested without transforming them.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+/////////////////// FRUSTUM class ///////////////////////
+class Frustum
+{
+public:
+    // left, right, bottom, top, near, far: (normal, distance), with the normal pointing inside
+    glm::vec4 planes[6];
+
+    Frustum()
+    {
+        for (int i = 0; i < 6; i++)
+            this->planes[i] = glm::vec4(0.0f);
+    }
+
+    // planes of the frustum of a (projection * view * model) matrix
+    Frustum(const glm::mat4& matrix)
+    {
+        // GLM matrices are column-major: matrix[c][r] is the element at row r and column c
+        glm::vec4 rows[4];
+        for (int r = 0; r < 4; r++)
+            rows[r] = glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+        this->planes[0] = rows[3] + rows[0];
+        this->planes[1] = rows[3] - rows[0];
+        this->planes[2] = rows[3] + rows[1];
+        this->planes[3] = rows[3] - rows[1];
+        this->planes[4] = rows[3] + rows[2];
+        this->planes[5] = rows[3] - rows[2];
+        for (int i = 0; i < 6; i++)
+        {
+            GLfloat length = glm::length(glm::vec3(this->planes[i]));
+            if (length > 0.0f)
+                this->planes[i] /= length;
+        }
+    }
+
+    // false if the sphere is completely outside one of the planes
+    bool IntersectsSphere(const glm::vec3& center, GLfloat radius) const
+    {
+        for (int i = 0; i < 6; i++)
+            if (glm::dot(glm::vec3(this->planes[i]), center) + this->planes[i].w < -radius)
+                return false;
+        return true;
+    }
+
+    // false if the box is completely outside one of the planes (for each plane, we test the corner of the box farthest inside)
+    bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 n = glm::vec3(this->planes[i]);
+            glm::vec3 corner(n.x >= 0.0f ? boxMax.x : boxMin.x, n.y >= 0.0f ? boxMax.y : boxMin.y, n.z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(n, corner) + this->planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
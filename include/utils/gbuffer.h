@@ -0,0 +1,174 @@
+/*
+GBuffer class - the geometry buffer of the deferred shading
+
+In the deferred path, the objects are rendered first in a geometry pass, which writes in the G-buffer only the attributes of the
+visible surface, and then a single full-screen pass evaluates the illumination model once per pixel, reading the attributes
+from the G-buffer: the cost of the shading depends only on the resolution, and not on the number of fragments hidden by other objects.
+
+The G-buffer is kept compact (16 bytes per pixel, plus the depth buffer used by the geometry pass):
+- GBUFFER_NORMALS (RGBA16): the normal and the smoothed normal in view coordinates, both with octahedral encoding, mapped to [0, 1]
+- GBUFFER_DEPTH (R32F): the linear depth (distance from the camera plane): the position in view coordinates is reconstructed
+  from the depth and from the coordinates of the pixel
+- GBUFFER_IDS (RG16UI): the identifier of the object (0 = no object) and of its material
+
+N.B. 1) the identifier of the object is used also by the full-screen pass, to estimate the curvature with a stencil which does not
+cross the silhouettes of the objects.
+
+N.B. 2) like Mesh, GBuffer is a "move-only" class, in charge of releasing the allocated GPU resources (RAII)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <iostream>
+
+// attachments of the G-buffer (= the locations of the outputs of the geometry pass, and the texture units of the full-screen pass)
+enum GBufferTarget
+{
+    GBUFFER_NORMALS = 0,
+    GBUFFER_DEPTH,
+    GBUFFER_IDS,
+    GBUFFER_TARGETS
+};
+
+// bytes per pixel of the attachments of the G-buffer
+const GLuint GBUFFER_BYTES_PER_PIXEL = 8 + 4 + 4;
+
+/////////////////// GBUFFER class ///////////////////////
+class GBuffer
+{
+public:
+
+    GLuint FBO;
+    GLsizei width, height;
+
+    GBuffer(GLsizei width, GLsizei height) noexcept
+        : width(width), height(height)
+    {
+        // internal format, and format and type of the (missing) data of each attachment
+        const GLint internalFormats[GBUFFER_TARGETS] = { GL_RGBA16, GL_R32F, GL_RG16UI };
+        const GLenum formats[GBUFFER_TARGETS] = { GL_RGBA, GL_RED, GL_RG_INTEGER };
+        const GLenum types[GBUFFER_TARGETS] = { GL_UNSIGNED_SHORT, GL_FLOAT, GL_UNSIGNED_SHORT };
+        glGenTextures(GBUFFER_TARGETS, this->textures);
+        for (GLuint i = 0; i < GBUFFER_TARGETS; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], NULL);
+            // the attachments are read with texelFetch, but the textures must not require mipmaps to be complete
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &this->depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &this->FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        GLenum drawBuffers[GBUFFER_TARGETS];
+        for (GLuint i = 0; i < GBUFFER_TARGETS; i++)
+        {
+            glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, this->textures[i], 0);
+            drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+        glDrawBuffers(GBUFFER_TARGETS, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::GBUFFER:: Framebuffer is not complete!" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // the full-screen triangle is generated from gl_VertexID, but the core profile needs a VAO bound to draw
+        glGenVertexArrays(1, &this->emptyVAO);
+    }
+
+    GBuffer(const GBuffer& copy) = delete;
+    GBuffer& operator=(const GBuffer& copy) = delete;
+
+    GBuffer(GBuffer&& move) noexcept
+        : FBO(move.FBO), width(move.width), height(move.height), depthBuffer(move.depthBuffer), emptyVAO(move.emptyVAO)
+    {
+        for (GLuint i = 0; i < GBUFFER_TARGETS; i++)
+            this->textures[i] = move.textures[i];
+        move.FBO = 0;
+    }
+
+    GBuffer& operator=(GBuffer&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->FBO = move.FBO;
+        this->width = move.width;
+        this->height = move.height;
+        for (GLuint i = 0; i < GBUFFER_TARGETS; i++)
+            this->textures[i] = move.textures[i];
+        this->depthBuffer = move.depthBuffer;
+        this->emptyVAO = move.emptyVAO;
+        move.FBO = 0;
+        return *this;
+    }
+
+    ~GBuffer() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // the G-buffer becomes the target of the geometry pass, and it is cleared (identifier 0 = no object)
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glViewport(0, 0, this->width, this->height);
+        const GLfloat zeros[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLuint noObject[4] = { 0, 0, 0, 0 };
+        const GLfloat farDepth = 1.0f;
+        glClearBufferfv(GL_COLOR, GBUFFER_NORMALS, zeros);
+        glClearBufferfv(GL_COLOR, GBUFFER_DEPTH, zeros);
+        glClearBufferuiv(GL_COLOR, GBUFFER_IDS, noObject);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    }
+
+    // the attachments are bound to the texture units firstUnit + GBufferTarget, to be read by the full-screen pass
+    void BindTextures(GLuint firstUnit = 0) const
+    {
+        for (GLuint i = 0; i < GBUFFER_TARGETS; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // it draws a triangle covering the whole viewport (the vertex shader computes the positions from gl_VertexID)
+    void DrawFullscreen() const
+    {
+        glBindVertexArray(this->emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+private:
+
+    GLuint textures[GBUFFER_TARGETS];
+    GLuint depthBuffer;
+    GLuint emptyVAO;
+
+    void freeGPUresources()
+    {
+        if (this->FBO)
+        {
+            glDeleteFramebuffers(1, &this->FBO);
+            glDeleteTextures(GBUFFER_TARGETS, this->textures);
+            glDeleteRenderbuffers(1, &this->depthBuffer);
+            glDeleteVertexArrays(1, &this->emptyVAO);
+        }
+    }
+};
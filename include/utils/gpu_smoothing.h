@@ -0,0 +1,664 @@
+/*
+GpuNormalSmoother class - computation of the smoothed surface normals (Sm_Normal) on the GPU, directly in the VBO of a Mesh
+
+The smoothed normals are computed on the CPU at loading (smoothed_normals.h, multiscale_normals.h). Here, the same computation runs
+on the GPU over the buffers already uploaded, and the result is written in place in the Sm_Normal attribute of the VBO (in the encoding
+of the vertex format of the mesh), so a mesh can be smoothed again with a different kernel while the application is running:
+1) the normal of each face is computed from the positions of the VBO and the indices of the EBO;
+2) each vertex gathers the normals of its faces from the CSR vertex-face adjacency, and normalizes the sum (the one-ring smoothed normal);
+3) optionally, the field is diffused on the CSR vertex-vertex adjacency for a number of iterations, as in multiscale_normals.h:
+   the variance of the kernel grows linearly with the iterations, so sigma grows with their square root;
+4) the field is normalized, encoded and written in the VBO.
+Each step is a gather, in the same order of the CPU code, so no atomic operations are needed, and the result is the same of the CPU
+up to the rounding of the floating point operations.
+
+Two implementations are available:
+- with OpenGL 4.3 or newer, each step is a compute shader, which reads and writes the buffers as shader storage buffers;
+- with OpenGL 4.1 (the context created by the application), each step is a vertex shader with transform feedback and rasterization
+  disabled: a point is drawn for each face or vertex, the buffers are read as buffer textures (texelFetch), and the results are captured
+  in a buffer. In the last step, the varyings are interleaved with gl_SkipComponents, which leave the other attributes of the VBO unchanged,
+  so the smoothed normal is written in place also in the interleaved layout.
+The adjacency is built on the CPU (from the indices read back from the EBO) once for each mesh, in a GpuSmoothingTopology.
+
+Verify compares the result with the CPU implementation on the same (decoded) positions, and returns the maximum angle between the normals.
+
+N.B.) the buffer textures of the fallback are limited to GL_MAX_TEXTURE_BUFFER_SIZE texels (at least 128M on desktop drivers)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <map>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/smoothed_normals.h>
+#include <utils/multiscale_normals.h>
+
+// size of the work groups of the compute shaders
+const GLuint GPU_SMOOTHING_GROUP_SIZE = 64;
+
+/////////////////// GPUSMOOTHINGTOPOLOGY class ///////////////////////
+// adjacency and work buffers of a mesh on the GPU. The mesh must not be destroyed before the topology (it refers to its buffers)
+class GpuSmoothingTopology
+{
+public:
+
+    GpuSmoothingTopology(const GpuSmoothingTopology& copy) = delete;
+    GpuSmoothingTopology& operator=(const GpuSmoothingTopology&) = delete;
+
+    // the adjacency is built from the indices of the EBO of the mesh
+    GpuSmoothingTopology(const Mesh& mesh)
+        : numVertices(mesh.numVertices), numFaces(mesh.numIndices / 3)
+    {
+        vector<GLuint> indices(mesh.numIndices);
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.EBO);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        VertexFaceAdjacency faces;
+        faces.Build(this->numVertices, indices.data(), indices.size());
+        VertexAdjacency neighbors;
+        neighbors.Build(this->numVertices, indices.data(), indices.size());
+
+        glGenBuffers(NUM_BUFFERS, this->buffers);
+        this->upload(FACE_OFFSETS, faces.offsets.data(), faces.offsets.size() * sizeof(GLuint));
+        this->upload(FACE_LIST, faces.faces.data(), faces.faces.size() * sizeof(GLuint));
+        this->upload(NEIGHBOR_OFFSETS, neighbors.offsets.data(), neighbors.offsets.size() * sizeof(GLuint));
+        this->upload(NEIGHBORS, neighbors.neighbors.data(), max(neighbors.neighbors.size(), (size_t)1) * sizeof(GLuint));
+        this->upload(FACE_NORMALS, nullptr, max(this->numFaces, 1) * sizeof(glm::vec4));
+        this->upload(FIELD, nullptr, max(this->numVertices, 1) * sizeof(glm::vec4));
+        this->upload(FIELD + 1, nullptr, max(this->numVertices, 1) * sizeof(glm::vec4));
+
+        // buffer textures, read by the transform feedback fallback (the positions are read with the size of their components)
+        glGenTextures(NUM_TEXTURES, this->textures);
+        this->view(FACE_OFFSETS, GL_R32UI, this->buffers[FACE_OFFSETS]);
+        this->view(FACE_LIST, GL_R32UI, this->buffers[FACE_LIST]);
+        this->view(NEIGHBOR_OFFSETS, GL_R32UI, this->buffers[NEIGHBOR_OFFSETS]);
+        this->view(NEIGHBORS, GL_R32UI, this->buffers[NEIGHBORS]);
+        this->view(FACE_NORMALS, GL_RGBA32F, this->buffers[FACE_NORMALS]);
+        this->view(FIELD, GL_RGBA32F, this->buffers[FIELD]);
+        this->view(FIELD + 1, GL_RGBA32F, this->buffers[FIELD + 1]);
+        this->view(INDICES, GL_R32UI, mesh.EBO);
+        GLenum positionFormat = mesh.format.positionEncoding == POSITION_FLOAT32 ? GL_R32F : (mesh.format.positionEncoding == POSITION_HALF ? GL_R16F : GL_R16);
+        this->view(POSITIONS, positionFormat, mesh.VBO);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    GpuSmoothingTopology(GpuSmoothingTopology&& move) noexcept
+        : numVertices(move.numVertices), numFaces(move.numFaces)
+    {
+        copy(move.buffers, move.buffers + NUM_BUFFERS, this->buffers);
+        copy(move.textures, move.textures + NUM_TEXTURES, this->textures);
+        // the first buffer is used to check the ownership of all the resources
+        move.buffers[0] = 0;
+    }
+
+    GpuSmoothingTopology& operator=(GpuSmoothingTopology&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->numVertices = move.numVertices;
+        this->numFaces = move.numFaces;
+        copy(move.buffers, move.buffers + NUM_BUFFERS, this->buffers);
+        copy(move.textures, move.textures + NUM_TEXTURES, this->textures);
+        move.buffers[0] = 0;
+        return *this;
+    }
+
+    ~GpuSmoothingTopology() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+private:
+
+    friend class GpuNormalSmoother;
+
+    // buffers (the two fields are used alternately by the iterations of the diffusion), and buffer textures (the same ones, plus the EBO and the VBO of the mesh)
+    enum { FACE_OFFSETS, FACE_LIST, NEIGHBOR_OFFSETS, NEIGHBORS, FACE_NORMALS, FIELD, NUM_BUFFERS = FIELD + 2 };
+    enum { INDICES = NUM_BUFFERS, POSITIONS, NUM_TEXTURES };
+
+    GLsizei numVertices, numFaces;
+    GLuint buffers[NUM_BUFFERS];
+    GLuint textures[NUM_TEXTURES];
+
+    void upload(int buffer, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffers[buffer]);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void view(int texture, GLenum format, GLuint buffer)
+    {
+        glBindTexture(GL_TEXTURE_BUFFER, this->textures[texture]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    }
+
+    void freeGPUresources()
+    {
+        if (this->buffers[0])
+        {
+            glDeleteTextures(NUM_TEXTURES, this->textures);
+            glDeleteBuffers(NUM_BUFFERS, this->buffers);
+        }
+    }
+};
+
+//////////////////////////////////////////
+// GLSL code of the two implementations
+
+// octahedral encoding of the smoothed normal in 2 x 16 bit signed normalized integers (the same of VertexFormat::OctEncode and glm::packSnorm1x16)
+const char* GPU_SMOOTHING_ENCODE = R"(
+int snorm16(float x)
+{
+  x = clamp(x, -1.0, 1.0) * 32767.0;
+  return int(sign(x) * floor(abs(x) + 0.5));
+}
+uint encodeOctahedral(vec3 n)
+{
+  if (!(dot(n, n) > 0.0))
+    n = vec3(0.0, 0.0, 1.0);
+  n = normalize(n);
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 p = n.xy;
+  if (n.z < 0.0)
+    p = vec2((1.0 - abs(n.y)) * (n.x >= 0.0 ? 1.0 : -1.0), (1.0 - abs(n.x)) * (n.y >= 0.0 ? 1.0 : -1.0));
+  return (uint(snorm16(p.x)) & 0xFFFFu) | (uint(snorm16(p.y)) << 16);
+}
+vec3 safeNormalize(vec3 n)
+{
+  return dot(n, n) > 0.0 ? normalize(n) : vec3(0.0);
+}
+)";
+
+// compute shaders (OpenGL 4.3)
+const char* GPU_SMOOTHING_CS_HEADER = R"(#version 430 core
+uniform int count;
+)";
+
+const char* GPU_SMOOTHING_CS_FACES = R"(
+layout (std430, binding = 0) readonly buffer Vertices { uint vertexWords[]; };
+layout (std430, binding = 1) readonly buffer Indices { uint indices[]; };
+layout (std430, binding = 2) writeonly buffer Results { vec4 results[]; };
+uniform int strideWords;
+uniform int positionEncoding;
+uniform vec3 decodeScale;
+uniform vec3 decodeOffset;
+vec3 fetchPosition(uint v)
+{
+  int base = int(v) * strideWords;
+  vec3 p;
+  if (positionEncoding == 0)
+    p = vec3(uintBitsToFloat(vertexWords[base]), uintBitsToFloat(vertexWords[base + 1]), uintBitsToFloat(vertexWords[base + 2]));
+  else if (positionEncoding == 1)
+    p = vec3(unpackHalf2x16(vertexWords[base]), unpackHalf2x16(vertexWords[base + 1]).x);
+  else
+    p = vec3(unpackUnorm2x16(vertexWords[base]), unpackUnorm2x16(vertexWords[base + 1]).x);
+  return decodeOffset + decodeScale * p;
+}
+void main()
+{
+  int f = int(gl_GlobalInvocationID.x);
+  if (f >= count)
+    return;
+  vec3 a = fetchPosition(indices[3 * f]);
+  vec3 b = fetchPosition(indices[3 * f + 1]);
+  vec3 c = fetchPosition(indices[3 * f + 2]);
+  results[f] = vec4(safeNormalize(cross(a - b, a - c)), 0.0);
+}
+)";
+
+const char* GPU_SMOOTHING_CS_GATHER = R"(
+layout (std430, binding = 0) readonly buffer Offsets { uint offsets[]; };
+layout (std430, binding = 1) readonly buffer Lists { uint lists[]; };
+layout (std430, binding = 2) readonly buffer Values { vec4 values[]; };
+layout (std430, binding = 3) writeonly buffer Results { vec4 results[]; };
+// false = sum of the face normals (one-ring), true = an iteration of the diffusion
+uniform bool diffusion;
+void main()
+{
+  int v = int(gl_GlobalInvocationID.x);
+  if (v >= count)
+    return;
+  uint first = offsets[v], last = offsets[v + 1];
+  vec3 sum = diffusion ? values[v].xyz : vec3(0.0);
+  for (uint k = first; k < last; k++)
+    sum += values[lists[k]].xyz;
+  results[v] = vec4(diffusion ? sum / float(last - first + 1u) : safeNormalize(sum), 0.0);
+}
+)";
+
+const char* GPU_SMOOTHING_CS_WRITE = R"(
+layout (std430, binding = 0) buffer Vertices { uint vertexWords[]; };
+layout (std430, binding = 1) readonly buffer Values { vec4 values[]; };
+uniform int strideWords;
+uniform int normalOffsetWords;
+uniform bool octahedral;
+void main()
+{
+  int v = int(gl_GlobalInvocationID.x);
+  if (v >= count)
+    return;
+  int base = v * strideWords + normalOffsetWords;
+  vec3 n = values[v].xyz;
+  if (octahedral)
+    vertexWords[base] = encodeOctahedral(n);
+  else
+  {
+    n = safeNormalize(n);
+    vertexWords[base] = floatBitsToUint(n.x);
+    vertexWords[base + 1] = floatBitsToUint(n.y);
+    vertexWords[base + 2] = floatBitsToUint(n.z);
+  }
+}
+)";
+
+// vertex shaders with transform feedback (OpenGL 4.1): a point for each face or vertex (gl_VertexID)
+const char* GPU_SMOOTHING_TF_HEADER = R"(#version 410 core
+)";
+
+const char* GPU_SMOOTHING_TF_FACES = R"(
+uniform usamplerBuffer indices;
+uniform samplerBuffer positions;
+// distance between the vertices, in components of the positions
+uniform int positionStride;
+uniform vec3 decodeScale;
+uniform vec3 decodeOffset;
+out vec4 result;
+vec3 fetchPosition(uint v)
+{
+  int base = int(v) * positionStride;
+  return decodeOffset + decodeScale * vec3(texelFetch(positions, base).r, texelFetch(positions, base + 1).r, texelFetch(positions, base + 2).r);
+}
+void main()
+{
+  int f = gl_VertexID;
+  vec3 a = fetchPosition(texelFetch(indices, 3 * f).r);
+  vec3 b = fetchPosition(texelFetch(indices, 3 * f + 1).r);
+  vec3 c = fetchPosition(texelFetch(indices, 3 * f + 2).r);
+  result = vec4(safeNormalize(cross(a - b, a - c)), 0.0);
+}
+)";
+
+const char* GPU_SMOOTHING_TF_GATHER = R"(
+uniform usamplerBuffer offsets;
+uniform usamplerBuffer lists;
+uniform samplerBuffer values;
+// false = sum of the face normals (one-ring), true = an iteration of the diffusion
+uniform bool diffusion;
+out vec4 result;
+void main()
+{
+  int v = gl_VertexID;
+  uint first = texelFetch(offsets, v).r, last = texelFetch(offsets, v + 1).r;
+  vec3 sum = diffusion ? texelFetch(values, v).xyz : vec3(0.0);
+  for (uint k = first; k < last; k++)
+    sum += texelFetch(values, int(texelFetch(lists, int(k)).r)).xyz;
+  result = vec4(diffusion ? sum / float(last - first + 1u) : safeNormalize(sum), 0.0);
+}
+)";
+
+// the output is captured between gl_SkipComponents, in the position of the smoothed normal inside the vertex
+const char* GPU_SMOOTHING_TF_WRITE = R"(
+uniform samplerBuffer values;
+#ifdef OCTAHEDRAL
+flat out uint smNormal;
+#else
+out vec3 smNormal;
+#endif
+void main()
+{
+  vec3 n = texelFetch(values, gl_VertexID).xyz;
+#ifdef OCTAHEDRAL
+  smNormal = encodeOctahedral(n);
+#else
+  smNormal = safeNormalize(n);
+#endif
+}
+)";
+
+/////////////////// GPUNORMALSMOOTHER class ///////////////////////
+class GpuNormalSmoother
+{
+public:
+
+    GpuNormalSmoother(const GpuNormalSmoother& copy) = delete;
+    GpuNormalSmoother& operator=(const GpuNormalSmoother&) = delete;
+
+    // the compute shaders are used if the context supports them (OpenGL 4.3), unless forceTransformFeedback is true
+    GpuNormalSmoother(bool forceTransformFeedback = false)
+        : compute(GLAD_GL_VERSION_4_3 && !forceTransformFeedback)
+    {
+        glGenVertexArrays(1, &this->emptyVAO);
+        if (this->compute)
+        {
+            string header = string(GPU_SMOOTHING_CS_HEADER) + "layout (local_size_x = " + to_string(GPU_SMOOTHING_GROUP_SIZE) + ") in;\n" + GPU_SMOOTHING_ENCODE;
+            this->facesProgram = buildProgram(GL_COMPUTE_SHADER, header + GPU_SMOOTHING_CS_FACES);
+            this->gatherProgram = buildProgram(GL_COMPUTE_SHADER, header + GPU_SMOOTHING_CS_GATHER);
+            this->writeProgram = buildProgram(GL_COMPUTE_SHADER, header + GPU_SMOOTHING_CS_WRITE);
+        }
+        else
+        {
+            vector<string> result(1, "result");
+            this->facesProgram = buildProgram(GL_VERTEX_SHADER, string(GPU_SMOOTHING_TF_HEADER) + GPU_SMOOTHING_ENCODE + GPU_SMOOTHING_TF_FACES, result);
+            this->gatherProgram = buildProgram(GL_VERTEX_SHADER, string(GPU_SMOOTHING_TF_HEADER) + GPU_SMOOTHING_ENCODE + GPU_SMOOTHING_TF_GATHER, result);
+            // the programs which write in the VBO depend on the vertex format, and they are created when needed
+            this->writeProgram = 0;
+            this->setSamplers(this->facesProgram, {"indices", "positions"});
+            this->setSamplers(this->gatherProgram, {"offsets", "lists", "values"});
+        }
+    }
+
+    ~GpuNormalSmoother() noexcept
+    {
+        glDeleteVertexArrays(1, &this->emptyVAO);
+        glDeleteProgram(this->facesProgram);
+        glDeleteProgram(this->gatherProgram);
+        glDeleteProgram(this->writeProgram);
+        for (auto& program : this->writePrograms)
+            glDeleteProgram(program.second);
+    }
+
+    // true if the compute shaders are used, false for the transform feedback fallback
+    bool UsesCompute() const { return this->compute; }
+
+    //////////////////////////////////////////
+    // it computes the smoothed normals of the mesh in its VBO (the attribute read with scale 0, see Mesh::SetSmoothingScale):
+    // one-ring smoothed normals, followed by the requested number of iterations of diffusion. It returns false if the mesh
+    // has no smoothed normals in the VBO, or if the programs are not available
+    bool Smooth(Mesh& mesh, const GpuSmoothingTopology& topology, GLuint iterations = 0)
+    {
+        if (!mesh.format.Has(ATTRIB_SM_NORMAL) || !topology.buffers[0] || topology.numFaces == 0 || !this->facesProgram || !this->gatherProgram)
+            return false;
+        iterations = min(iterations, MULTISCALE_MAX_ITERATIONS);
+        bool done = this->compute ? this->smoothCompute(mesh, topology, iterations) : this->smoothFeedback(mesh, topology, iterations);
+        glUseProgram(0);
+        return done;
+    }
+
+    //////////////////////////////////////////
+    // it smooths the mesh on the GPU, and it compares the result with the CPU implementation (smoothed_normals.h and the diffusion of
+    // multiscale_normals.h) on the positions read back from the VBO. It returns the maximum angle (in degrees) between the normals,
+    // or a negative value if the mesh cannot be smoothed. The vertices without a valid CPU normal (e.g., without faces) are not compared
+    GLfloat Verify(Mesh& mesh, const GpuSmoothingTopology& topology, GLuint iterations = 0)
+    {
+        if (!this->Smooth(mesh, topology, iterations))
+            return -1.0f;
+        iterations = min(iterations, MULTISCALE_MAX_ITERATIONS);
+        GLsizei stride = mesh.format.Stride();
+        vector<unsigned char> data((size_t)mesh.numVertices * stride);
+        vector<GLuint> indices(mesh.numIndices);
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.VBO);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, data.size(), data.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, mesh.EBO);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, indices.size() * sizeof(GLuint), indices.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        // CPU reference: one-ring smoothed normals, and diffusion
+        vector<Vertex> vertices(mesh.numVertices);
+        for (GLsizei v = 0; v < mesh.numVertices; v++)
+            vertices[v].Position = mesh.format.UnpackPosition(&data[v * stride], mesh.decode);
+        ComputeSmoothedNormals(vertices, indices);
+        vector<glm::vec3> current(vertices.size()), next(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            glm::vec3 n = vertices[v].Sm_Normal;
+            current[v] = (std::isfinite(n.x) && std::isfinite(n.y) && std::isfinite(n.z)) ? n : glm::vec3(0.0f);
+        }
+        VertexAdjacency adjacency;
+        if (iterations > 0)
+            adjacency.Build(vertices.size(), indices.data(), indices.size());
+        for (GLuint t = 0; t < iterations; t++)
+        {
+            for (size_t v = 0; v < vertices.size(); v++)
+            {
+                glm::vec3 sum = current[v];
+                for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+                    sum += current[adjacency.neighbors[k]];
+                next[v] = sum / (GLfloat)(adjacency.offsets[v + 1] - adjacency.offsets[v] + 1);
+            }
+            current.swap(next);
+        }
+
+        GLfloat maxAngle = 0.0f;
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            glm::vec3 expected = glm::normalize(current[v]);
+            if (!(std::isfinite(expected.x) && std::isfinite(expected.y) && std::isfinite(expected.z)))
+                continue;
+            glm::vec3 result = glm::normalize(mesh.format.UnpackUnitVector(&data[v * stride], 2));
+            // the angle from the sine and the cosine is accurate also for very small angles. A NaN in the GPU result is the maximum error
+            GLfloat angle = glm::degrees(atan2(glm::length(glm::cross(expected, result)), glm::dot(expected, result)));
+            maxAngle = std::isfinite(angle) ? max(maxAngle, angle) : 180.0f;
+        }
+        return maxAngle;
+    }
+
+private:
+
+    bool compute;
+    GLuint emptyVAO;
+    GLuint facesProgram, gatherProgram, writeProgram;
+    // programs of the fallback which write in the VBO, for each layout (offset and stride in words, octahedral encoding)
+    map<GLuint, GLuint> writePrograms;
+
+    //////////////////////////////////////////
+    bool smoothCompute(Mesh& mesh, const GpuSmoothingTopology& topology, GLuint iterations)
+    {
+        if (!this->writeProgram)
+            return false;
+        auto dispatch = [](GLsizei count)
+        {
+            glDispatchCompute((count + GPU_SMOOTHING_GROUP_SIZE - 1) / GPU_SMOOTHING_GROUP_SIZE, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        };
+        const GLuint* buffers = topology.buffers;
+
+        // Step 1: normals of the faces
+        glUseProgram(this->facesProgram);
+        glUniform1i(glGetUniformLocation(this->facesProgram, "count"), topology.numFaces);
+        glUniform1i(glGetUniformLocation(this->facesProgram, "strideWords"), mesh.format.Stride() / 4);
+        glUniform1i(glGetUniformLocation(this->facesProgram, "positionEncoding"), (GLint)mesh.format.positionEncoding);
+        glUniform3fv(glGetUniformLocation(this->facesProgram, "decodeScale"), 1, &mesh.decode[0].x);
+        glUniform3fv(glGetUniformLocation(this->facesProgram, "decodeOffset"), 1, &mesh.decode[1].x);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.VBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mesh.EBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[GpuSmoothingTopology::FACE_NORMALS]);
+        dispatch(topology.numFaces);
+
+        // Step 2 and 3: one-ring smoothed normals, and diffusion
+        glUseProgram(this->gatherProgram);
+        glUniform1i(glGetUniformLocation(this->gatherProgram, "count"), topology.numVertices);
+        GLint diffusion = glGetUniformLocation(this->gatherProgram, "diffusion");
+        glUniform1i(diffusion, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[GpuSmoothingTopology::FACE_OFFSETS]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[GpuSmoothingTopology::FACE_LIST]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[GpuSmoothingTopology::FACE_NORMALS]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffers[GpuSmoothingTopology::FIELD]);
+        dispatch(topology.numVertices);
+        GLuint field = 0;
+        glUniform1i(diffusion, 1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[GpuSmoothingTopology::NEIGHBOR_OFFSETS]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[GpuSmoothingTopology::NEIGHBORS]);
+        for (GLuint t = 0; t < iterations; t++, field = 1 - field)
+        {
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buffers[GpuSmoothingTopology::FIELD + field]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffers[GpuSmoothingTopology::FIELD + 1 - field]);
+            dispatch(topology.numVertices);
+        }
+
+        // Step 4: normalization and encoding in the VBO
+        glUseProgram(this->writeProgram);
+        glUniform1i(glGetUniformLocation(this->writeProgram, "count"), topology.numVertices);
+        glUniform1i(glGetUniformLocation(this->writeProgram, "strideWords"), mesh.format.Stride() / 4);
+        glUniform1i(glGetUniformLocation(this->writeProgram, "normalOffsetWords"), mesh.format.AttributeOffset(2) / 4);
+        glUniform1i(glGetUniformLocation(this->writeProgram, "octahedral"), mesh.format.normalEncoding == NORMAL_OCT16);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mesh.VBO);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[GpuSmoothingTopology::FIELD + field]);
+        glDispatchCompute((topology.numVertices + GPU_SMOOTHING_GROUP_SIZE - 1) / GPU_SMOOTHING_GROUP_SIZE, 1, 1);
+        // the VBO is then read as vertex attributes (and by glGetBufferSubData in Verify)
+        glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        for (GLuint b = 0; b < 4; b++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, 0);
+        return true;
+    }
+
+    //////////////////////////////////////////
+    bool smoothFeedback(Mesh& mesh, const GpuSmoothingTopology& topology, GLuint iterations)
+    {
+        GLuint writeProgram = this->feedbackWriteProgram(mesh.format);
+        if (!writeProgram)
+            return false;
+        const GLuint* textures = topology.textures;
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(this->emptyVAO);
+
+        // Step 1: normals of the faces
+        glUseProgram(this->facesProgram);
+        GLsizei positionSize = mesh.format.positionEncoding == POSITION_FLOAT32 ? sizeof(GLfloat) : sizeof(GLushort);
+        glUniform1i(glGetUniformLocation(this->facesProgram, "positionStride"), mesh.format.Stride() / positionSize);
+        glUniform3fv(glGetUniformLocation(this->facesProgram, "decodeScale"), 1, &mesh.decode[0].x);
+        glUniform3fv(glGetUniformLocation(this->facesProgram, "decodeOffset"), 1, &mesh.decode[1].x);
+        bindTextures({textures[GpuSmoothingTopology::INDICES], textures[GpuSmoothingTopology::POSITIONS]});
+        feedback(topology.buffers[GpuSmoothingTopology::FACE_NORMALS], topology.numFaces);
+
+        // Step 2 and 3: one-ring smoothed normals, and diffusion
+        glUseProgram(this->gatherProgram);
+        GLint diffusion = glGetUniformLocation(this->gatherProgram, "diffusion");
+        glUniform1i(diffusion, 0);
+        bindTextures({textures[GpuSmoothingTopology::FACE_OFFSETS], textures[GpuSmoothingTopology::FACE_LIST], textures[GpuSmoothingTopology::FACE_NORMALS]});
+        feedback(topology.buffers[GpuSmoothingTopology::FIELD], topology.numVertices);
+        GLuint field = 0;
+        glUniform1i(diffusion, 1);
+        for (GLuint t = 0; t < iterations; t++, field = 1 - field)
+        {
+            bindTextures({textures[GpuSmoothingTopology::NEIGHBOR_OFFSETS], textures[GpuSmoothingTopology::NEIGHBORS], textures[GpuSmoothingTopology::FIELD + field]});
+            feedback(topology.buffers[GpuSmoothingTopology::FIELD + 1 - field], topology.numVertices);
+        }
+
+        // Step 4: normalization and encoding in the VBO
+        glUseProgram(writeProgram);
+        bindTextures({textures[GpuSmoothingTopology::FIELD + field], 0, 0});
+        feedback(mesh.VBO, topology.numVertices);
+
+        bindTextures({0});
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        return true;
+    }
+
+    // it binds the buffer textures to the first texture units
+    static void bindTextures(const vector<GLuint>& textures)
+    {
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + (GLenum)i);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // it draws count points, and it captures the outputs of the vertex shader in the buffer
+    static void feedback(GLuint buffer, GLsizei count)
+    {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    }
+
+    //////////////////////////////////////////
+    // program of the fallback which writes the smoothed normals in a VBO with the layout of the format
+    GLuint feedbackWriteProgram(const VertexFormat& format)
+    {
+        GLuint offset = format.AttributeOffset(2) / 4, stride = format.Stride() / 4;
+        bool octahedral = format.normalEncoding == NORMAL_OCT16;
+        GLuint size = octahedral ? 1 : 3;
+        GLuint key = (offset << 16) | (stride << 1) | (octahedral ? 1 : 0);
+        auto it = this->writePrograms.find(key);
+        if (it != this->writePrograms.end())
+            return it->second;
+
+        // the components before and after the smoothed normal are skipped (at most 4 for each gl_SkipComponents)
+        vector<string> varyings;
+        auto skip = [&](GLuint components)
+        {
+            for (; components > 0; components -= min(components, 4u))
+                varyings.push_back("gl_SkipComponents" + to_string(min(components, 4u)));
+        };
+        skip(offset);
+        varyings.push_back("smNormal");
+        skip(stride - offset - size);
+        string source = string(GPU_SMOOTHING_TF_HEADER) + (octahedral ? "#define OCTAHEDRAL\n" : "") + GPU_SMOOTHING_ENCODE + GPU_SMOOTHING_TF_WRITE;
+        GLuint program = buildProgram(GL_VERTEX_SHADER, source, varyings);
+        this->setSamplers(program, {"values"});
+        this->writePrograms[key] = program;
+        return program;
+    }
+
+    // the samplers of a program read the texture units 0, 1, ... in the order of the names
+    static void setSamplers(GLuint program, const vector<string>& names)
+    {
+        if (!program)
+            return;
+        glUseProgram(program);
+        for (size_t i = 0; i < names.size(); i++)
+            glUniform1i(glGetUniformLocation(program, names[i].c_str()), (GLint)i);
+        glUseProgram(0);
+    }
+
+    //////////////////////////////////////////
+    // it compiles and links a program with a single shader (and the varyings captured by transform feedback, if any). It returns 0 on errors
+    static GLuint buildProgram(GLenum stage, const string& source, const vector<string>& varyings = vector<string>())
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        GLuint shader = glCreateShader(stage);
+        const GLchar* code = source.c_str();
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            cout << "| ERROR::::SHADER-COMPILATION-ERROR of type: GPU SMOOTHING|\n" << infoLog << "\n| -- --------------------------------------------------- -- |" << endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+        GLuint program = glCreateProgram();
+        glAttachShader(program, shader);
+        if (!varyings.empty())
+        {
+            vector<const GLchar*> names;
+            for (const string& name : varyings)
+                names.push_back(name.c_str());
+            glTransformFeedbackVaryings(program, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        glLinkProgram(program);
+        glDeleteShader(shader);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(program, 1024, NULL, infoLog);
+            cout << "| ERROR::::PROGRAM-LINKING-ERROR of type: GPU SMOOTHING|\n" << infoLog << "\n| -- --------------------------------------------------- -- |" << endl;
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+};
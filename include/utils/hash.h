@@ -0,0 +1,42 @@
+/*
+Hash functions
+
+HashBytes computes a 64 bit hash of a memory buffer, used as key of the binary caches of the application
+(e.g., the cache of the processed meshes, see mesh_cache.h, and the cache of the Shader Programs, see program_cache.h).
+The hash of several buffers is computed passing the result of each call as seed of the following one.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+// Std. Includes
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//////////////////////////////////////////
+// 64 bit hash of a memory buffer (FNV-1a applied to 8 bytes at a time, plus a final mixing step)
+inline uint64_t HashBytes(const unsigned char* data, size_t size, uint64_t seed = 14695981039346656037ULL)
+{
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = seed;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++)
+        hash = (hash ^ data[i]) * prime;
+    // final mixing (from MurmurHash3), to spread the differences of the last words on all the bits
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
@@ -0,0 +1,146 @@
+/*
+InstanceBuffer class
+- a VBO with per-instance data (model matrix and normals transformation matrix), used to render many copies of the same Mesh/Model
+  with a single glDrawElementsInstanced call per mesh
+
+The matrices are read in the vertex shader as vertex attributes with divisor = 1 (= they advance once per instance):
+- locations 8-11: model matrix (a mat4 takes 4 locations, one for each column)
+- locations 12-14: normals transformation matrix in world coordinates (= transpose of the inverse of the model matrix)
+
+N.B. 1) the view matrix is the same for all the instances, so the vertex shader obtains the matrix for the normals in view coordinates
+as mat3(viewMatrix) * normalMatrix (which is equal to the transpose of the inverse of mat3(view * model), because the view matrix is a rigid transformation)
+
+N.B. 2) like Mesh, InstanceBuffer is a "move-only" class, in charge of releasing the allocated GPU buffer (RAII)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+
+// first location of the per-instance attributes
+const GLuint INSTANCE_MODEL_LOCATION = 8;
+const GLuint INSTANCE_NORMAL_LOCATION = 12;
+
+// data of an instance
+struct InstanceData
+{
+    glm::mat4 modelMatrix;
+    glm::mat3 normalMatrix;
+
+    InstanceData() : modelMatrix(1.0f), normalMatrix(1.0f) {}
+
+    // the normals transformation matrix is computed from the model matrix
+    InstanceData(const glm::mat4& modelMatrix)
+        : modelMatrix(modelMatrix), normalMatrix(glm::inverseTranspose(glm::mat3(modelMatrix))) {}
+};
+
+/////////////////// INSTANCEBUFFER class ///////////////////////
+class InstanceBuffer
+{
+public:
+
+    InstanceBuffer() noexcept : numInstances(0), capacity(0), id(nextId())
+    {
+        glGenBuffers(1, &this->VBO);
+    }
+
+    InstanceBuffer(const InstanceBuffer& copy) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer& copy) = delete;
+
+    InstanceBuffer(InstanceBuffer&& move) noexcept
+        : VBO(move.VBO), numInstances(move.numInstances), capacity(move.capacity), id(move.id)
+    {
+        move.VBO = 0;
+    }
+
+    InstanceBuffer& operator=(InstanceBuffer&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->VBO = move.VBO;
+        this->numInstances = move.numInstances;
+        this->capacity = move.capacity;
+        this->id = move.id;
+        move.VBO = 0;
+        return *this;
+    }
+
+    ~InstanceBuffer() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // it uploads the data of the instances
+    // if the buffer is big enough, the old content is "orphaned" (glBufferData with NULL), so the driver does not wait for the previous draw calls
+    void Update(const InstanceData* instances, GLsizei count)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        if (count > this->capacity)
+            this->capacity = count;
+        glBufferData(GL_ARRAY_BUFFER, this->capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->numInstances = count;
+    }
+
+    void Update(const vector<InstanceData>& instances) { this->Update(instances.data(), (GLsizei)instances.size()); }
+
+    GLsizei NumInstances() const { return this->numInstances; }
+
+    // unique identifier of the buffer (buffer names can be reused by OpenGL after a deletion, identifiers are never reused)
+    GLuint64 Id() const { return this->id; }
+
+    //////////////////////////////////////////
+    // it sets the pointers to the per-instance attributes in the currently bound VAO
+    void SetupAttributes() const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        for (GLuint c = 0; c < 4; c++)
+        {
+            glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + c);
+            glVertexAttribPointer(INSTANCE_MODEL_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offsetof(InstanceData, modelMatrix) + c * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + c, 1);
+        }
+        for (GLuint c = 0; c < 3; c++)
+        {
+            glEnableVertexAttribArray(INSTANCE_NORMAL_LOCATION + c);
+            glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (GLvoid*)(offsetof(InstanceData, normalMatrix) + c * sizeof(glm::vec3)));
+            glVertexAttribDivisor(INSTANCE_NORMAL_LOCATION + c, 1);
+        }
+    }
+
+private:
+
+    GLuint VBO;
+    GLsizei numInstances;
+    GLsizei capacity;
+    GLuint64 id;
+
+    static GLuint64 nextId()
+    {
+        static GLuint64 counter = 0;
+        return ++counter;
+    }
+
+    void freeGPUresources()
+    {
+        if (this->VBO)
+            glDeleteBuffers(1, &this->VBO);
+    }
+};
@@ -0,0 +1,505 @@
+/*
+LightClusters class - clustered forward lighting with many point lights
+
+The view frustum is split in a grid of clusters: CLUSTER_GRID_X x CLUSTER_GRID_Y tiles of the screen, and CLUSTER_GRID_Z slices of depth,
+with logarithmic spacing between the near and the far plane (so the clusters have about the same proportions at every depth).
+At each frame, the lights are assigned on the CPU to the clusters intersected by their spheres of influence, and a fragment shades
+only the lights of its cluster: the cost of a fragment depends on the lights near it, and not on the total number of lights
+(see "Clustered Deferred and Forward Shading", Olsson et al., HPG 2012).
+
+Assignment (Update):
+- the lights are transformed in view coordinates, and stored as separate arrays of x, y, depth and radius (structure of arrays)
+- the slices are split among the threads of a ThreadPool (see parallel.h): for each slice, the lights whose depth range overlaps
+  the slice are selected, and then each tile of the slice tests them against the bounding box of its cluster (in view coordinates,
+  precomputed by SetProjection). With SSE, the selection and the sphere-box tests process 4 lights with each instruction
+- each slice writes only its own lists, and the lists are then concatenated in slice order, so the result does not depend on the
+  number of threads
+- a cluster keeps at most maxLightsPerCluster lights: if more lights intersect it, the ones with the biggest intensity at the nearest
+  point of the cluster are kept, so the cost of a fragment is bounded also when many lights overlap
+
+The data are read by the fragment shader from three texture buffers (OpenGL 3.1, so they can be used with the OpenGL 4.1 context,
+without shader storage buffers):
+- the lights (RGBA32F, 2 texels for each light): position in view coordinates and radius, color multiplied by the intensity
+- the clusters (RG32UI, 1 texel for each cluster): first element and number of its lights in the list of indices
+- the list of the indices of the lights of all the clusters (R16UI)
+They are bound to the texture units CLUSTER_TEXTURE_UNIT, +1 and +2. SetupProgram sets, in a Shader Program, the units of the samplers,
+and the parameters to find the cluster of a fragment (they change only with the projection and the size of the viewport).
+
+N.B. 1) the buffers are created at the first Update, so the object can be created before the OpenGL context. Like Mesh,
+LightClusters is a "move-only" class, in charge of releasing the allocated GPU resources (RAII)
+
+N.B. 2) the bounding boxes of the clusters assume a symmetric perspective projection (e.g., glm::perspective)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include <utils/parallel.h>
+
+// default size of the grid of clusters
+const GLuint CLUSTER_GRID_X = 16;
+const GLuint CLUSTER_GRID_Y = 9;
+const GLuint CLUSTER_GRID_Z = 24;
+// default maximum number of lights of a cluster (= maximum number of lights shaded by a fragment)
+const GLuint CLUSTER_MAX_LIGHTS = 32;
+// maximum number of lights (the indices are 16 bit)
+const size_t CLUSTER_MAX_TOTAL_LIGHTS = 65535;
+// first texture unit of the texture buffers (the following two are used too)
+const GLuint CLUSTER_TEXTURE_UNIT = 8;
+
+// a point light: its contribution goes to 0 at distance radius from its position (in world coordinates)
+struct PointLight
+{
+    glm::vec3 position;
+    GLfloat radius;
+    glm::vec3 color;
+    GLfloat intensity;
+};
+
+/////////////////// LIGHTCLUSTERS class ///////////////////////
+class LightClusters
+{
+public:
+
+    LightClusters(GLuint gridX = CLUSTER_GRID_X, GLuint gridY = CLUSTER_GRID_Y, GLuint gridZ = CLUSTER_GRID_Z,
+                  GLuint maxLightsPerCluster = CLUSTER_MAX_LIGHTS) noexcept
+        : gridX(gridX), gridY(gridY), gridZ(gridZ), maxLightsPerCluster(maxLightsPerCluster), width(1), height(1),
+          depthScale(0.0f), depthBias(0.0f), numIndices(0), maxInCluster(0), droppedLights(0), uploadedEmpty(false)
+    {
+        for (int i = 0; i < 3; i++)
+            this->buffers[i] = this->textures[i] = 0;
+    }
+
+    LightClusters(const LightClusters& copy) = delete;
+    LightClusters& operator=(const LightClusters& copy) = delete;
+
+    LightClusters(LightClusters&& move) noexcept
+        : LightClusters(move.gridX, move.gridY, move.gridZ, move.maxLightsPerCluster)
+    {
+        *this = std::move(move);
+    }
+
+    LightClusters& operator=(LightClusters&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->gridX = move.gridX;
+        this->gridY = move.gridY;
+        this->gridZ = move.gridZ;
+        this->maxLightsPerCluster = move.maxLightsPerCluster;
+        this->width = move.width;
+        this->height = move.height;
+        this->depthScale = move.depthScale;
+        this->depthBias = move.depthBias;
+        this->boxes = std::move(move.boxes);
+        this->slices = std::move(move.slices);
+        this->lights = std::move(move.lights);
+        this->numIndices = move.numIndices;
+        this->maxInCluster = move.maxInCluster;
+        this->droppedLights = move.droppedLights;
+        this->uploadedEmpty = move.uploadedEmpty;
+        for (int i = 0; i < 3; i++)
+        {
+            this->buffers[i] = move.buffers[i];
+            this->textures[i] = move.textures[i];
+            move.buffers[i] = move.textures[i] = 0;
+        }
+        return *this;
+    }
+
+    ~LightClusters() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // the lights of the scene (in world coordinates). The lights after the first CLUSTER_MAX_TOTAL_LIGHTS are ignored
+    void SetLights(const vector<PointLight>& lights)
+    {
+        if (lights.size() > CLUSTER_MAX_TOTAL_LIGHTS)
+            cout << "WARNING::LIGHTCLUSTERS:: only the first " << CLUSTER_MAX_TOTAL_LIGHTS << " lights are used" << endl;
+        this->lights.assign(lights.begin(), lights.begin() + min(lights.size(), CLUSTER_MAX_TOTAL_LIGHTS));
+    }
+
+    const vector<PointLight>& Lights() const { return this->lights; }
+
+    //////////////////////////////////////////
+    // it computes the bounding boxes of the clusters (in view coordinates) for a symmetric perspective projection, with its near and far
+    // planes, and the size in pixels of the viewport
+    void SetProjection(const glm::mat4& projection, GLfloat near, GLfloat far, GLsizei width, GLsizei height)
+    {
+        this->width = width;
+        this->height = height;
+        // slice k covers the depths [near * (far / near)^(k / gridZ), near * (far / near)^((k + 1) / gridZ)]:
+        // the slice of a depth d is log(d) * depthScale + depthBias
+        this->depthScale = (GLfloat)this->gridZ / log(far / near);
+        this->depthBias = -log(near) * this->depthScale;
+        this->boxes.resize(this->NumClusters());
+        for (GLuint z = 0; z < this->gridZ; z++)
+        {
+            GLfloat depthNear = near * pow(far / near, (GLfloat)z / this->gridZ);
+            GLfloat depthFar = near * pow(far / near, (GLfloat)(z + 1) / this->gridZ);
+            for (GLuint y = 0; y < this->gridY; y++)
+                for (GLuint x = 0; x < this->gridX; x++)
+                {
+                    // the tile in normalized device coordinates, and its extent in view coordinates at the two depths (x = ndc * depth / P[0][0])
+                    GLfloat ndcX0 = -1.0f + 2.0f * x / this->gridX, ndcX1 = -1.0f + 2.0f * (x + 1) / this->gridX;
+                    GLfloat ndcY0 = -1.0f + 2.0f * y / this->gridY, ndcY1 = -1.0f + 2.0f * (y + 1) / this->gridY;
+                    ClusterBox& box = this->boxes[this->clusterIndex(x, y, z)];
+                    box.minX = min(ndcX0 * depthNear, ndcX0 * depthFar) / projection[0][0];
+                    box.maxX = max(ndcX1 * depthNear, ndcX1 * depthFar) / projection[0][0];
+                    box.minY = min(ndcY0 * depthNear, ndcY0 * depthFar) / projection[1][1];
+                    box.maxY = max(ndcY1 * depthNear, ndcY1 * depthFar) / projection[1][1];
+                    box.minDepth = depthNear;
+                    box.maxDepth = depthFar;
+                }
+        }
+        this->uploadedEmpty = false;
+    }
+
+    //////////////////////////////////////////
+    // it sets in a Shader Program the texture units of the buffers, and the parameters to find the cluster of a fragment
+    // (the program is left in use). Before SetProjection, the clustered lights are disabled in the program (clusterGrid.x = 0)
+    // N.B.) the samplers of different types must be on different texture units, so the units must be set also if the lights are not used
+    void SetupProgram(GLuint program) const
+    {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "clusterLights"), CLUSTER_TEXTURE_UNIT);
+        glUniform1i(glGetUniformLocation(program, "clusterRanges"), CLUSTER_TEXTURE_UNIT + 1);
+        glUniform1i(glGetUniformLocation(program, "clusterIndices"), CLUSTER_TEXTURE_UNIT + 2);
+        glUniform3i(glGetUniformLocation(program, "clusterGrid"), this->boxes.empty() ? 0 : this->gridX, this->gridY, this->gridZ);
+        glUniform2f(glGetUniformLocation(program, "clusterTileSize"), (GLfloat)this->width / this->gridX, (GLfloat)this->height / this->gridY);
+        glUniform2f(glGetUniformLocation(program, "clusterDepthScale"), this->depthScale, this->depthBias);
+        glUniform1i(glGetUniformLocation(program, "clusterMaxLights"), this->maxLightsPerCluster);
+    }
+
+    //////////////////////////////////////////
+    // it assigns the lights to the clusters of the view, and it uploads the lights and the clusters in the texture buffers.
+    // The slices are split among the threads of the pool (if not null). It returns the number of light indices of all the clusters
+    size_t Update(const glm::mat4& view, ThreadPool* pool = nullptr)
+    {
+        if (!this->textures[0])
+            this->createBuffers();
+        // without lights, the clusters are all empty, and they are uploaded only once
+        if (this->lights.empty() && this->uploadedEmpty)
+            return 0;
+
+        // lights in view coordinates (the depth is positive in front of the camera), padded to a multiple of 4
+        size_t numLights = this->lights.size();
+        size_t padded = (numLights + 3) & ~(size_t)3;
+        this->lx.assign(padded, 0.0f);
+        this->ly.assign(padded, 0.0f);
+        this->ld.assign(padded, -1e30f);
+        this->lr.assign(padded, 0.0f);
+        this->lightData.resize(2 * numLights);
+        for (size_t i = 0; i < numLights; i++)
+        {
+            const PointLight& light = this->lights[i];
+            glm::vec3 p = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            this->lx[i] = p.x;
+            this->ly[i] = p.y;
+            this->ld[i] = -p.z;
+            this->lr[i] = light.radius;
+            this->lightData[2 * i] = glm::vec4(p, light.radius);
+            this->lightData[2 * i + 1] = glm::vec4(light.color * light.intensity, 0.0f);
+        }
+
+        // assignment of the lights to the clusters, one slice at a time
+        this->slices.resize(this->gridZ);
+        auto assign = [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t z = begin; z < end; z++)
+                this->assignSlice((GLuint)z, numLights);
+        };
+        if (pool)
+            pool->ParallelFor(this->gridZ, assign, 1);
+        else
+            assign(0, this->gridZ, 0);
+
+        // the lists of the slices are concatenated in slice order
+        GLuint tilesPerSlice = this->gridX * this->gridY;
+        this->ranges.resize(this->NumClusters());
+        this->indices.clear();
+        this->maxInCluster = 0;
+        this->droppedLights = 0;
+        for (GLuint z = 0; z < this->gridZ; z++)
+        {
+            const SliceLists& slice = this->slices[z];
+            GLuint offset = (GLuint)this->indices.size();
+            for (GLuint t = 0; t < tilesPerSlice; t++)
+            {
+                this->ranges[z * tilesPerSlice + t] = glm::uvec2(offset + slice.ranges[t].x, slice.ranges[t].y);
+                this->maxInCluster = max(this->maxInCluster, slice.ranges[t].y);
+            }
+            this->indices.insert(this->indices.end(), slice.indices.begin(), slice.indices.end());
+            this->droppedLights += slice.dropped;
+        }
+        this->numIndices = this->indices.size();
+
+        // upload: the buffers are orphaned (glBufferData), so the driver does not wait for the frames still reading the previous data
+        this->upload(0, this->lightData.data(), this->lightData.size() * sizeof(glm::vec4));
+        this->upload(1, this->ranges.data(), this->ranges.size() * sizeof(glm::uvec2));
+        this->upload(2, this->indices.data(), this->indices.size() * sizeof(GLushort));
+        this->uploadedEmpty = this->lights.empty();
+        return this->numIndices;
+    }
+
+    // the texture buffers are bound to their texture units
+    void Bind() const
+    {
+        for (GLuint i = 0; i < 3; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    //////////////////////////////////////////
+    // statistics of the last Update
+
+    GLuint NumClusters() const { return this->gridX * this->gridY * this->gridZ; }
+
+    // light indices of all the clusters, and maximum number of lights of a cluster
+    size_t NumIndices() const { return this->numIndices; }
+    GLuint MaxLightsInCluster() const { return this->maxInCluster; }
+
+    // lights discarded because a cluster had more than maxLightsPerCluster lights (counted once for each cluster)
+    size_t DroppedLights() const { return this->droppedLights; }
+
+    void Print(ostream& out = cout) const
+    {
+        out << "light clusters: " << this->lights.size() << " lights, " << this->NumClusters() << " clusters, "
+            << (double)this->numIndices / this->NumClusters() << " lights/cluster (max " << this->maxInCluster << ", "
+            << this->droppedLights << " dropped)" << endl;
+    }
+
+private:
+
+    // bounding box of a cluster in view coordinates (the depth is positive in front of the camera)
+    struct ClusterBox
+    {
+        GLfloat minX, maxX, minY, maxY, minDepth, maxDepth;
+    };
+
+    // lists of the lights of the clusters of a slice, written by a single thread
+    struct SliceLists
+    {
+        // lights overlapping the slice (structure of arrays, padded to a multiple of 4)
+        vector<GLfloat> x, y, d, r;
+        vector<GLushort> id;
+        // (offset in indices, number of lights) of each tile, and indices of the lights
+        vector<glm::uvec2> ranges;
+        vector<GLushort> indices;
+        size_t dropped;
+    };
+
+    GLuint gridX, gridY, gridZ;
+    GLuint maxLightsPerCluster;
+    GLsizei width, height;
+    GLfloat depthScale, depthBias;
+    vector<ClusterBox> boxes;
+    vector<SliceLists> slices;
+    vector<PointLight> lights;
+    // lights in view coordinates (structure of arrays), and data uploaded in the texture buffers
+    vector<GLfloat> lx, ly, ld, lr;
+    vector<glm::vec4> lightData;
+    vector<glm::uvec2> ranges;
+    vector<GLushort> indices;
+    size_t numIndices;
+    GLuint maxInCluster;
+    size_t droppedLights;
+    bool uploadedEmpty;
+    // buffers and texture buffers of the lights, of the clusters and of the indices
+    GLuint buffers[3];
+    GLuint textures[3];
+
+    //////////////////////////////////////////
+
+    GLuint clusterIndex(GLuint x, GLuint y, GLuint z) const { return (z * this->gridY + y) * this->gridX + x; }
+
+    //////////////////////////////////////////
+    // assignment of the lights to the tiles of a slice
+    void assignSlice(GLuint z, size_t numLights)
+    {
+        SliceLists& slice = this->slices[z];
+        slice.x.clear();
+        slice.y.clear();
+        slice.d.clear();
+        slice.r.clear();
+        slice.id.clear();
+        slice.indices.clear();
+        slice.dropped = 0;
+        GLuint tilesPerSlice = this->gridX * this->gridY;
+        slice.ranges.assign(tilesPerSlice, glm::uvec2(0));
+        if (numLights == 0)
+            return;
+
+        // lights whose depth range [d - r, d + r] overlaps the slice
+        const ClusterBox& first = this->boxes[this->clusterIndex(0, 0, z)];
+        for (size_t i = 0; i < this->ld.size(); i += 4)
+        {
+#ifdef CLUSTERS_SSE
+            __m128 d = _mm_loadu_ps(&this->ld[i]);
+            __m128 r = _mm_loadu_ps(&this->lr[i]);
+            __m128 inside = _mm_and_ps(_mm_cmplt_ps(_mm_sub_ps(d, r), _mm_set1_ps(first.maxDepth)),
+                                       _mm_cmpgt_ps(_mm_add_ps(d, r), _mm_set1_ps(first.minDepth)));
+            int mask = _mm_movemask_ps(inside);
+#else
+            int mask = 0;
+            for (int k = 0; k < 4; k++)
+                if (this->ld[i + k] - this->lr[i + k] < first.maxDepth && this->ld[i + k] + this->lr[i + k] > first.minDepth)
+                    mask |= 1 << k;
+#endif
+            for (int k = 0; k < 4; k++)
+                if ((mask & (1 << k)) && i + k < numLights)
+                {
+                    slice.x.push_back(this->lx[i + k]);
+                    slice.y.push_back(this->ly[i + k]);
+                    slice.d.push_back(this->ld[i + k]);
+                    slice.r.push_back(this->lr[i + k]);
+                    slice.id.push_back((GLushort)(i + k));
+                }
+        }
+        size_t numCandidates = slice.id.size();
+        // the padding lights are far away, with radius 0
+        while (slice.x.size() % 4 != 0)
+        {
+            slice.x.push_back(1e30f);
+            slice.y.push_back(1e30f);
+            slice.d.push_back(1e30f);
+            slice.r.push_back(0.0f);
+            slice.id.push_back(0);
+        }
+
+        // each tile tests the lights of the slice with its box: a sphere intersects the box if the squared distance of its center
+        // from the box is at most the squared radius
+        for (GLuint t = 0; t < tilesPerSlice; t++)
+        {
+            const ClusterBox& box = this->boxes[z * tilesPerSlice + t];
+            size_t start = slice.indices.size();
+            for (size_t i = 0; i < numCandidates; i += 4)
+            {
+#ifdef CLUSTERS_SSE
+                __m128 zero = _mm_setzero_ps();
+                __m128 x = _mm_loadu_ps(&slice.x[i]);
+                __m128 y = _mm_loadu_ps(&slice.y[i]);
+                __m128 d = _mm_loadu_ps(&slice.d[i]);
+                __m128 r = _mm_loadu_ps(&slice.r[i]);
+                __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.minX), x), _mm_sub_ps(x, _mm_set1_ps(box.maxX))), zero);
+                __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.minY), y), _mm_sub_ps(y, _mm_set1_ps(box.maxY))), zero);
+                __m128 dd = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.minDepth), d), _mm_sub_ps(d, _mm_set1_ps(box.maxDepth))), zero);
+                __m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dd, dd));
+                int mask = _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_mul_ps(r, r)));
+#else
+                int mask = 0;
+                for (int k = 0; k < 4; k++)
+                    if (this->distance2(box, slice, i + k) <= slice.r[i + k] * slice.r[i + k])
+                        mask |= 1 << k;
+#endif
+                for (int k = 0; k < 4; k++)
+                    if (mask & (1 << k))
+                        slice.indices.push_back((GLushort)(i + k));
+            }
+            GLuint count = (GLuint)(slice.indices.size() - start);
+            if (count > this->maxLightsPerCluster)
+            {
+                this->keepStrongest(box, slice, start);
+                slice.dropped += count - this->maxLightsPerCluster;
+                count = this->maxLightsPerCluster;
+            }
+            // the positions in the candidates are replaced by the indices of the lights
+            for (size_t k = start; k < slice.indices.size(); k++)
+                slice.indices[k] = slice.id[slice.indices[k]];
+            slice.ranges[t] = glm::uvec2((GLuint)start, count);
+        }
+    }
+
+    // squared distance of a candidate light from a box
+    GLfloat distance2(const ClusterBox& box, const SliceLists& slice, size_t i) const
+    {
+        GLfloat dx = max(max(box.minX - slice.x[i], slice.x[i] - box.maxX), 0.0f);
+        GLfloat dy = max(max(box.minY - slice.y[i], slice.y[i] - box.maxY), 0.0f);
+        GLfloat dd = max(max(box.minDepth - slice.d[i], slice.d[i] - box.maxDepth), 0.0f);
+        return dx * dx + dy * dy + dd * dd;
+    }
+
+    // it keeps, among the candidates of a cluster (from start to the end of the indices), the maxLightsPerCluster lights with the biggest
+    // intensity at the nearest point of the box (the same attenuation of the shader, without the window), in the original order
+    void keepStrongest(const ClusterBox& box, SliceLists& slice, size_t start)
+    {
+        vector<pair<GLfloat, GLushort>> weights;
+        for (size_t k = start; k < slice.indices.size(); k++)
+        {
+            GLushort candidate = slice.indices[k];
+            const PointLight& light = this->lights[slice.id[candidate]];
+            GLfloat strength = light.intensity * max(light.color.r, max(light.color.g, light.color.b));
+            weights.push_back(make_pair(-strength / (1.0f + this->distance2(box, slice, candidate)), candidate));
+        }
+        // ties are resolved by position, so the selection is deterministic
+        nth_element(weights.begin(), weights.begin() + this->maxLightsPerCluster, weights.end());
+        sort(weights.begin(), weights.begin() + this->maxLightsPerCluster,
+             [](const pair<GLfloat, GLushort>& a, const pair<GLfloat, GLushort>& b) { return a.second < b.second; });
+        slice.indices.resize(start);
+        for (GLuint k = 0; k < this->maxLightsPerCluster; k++)
+            slice.indices.push_back(weights[k].second);
+    }
+
+    //////////////////////////////////////////
+
+    void createBuffers()
+    {
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+        glGenBuffers(3, this->buffers);
+        glGenTextures(3, this->textures);
+        for (GLuint i = 0; i < 3; i++)
+        {
+            glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // the buffers are never empty (an empty buffer could make the texture incomplete)
+    void upload(GLuint i, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+        if (bytes > 0)
+            glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+        else
+            glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void freeGPUresources()
+    {
+        if (this->textures[0])
+        {
+            glDeleteTextures(3, this->textures);
+            glDeleteBuffers(3, this->buffers);
+        }
+    }
+};
@@ -0,0 +1,149 @@
+/*
+MappedFile class
+- read-only memory mapping of a file (mmap on MacOS/Linux, CreateFileMapping on Windows)
+
+The content of the file is accessible through a pointer, and the pages are loaded by the OS only when they are accessed:
+this avoids the copy of the file in a buffer allocated by the application, which is useful for big binary files
+(e.g., the mesh cache, or the binary PLY scans).
+
+N.B.) MappedFile follows RAII principles, and, like Mesh and Model, it is a "move-only" class: the mapping is released by the destructor.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    // windows.h defines "near" and "far" as (empty) macros, which collide with the names used by the applications
+    #undef near
+    #undef far
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+/////////////////// MAPPEDFILE class ///////////////////////
+class MappedFile
+{
+public:
+
+    MappedFile() noexcept : data(nullptr), size(0) {}
+
+    // it maps the file in memory. If the file does not exist (or if it is empty), IsValid() returns false
+    MappedFile(const string& path) noexcept : data(nullptr), size(0)
+    {
+        this->open(path);
+    }
+
+    // move-only class: we delete copy constructor and copy assignment
+    MappedFile(const MappedFile& copy) = delete;
+    MappedFile& operator=(const MappedFile& copy) = delete;
+
+    MappedFile(MappedFile&& move) noexcept : data(move.data), size(move.size)
+    {
+        move.data = nullptr;
+        move.size = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& move) noexcept
+    {
+        this->close();
+        this->data = move.data;
+        this->size = move.size;
+        move.data = nullptr;
+        move.size = 0;
+        return *this;
+    }
+
+    ~MappedFile() noexcept
+    {
+        this->close();
+    }
+
+    //////////////////////////////////////////
+
+    bool IsValid() const { return this->data != nullptr; }
+    const unsigned char* Data() const { return this->data; }
+    size_t Size() const { return this->size; }
+
+private:
+
+    const unsigned char* data;
+    size_t size;
+
+    //////////////////////////////////////////
+    void open(const string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping)
+            {
+                // the view keeps a reference to the mapping, so we can close the handles immediately
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view)
+                {
+                    this->data = (const unsigned char*)view;
+                    this->size = (size_t)fileSize.QuadPart;
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            // the mapping remains valid after the file descriptor is closed
+            void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED)
+            {
+                this->data = (const unsigned char*)view;
+                this->size = (size_t)info.st_size;
+            }
+        }
+        ::close(fd);
+#endif
+    }
+
+    //////////////////////////////////////////
+    void close()
+    {
+        if (!this->data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(this->data);
+#else
+        munmap((void*)this->data, this->size);
+#endif
+        this->data = nullptr;
+        this->size = 0;
+    }
+};
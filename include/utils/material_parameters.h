@@ -0,0 +1,99 @@
+/*
+MaterialParameters structure
+- the material and paper parameters of the illumination models, sent to the shaders in a uniform buffer (see uniform_buffer.h)
+
+The structure follows the std140 layout of the MaterialParameters block in illumination_models_modified_fr.frag:
+each vec3 is followed by a float, so that no padding is added between the members.
+It is shared by the application and by the benchmark, which renders with the same default values of the application.
+The specialized programs of the illumination models (see shader_permutations.h) receive the same values as GLSL constants
+(MaterialParameterConstants), so they must be created again if a value changes.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <sstream>
+
+#include <glm/glm.hpp>
+
+struct MaterialParameters
+{
+    glm::vec3 ambientColor;  GLfloat Ka;
+    glm::vec3 specularColor; GLfloat Ks;
+    glm::vec3 shinestColor;  GLfloat shininess;
+    glm::vec3 shinyColor;    GLfloat lambda;
+    glm::vec3 darkColor;     GLfloat alpha;
+    glm::vec3 gloomyColor;   GLfloat r;
+    glm::vec3 SurfaceColor;  GLfloat Ql;
+    glm::vec3 WarmColor;     GLfloat DiffuseWarm;
+    glm::vec3 CoolColor;     GLfloat DiffuseCool;
+    GLfloat Kd;
+    GLfloat myWeightA;
+    GLfloat myWeightD;
+    GLfloat near;
+    GLfloat far;
+    // the size of a std140 block is rounded up to a multiple of 16 bytes
+    GLfloat padding[3];
+};
+
+// binding point of the uniform buffer with the material parameters
+const GLuint MATERIAL_BINDING_POINT = 0;
+
+//////////////////////////////////////////
+// the default values of the parameters (the initial values of the application)
+inline MaterialParameters DefaultMaterialParameters()
+{
+    MaterialParameters m;
+    m.ambientColor = glm::vec3(0.8f, 0.9f, 1.0f);   m.Ka = 0.1f;
+    m.specularColor = glm::vec3(1.0f, 1.0f, 0.1f);  m.Ks = 0.3f;
+    m.shinestColor = glm::vec3(1.0f, 0.8f, 0.4f);   m.shininess = 32.0f;
+    m.shinyColor = glm::vec3(0.6f, 0.5f, 0.2f);     m.lambda = 1.1f;
+    m.darkColor = glm::vec3(0.4f, 0.4f, 0.1f);      m.alpha = 2.0f;
+    m.gloomyColor = glm::vec3(0.2f, 0.1f, 0.1f);    m.r = 0.9f;
+    m.SurfaceColor = glm::vec3(0.65f, 0.65f, 0.65f); m.Ql = 4.0f;
+    m.WarmColor = glm::vec3(0.3f, 0.3f, 0.0f);      m.DiffuseWarm = 0.5f;
+    m.CoolColor = glm::vec3(0.0f, 0.0f, 0.55f);     m.DiffuseCool = 0.25f;
+    m.Kd = 0.6f;
+    m.myWeightA = 0.1f;
+    m.myWeightD = 0.9f;
+    m.near = 0.1f;
+    m.far = 100.0f;
+    m.padding[0] = m.padding[1] = m.padding[2] = 0.0f;
+    return m;
+}
+
+//////////////////////////////////////////
+// GLSL declarations of the parameters as constants, with the same names of the members of the uniform block, in a single line
+// (the value of the STATIC_PARAMETERS macro of the fragment shader). The floats are written with 9 significant digits, so the
+// constants have exactly the values of the structure
+inline string MaterialParameterConstants(const MaterialParameters& m)
+{
+    ostringstream out;
+    out.precision(9);
+    auto vec3 = [&](const char* name, const glm::vec3& v) { out << "const vec3 " << name << " = vec3(" << v.x << ", " << v.y << ", " << v.z << "); "; };
+    auto scalar = [&](const char* name, GLfloat value) { out << "const float " << name << " = " << value << "; "; };
+    vec3("ambientColor", m.ambientColor);   scalar("Ka", m.Ka);
+    vec3("specularColor", m.specularColor); scalar("Ks", m.Ks);
+    vec3("shinestColor", m.shinestColor);   scalar("shininess", m.shininess);
+    vec3("shinyColor", m.shinyColor);       scalar("lambda", m.lambda);
+    vec3("darkColor", m.darkColor);         scalar("alpha", m.alpha);
+    vec3("gloomyColor", m.gloomyColor);     scalar("r", m.r);
+    vec3("SurfaceColor", m.SurfaceColor);   scalar("Ql", m.Ql);
+    vec3("WarmColor", m.WarmColor);         scalar("DiffuseWarm", m.DiffuseWarm);
+    vec3("CoolColor", m.CoolColor);         scalar("DiffuseCool", m.DiffuseCool);
+    scalar("Kd", m.Kd);
+    scalar("myWeightA", m.myWeightA);
+    scalar("myWeightD", m.myWeightD);
+    scalar("near", m.near);
+    scalar("far", m.far);
+    return out.str();
+}
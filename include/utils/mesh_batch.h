@@ -0,0 +1,341 @@
+/*
+MeshBatch class
+- it packs many meshes in shared VBOs/EBOs, and it renders them with a single glMultiDrawElementsBaseVertex call
+
+Each mesh keeps its indices unchanged: in the shared EBO, the indices of a mesh are stored after the ones of the previous meshes,
+and in the shared VBO its vertices are stored after the ones of the previous meshes. The draw call receives, for each mesh,
+the number of indices, the offset of the first index, and the "base vertex" (= the position of the first vertex of the mesh in the VBO),
+which is added by the GPU to each index.
+
+The data are copied directly from the GPU buffers of the meshes (glCopyBufferSubData), so the meshes do not need to keep their
+CPU-side data (e.g., meshes created from the mesh cache), and they can be destroyed after Build().
+
+N.B. 1) meshes can share the same buffers only if they have the same vertex format (see vertex_format.h). The decoding parameters are shared
+too: with 16 bit normalized positions, which are relative to the bounding box of each mesh, the positions of the meshes are encoded again
+relative to the bounding box of the whole group (the VBO of a mesh is read back once, in Build). The positions are quantized twice, so
+the error is at most half a step of the box of the mesh plus half a step of the box of the group. Meshes with different formats are
+placed in different groups, and each group is rendered with its own draw call.
+
+N.B. 2) all the meshes of a batch are rendered with the same transformation matrices (e.g., static scene geometry, or all the meshes of a Model)
+
+N.B. 3) all the levels of detail of each mesh are copied (see mesh_simplifier.h): Draw renders the level selected with SetLod
+(by default the level 0). The meshlets, the additional streams of smoothed normals and the stream of the positions are not copied,
+while the curvatures are copied if all the meshes of a group have them (see curvature.h): only the block of the scale 0 of the smoothed
+normals, the one in the VBOs
+
+N.B. 4) like Mesh, MeshBatch is a "move-only" class, in charge of releasing the allocated GPU buffers (RAII)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+
+#include <utils/model_modified.h>
+
+/////////////////// MESHBATCH class ///////////////////////
+class MeshBatch
+{
+public:
+
+    MeshBatch() noexcept {}
+
+    MeshBatch(const MeshBatch& copy) = delete;
+    MeshBatch& operator=(const MeshBatch& copy) = delete;
+
+    MeshBatch(MeshBatch&& move) noexcept
+        : groups(std::move(move.groups)), entries(std::move(move.entries)), pending(std::move(move.pending))
+    {
+        move.groups.clear();
+    }
+
+    MeshBatch& operator=(MeshBatch&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->groups = std::move(move.groups);
+        this->entries = std::move(move.entries);
+        this->pending = std::move(move.pending);
+        move.groups.clear();
+        return *this;
+    }
+
+    ~MeshBatch() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // meshes (or all the meshes of a model) are added to the batch. They are copied in the shared buffers when Build() is called
+    void Add(const Mesh& mesh) { this->pending.push_back(&mesh); }
+
+    void Add(const Model& model)
+    {
+        for (const Mesh& mesh : model.meshes)
+            this->Add(mesh);
+    }
+
+    //////////////////////////////////////////
+
+    // it creates the shared buffers of the meshes added since the last call
+    // (groups created by a previous call are not extended: the new meshes are placed in new groups)
+    void Build()
+    {
+        // Step 1: we assign the meshes to groups with the same vertex format, and we compute the union of their bounding boxes
+        // (decoded from the parameters of each mesh, so they are the boxes used by the quantization of the positions)
+        size_t firstGroup = this->groups.size();
+        vector<vector<const Mesh*>> members;
+        vector<glm::vec3> boxMin, boxMax;
+        for (const Mesh* mesh : this->pending)
+        {
+            size_t g = firstGroup;
+            while (g < this->groups.size() && !this->compatible(this->groups[g], *mesh))
+                g++;
+            glm::vec3 meshMin(mesh->decode[1]), meshMax = meshMin + glm::vec3(mesh->decode[0]);
+            if (g == this->groups.size())
+            {
+                Group group;
+                group.format = mesh->format;
+                group.decode[0] = mesh->decode[0];
+                group.decode[1] = mesh->decode[1];
+                group.curvatures = mesh->HasCurvatures();
+                group.VAO = group.VBO = group.EBO = group.decodeBuffer = group.curvatureBuffer = 0;
+                group.dirty = true;
+                this->groups.push_back(group);
+                members.push_back(vector<const Mesh*>());
+                boxMin.push_back(meshMin);
+                boxMax.push_back(meshMax);
+            }
+            members[g - firstGroup].push_back(mesh);
+            boxMin[g - firstGroup] = glm::min(boxMin[g - firstGroup], meshMin);
+            boxMax[g - firstGroup] = glm::max(boxMax[g - firstGroup], meshMax);
+            this->entries.push_back(Entry{(GLuint)g, mesh->Lods(), 0, 0, 0});
+        }
+
+        // Step 2: for each group, we create the shared buffers and we copy the data of the meshes
+        size_t entry = this->entries.size() - this->pending.size();
+        for (size_t g = firstGroup; g < this->groups.size(); g++)
+        {
+            Group& group = this->groups[g];
+            if (group.format.positionEncoding == POSITION_UNORM16)
+            {
+                group.decode[0] = glm::vec4(boxMax[g - firstGroup] - boxMin[g - firstGroup], group.decode[0].w);
+                group.decode[1] = glm::vec4(boxMin[g - firstGroup], 0.0f);
+            }
+            this->buildGroup(group, members[g - firstGroup]);
+        }
+        // the positions of the meshes in the shared buffers (the meshes of a group are copied in the order in which they were added)
+        vector<GLsizeiptr> indexOffsets(this->groups.size(), 0);
+        vector<GLint> vertexOffsets(this->groups.size(), 0);
+        for (const Mesh* mesh : this->pending)
+        {
+            Entry& e = this->entries[entry++];
+            e.indexOffset = indexOffsets[e.group];
+            e.baseVertex = vertexOffsets[e.group];
+            indexOffsets[e.group] += mesh->numIndices * sizeof(GLuint);
+            vertexOffsets[e.group] += mesh->numVertices;
+        }
+        this->pending.clear();
+    }
+
+    //////////////////////////////////////////
+
+    // it selects the level of detail rendered for a mesh (the index of the mesh is the order in which it was added).
+    // The level is clamped to the available levels
+    void SetLod(size_t mesh, GLuint lod)
+    {
+        Entry& e = this->entries[mesh];
+        lod = min(lod, (GLuint)e.lods.size() - 1);
+        if (lod == e.lod)
+            return;
+        e.lod = lod;
+        this->groups[e.group].dirty = true;
+    }
+
+    // rendering of all the meshes of the batch: one draw call for each group
+    void Draw()
+    {
+        this->updateDraws();
+        for (const Group& group : this->groups)
+        {
+            glBindVertexArray(group.VAO);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.counts.data(), GL_UNSIGNED_INT,
+                                          (const GLvoid* const*)group.offsets.data(), (GLsizei)group.counts.size(), const_cast<GLint*>(group.baseVertices.data()));
+        }
+        glBindVertexArray(0);
+    }
+
+    // number of draw calls issued by Draw(), and number of meshes in the batch
+    size_t NumDrawCalls() const { return this->groups.size(); }
+    size_t NumMeshes() const { return this->entries.size(); }
+
+private:
+
+    // a set of meshes sharing the same buffers
+    struct Group
+    {
+        VertexFormat format;
+        glm::vec4 decode[2];
+        // true if the meshes have the curvatures of the vertices
+        bool curvatures;
+        GLuint VAO, VBO, EBO, decodeBuffer, curvatureBuffer;
+        // parameters of glMultiDrawElementsBaseVertex, one element for each mesh (dirty = the levels of detail have changed)
+        bool dirty;
+        vector<GLsizei> counts;
+        vector<GLvoid*> offsets;
+        vector<GLint> baseVertices;
+    };
+
+    // a mesh of the batch: its group, its levels of detail and the current one, and the position of its data in the shared buffers
+    struct Entry
+    {
+        GLuint group;
+        vector<MeshLod> lods;
+        GLuint lod;
+        GLsizeiptr indexOffset;
+        GLint baseVertex;
+    };
+
+    vector<Group> groups;
+    vector<Entry> entries;
+    // meshes added but not yet copied in the shared buffers
+    vector<const Mesh*> pending;
+
+    //////////////////////////////////////////
+
+    bool compatible(const Group& group, const Mesh& mesh) const
+    {
+        return group.format == mesh.format && group.curvatures == mesh.HasCurvatures();
+    }
+
+    //////////////////////////////////////////
+    // it builds again the parameters of the draw calls of the groups whose levels of detail have changed
+    void updateDraws()
+    {
+        for (Group& group : this->groups)
+        {
+            if (!group.dirty)
+                continue;
+            group.counts.clear();
+            group.offsets.clear();
+            group.baseVertices.clear();
+        }
+        for (const Entry& e : this->entries)
+        {
+            Group& group = this->groups[e.group];
+            if (!group.dirty)
+                continue;
+            const MeshLod& lod = e.lods[e.lod];
+            group.counts.push_back(lod.numIndices);
+            group.offsets.push_back((GLvoid*)(e.indexOffset + lod.firstIndex * sizeof(GLuint)));
+            group.baseVertices.push_back(e.baseVertex);
+        }
+        for (Group& group : this->groups)
+            group.dirty = false;
+    }
+
+    //////////////////////////////////////////
+    void buildGroup(Group& group, const vector<const Mesh*>& meshes)
+    {
+        GLsizeiptr stride = group.format.Stride();
+        GLsizeiptr vertexBytes = 0, indexBytes = 0, curvatureBytes = 0;
+        for (const Mesh* mesh : meshes)
+        {
+            vertexBytes += mesh->numVertices * stride;
+            indexBytes += mesh->numIndices * sizeof(GLuint);
+            curvatureBytes += mesh->numVertices * 4 * sizeof(GLushort);
+        }
+
+        glGenVertexArrays(1, &group.VAO);
+        glGenBuffers(1, &group.VBO);
+        glGenBuffers(1, &group.EBO);
+        glGenBuffers(1, &group.decodeBuffer);
+
+        // we allocate the shared buffers (the EBO is not bound to GL_ELEMENT_ARRAY_BUFFER here, to avoid modifying the currently bound VAO)
+        glBindBuffer(GL_COPY_WRITE_BUFFER, group.VBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, group.EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+        if (group.curvatures)
+        {
+            glGenBuffers(1, &group.curvatureBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, group.curvatureBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, curvatureBytes, NULL, GL_STATIC_DRAW);
+        }
+
+        // we copy the buffers of each mesh after the ones of the previous meshes. The vertices of a mesh with different decoding
+        // parameters are read back, and their positions are encoded with the parameters of the group
+        GLsizeiptr vertexOffset = 0, indexOffset = 0, curvatureOffset = 0;
+        vector<unsigned char> vertices;
+        for (const Mesh* mesh : meshes)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, mesh->VBO);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, group.VBO);
+            if (mesh->decode[0] == group.decode[0] && mesh->decode[1] == group.decode[1])
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, vertexOffset, mesh->numVertices * stride);
+            else
+            {
+                vertices.resize(mesh->numVertices * stride);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertices.size(), vertices.data());
+                group.format.RequantizePositions(vertices.data(), mesh->numVertices, mesh->decode, group.decode);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, vertexOffset, vertices.size(), vertices.data());
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, mesh->EBO);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, group.EBO);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, indexOffset, mesh->numIndices * sizeof(GLuint));
+            if (group.curvatures)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, mesh->curvatureBuffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, group.curvatureBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, curvatureOffset, mesh->numVertices * 4 * sizeof(GLushort));
+            }
+
+            vertexOffset += mesh->numVertices * stride;
+            indexOffset += mesh->numIndices * sizeof(GLuint);
+            curvatureOffset += mesh->numVertices * 4 * sizeof(GLushort);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        // we set the VAO as in Mesh::setupMesh
+        glBindVertexArray(group.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, group.VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.EBO);
+        group.format.SetupAttributes();
+        VertexFormat::SetupDecodeAttributes(group.decodeBuffer, group.decode);
+        if (group.curvatures)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, group.curvatureBuffer);
+            glEnableVertexAttribArray(CURVATURE_LOCATION);
+            glVertexAttribPointer(CURVATURE_LOCATION, 4, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(GLushort), (GLvoid*)0);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    void freeGPUresources()
+    {
+        for (Group& group : this->groups)
+        {
+            if (!group.VAO)
+                continue;
+            glDeleteVertexArrays(1, &group.VAO);
+            glDeleteBuffers(1, &group.VBO);
+            glDeleteBuffers(1, &group.EBO);
+            glDeleteBuffers(1, &group.decodeBuffer);
+            if (group.curvatureBuffer)
+                glDeleteBuffers(1, &group.curvatureBuffer);
+        }
+        this->groups.clear();
+        this->entries.clear();
+    }
+};
@@ -0,0 +1,264 @@
+/*
+Mesh Cache - binary cache of the processed meshes of a model
+
+The first time a model is loaded, the final arrays of vertices (including the smoothed normals) and indices of each mesh are
+saved in a binary file next to the source file (e.g., "stanford-bunny.obj.meshcache").
+In the following runs, the cache file is memory-mapped, and the arrays are uploaded to the GPU directly from the mapping,
+skipping the Assimp import and the computation of the smoothed normals.
+
+File layout (all the arrays start at an offset aligned to 16 bytes):
+- MeshCacheHeader
+- MeshCacheEntry for each mesh
+- the arrays of vertices (Vertex), indices (GLuint) and levels of detail (MeshLod, see mesh_simplifier.h) referred by the entries
+
+The cache is used only if:
+- the magic number and the format version match (MESH_CACHE_VERSION must be incremented every time the layout of the file,
+  the Vertex structure or the processing of the meshes change)
+- the key stored in the header matches the hash of the size and of the time of the last modification of the source file,
+  plus the Assimp post-processing flags and the processing options of the application. Reading the whole source file at each
+  run would cost about as much as importing it: the hash of its content is added to the key only if it is requested
+  (ModelOptions::cacheHashContent), e.g. when the source files are copied with tools which do not preserve the times
+
+N.B.) the cache is written in a temporary file, which is then renamed: an interrupted write never leaves a corrupted cache.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <utils/mesh_v1.h>
+#include <utils/mapped_file.h>
+#include <utils/hash.h>
+
+// magic number and version of the format
+const char MESH_CACHE_MAGIC[8] = {'R','T','G','P','M','S','H','\0'};
+const uint32_t MESH_CACHE_VERSION = 3;
+// extension added to the path of the source file
+const string MESH_CACHE_EXTENSION = ".meshcache";
+
+// header of the cache file
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    // size of the Vertex structure: a different size means that the cache was created by a different version of the application
+    uint32_t vertexSize;
+    // hash of the source file (size and time of the last modification, optionally the content) and of the processing options
+    uint64_t key;
+    uint32_t postProcessFlags;
+    uint32_t numMeshes;
+};
+
+// position (in bytes from the beginning of the file) and size (in number of elements) of the arrays of a mesh
+struct MeshCacheEntry
+{
+    uint64_t verticesOffset;
+    uint64_t numVertices;
+    uint64_t indicesOffset;
+    uint64_t numIndices;
+    uint64_t lodsOffset;
+    uint64_t numLods;
+};
+
+//////////////////////////////////////////
+// size and time of the last modification (in seconds) of a file. It returns false if the file does not exist
+inline bool MeshCacheFileStamp(const string& path, uint64_t& size, int64_t& modified)
+{
+#ifdef _WIN32
+    struct _stat64 info;
+    if (_stat64(path.c_str(), &info) != 0)
+        return false;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+#endif
+    size = (uint64_t)info.st_size;
+    modified = (int64_t)info.st_mtime;
+    return true;
+}
+
+//////////////////////////////////////////
+// key of the cache of a model: hash of the size and of the time of the last modification of the source file (and of its content,
+// if hashContent is true), combined with the post-processing flags and with the options of the processing performed by the
+// application (e.g., the mesh optimization). It returns false if the source file cannot be read
+inline bool ComputeMeshCacheKey(const string& sourcePath, uint32_t postProcessFlags, uint64_t processing, bool hashContent, uint64_t& key)
+{
+    uint64_t size;
+    int64_t modified;
+    if (!MeshCacheFileStamp(sourcePath, size, modified) || size == 0)
+        return false;
+    key = HashBytes((const unsigned char*)&size, sizeof(size));
+    key = HashBytes((const unsigned char*)&modified, sizeof(modified), key);
+    if (hashContent)
+    {
+        MappedFile source(sourcePath);
+        if (!source.IsValid())
+            return false;
+        key = HashBytes(source.Data(), source.Size(), key);
+    }
+    key = HashBytes((const unsigned char*)&postProcessFlags, sizeof(postProcessFlags), key);
+    key = HashBytes((const unsigned char*)&processing, sizeof(processing), key);
+    return true;
+}
+
+/////////////////// MESHCACHE class ///////////////////////
+// read-only view of a memory-mapped cache file
+class MeshCache
+{
+public:
+
+    // it maps the cache file and checks its validity; if it is not valid, IsValid() returns false
+    MeshCache(const string& cachePath, uint64_t key, uint32_t postProcessFlags)
+        : file(cachePath), valid(false)
+    {
+        this->valid = this->validate(key, postProcessFlags);
+    }
+
+    bool IsValid() const { return this->valid; }
+
+    GLuint NumMeshes() const { return this->header()->numMeshes; }
+
+    const Vertex* Vertices(GLuint mesh) const { return (const Vertex*)(this->file.Data() + this->entry(mesh)->verticesOffset); }
+    size_t NumVertices(GLuint mesh) const { return (size_t)this->entry(mesh)->numVertices; }
+
+    const GLuint* Indices(GLuint mesh) const { return (const GLuint*)(this->file.Data() + this->entry(mesh)->indicesOffset); }
+    size_t NumIndices(GLuint mesh) const { return (size_t)this->entry(mesh)->numIndices; }
+
+    const MeshLod* Lods(GLuint mesh) const { return (const MeshLod*)(this->file.Data() + this->entry(mesh)->lodsOffset); }
+    size_t NumLods(GLuint mesh) const { return (size_t)this->entry(mesh)->numLods; }
+
+    //////////////////////////////////////////
+    // it writes the cache of a set of meshes. The vertices, indices and levels of detail of mesh i are vertices[i], indices[i], lods[i]
+    static bool Write(const string& cachePath, uint64_t key, uint32_t postProcessFlags,
+                      const vector<const vector<Vertex>*>& vertices, const vector<const vector<GLuint>*>& indices,
+                      const vector<const vector<MeshLod>*>& lods)
+    {
+        MeshCacheHeader header;
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.key = key;
+        header.postProcessFlags = postProcessFlags;
+        header.numMeshes = (uint32_t)vertices.size();
+
+        // we compute the offsets of the arrays
+        vector<MeshCacheEntry> entries(vertices.size());
+        uint64_t offset = align(sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry));
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            entries[i].verticesOffset = offset;
+            entries[i].numVertices = vertices[i]->size();
+            offset = align(offset + vertices[i]->size() * sizeof(Vertex));
+            entries[i].indicesOffset = offset;
+            entries[i].numIndices = indices[i]->size();
+            offset = align(offset + indices[i]->size() * sizeof(GLuint));
+            entries[i].lodsOffset = offset;
+            entries[i].numLods = lods[i]->size();
+            offset = align(offset + lods[i]->size() * sizeof(MeshLod));
+        }
+
+        string tmpPath = cachePath + ".tmp";
+        FILE* out = fopen(tmpPath.c_str(), "wb");
+        if (!out)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        if (!entries.empty())
+            ok = ok && fwrite(entries.data(), sizeof(MeshCacheEntry), entries.size(), out) == entries.size();
+        for (size_t i = 0; ok && i < entries.size(); i++)
+        {
+            ok = pad(out, entries[i].verticesOffset);
+            if (ok && !vertices[i]->empty())
+                ok = fwrite(vertices[i]->data(), sizeof(Vertex), vertices[i]->size(), out) == vertices[i]->size();
+            ok = ok && pad(out, entries[i].indicesOffset);
+            if (ok && !indices[i]->empty())
+                ok = fwrite(indices[i]->data(), sizeof(GLuint), indices[i]->size(), out) == indices[i]->size();
+            ok = ok && pad(out, entries[i].lodsOffset);
+            if (ok && !lods[i]->empty())
+                ok = fwrite(lods[i]->data(), sizeof(MeshLod), lods[i]->size(), out) == lods[i]->size();
+        }
+        ok = (fclose(out) == 0) && ok;
+        if (ok)
+        {
+            // rename fails on Windows if the destination exists
+            remove(cachePath.c_str());
+            ok = rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+        }
+        if (!ok)
+            remove(tmpPath.c_str());
+        return ok;
+    }
+
+private:
+
+    MappedFile file;
+    bool valid;
+
+    const MeshCacheHeader* header() const { return (const MeshCacheHeader*)this->file.Data(); }
+    const MeshCacheEntry* entry(GLuint mesh) const { return (const MeshCacheEntry*)(this->file.Data() + sizeof(MeshCacheHeader)) + mesh; }
+
+    static uint64_t align(uint64_t offset) { return (offset + 15) & ~(uint64_t)15; }
+
+    // it writes zeros up to the requested offset
+    static bool pad(FILE* out, uint64_t offset)
+    {
+        long current = ftell(out);
+        if (current < 0 || (uint64_t)current > offset)
+            return false;
+        static const char zeros[16] = {0};
+        return fwrite(zeros, 1, (size_t)(offset - current), out) == (size_t)(offset - current);
+    }
+
+    // true if an array of count elements starting at offset is inside a file of the given size
+    // (the comparisons are written so that corrupted offsets and sizes cannot overflow)
+    static bool inFile(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+    {
+        return offset <= size && count <= (size - offset) / elementSize;
+    }
+
+    //////////////////////////////////////////
+    // it checks header, key and the bounds of all the arrays
+    bool validate(uint64_t key, uint32_t postProcessFlags) const
+    {
+        if (!this->file.IsValid() || this->file.Size() < sizeof(MeshCacheHeader))
+            return false;
+        const MeshCacheHeader* h = this->header();
+        if (memcmp(h->magic, MESH_CACHE_MAGIC, sizeof(h->magic)) != 0 || h->version != MESH_CACHE_VERSION ||
+            h->vertexSize != sizeof(Vertex) || h->key != key || h->postProcessFlags != postProcessFlags)
+            return false;
+        uint64_t size = this->file.Size();
+        if (sizeof(MeshCacheHeader) + (uint64_t)h->numMeshes * sizeof(MeshCacheEntry) > size)
+            return false;
+        for (GLuint i = 0; i < h->numMeshes; i++)
+        {
+            const MeshCacheEntry* e = this->entry(i);
+            if (e->verticesOffset % 16 || e->indicesOffset % 16 || e->lodsOffset % 16 ||
+                !inFile(e->verticesOffset, e->numVertices, sizeof(Vertex), size) ||
+                !inFile(e->indicesOffset, e->numIndices, sizeof(GLuint), size) ||
+                !inFile(e->lodsOffset, e->numLods, sizeof(MeshLod), size))
+                return false;
+            // the levels must be ranges of the indices
+            const MeshLod* lods = (const MeshLod*)(this->file.Data() + e->lodsOffset);
+            for (uint64_t l = 0; l < e->numLods; l++)
+                if ((uint64_t)lods[l].firstIndex + (uint64_t)lods[l].numIndices > e->numIndices || lods[l].numIndices < 0)
+                    return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,366 @@
+/*
+Mesh Optimizer - reordering of the triangles and of the vertices of a mesh for the GPU, performed at loading
+
+The order of the triangles in the scanned models follows the scanning/reconstruction process, which is very unfriendly for the
+post-transform vertex cache of the GPU: the same vertex is transformed (= the vertex shader runs) several times. The
+optimization has three steps:
+1) vertex cache: the triangles are reordered with the Tipsify algorithm (P. V. Sander, D. Nehab, J. Barczak, "Fast Triangle
+   Reordering for Vertex Locality and Reduced Overdraw", SIGGRAPH 2007): the triangles around a "fanning" vertex are emitted
+   together, and the next fanning vertex is chosen among the vertices still in the cache. It is linear in the number of triangles.
+2) overdraw (optional): the Tipsify sequence is split in clusters (at the points where the cache locality is lost, and then
+   where the local ACMR is already good), and the clusters are sorted with a view-independent measure of occlusion: the
+   clusters which face outwards (dot product between the normal of the cluster and the direction from the center of the mesh
+   to the cluster) are drawn first, so they fill the depth buffer and the early depth test discards more fragments of the
+   clusters drawn later (the illumination subroutines are the expensive part of the rendering).
+3) vertex fetch: the vertices are renumbered in the order of their first use, so the vertex fetches are sequential in memory.
+   The vertices not used by any triangle are removed.
+
+The results are measured with a FIFO cache simulation: ACMR (average cache miss ratio, transformed vertices per triangle,
+0.5 is the optimum for big regular meshes, 3 the worst case) and ATVR (average transformed vertex ratio, transformed vertices
+per vertex, the optimum is 1).
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/smoothed_normals.h>
+
+// size of the simulated post-transform cache (Tipsify parameter, and FIFO size of the statistics)
+const GLuint MESH_OPTIMIZER_CACHE_SIZE = 16;
+// a cluster is split when its ACMR is lower than this factor times the ACMR of the original cluster (lambda in Sander et al.)
+const GLfloat MESH_OPTIMIZER_OVERDRAW_THRESHOLD = 1.05f;
+
+// optimization steps performed on the meshes at loading
+enum MeshOptimization {
+    MESH_OPTIMIZATION_NONE,
+    // vertex cache and vertex fetch
+    MESH_OPTIMIZATION_VERTEX_CACHE,
+    // vertex cache, overdraw and vertex fetch
+    MESH_OPTIMIZATION_OVERDRAW
+};
+
+// statistics of the post-transform cache
+struct VertexCacheStatistics
+{
+    // transformed vertices per triangle, and per referenced vertex
+    GLfloat acmr;
+    GLfloat atvr;
+};
+
+/////////////////// FIFO CACHE simulation ///////////////////////
+// the cache is simulated with timestamps: a vertex is in the cache if it has been inserted less than cacheSize misses ago
+class FifoCacheSimulator
+{
+public:
+    FifoCacheSimulator(size_t numVertices, GLuint cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+        : timestamps(numVertices, 0), time(cacheSize + 1), cacheSize(cacheSize), misses(0)
+    {
+    }
+
+    // it processes a vertex, and it returns true if it was a miss
+    bool Access(GLuint vertex)
+    {
+        if (this->time - this->timestamps[vertex] > this->cacheSize)
+        {
+            this->timestamps[vertex] = this->time++;
+            this->misses++;
+            return true;
+        }
+        return false;
+    }
+
+    // all the vertices are removed from the cache
+    void Clear()
+    {
+        this->time += this->cacheSize + 1;
+    }
+
+    size_t Misses() const { return this->misses; }
+
+private:
+    vector<size_t> timestamps;
+    size_t time;
+    size_t cacheSize;
+    size_t misses;
+};
+
+//////////////////////////////////////////
+// it measures ACMR and ATVR of an index buffer
+inline VertexCacheStatistics AnalyzeVertexCache(const GLuint* indices, size_t numIndices, size_t numVertices, GLuint cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    FifoCacheSimulator cache(numVertices, cacheSize);
+    vector<bool> used(numVertices, false);
+    size_t numUsed = 0;
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        cache.Access(indices[i]);
+        if (!used[indices[i]])
+        {
+            used[indices[i]] = true;
+            numUsed++;
+        }
+    }
+    VertexCacheStatistics statistics;
+    statistics.acmr = numIndices > 0 ? (GLfloat)cache.Misses() / (numIndices / 3) : 0.0f;
+    statistics.atvr = numUsed > 0 ? (GLfloat)cache.Misses() / numUsed : 0.0f;
+    return statistics;
+}
+
+//////////////////////////////////////////
+// Tipsify: reordering of the triangles for the vertex cache. If clusters is not null, it receives the index of the first triangle
+// of each "hard" cluster (where the algorithm jumps to a vertex which is not in the cache)
+inline void OptimizeVertexCache(vector<GLuint>& indices, size_t numVertices, vector<size_t>* clusters = nullptr, GLuint cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    size_t numFaces = indices.size() / 3;
+    if (clusters)
+        clusters->clear();
+    if (numFaces == 0)
+        return;
+
+    // triangles of each vertex (CSR), and number of triangles not yet emitted ("live" triangles)
+    VertexFaceAdjacency adjacency;
+    adjacency.Build(numVertices, indices.data(), indices.size());
+    vector<GLuint> live(numVertices);
+    for (size_t v = 0; v < numVertices; v++)
+        live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+    vector<size_t> timestamps(numVertices, 0);
+    vector<bool> emitted(numFaces, false);
+    // vertices of the emitted triangles, used to continue from a recent vertex when the fanning vertex has no more triangles
+    vector<GLuint> deadEnd;
+    vector<GLuint> candidates;
+    vector<GLuint> result;
+    result.reserve(indices.size());
+
+    size_t time = cacheSize + 1;
+    size_t cursor = 0;
+    // the first fanning vertex is the first vertex of the first triangle
+    long long fanning = indices[0];
+    if (clusters)
+        clusters->push_back(0);
+
+    while (fanning >= 0)
+    {
+        // we emit all the live triangles of the fanning vertex
+        candidates.clear();
+        for (GLuint k = adjacency.offsets[fanning]; k < adjacency.offsets[fanning + 1]; k++)
+        {
+            GLuint face = adjacency.faces[k];
+            if (emitted[face])
+                continue;
+            emitted[face] = true;
+            for (int j = 0; j < 3; j++)
+            {
+                GLuint v = indices[3*face+j];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - timestamps[v] > cacheSize)
+                    timestamps[v] = time++;
+            }
+        }
+
+        // the next fanning vertex is the candidate which remains in the cache after its triangles have been emitted,
+        // with the oldest timestamp (= it would be the first one to leave the cache). As in GetNextVertex of the paper, the best
+        // priority starts at -1, so a candidate with live triangles which would leave the cache (priority 0) is preferred to a dead end
+        long long next = -1;
+        long long best = -1;
+        for (GLuint v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            long long priority = 0;
+            if ((long long)(time - timestamps[v]) + 2 * (long long)live[v] <= (long long)cacheSize)
+                priority = (long long)(time - timestamps[v]);
+            if (priority > best)
+            {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next < 0)
+        {
+            // dead end: we take the most recent vertex with live triangles, or the next one in the input order
+            while (!deadEnd.empty() && next < 0)
+            {
+                GLuint v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < numFaces)
+            {
+                for (int j = 0; j < 3 && next < 0; j++)
+                    if (live[indices[3*cursor+j]] > 0)
+                        next = indices[3*cursor+j];
+                if (next < 0)
+                    cursor++;
+            }
+            // if the new fanning vertex is not in the cache, a new cluster starts
+            if (next >= 0 && clusters && time - timestamps[next] > cacheSize)
+                clusters->push_back(result.size() / 3);
+        }
+        fanning = next;
+    }
+    indices.swap(result);
+}
+
+//////////////////////////////////////////
+// overdraw: the clusters of the Tipsify order are split where the local ACMR becomes good enough, and they are sorted
+// from the most "external" to the most "internal" one
+inline void OptimizeOverdraw(vector<GLuint>& indices, const Vertex* vertices, size_t numVertices, const vector<size_t>& hardClusters,
+                             GLfloat threshold = MESH_OPTIMIZER_OVERDRAW_THRESHOLD, GLuint cacheSize = MESH_OPTIMIZER_CACHE_SIZE)
+{
+    size_t numFaces = indices.size() / 3;
+    if (numFaces == 0 || hardClusters.empty())
+        return;
+
+    // soft boundaries: inside each cluster, we close a sub-cluster when its ACMR is lower than threshold * ACMR of the cluster
+    vector<size_t> clusters;
+    FifoCacheSimulator cache(numVertices, cacheSize);
+    for (size_t c = 0; c < hardClusters.size(); c++)
+    {
+        size_t begin = hardClusters[c];
+        size_t end = (c + 1 < hardClusters.size()) ? hardClusters[c + 1] : numFaces;
+        cache.Clear();
+        size_t startMisses = cache.Misses();
+        for (size_t f = begin; f < end; f++)
+            for (int j = 0; j < 3; j++)
+                cache.Access(indices[3*f+j]);
+        GLfloat clusterAcmr = (GLfloat)(cache.Misses() - startMisses) / (end - begin);
+
+        clusters.push_back(begin);
+        cache.Clear();
+        startMisses = cache.Misses();
+        size_t start = begin;
+        for (size_t f = begin; f < end; f++)
+        {
+            for (int j = 0; j < 3; j++)
+                cache.Access(indices[3*f+j]);
+            GLfloat acmr = (GLfloat)(cache.Misses() - startMisses) / (f + 1 - start);
+            if (acmr < threshold * clusterAcmr && f + 1 < end)
+            {
+                clusters.push_back(f + 1);
+                cache.Clear();
+                startMisses = cache.Misses();
+                start = f + 1;
+            }
+        }
+    }
+
+    // center of the mesh (mean of the face centroids, weighted by area)
+    glm::dvec3 meshCenter(0.0);
+    double meshArea = 0.0;
+    for (size_t f = 0; f < numFaces; f++)
+    {
+        const glm::vec3& a = vertices[indices[3*f]].Position;
+        const glm::vec3& b = vertices[indices[3*f+1]].Position;
+        const glm::vec3& c = vertices[indices[3*f+2]].Position;
+        double area = 0.5 * glm::length(glm::cross(b - a, c - a));
+        meshCenter += glm::dvec3((a + b + c) / 3.0f) * area;
+        meshArea += area;
+    }
+    if (meshArea > 0.0)
+        meshCenter /= meshArea;
+
+    // sorting key of each cluster: dot product between its normal and the direction from the center of the mesh
+    vector<GLfloat> keys(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        size_t begin = clusters[c];
+        size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : numFaces;
+        glm::dvec3 center(0.0), normal(0.0);
+        double area = 0.0;
+        for (size_t f = begin; f < end; f++)
+        {
+            const glm::vec3& a = vertices[indices[3*f]].Position;
+            const glm::vec3& b = vertices[indices[3*f+1]].Position;
+            const glm::vec3& v = vertices[indices[3*f+2]].Position;
+            glm::vec3 cross = glm::cross(b - a, v - a);
+            double faceArea = 0.5 * glm::length(cross);
+            center += glm::dvec3((a + b + v) / 3.0f) * faceArea;
+            normal += glm::dvec3(cross);
+            area += faceArea;
+        }
+        if (area > 0.0)
+            center /= area;
+        double length = glm::length(normal);
+        keys[c] = length > 0.0 ? (GLfloat)glm::dot(center - meshCenter, normal / length) : 0.0f;
+    }
+
+    vector<size_t> order(clusters.size());
+    for (size_t c = 0; c < order.size(); c++)
+        order[c] = c;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    vector<GLuint> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+    {
+        size_t begin = clusters[c];
+        size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : numFaces;
+        result.insert(result.end(), indices.begin() + 3 * begin, indices.begin() + 3 * end);
+    }
+    indices.swap(result);
+}
+
+//////////////////////////////////////////
+// vertex fetch: the vertices used by the index buffer are gathered in result, in the order of their first use, and the indices
+// are renumbered. The source array is not modified (e.g., a level of detail takes only its vertices from the ones of the mesh)
+inline void OptimizeVertexFetch(const Vertex* vertices, size_t numVertices, vector<GLuint>& indices, vector<Vertex>& result)
+{
+    const GLuint unused = 0xFFFFFFFFu;
+    vector<GLuint> remap(numVertices, unused);
+    result.clear();
+    for (GLuint& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (GLuint)result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+}
+
+// vertex fetch: the vertices are renumbered in the order of their first use in the index buffer (unused vertices are removed)
+inline void OptimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    vector<Vertex> result;
+    result.reserve(vertices.size());
+    OptimizeVertexFetch(vertices.data(), vertices.size(), indices, result);
+    vertices.swap(result);
+}
+
+//////////////////////////////////////////
+// it applies the optimization steps to a mesh, and it returns the statistics before and after the optimization
+inline void OptimizeMesh(vector<Vertex>& vertices, vector<GLuint>& indices, MeshOptimization optimization,
+                         VertexCacheStatistics& before, VertexCacheStatistics& after)
+{
+    before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    if (optimization != MESH_OPTIMIZATION_NONE)
+    {
+        vector<size_t> clusters;
+        OptimizeVertexCache(indices, vertices.size(), &clusters);
+        if (optimization == MESH_OPTIMIZATION_OVERDRAW)
+            OptimizeOverdraw(indices, vertices.data(), vertices.size(), clusters);
+        OptimizeVertexFetch(vertices, indices);
+    }
+    after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+}
@@ -0,0 +1,419 @@
+/*
+Mesh Simplifier - quadric error mesh simplification, and generation of the chain of levels of detail (LOD) of a mesh
+
+The simplification follows M. Garland, P. Heckbert, "Surface Simplification Using Quadric Error Metrics" (SIGGRAPH 1997):
+- each vertex has a quadric Q (a symmetric 4x4 matrix), the sum of the squared distances from the planes of its faces
+  (weighted by the area of the faces). Open borders add the planes perpendicular to the faces through the border edges,
+  so the borders are not eroded;
+- the edges are collapsed in order of cost (Qu + Qv evaluated at the position of the collapse), using a priority queue.
+  The collapses are "half-edge" collapses: u is moved on v, so the simplified mesh uses a subset of the original vertices,
+  and the attributes of the vertices do not need to be interpolated;
+- a collapse is rejected if it flips a face, or if it would create a non-manifold configuration (link condition).
+
+The levels of detail are snapshots of a single simplification: when the number of faces reaches the target of a level, the
+current faces are saved, and the simplification continues from them. The error of a level is the maximum RMS distance
+(sqrt(Q(p) / sum of the weights)) of the collapses performed so far, in object space: it is used at runtime to choose the level
+from the projected size of the error on screen (Model::SelectLod).
+
+The vertices of each level are copies of the original ones (in the order of first use), appended to the vertex array of the
+mesh, so each level has its own smoothed surface normals, computed on its own faces (the smoothed normals of a coarse level
+average larger regions, and the unsharp masking of the illumination models stays consistent with the geometry that is drawn).
+
+N.B.) the vertices are welded by position before the simplification: the seams of the texture coordinates are not preserved
+(the illumination models of the application do not use textures).
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/mesh_optimizer.h>
+
+// weight of the planes of the border edges, relative to the planes of the faces
+const double SIMPLIFIER_BORDER_WEIGHT = 10.0;
+// a level is saved only if it has at most this fraction of the faces of the previous level
+const GLfloat LOD_MIN_REDUCTION = 0.9f;
+// minimum number of faces of a level
+const size_t LOD_MIN_FACES = 16;
+
+/////////////////// QUADRIC ///////////////////////
+// symmetric 4x4 matrix of the quadric error, stored as the 10 coefficients of the upper triangle, with the sum of the weights
+struct Quadric
+{
+    double a[10];
+    double weight;
+
+    Quadric() : weight(0.0)
+    {
+        for (int i = 0; i < 10; i++)
+            a[i] = 0.0;
+    }
+
+    // quadric of the plane n.p + d = 0 (n unit vector), with the given weight
+    static Quadric Plane(const glm::dvec3& n, double d, double w)
+    {
+        Quadric q;
+        q.a[0] = w*n.x*n.x; q.a[1] = w*n.x*n.y; q.a[2] = w*n.x*n.z; q.a[3] = w*n.x*d;
+        q.a[4] = w*n.y*n.y; q.a[5] = w*n.y*n.z; q.a[6] = w*n.y*d;
+        q.a[7] = w*n.z*n.z; q.a[8] = w*n.z*d;
+        q.a[9] = w*d*d;
+        q.weight = w;
+        return q;
+    }
+
+    void Add(const Quadric& q)
+    {
+        for (int i = 0; i < 10; i++)
+            this->a[i] += q.a[i];
+        this->weight += q.weight;
+    }
+
+    // weighted sum of the squared distances of p from the planes
+    double Evaluate(const glm::dvec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = this->a[0]*x*x + 2.0*this->a[1]*x*y + 2.0*this->a[2]*x*z + 2.0*this->a[3]*x
+                 + this->a[4]*y*y + 2.0*this->a[5]*y*z + 2.0*this->a[6]*y
+                 + this->a[7]*z*z + 2.0*this->a[8]*z
+                 + this->a[9];
+        return e > 0.0 ? e : 0.0;
+    }
+};
+
+/////////////////// MESHSIMPLIFIER class ///////////////////////
+class MeshSimplifier
+{
+public:
+
+    // the mesh to simplify: positions, and triangles with indices in the positions
+    MeshSimplifier(const vector<glm::vec3>& positions, const vector<GLuint>& indices)
+        : positions(positions.begin(), positions.end()), faces(indices), error(0.0)
+    {
+        size_t numVertices = positions.size();
+        size_t numFaces = indices.size() / 3;
+        this->quadrics.assign(numVertices, Quadric());
+        this->vertexFaces.assign(numVertices, vector<GLuint>());
+        this->faceAlive.assign(numFaces, true);
+        this->version.assign(numVertices, 0);
+        this->vertexAlive.assign(numVertices, true);
+        this->numAliveFaces = numFaces;
+
+        // quadrics of the faces
+        for (size_t f = 0; f < numFaces; f++)
+        {
+            glm::dvec3 p0 = this->positions[indices[3*f]], p1 = this->positions[indices[3*f+1]], p2 = this->positions[indices[3*f+2]];
+            glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(cross);
+            for (int j = 0; j < 3; j++)
+                this->vertexFaces[indices[3*f+j]].push_back((GLuint)f);
+            if (length <= 0.0)
+                continue;
+            glm::dvec3 n = cross / length;
+            Quadric q = Quadric::Plane(n, -glm::dot(n, p0), 0.5 * length);
+            for (int j = 0; j < 3; j++)
+                this->quadrics[indices[3*f+j]].Add(q);
+        }
+
+        // quadrics of the border edges (edges used by a single face): the edges are sorted, and the unique ones are borders
+        vector<Edge> edges;
+        edges.reserve(indices.size());
+        for (size_t f = 0; f < numFaces; f++)
+            for (int j = 0; j < 3; j++)
+            {
+                GLuint a = indices[3*f+j], b = indices[3*f+(j+1)%3];
+                edges.push_back(Edge{min(a, b), max(a, b), (GLuint)f});
+            }
+        sort(edges.begin(), edges.end(), [](const Edge& x, const Edge& y) { return x.a < y.a || (x.a == y.a && x.b < y.b); });
+        for (size_t i = 0; i < edges.size(); )
+        {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j].a == edges[i].a && edges[j].b == edges[i].b)
+                j++;
+            if (j == i + 1)
+                this->addBorderQuadric(edges[i]);
+            i = j;
+        }
+
+        // initial candidates: all the edges
+        for (size_t i = 0; i < edges.size(); i++)
+            if (i == 0 || edges[i].a != edges[i-1].a || edges[i].b != edges[i-1].b)
+                this->pushEdge(edges[i].a, edges[i].b);
+    }
+
+    //////////////////////////////////////////
+    // it collapses edges until the number of faces is at most targetFaces (or no more collapses are possible)
+    void Simplify(size_t targetFaces)
+    {
+        while (this->numAliveFaces > targetFaces && !this->heap.empty())
+        {
+            Collapse c = this->heap.top();
+            this->heap.pop();
+            if (!this->vertexAlive[c.from] || !this->vertexAlive[c.to] ||
+                this->version[c.from] != c.fromVersion || this->version[c.to] != c.toVersion)
+                continue;
+            if (!this->canCollapse(c.from, c.to))
+                continue;
+            this->collapse(c.from, c.to);
+            double w = this->quadrics[c.to].weight;
+            if (w > 0.0)
+                this->error = max(this->error, sqrt(c.cost / w));
+        }
+    }
+
+    size_t NumFaces() const { return this->numAliveFaces; }
+
+    // maximum RMS distance of the collapses performed so far
+    GLfloat Error() const { return (GLfloat)this->error; }
+
+    // the current faces, with indices in the original positions
+    void Indices(vector<GLuint>& indices) const
+    {
+        indices.clear();
+        indices.reserve(this->numAliveFaces * 3);
+        for (size_t f = 0; f < this->faceAlive.size(); f++)
+            if (this->faceAlive[f])
+                indices.insert(indices.end(), this->faces.begin() + 3 * f, this->faces.begin() + 3 * f + 3);
+    }
+
+private:
+
+    struct Edge
+    {
+        GLuint a, b, face;
+    };
+
+    // a candidate collapse (from is moved on to), with the versions of the vertices at the time of the computation of the cost
+    struct Collapse
+    {
+        double cost;
+        GLuint from, to;
+        GLuint fromVersion, toVersion;
+        bool operator<(const Collapse& c) const { return this->cost > c.cost; }
+    };
+
+    vector<glm::dvec3> positions;
+    vector<GLuint> faces;
+    vector<Quadric> quadrics;
+    vector<vector<GLuint>> vertexFaces;
+    vector<bool> faceAlive;
+    vector<bool> vertexAlive;
+    vector<GLuint> version;
+    size_t numAliveFaces;
+    priority_queue<Collapse> heap;
+    double error;
+
+    //////////////////////////////////////////
+    void addBorderQuadric(const Edge& edge)
+    {
+        const GLuint* f = &this->faces[3 * edge.face];
+        glm::dvec3 p0 = this->positions[f[0]], p1 = this->positions[f[1]], p2 = this->positions[f[2]];
+        glm::dvec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+        glm::dvec3 direction = this->positions[edge.b] - this->positions[edge.a];
+        glm::dvec3 n = glm::cross(direction, faceNormal);
+        double length = glm::length(n);
+        if (length <= 0.0)
+            return;
+        n /= length;
+        double edgeLength = glm::length(direction);
+        Quadric q = Quadric::Plane(n, -glm::dot(n, this->positions[edge.a]), SIMPLIFIER_BORDER_WEIGHT * edgeLength * edgeLength);
+        this->quadrics[edge.a].Add(q);
+        this->quadrics[edge.b].Add(q);
+    }
+
+    // it adds the cheaper direction of the collapse of an edge to the queue
+    void pushEdge(GLuint a, GLuint b)
+    {
+        Quadric q = this->quadrics[a];
+        q.Add(this->quadrics[b]);
+        double costAB = q.Evaluate(this->positions[b]);
+        double costBA = q.Evaluate(this->positions[a]);
+        if (costAB <= costBA)
+            this->heap.push(Collapse{costAB, a, b, this->version[a], this->version[b]});
+        else
+            this->heap.push(Collapse{costBA, b, a, this->version[b], this->version[a]});
+    }
+
+    bool faceHas(GLuint face, GLuint vertex) const
+    {
+        const GLuint* f = &this->faces[3 * face];
+        return f[0] == vertex || f[1] == vertex || f[2] == vertex;
+    }
+
+    // neighbours of a vertex (sorted, unique)
+    void neighbors(GLuint vertex, vector<GLuint>& result) const
+    {
+        result.clear();
+        for (GLuint face : this->vertexFaces[vertex])
+        {
+            if (!this->faceAlive[face])
+                continue;
+            for (int j = 0; j < 3; j++)
+                if (this->faces[3*face+j] != vertex)
+                    result.push_back(this->faces[3*face+j]);
+        }
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+    }
+
+    //////////////////////////////////////////
+    bool canCollapse(GLuint from, GLuint to)
+    {
+        // link condition: the common neighbours of the two vertices must be the opposite vertices of the faces of the edge
+        size_t sharedFaces = 0;
+        for (GLuint face : this->vertexFaces[from])
+            if (this->faceAlive[face] && this->faceHas(face, to))
+                sharedFaces++;
+        if (sharedFaces == 0)
+            return false;
+        this->neighbors(from, this->fromNeighbors);
+        this->neighbors(to, this->toNeighbors);
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < this->fromNeighbors.size() && j < this->toNeighbors.size(); )
+        {
+            if (this->fromNeighbors[i] < this->toNeighbors[j]) i++;
+            else if (this->fromNeighbors[i] > this->toNeighbors[j]) j++;
+            else { common++; i++; j++; }
+        }
+        if (common != sharedFaces)
+            return false;
+
+        // the faces which remain must not flip (or become degenerate)
+        const glm::dvec3& target = this->positions[to];
+        for (GLuint face : this->vertexFaces[from])
+        {
+            if (!this->faceAlive[face] || this->faceHas(face, to))
+                continue;
+            const GLuint* f = &this->faces[3 * face];
+            glm::dvec3 p[3], q[3];
+            for (int j = 0; j < 3; j++)
+            {
+                p[j] = this->positions[f[j]];
+                q[j] = (f[j] == from) ? target : p[j];
+            }
+            glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::dvec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            double lengths = glm::length(before) * glm::length(after);
+            if (lengths <= 0.0 || glm::dot(before, after) < 0.2 * lengths)
+                return false;
+        }
+        return true;
+    }
+
+    void collapse(GLuint from, GLuint to)
+    {
+        this->quadrics[to].Add(this->quadrics[from]);
+        for (GLuint face : this->vertexFaces[from])
+        {
+            if (!this->faceAlive[face])
+                continue;
+            if (this->faceHas(face, to))
+            {
+                this->faceAlive[face] = false;
+                this->numAliveFaces--;
+                continue;
+            }
+            GLuint* f = &this->faces[3 * face];
+            for (int j = 0; j < 3; j++)
+                if (f[j] == from)
+                    f[j] = to;
+            this->vertexFaces[to].push_back(face);
+        }
+        this->vertexAlive[from] = false;
+        vector<GLuint>().swap(this->vertexFaces[from]);
+
+        // the dead faces are removed from the list of the vertex, and the costs of its edges are updated
+        vector<GLuint>& list = this->vertexFaces[to];
+        list.erase(remove_if(list.begin(), list.end(), [this](GLuint face) { return !this->faceAlive[face]; }), list.end());
+        this->version[to]++;
+        this->neighbors(to, this->toNeighbors);
+        for (GLuint w : this->toNeighbors)
+            this->pushEdge(to, w);
+    }
+
+    // temporary lists of neighbours
+    vector<GLuint> fromNeighbors, toNeighbors;
+};
+
+//////////////////////////////////////////
+// it builds numLevels levels of detail, each one with about ratio times the faces of the previous one.
+// The vertices and indices of the levels are appended to the arrays (LOD 0 is the original mesh), and lods receives the
+// range of the indices and the error of each level (the indices are absolute positions in the vertex array).
+// If optimization is not NONE, the triangles and the vertices of the levels are reordered for the vertex cache (see mesh_optimizer.h)
+inline void BuildLodChain(vector<Vertex>& vertices, vector<GLuint>& indices, GLuint numLevels, GLfloat ratio,
+                          MeshOptimization optimization, vector<MeshLod>& lods)
+{
+    lods.assign(1, MeshLod{0, (GLsizei)indices.size(), 0.0f});
+    size_t numFaces = indices.size() / 3;
+    if (numLevels == 0 || numFaces < LOD_MIN_FACES)
+        return;
+
+    // the vertices are welded by position: welded[v] is the first vertex with the same position of v
+    size_t numVertices = vertices.size();
+    vector<GLuint> order(numVertices);
+    for (size_t v = 0; v < numVertices; v++)
+        order[v] = (GLuint)v;
+    auto less = [&](GLuint a, GLuint b)
+    {
+        const glm::vec3& p = vertices[a].Position;
+        const glm::vec3& q = vertices[b].Position;
+        if (p.x != q.x) return p.x < q.x;
+        if (p.y != q.y) return p.y < q.y;
+        if (p.z != q.z) return p.z < q.z;
+        return a < b;
+    };
+    sort(order.begin(), order.end(), less);
+    vector<GLuint> welded(numVertices);
+    for (size_t i = 0; i < numVertices; i++)
+        welded[order[i]] = (i > 0 && vertices[order[i]].Position == vertices[order[i-1]].Position) ? welded[order[i-1]] : order[i];
+
+    vector<glm::vec3> positions(numVertices);
+    for (size_t v = 0; v < numVertices; v++)
+        positions[v] = vertices[v].Position;
+    vector<GLuint> weldedIndices(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+        weldedIndices[i] = welded[indices[i]];
+
+    MeshSimplifier simplifier(positions, weldedIndices);
+    size_t previousFaces = numFaces;
+    vector<GLuint> levelIndices;
+    vector<Vertex> levelVertices;
+    for (GLuint level = 1; level <= numLevels; level++)
+    {
+        size_t target = (size_t)(previousFaces * ratio);
+        if (target < LOD_MIN_FACES)
+            break;
+        simplifier.Simplify(target);
+        if (simplifier.NumFaces() > previousFaces * LOD_MIN_REDUCTION)
+            break;
+        previousFaces = simplifier.NumFaces();
+
+        // the vertices used by the level are gathered from the ones of the original mesh, in the order of first use
+        simplifier.Indices(levelIndices);
+        if (optimization != MESH_OPTIMIZATION_NONE)
+            OptimizeVertexCache(levelIndices, numVertices);
+        OptimizeVertexFetch(vertices.data(), numVertices, levelIndices, levelVertices);
+
+        GLuint base = (GLuint)vertices.size();
+        MeshLod lod = {(GLuint)indices.size(), (GLsizei)levelIndices.size(), simplifier.Error()};
+        vertices.insert(vertices.end(), levelVertices.begin(), levelVertices.end());
+        for (GLuint index : levelIndices)
+            indices.push_back(base + index);
+        lods.push_back(lod);
+    }
+}
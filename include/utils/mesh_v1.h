@@ -17,6 +17,32 @@ N.B. 2) no texturing in this version of the class
 
 N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
 
+N.B. 4) the layout of the data in the VBO is described by a VertexFormat (see vertex_format.h): by default it is the Vertex structure,
+but it is possible to upload only some attributes, and to use compact encodings for positions and normals
+
+N.B. 5) a mesh can have additional streams of smoothed normals, computed at different scales (see multiscale_normals.h), in a separate VBO.
+SetSmoothingScale changes the buffer read by the smoothed normal attribute (location 2) in the VAO: scale 0 is the smoothed normal in the VBO
+of the vertices, scale k > 0 is the k-th additional stream
+
+N.B. 6) a mesh can have several levels of detail (see mesh_simplifier.h): each level is a range of the EBO, with its own vertices in the VBO.
+Draw and DrawInstanced render the level selected with SetLod (by default the level 0, the original mesh)
+
+N.B. 7) the level 0 can be split in meshlets (see meshlets.h): CullMeshlets tests them against the view frustum and the position of the camera,
+and DrawMeshlets renders only the visible ones with a single glMultiDrawElementsBaseVertex call
+
+N.B. 8) the coarsest level of detail is also kept on the CPU, as occluder for the software occlusion culling (see occlusion.h)
+
+N.B. 9) a mesh can have the curvatures of its vertices (see curvature.h), as 4 half floats in a separate buffer read by the attribute at
+location 15. Without curvatures, the attribute is disabled, and the shaders read (0, 0, 0, 1). The buffer has a block of curvatures for
+each scale of the smoothed normals, and SetSmoothingScale changes the block read by location 15 together with the normals of location 2
+
+N.B. 10) a mesh can have a second copy of its positions, tightly packed in a separate buffer, with its own VAO which enables only
+location 0 (and the decoding attributes): DrawDepth renders the same triangles of DrawMeshlets reading only this stream, for a depth
+pre-pass which does not fetch the whole interleaved vertices. Without the stream, DrawDepth uses the VAO of the mesh.
+The stream is uploaded with the vertices, or BuildPositionStream creates it later from the VBO.
+DrawShadow reads the same stream, but it renders a given level of detail without the meshlets: the shadow maps are not rendered from the camera,
+so the level and the visible meshlets selected for the view must not be used
+
 author: Davide Gadia, Michael Marchesan
 
 Real-Time Graphics Programming - a.a. 2020/2021
@@ -30,6 +56,7 @@ using namespace std;
 
 // Std. Includes
 #include <vector>
+#include <cstring>
 
 // data structure for vertices
 struct Vertex {
@@ -47,14 +74,75 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// configurable layout of the vertex data in the VBO
+#include <utils/vertex_format.h>
+// per-instance data for instanced rendering
+#include <utils/instance_buffer.h>
+// bounding volumes
+#include <utils/bounds.h>
+// clusters of triangles culled on the CPU
+#include <utils/meshlets.h>
+#include <utils/parallel.h>
+// simplified occluders for the occlusion culling on the CPU
+#include <utils/occlusion.h>
+
+// number of meshlets tested by a thread, at least
+const size_t MESHLET_CULL_CHUNK_SIZE = 256;
+
+// a level of detail of a mesh: range of its indices in the EBO, and maximum geometric error (in object space) with respect to the original mesh
+struct MeshLod
+{
+    GLuint firstIndex;
+    GLsizei numIndices;
+    GLfloat error;
+};
+
+// data of a mesh converted in a VertexFormat, ready to be copied in the GPU buffers
+// (they are prepared without OpenGL calls, e.g. on a worker thread: see Model::LoadMeshData and model_loader.h)
+struct MeshData
+{
+    VertexFormat format;
+    GLsizei numVertices;
+    vector<unsigned char> vertexData;
+    glm::vec4 decode[2];
+    vector<GLuint> indices;
+    // additional streams of smoothed normals, in the encoding of the normals of the format
+    GLuint numSmoothingStreams;
+    vector<unsigned char> smoothingData;
+    // levels of detail (empty = a single level, with all the indices), and bounds of the vertices
+    vector<MeshLod> lods;
+    Bounds bounds;
+    // meshlets of the level 0, and their 16 bit local indices (empty if the meshlets use the 32 bit indices)
+    vector<Meshlet> meshlets;
+    vector<GLushort> meshletIndices;
+    // coarsest level of detail, used as occluder
+    OccluderGeometry occluder;
+    // curvatures of the vertices, as 4 half floats for each vertex and for each scale of the smoothed normals (empty = none)
+    vector<GLushort> curvatureData;
+    // positions of the vertices, tightly packed in the encoding of the format (empty = none)
+    vector<unsigned char> positionData;
+};
+
+class MeshBatch;
+class ModelLoader;
+
 /////////////////// MESH class ///////////////////////
 class Mesh {
 public:
     // data structures for vertices, and indices of vertices (for faces)
     vector<Vertex> vertices;
     vector<GLuint> indices;
+    // number of vertices in the VBO and of indices in the EBO (they are equal to the sizes of the vectors, unless the mesh has been created without keeping the CPU-side data)
+    GLsizei numVertices;
+    GLsizei numIndices;
+    // layout of the vertex data in the VBO
+    VertexFormat format;
     // VAO
     GLuint VAO;
+    // bounding box and bounding sphere of the vertices, in object space (see bounds.h)
+    Bounds bounds;
+    // coarsest level of detail on the CPU, used as occluder (empty if the level has too many triangles, see occlusion.h)
+    OccluderGeometry occluder;
 
     // We want Mesh to be a move-only class. We delete copy constructor and copy assignment
     // see:
@@ -69,10 +157,39 @@ public:
     // Constructor
     // We use initializer list and std::move in order to avoid a copy of the arguments
     // This constructor empties the source vectors (vertices and indices)
-    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices) noexcept
-        : vertices(std::move(vertices)), indices(std::move(indices))
+    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices, const VertexFormat& format = VertexFormat()) noexcept
+        : vertices(std::move(vertices)), indices(std::move(indices)), format(format)
+    {
+        this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    }
+
+    // Constructor from arrays owned by someone else (e.g., a memory-mapped mesh cache)
+    // data are uploaded directly to the GPU, and the vertices and indices vectors remain empty
+    Mesh(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, const VertexFormat& format = VertexFormat()) noexcept
+        : format(format)
     {
-        this->setupMesh();
+        this->setupMesh(vertices, numVertices, indices, numIndices);
+    }
+
+    // Constructor from data already converted in the vertex format (see MeshData)
+    // if upload is false, the buffers are only allocated, and the data are copied later (e.g., incrementally by ModelLoader)
+    Mesh(const MeshData& data, bool upload = true) noexcept
+        : format(data.format)
+    {
+        this->decode[0] = data.decode[0];
+        this->decode[1] = data.decode[1];
+        this->bounds = data.bounds;
+        this->occluder = data.occluder;
+        this->createBuffers(upload ? data.vertexData.data() : nullptr, data.vertexData.size(), data.numVertices,
+                            upload ? data.indices.data() : nullptr, data.indices.size());
+        if (data.numSmoothingStreams > 0)
+            this->setSmoothingData(upload ? data.smoothingData.data() : nullptr, data.smoothingData.size(), data.numSmoothingStreams);
+        this->SetLods(data.lods);
+        this->SetMeshlets(data.meshlets, upload ? data.meshletIndices.data() : nullptr, data.meshletIndices.size());
+        if (!data.curvatureData.empty())
+            this->SetCurvatureData(upload ? data.curvatureData.data() : nullptr, data.curvatureData.size());
+        if (!data.positionData.empty())
+            this->setPositionData(upload ? data.positionData.data() : nullptr, data.positionData.size());
     }
 
     // We implement a user-defined move constructor and move assignment
@@ -89,11 +206,16 @@ public:
     // In our case it will no longer imply ownership of the GPU resources and its vectors will be empty.
     Mesh(Mesh&& move) noexcept
         // Calls move for both vectors, which internally consists of a simple pointer swap between the new instance and the source one.
-        : vertices(std::move(move.vertices)), indices(std::move(move.indices)),
-        VAO(move.VAO), VBO(move.VBO), EBO(move.EBO)
+        : vertices(std::move(move.vertices)), indices(std::move(move.indices)), numVertices(move.numVertices), numIndices(move.numIndices), format(move.format),
+        VAO(move.VAO), bounds(move.bounds), occluder(std::move(move.occluder)), VBO(move.VBO), EBO(move.EBO), decodeBuffer(move.decodeBuffer), instanceBufferId(move.instanceBufferId),
+        smoothingBuffer(move.smoothingBuffer), numSmoothingStreams(move.numSmoothingStreams), smoothingScale(move.smoothingScale),
+        lods(std::move(move.lods)), lod(move.lod), meshlets(std::move(move.meshlets)), meshletEBO(move.meshletEBO), meshletDraws(std::move(move.meshletDraws)),
+        curvatureBuffer(move.curvatureBuffer), numCurvatureScales(move.numCurvatureScales), positionBuffer(move.positionBuffer), positionVAO(move.positionVAO)
     {
-        move.VAO = 0; // We *could* set VBO and EBO to 0 too,
-        // but since we bring all the 3 values around we can use just one of them to check ownership of the 3 resources.
+        this->decode[0] = move.decode[0];
+        this->decode[1] = move.decode[1];
+        move.VAO = 0; // We *could* set VBO, EBO and decodeBuffer to 0 too,
+        // but since we bring all the values around we can use just one of them to check ownership of all the resources.
     }
 
     // Move assignment
@@ -106,9 +228,30 @@ public:
         {
             vertices = std::move(move.vertices);
             indices = std::move(move.indices);
+            numVertices = move.numVertices;
+            numIndices = move.numIndices;
+            format = move.format;
+            bounds = move.bounds;
+            occluder = std::move(move.occluder);
+            lods = std::move(move.lods);
+            lod = move.lod;
+            meshlets = std::move(move.meshlets);
+            meshletEBO = move.meshletEBO;
+            meshletDraws = std::move(move.meshletDraws);
+            curvatureBuffer = move.curvatureBuffer;
+            numCurvatureScales = move.numCurvatureScales;
+            positionBuffer = move.positionBuffer;
+            positionVAO = move.positionVAO;
+            decode[0] = move.decode[0];
+            decode[1] = move.decode[1];
+            instanceBufferId = move.instanceBufferId;
             VAO = move.VAO;
             VBO = move.VBO;
             EBO = move.EBO;
+            decodeBuffer = move.decodeBuffer;
+            smoothingBuffer = move.smoothingBuffer;
+            numSmoothingStreams = move.numSmoothingStreams;
+            smoothingScale = move.smoothingScale;
 
             move.VAO = 0;
         }
@@ -131,18 +274,273 @@ public:
     // rendering of mesh
     void Draw()
     {
-        // VAO is made "active"
+        this->drawLod(this->VAO);
+    }
+
+    // instanced rendering of mesh: a copy of the mesh is drawn for each instance in the buffer, with a single draw call
+    // the vertex shader must read the per-instance matrices (see instance_buffer.h)
+    void DrawInstanced(const InstanceBuffer& instances)
+    {
         glBindVertexArray(this->VAO);
-        // rendering of data in the VAO
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-        // VAO is "detached"
+        // the per-instance attributes are added to the VAO only the first time a buffer is used
+        if (this->instanceBufferId != instances.Id())
+        {
+            instances.SetupAttributes();
+            this->instanceBufferId = instances.Id();
+        }
+        const MeshLod& lod = this->lods[this->lod];
+        glDrawElementsInstanced(GL_TRIANGLES, lod.numIndices, GL_UNSIGNED_INT, (void*)(lod.firstIndex * sizeof(GLuint)), instances.NumInstances());
+        glBindVertexArray(0);
+    }
+
+    //////////////////////////////////////////
+
+    // it uploads the additional streams of smoothed normals (one vector for each scale, with a normal for each vertex)
+    // the streams are ignored if the format of the mesh does not include the smoothed normals
+    void SetSmoothingStreams(const vector<vector<glm::vec3>>& streams)
+    {
+        if (!this->format.Has(ATTRIB_SM_NORMAL) || streams.empty())
+            return;
+        vector<unsigned char> data;
+        for (const vector<glm::vec3>& stream : streams)
+            this->format.PackUnitVectors(stream.data(), this->numVertices, data);
+        this->setSmoothingData(data.data(), data.size(), (GLuint)streams.size());
+    }
+
+    // number of available scales of the smoothed normals (the one in the VBO of the vertices, and the additional streams)
+    GLuint NumSmoothingScales() const { return 1 + this->numSmoothingStreams; }
+
+    GLuint SmoothingScale() const { return this->smoothingScale; }
+
+    // the smoothed normal attribute reads the requested scale, and the curvature attribute the curvatures estimated at the same scale.
+    // Only the VAO is changed, so the cost is negligible
+    void SetSmoothingScale(GLuint scale)
+    {
+        if (scale >= this->NumSmoothingScales() || !this->format.Has(ATTRIB_SM_NORMAL))
+            return;
+        GLuint location = 2;
+        glBindVertexArray(this->VAO);
+        if (scale == 0)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+            this->format.SetupAttribute(location, this->format.Stride(), this->format.AttributeOffset(location));
+        }
+        else
+        {
+            GLsizei size = this->format.AttributeSize(location);
+            glBindBuffer(GL_ARRAY_BUFFER, this->smoothingBuffer);
+            this->format.SetupAttribute(location, size, (GLintptr)(scale - 1) * this->numVertices * size);
+        }
+        this->smoothingScale = scale;
+        if (this->curvatureBuffer)
+            this->setupCurvatureAttribute();
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+
+    // it uploads the curvatures of the vertices (4 half floats for each vertex, see curvature.h), and it enables their attribute in the VAO.
+    // The data can have a block of curvatures for each scale of the smoothed normals. If data is null, the buffer is only allocated
+    void SetCurvatureData(const GLushort* data, size_t numValues)
+    {
+        if (!this->curvatureBuffer)
+            glGenBuffers(1, &this->curvatureBuffer);
+        this->numCurvatureScales = this->numVertices > 0 ? (GLuint)(numValues / (4 * (size_t)this->numVertices)) : 0;
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->curvatureBuffer);
+        glBufferData(GL_ARRAY_BUFFER, numValues * sizeof(GLushort), data, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(CURVATURE_LOCATION);
+        this->setupCurvatureAttribute();
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    bool HasCurvatures() const { return this->curvatureBuffer != 0; }
+
+    //////////////////////////////////////////
+
+    // it sets the levels of detail of the mesh (empty = a single level, with all the indices). The level 0 is selected
+    void SetLods(const vector<MeshLod>& lods)
+    {
+        if (lods.empty())
+            this->lods.assign(1, MeshLod{0, this->numIndices, 0.0f});
+        else
+            this->lods = lods;
+        this->lod = 0;
+    }
+
+    const vector<MeshLod>& Lods() const { return this->lods; }
+
+    GLuint NumLods() const { return (GLuint)this->lods.size(); }
+
+    GLuint Lod() const { return this->lod; }
+
+    // the level is clamped to the available levels
+    void SetLod(GLuint lod) { this->lod = min(lod, this->NumLods() - 1); }
+
+    GLfloat LodError(GLuint lod) const { return this->lods[lod].error; }
+
+    // number of indices rendered by Draw with the current level of detail
+    GLsizei DrawnIndices() const { return this->lods[this->lod].numIndices; }
+
+    //////////////////////////////////////////
+
+    // it sets the meshlets of the level 0 (see meshlets.h), with their 16 bit local indices (numLocalIndices = 0 if the meshlets use the indices of the EBO).
+    // If localIndices is null, the buffer of the local indices is only allocated
+    void SetMeshlets(const vector<Meshlet>& meshlets, const GLushort* localIndices, size_t numLocalIndices)
+    {
+        this->meshlets = meshlets;
+        this->meshletDraws = MeshletDrawList();
+        this->meshletDraws.visible.assign(meshlets.size(), 1);
+        if (this->meshletEBO)
+            glDeleteBuffers(1, &this->meshletEBO);
+        this->meshletEBO = 0;
+        if (meshlets.empty() || numLocalIndices == 0)
+            return;
+        glGenBuffers(1, &this->meshletEBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, this->meshletEBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, numLocalIndices * sizeof(GLushort), localIndices, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    GLuint NumMeshlets() const { return (GLuint)this->meshlets.size(); }
+
+    // number of meshlets and of indices in the draw list of the last culling
+    GLuint VisibleMeshlets() const { return this->meshletDraws.numVisible; }
+    GLuint64 VisibleMeshletIndices() const { return this->meshletDraws.numIndices; }
+
+    // it tests the meshlets with the frustum and the position of the camera in object space, and it builds the draw list of DrawMeshlets.
+    // The tests are split among the threads of the pool (if not null). It returns the number of indices rendered by DrawMeshlets
+    GLuint64 CullMeshlets(const Frustum& frustum, const glm::vec3& camera, ThreadPool* pool = nullptr)
+    {
+        if (this->meshlets.empty() || this->lod != 0)
+            return (GLuint64)this->DrawnIndices();
+
+        MeshletDrawList& draws = this->meshletDraws;
+        auto test = [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                draws.visible[i] = IsMeshletVisible(this->meshlets[i], frustum, camera) ? 1 : 0;
+        };
+        if (pool)
+            pool->ParallelFor(this->meshlets.size(), test, MESHLET_CULL_CHUNK_SIZE);
+        else
+            test(0, this->meshlets.size(), 0);
+
+        // compaction of the visible meshlets in the draw list: consecutive ranges with the same base vertex are merged
+        GLsizeiptr indexSize = this->meshletEBO ? sizeof(GLushort) : sizeof(GLuint);
+        draws.counts.clear();
+        draws.offsets.clear();
+        draws.baseVertices.clear();
+        draws.numVisible = 0;
+        draws.numIndices = 0;
+        GLuint rangeEnd = 0;
+        for (size_t i = 0; i < this->meshlets.size(); i++)
+        {
+            if (!draws.visible[i])
+                continue;
+            const Meshlet& meshlet = this->meshlets[i];
+            GLint baseVertex = this->meshletEBO ? (GLint)meshlet.baseVertex : 0;
+            if (!draws.counts.empty() && rangeEnd == meshlet.firstIndex && draws.baseVertices.back() == baseVertex)
+                draws.counts.back() += meshlet.numIndices;
+            else
+            {
+                draws.counts.push_back(meshlet.numIndices);
+                draws.offsets.push_back((GLvoid*)(meshlet.firstIndex * indexSize));
+                draws.baseVertices.push_back(baseVertex);
+            }
+            rangeEnd = meshlet.firstIndex + meshlet.numIndices;
+            draws.numVisible++;
+            draws.numIndices += meshlet.numIndices;
+        }
+        return draws.numIndices;
+    }
+
+    // rendering of the visible meshlets (of the last call of CullMeshlets). If the mesh has no meshlets, or the current level is not 0, it calls Draw
+    void DrawMeshlets()
+    {
+        this->drawMeshlets(this->VAO);
+    }
+
+    //////////////////////////////////////////
+
+    // it uploads a copy of the positions of the vertices, tightly packed in the encoding of the format, and it creates the VAO used by DrawDepth
+    void SetPositionStream(const Vertex* vertices, size_t numVertices)
+    {
+        vector<unsigned char> data;
+        this->format.PackPositions(vertices, numVertices, data, this->decode);
+        this->setPositionData(data.data(), data.size());
+    }
+
+    // it creates the stream of the positions from the VBO, if the mesh does not have it (e.g., when the depth pre-pass is activated at runtime):
+    // the vertices are read back from the GPU, and their positions are copied tightly packed, without decoding them
+    void BuildPositionStream()
+    {
+        if (this->positionVAO)
+            return;
+        GLsizei stride = this->format.Stride();
+        GLsizei offset = this->format.AttributeOffset(0);
+        GLsizei size = this->format.AttributeSize(0);
+        vector<unsigned char> vertices((size_t)this->numVertices * stride);
+        vector<unsigned char> data((size_t)this->numVertices * size);
+        glBindBuffer(GL_COPY_READ_BUFFER, this->VBO);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, vertices.size(), vertices.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for (size_t v = 0; v < (size_t)this->numVertices; v++)
+            memcpy(data.data() + v * size, vertices.data() + v * stride + offset, size);
+        this->setPositionData(data.data(), data.size());
+    }
+
+    bool HasPositionStream() const { return this->positionVAO != 0; }
+
+    // rendering of the same triangles of DrawMeshlets (current level of detail, and visible meshlets), reading only the positions
+    // (e.g., for a depth pre-pass). The program must read only the location 0 and the decoding attributes
+    void DrawDepth()
+    {
+        this->drawMeshlets(this->positionVAO ? this->positionVAO : this->VAO);
+    }
+
+    // rendering of a level of detail (the coarsest one, if the mesh has less levels), reading only the positions (e.g., in a shadow map)
+    void DrawShadow(GLuint level = 0)
+    {
+        this->drawLevel(this->positionVAO ? this->positionVAO : this->VAO, min(level, this->NumLods() - 1));
     }
 
 private:
 
+    // MeshBatch copies the GPU buffers of the meshes in its shared buffers
+    friend class MeshBatch;
+    // ModelLoader copies the data in the buffers of the meshes incrementally
+    friend class ModelLoader;
+    // GpuNormalSmoother computes the smoothed normals in the VBO (see gpu_smoothing.h)
+    friend class GpuSmoothingTopology;
+    friend class GpuNormalSmoother;
+
     // VBO and EBO
     GLuint VBO, EBO;
+    // buffer with the parameters to decode the vertex format in the shaders (see vertex_format.h), and their values
+    GLuint decodeBuffer;
+    glm::vec4 decode[2];
+    // identifier of the InstanceBuffer whose attributes are currently set in the VAO (0 = none)
+    GLuint64 instanceBufferId;
+    // buffer with the additional streams of smoothed normals (0 = none), number of streams, and scale currently used
+    GLuint smoothingBuffer;
+    GLuint numSmoothingStreams;
+    GLuint smoothingScale;
+    // levels of detail, and level currently rendered
+    vector<MeshLod> lods;
+    GLuint lod;
+    // meshlets of the level 0, buffer of their 16 bit local indices (0 = none), and draw list of the visible ones
+    vector<Meshlet> meshlets;
+    GLuint meshletEBO;
+    MeshletDrawList meshletDraws;
+    // buffer of the curvatures of the vertices (0 = none), and number of scales of the smoothed normals with a block of curvatures
+    GLuint curvatureBuffer;
+    GLuint numCurvatureScales;
+    // buffer with the tightly packed positions, and VAO which reads only them (0 = none)
+    GLuint positionBuffer;
+    GLuint positionVAO;
 
     //////////////////////////////////////////
     // buffer objects\arrays are initialized
@@ -150,46 +548,158 @@ private:
     // https://learnopengl.com/#!Getting-started/Hello-Triangle
     // (in different parts of the page), or here:
     // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
-    void setupMesh()
+    void setupMesh(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices)
+    {
+        // parameters to decode the vertex format in the shaders: scale and offset of the positions, and flag for octahedral normals
+        this->decode[0] = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+        this->decode[1] = glm::vec4(0.0f);
+
+        this->bounds = Bounds::FromVertices(vertices, numVertices);
+
+        if (this->format.IsFullLayout())
+            this->createBuffers(vertices, numVertices * sizeof(Vertex), numVertices, indices, numIndices);
+        else
+        {
+            // the vertices are converted to the requested format before the upload
+            vector<unsigned char> packed;
+            this->format.Pack(vertices, numVertices, packed, this->decode);
+            this->createBuffers(packed.data(), packed.size(), numVertices, indices, numIndices);
+        }
+    }
+
+    //////////////////////////////////////////
+    // it creates the buffers and the VAO. The vertex data must be already in the format of the mesh.
+    // If the pointers are null, the buffers are only allocated
+    void createBuffers(const void* vertexData, size_t vertexBytes, size_t numVertices, const GLuint* indices, size_t numIndices)
     {
+        this->numVertices = (GLsizei)numVertices;
+        this->numIndices = (GLsizei)numIndices;
+        this->instanceBufferId = 0;
+        this->smoothingBuffer = 0;
+        this->numSmoothingStreams = 0;
+        this->smoothingScale = 0;
+        this->SetLods(vector<MeshLod>());
+        this->meshletEBO = 0;
+        this->curvatureBuffer = 0;
+        this->numCurvatureScales = 0;
+        this->positionBuffer = 0;
+        this->positionVAO = 0;
+
         // we create the buffers
         glGenVertexArrays(1, &this->VAO);
         glGenBuffers(1, &this->VBO);
         glGenBuffers(1, &this->EBO);
+        glGenBuffers(1, &this->decodeBuffer);
 
         // VAO is made "active"
         glBindVertexArray(this->VAO);
         // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
         glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
         // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(GLuint), indices, GL_STATIC_DRAW);
 
         // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
-        // vertex positions
         // these will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)"")
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-        // Normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Sm_Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-        // Tangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
-        // Bitangent
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
+        // 0 = positions, 1 = normals, 2 = smoothed normals, 3 = texture coordinates, 4 = tangents, 5 = bitangents
+        this->format.SetupAttributes();
+
+        // the decoding parameters are "constant" attributes of the VAO
+        VertexFormat::SetupDecodeAttributes(this->decodeBuffer, this->decode);
 
         glBindVertexArray(0);
     }
 
+    //////////////////////////////////////////
+    // it creates the buffer of the additional streams of smoothed normals (already converted in the format). If data is null, the buffer is only allocated
+    void setSmoothingData(const unsigned char* data, size_t bytes, GLuint numStreams)
+    {
+        if (!this->smoothingBuffer)
+            glGenBuffers(1, &this->smoothingBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, this->smoothingBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->numSmoothingStreams = numStreams;
+        this->SetSmoothingScale(0);
+    }
+
+    //////////////////////////////////////////
+    // it points the curvature attribute of the bound VAO to the block of the current scale of the smoothed normals
+    // (the block 0, if the curvatures have not been estimated at that scale)
+    void setupCurvatureAttribute()
+    {
+        GLuint block = this->smoothingScale < this->numCurvatureScales ? this->smoothingScale : 0;
+        glBindBuffer(GL_ARRAY_BUFFER, this->curvatureBuffer);
+        glVertexAttribPointer(CURVATURE_LOCATION, 4, GL_HALF_FLOAT, GL_FALSE, 4 * sizeof(GLushort),
+                              (GLvoid*)((GLintptr)block * this->numVertices * 4 * sizeof(GLushort)));
+    }
+
+    //////////////////////////////////////////
+    // it creates the buffer of the positions (already converted in the format) and the VAO which reads them, with the decoding attributes
+    // and the EBO of the mesh. If data is null, the buffer is only allocated
+    void setPositionData(const unsigned char* data, size_t bytes)
+    {
+        if (!this->positionVAO)
+        {
+            glGenVertexArrays(1, &this->positionVAO);
+            glGenBuffers(1, &this->positionBuffer);
+        }
+        glBindVertexArray(this->positionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->positionBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+        this->format.SetupAttribute(0, this->format.AttributeSize(0), 0);
+        VertexFormat::SetupDecodeAttributes(this->decodeBuffer, this->decode);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    // it renders the current level of detail with a VAO (the one of the mesh, or the one of the positions)
+    void drawLod(GLuint vao)
+    {
+        this->drawLevel(vao, this->lod);
+    }
+
+    // it renders a level of detail with a VAO
+    void drawLevel(GLuint vao, GLuint level)
+    {
+        // VAO is made "active"
+        glBindVertexArray(vao);
+        // rendering of data in the VAO
+        const MeshLod& lod = this->lods[level];
+        glDrawElements(GL_TRIANGLES, lod.numIndices, GL_UNSIGNED_INT, (void*)(lod.firstIndex * sizeof(GLuint)));
+        // VAO is "detached"
+        glBindVertexArray(0);
+    }
+
+    // it renders the visible meshlets with a VAO (or the current level of detail, see DrawMeshlets)
+    void drawMeshlets(GLuint vao)
+    {
+        if (this->meshlets.empty() || this->lod != 0)
+        {
+            this->drawLod(vao);
+            return;
+        }
+        const MeshletDrawList& draws = this->meshletDraws;
+        if (draws.counts.empty())
+            return;
+        glBindVertexArray(vao);
+        // the local indices are read from their buffer, which replaces the EBO in the VAO during the draw
+        if (this->meshletEBO)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->meshletEBO);
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, draws.counts.data(), GL_UNSIGNED_SHORT, draws.offsets.data(),
+                                          (GLsizei)draws.counts.size(), const_cast<GLint*>(draws.baseVertices.data()));
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        }
+        else
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, draws.counts.data(), GL_UNSIGNED_INT, draws.offsets.data(),
+                                          (GLsizei)draws.counts.size(), const_cast<GLint*>(draws.baseVertices.data()));
+        glBindVertexArray(0);
+    }
+
     //////////////////////////////////////////
 
     void freeGPUresources()
@@ -201,6 +711,18 @@ private:
             glDeleteVertexArrays(1, &this->VAO);
             glDeleteBuffers(1, &this->VBO);
             glDeleteBuffers(1, &this->EBO);
+            glDeleteBuffers(1, &this->decodeBuffer);
+            if (this->smoothingBuffer)
+                glDeleteBuffers(1, &this->smoothingBuffer);
+            if (this->meshletEBO)
+                glDeleteBuffers(1, &this->meshletEBO);
+            if (this->curvatureBuffer)
+                glDeleteBuffers(1, &this->curvatureBuffer);
+            if (this->positionVAO)
+            {
+                glDeleteVertexArrays(1, &this->positionVAO);
+                glDeleteBuffers(1, &this->positionBuffer);
+            }
         }
     }
 };
@@ -0,0 +1,177 @@
+/*
+Meshlets - partition of a mesh in small clusters of triangles, with the bounds used to cull them on the CPU
+
+A big scan is rendered with a single glDrawElements over the whole EBO: all its triangles reach the GPU, also when most of them are
+outside the view (close-up views) or facing away from the camera. We split the triangles of the mesh in meshlets of at most
+MESHLET_MAX_TRIANGLES triangles and MESHLET_MAX_VERTICES vertices, and at each frame we test them on the CPU:
+- the bounding sphere of the meshlet against the planes of the view frustum (see frustum.h);
+- the normal cone of the meshlet (the axis and the maximum angle between the axis and the normals of its triangles) against the
+  position of the camera: if the camera is "behind" the cone, all the triangles are back-facing.
+  The test is the conservative one of meshoptimizer (A. Kapoulkine, https://github.com/zeux/meshoptimizer):
+  dot(center - camera, axis) >= cutoff * |center - camera| + radius, with cutoff = sin of the angle of the cone.
+The visible meshlets are rendered with a single glMultiDrawElementsBaseVertex call (consecutive visible meshlets are merged in a single range).
+
+The meshlets are consecutive ranges of the indices of the mesh: the triangles are already ordered for the vertex cache (see mesh_optimizer.h),
+so consecutive triangles are close on the surface, and the EBO does not need to be reordered.
+If the vertices of each meshlet are in a range of at most 65536 positions of the VBO (e.g., always on the Stanford scans after the optimization
+of the vertex fetch), the indices are also stored as 16 bit offsets from the first vertex of the meshlet ("local indices", half of the memory
+bandwidth of the indices), and the first vertex is the base vertex of the draw. Otherwise, the meshlets use the 32 bit indices of the EBO.
+N.B.) we do not close a meshlet when its range becomes too wide: after the sorting of the clusters for the overdraw, the neighbours of a
+triangle can be far in the VBO, and the meshlets would become very small.
+
+N.B.) the bounds are in the object space of the mesh: the frustum and the camera are transformed in object space (the cone test assumes
+uniform scale factors in the model matrix).
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include <utils/frustum.h>
+
+// maximum number of vertices and triangles of a meshlet
+const GLuint MESHLET_MAX_VERTICES = 64;
+const GLuint MESHLET_MAX_TRIANGLES = 124;
+// if the normals of a meshlet are not inside a cone with cos(angle) >= this value, the cone test is disabled for it
+const GLfloat MESHLET_MIN_CONE_COS = 0.1f;
+
+// a meshlet: range of the indices, first vertex (base vertex of the local indices), bounding sphere and normal cone
+struct Meshlet
+{
+    GLuint firstIndex;
+    GLuint numIndices;
+    GLuint baseVertex;
+    GLuint numVertices;
+    glm::vec3 center;
+    GLfloat radius;
+    glm::vec3 coneAxis;
+    GLfloat coneCutoff;
+};
+
+//////////////////////////////////////////
+// it splits the triangles in [firstIndex, firstIndex + numIndices) in meshlets. If all the meshlets allow it, localIndices
+// receives the indices as 16 bit offsets from the base vertex of their meshlet, otherwise it is empty (the meshlets use the 32 bit indices)
+inline void BuildMeshlets(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t firstIndex, size_t numIndices,
+                          vector<Meshlet>& meshlets, vector<GLushort>& localIndices)
+{
+    meshlets.clear();
+    localIndices.clear();
+    // marker[v] = number of the meshlet + 1 that last used the vertex v
+    vector<GLuint> marker(numVertices, 0);
+    vector<GLuint> meshletVertices;
+    meshletVertices.reserve(MESHLET_MAX_VERTICES);
+    vector<glm::vec3> normals;
+    normals.reserve(MESHLET_MAX_TRIANGLES);
+
+    size_t end = firstIndex + numIndices;
+    size_t t = firstIndex;
+    bool local = true;
+    while (t < end)
+    {
+        Meshlet meshlet;
+        meshlet.firstIndex = (GLuint)t;
+        GLuint stamp = (GLuint)meshlets.size() + 1;
+        meshletVertices.clear();
+        // we add triangles until one of the limits is reached
+        for (; t < end && (t - meshlet.firstIndex) / 3 < MESHLET_MAX_TRIANGLES; t += 3)
+        {
+            GLuint added = 0;
+            for (int j = 0; j < 3; j++)
+                if (marker[indices[t + j]] != stamp)
+                    added++;
+            if (meshletVertices.size() + added > MESHLET_MAX_VERTICES)
+                break;
+            for (int j = 0; j < 3; j++)
+                if (marker[indices[t + j]] != stamp)
+                {
+                    marker[indices[t + j]] = stamp;
+                    meshletVertices.push_back(indices[t + j]);
+                }
+        }
+        meshlet.numIndices = (GLuint)(t - meshlet.firstIndex);
+        meshlet.numVertices = (GLuint)meshletVertices.size();
+
+        // bounding sphere: center of the bounding box, and maximum distance of the vertices from it
+        glm::vec3 minimum = vertices[meshletVertices[0]].Position, maximum = minimum;
+        GLuint firstVertex = meshletVertices[0], lastVertex = meshletVertices[0];
+        for (GLuint v : meshletVertices)
+        {
+            minimum = glm::min(minimum, vertices[v].Position);
+            maximum = glm::max(maximum, vertices[v].Position);
+            firstVertex = min(firstVertex, v);
+            lastVertex = max(lastVertex, v);
+        }
+        meshlet.center = 0.5f * (minimum + maximum);
+        meshlet.radius = 0.0f;
+        for (GLuint v : meshletVertices)
+            meshlet.radius = max(meshlet.radius, glm::length(vertices[v].Position - meshlet.center));
+        meshlet.baseVertex = firstVertex;
+        if (lastVertex - firstVertex > 0xFFFF)
+            local = false;
+
+        // normal cone: the axis is the mean of the normals of the triangles, and the cutoff depends on the normal farthest from it
+        normals.clear();
+        glm::vec3 axis(0.0f);
+        for (size_t i = meshlet.firstIndex; i < t; i += 3)
+        {
+            const glm::vec3& p0 = vertices[indices[i]].Position;
+            glm::vec3 cross = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+            GLfloat length = glm::length(cross);
+            if (length <= 0.0f)
+                continue;
+            normals.push_back(cross / length);
+            axis += normals.back();
+        }
+        GLfloat axisLength = glm::length(axis);
+        meshlet.coneAxis = (axisLength > 0.0f) ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        GLfloat minCos = (axisLength > 0.0f) ? 1.0f : -1.0f;
+        for (const glm::vec3& n : normals)
+            minCos = min(minCos, glm::dot(n, meshlet.coneAxis));
+        // a cutoff of 1 never satisfies the test (radius > 0), so the meshlet is never culled as back-facing
+        meshlet.coneCutoff = (minCos < MESHLET_MIN_CONE_COS) ? 1.0f : sqrt(1.0f - minCos * minCos);
+        meshlets.push_back(meshlet);
+    }
+
+    if (!local)
+        return;
+    localIndices.resize(numIndices);
+    for (const Meshlet& meshlet : meshlets)
+        for (GLuint i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.numIndices; i++)
+            localIndices[i - firstIndex] = (GLushort)(indices[i] - meshlet.baseVertex);
+}
+
+//////////////////////////////////////////
+// visibility of a meshlet, with the frustum and the position of the camera in the object space of the mesh
+inline bool IsMeshletVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& camera)
+{
+    if (!frustum.IntersectsSphere(meshlet.center, meshlet.radius))
+        return false;
+    glm::vec3 direction = meshlet.center - camera;
+    return glm::dot(direction, meshlet.coneAxis) < meshlet.coneCutoff * glm::length(direction) + meshlet.radius;
+}
+
+// draw list of the visible meshlets of a mesh, rebuilt at each culling (the vectors are reused among the frames)
+struct MeshletDrawList
+{
+    vector<unsigned char> visible;
+    vector<GLsizei> counts;
+    vector<GLvoid*> offsets;
+    vector<GLint> baseVertices;
+    // number of visible meshlets, and number of indices in the draw list
+    GLuint numVisible;
+    GLuint64 numIndices;
+
+    MeshletDrawList() : numVisible(0), numIndices(0) {}
+};
@@ -0,0 +1,302 @@
+/*
+ModelLoader class
+- asynchronous loading of the models: import, smoothed normals and vertex conversion run on worker threads,
+  and the GPU buffers are filled incrementally by the render thread, with a budget of bytes for each frame
+
+The loading of a model has two phases:
+1) on a worker thread, Model::LoadMeshData reads the model (from the mesh cache, or with Assimp), computes the smoothed normals
+   and converts the vertices in the vertex format. No OpenGL call is made, so the workers do not need a context.
+2) on the render thread, Update creates the buffers of each mesh (allocation only, glBufferData with a null pointer),
+   and copies the data in chunks: each frame copies at most budgetBytes, so a big model does not stall the rendering.
+   A mesh is added to its Model only when all its buffers are complete, so the meshes appear one by one as they become ready.
+
+The chunks are written with glMapBufferRange(GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT): the buffers of a mesh
+are not used by the GPU until the mesh is complete, so the driver does not need to synchronize, and the copy goes directly in
+the driver memory without the intermediate copy of glBufferSubData.
+N.B.) persistent mapping (GL_MAP_PERSISTENT_BIT) would avoid the map/unmap at each chunk, but it needs OpenGL 4.4
+(ARB_buffer_storage), while the application uses an OpenGL 4.1 context.
+
+The buffers are bound to GL_COPY_WRITE_BUFFER, so the bindings of the VAOs and of GL_ARRAY_BUFFER are not changed.
+
+N.B.) the target Model must not be moved or destroyed while its loading is pending (e.g., use a vector with reserved memory)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+
+#include <utils/model_modified.h>
+
+// default number of bytes copied in the GPU buffers at each call of Update
+const size_t MODEL_LOADER_DEFAULT_BUDGET = 8 << 20;
+
+/////////////////// MODELLOADER class ///////////////////////
+class ModelLoader
+{
+public:
+    // it starts the worker threads (if numWorkers = 0, we use 2 workers: the processing of a model is already parallel, see parallel.h)
+    ModelLoader(unsigned int numWorkers = 0)
+        : stop(false), busy(0)
+    {
+        if (numWorkers == 0)
+            numWorkers = 2;
+        for (unsigned int i = 0; i < numWorkers; i++)
+            this->workers.emplace_back(&ModelLoader::work, this);
+    }
+
+    // the loader owns threads and GPU resources under construction, so it is not copyable or movable
+    ModelLoader(const ModelLoader& copy) = delete;
+    ModelLoader& operator=(const ModelLoader& copy) = delete;
+
+    ~ModelLoader()
+    {
+        this->Stop();
+    }
+
+    //////////////////////////////////////////
+    // the workers are stopped: the models still in the queue are not loaded, and the meshes not yet complete are discarded
+    // (it must be called while the OpenGL context exists, if some meshes are still being uploaded)
+    void Stop()
+    {
+        {
+            lock_guard<mutex> lock(this->queueMutex);
+            this->stop = true;
+        }
+        this->wakeup.notify_all();
+        for (thread& worker : this->workers)
+            if (worker.joinable())
+                worker.join();
+        this->jobs.clear();
+        this->results.clear();
+        this->uploads.clear();
+    }
+
+    //////////////////////////////////////////
+    // it adds a model to the loading queue. The meshes will be added to target->meshes by Update
+    void Load(const string& path, const ModelOptions& options, Model* target)
+    {
+        {
+            lock_guard<mutex> lock(this->queueMutex);
+            this->jobs.push_back(Job{path, options, target});
+        }
+        this->wakeup.notify_one();
+    }
+
+    //////////////////////////////////////////
+    // it must be called by the render thread (e.g., once for each frame): it copies at most budgetBytes of mesh data
+    // in the GPU buffers (0 = no limit), and it returns the number of meshes completed and added to their models
+    GLuint Update(size_t budgetBytes = MODEL_LOADER_DEFAULT_BUDGET)
+    {
+        // we take the meshes prepared by the workers
+        {
+            lock_guard<mutex> lock(this->queueMutex);
+            while (!this->results.empty())
+            {
+                this->uploads.push_back(std::move(this->results.front()));
+                this->results.pop_front();
+            }
+        }
+
+        GLuint completed = 0;
+        size_t budget = budgetBytes > 0 ? budgetBytes : SIZE_MAX;
+        while (!this->uploads.empty() && budget > 0)
+        {
+            PendingMesh& pending = this->uploads.front();
+            const MeshData& data = pending.data;
+            // the buffers are allocated when the upload of the mesh starts
+            if (!pending.mesh)
+                pending.mesh.reset(new Mesh(data, false));
+
+            // the data of the mesh are copied as a single sequence: vertices, indices, additional smoothed normals, local indices of the meshlets,
+            // curvatures, and stream of the positions
+            size_t vertexBytes = data.vertexData.size();
+            size_t indexBytes = data.indices.size() * sizeof(GLuint);
+            size_t smoothingBytes = data.smoothingData.size();
+            size_t meshletBytes = data.meshletIndices.size() * sizeof(GLushort);
+            size_t curvatureBytes = data.curvatureData.size() * sizeof(GLushort);
+            size_t total = vertexBytes + indexBytes + smoothingBytes + meshletBytes + curvatureBytes + data.positionData.size();
+            while (pending.uploaded < total && budget > 0)
+            {
+                GLuint buffer;
+                const unsigned char* source;
+                size_t offset, size;
+                if (pending.uploaded < vertexBytes)
+                {
+                    buffer = pending.mesh->VBO;
+                    source = data.vertexData.data();
+                    offset = pending.uploaded;
+                    size = vertexBytes;
+                }
+                else if (pending.uploaded < vertexBytes + indexBytes)
+                {
+                    buffer = pending.mesh->EBO;
+                    source = reinterpret_cast<const unsigned char*>(data.indices.data());
+                    offset = pending.uploaded - vertexBytes;
+                    size = indexBytes;
+                }
+                else if (pending.uploaded < vertexBytes + indexBytes + smoothingBytes)
+                {
+                    buffer = pending.mesh->smoothingBuffer;
+                    source = data.smoothingData.data();
+                    offset = pending.uploaded - vertexBytes - indexBytes;
+                    size = smoothingBytes;
+                }
+                else if (pending.uploaded < vertexBytes + indexBytes + smoothingBytes + meshletBytes)
+                {
+                    buffer = pending.mesh->meshletEBO;
+                    source = reinterpret_cast<const unsigned char*>(data.meshletIndices.data());
+                    offset = pending.uploaded - vertexBytes - indexBytes - smoothingBytes;
+                    size = meshletBytes;
+                }
+                else if (pending.uploaded < vertexBytes + indexBytes + smoothingBytes + meshletBytes + curvatureBytes)
+                {
+                    buffer = pending.mesh->curvatureBuffer;
+                    source = reinterpret_cast<const unsigned char*>(data.curvatureData.data());
+                    offset = pending.uploaded - vertexBytes - indexBytes - smoothingBytes - meshletBytes;
+                    size = curvatureBytes;
+                }
+                else
+                {
+                    buffer = pending.mesh->positionBuffer;
+                    source = data.positionData.data();
+                    offset = pending.uploaded - vertexBytes - indexBytes - smoothingBytes - meshletBytes - curvatureBytes;
+                    size = data.positionData.size();
+                }
+                size_t chunk = min(size - offset, budget);
+                copyToBuffer(buffer, offset, source + offset, chunk);
+                pending.uploaded += chunk;
+                budget -= chunk;
+            }
+
+            if (pending.uploaded < total)
+                break;
+            // the mesh is complete, and it can be rendered
+            pending.target->AddMesh(std::move(*pending.mesh));
+            this->uploads.pop_front();
+            completed++;
+        }
+        return completed;
+    }
+
+    //////////////////////////////////////////
+    // it waits for the loading of all the models in the queue, and it completes their upload (e.g., for the headless rendering)
+    void Finish()
+    {
+        {
+            unique_lock<mutex> lock(this->queueMutex);
+            this->done.wait(lock, [this] { return this->jobs.empty() && this->busy == 0; });
+        }
+        this->Update(0);
+    }
+
+    // true if there are no models to load, and no meshes to upload
+    bool Idle()
+    {
+        lock_guard<mutex> lock(this->queueMutex);
+        return this->jobs.empty() && this->busy == 0 && this->results.empty() && this->uploads.empty();
+    }
+
+private:
+
+    // a model to load
+    struct Job
+    {
+        string path;
+        ModelOptions options;
+        Model* target;
+    };
+
+    // a mesh prepared by a worker, with the state of its upload
+    struct PendingMesh
+    {
+        Model* target;
+        MeshData data;
+        unique_ptr<Mesh> mesh;
+        size_t uploaded;
+    };
+
+    vector<thread> workers;
+    // the queues shared with the workers, protected by queueMutex
+    mutex queueMutex;
+    condition_variable wakeup;
+    condition_variable done;
+    bool stop;
+    deque<Job> jobs;
+    GLuint busy;
+    deque<PendingMesh> results;
+    // the meshes being uploaded (used only by the render thread)
+    deque<PendingMesh> uploads;
+
+    //////////////////////////////////////////
+    // loop of the worker threads
+    void work()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(this->queueMutex);
+                this->wakeup.wait(lock, [this] { return this->stop || !this->jobs.empty(); });
+                if (this->stop)
+                    return;
+                job = this->jobs.front();
+                this->jobs.pop_front();
+                this->busy++;
+            }
+
+            vector<MeshData> data;
+            if (!Model::LoadMeshData(job.path, job.options, data))
+                cout << "ERROR::MODEL_LOADER:: unable to load " << job.path << endl;
+
+            {
+                lock_guard<mutex> lock(this->queueMutex);
+                for (MeshData& mesh : data)
+                {
+                    PendingMesh pending;
+                    pending.target = job.target;
+                    pending.data = std::move(mesh);
+                    pending.uploaded = 0;
+                    this->results.push_back(std::move(pending));
+                }
+                this->busy--;
+            }
+            this->done.notify_all();
+        }
+    }
+
+    //////////////////////////////////////////
+    // it copies size bytes in the buffer, at the given offset
+    static void copyToBuffer(GLuint buffer, size_t offset, const void* source, size_t size)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* destination = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        bool copied = false;
+        if (destination)
+        {
+            memcpy(destination, source, size);
+            // if the content of the mapped memory has been lost (e.g., after a mode change), glUnmapBuffer returns false
+            copied = (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE);
+        }
+        if (!copied)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+};
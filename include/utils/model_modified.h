@@ -3,6 +3,17 @@ Model class - Modified
 - OBJ models loading using Assimp library
 - the class converts data from Assimp data structure to a OpenGL-compatible data structure (Mesh class in mesh_v1.h)
 - It is a modification of the model_v1.h, that computes also the smoothed surface normal used in fragment shader.
+- the simple OBJ files (a single triangulated object, like the Stanford scans) are read by a native parser (obj_loader.h),
+  which is much faster than Assimp on big files, and the binary PLY files (like the original Stanford repository) are read
+  directly from the memory-mapped file (ply_loader.h); Assimp is used for all the other files.
+- the triangles and the vertices of the meshes are reordered for the vertex cache and the overdraw (mesh_optimizer.h)
+- a chain of levels of detail is built for each mesh (mesh_simplifier.h), and SelectLod chooses the level of each mesh
+  from the projection of its geometric error on the screen
+- optionally, the level 0 of the meshes is split in meshlets (meshlets.h), culled on the CPU at each frame by CullMeshlets
+- optionally, the principal curvatures of the vertices are estimated (curvature.h), and uploaded as a vertex attribute
+- the coarsest level of detail of each mesh is kept as occluder for the software occlusion culling (occlusion.h, see AddOccluders)
+- optionally, the positions are uploaded also in a separate stream, read by DrawDepth in a depth pre-pass and by DrawShadow in a shadow map
+  (see N.B. 10 in mesh_v1.h)
 
 N.B. 1)  
 Model and Mesh classes follow RAII principles (https://en.cppreference.com/w/cpp/language/raii).
@@ -10,7 +21,10 @@ Model is a "move-only" class. A move-only class ensures that you always have a 1
 
 N.B. 2) no texturing in this version of the class
 
-N.B. 3) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
+N.B. 3) the loading can be split in two phases: LoadMeshData performs the import and the processing of the meshes without OpenGL calls
+(so it can run on a worker thread), and the GPU buffers are then created from the MeshData (see model_loader.h)
+
+N.B. 4) based on https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
 
 authors: Davide Gadia, Michael Marchesan
 refined by: Francesco Brischetto  mat. 958022
@@ -36,6 +50,69 @@ using namespace std;
 
 // we include the Mesh class, which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
 #include <utils/mesh_v1.h>
+// multi-threaded computation of the smoothed surface normals
+#include <utils/smoothed_normals.h>
+// binary cache of the processed meshes
+#include <utils/mesh_cache.h>
+// smoothed normals at several scales
+#include <utils/multiscale_normals.h>
+// native parsers of the OBJ and binary PLY files
+#include <utils/obj_loader.h>
+#include <utils/ply_loader.h>
+// optimization of the meshes for the vertex cache and the overdraw
+#include <utils/mesh_optimizer.h>
+// levels of detail of the meshes
+#include <utils/mesh_simplifier.h>
+// per-vertex curvatures
+#include <utils/curvature.h>
+
+#include <algorithm>
+#include <cctype>
+
+// post-processing operations performed by Assimp after the loading.
+// Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
+const unsigned int MODEL_POSTPROCESS_FLAGS = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
+
+// options for the loading of a model
+struct ModelOptions
+{
+    // strategy used to compute the smoothed surface normals (see smoothed_normals.h)
+    SmoothingMode smoothingMode;
+    // number of threads used in the processing of the meshes (0 = all the hardware threads)
+    unsigned int numThreads;
+    // if true, the processed meshes are read from (and saved to) a binary cache next to the model file (see mesh_cache.h)
+    bool useCache;
+    // if true, the key of the cache includes the hash of the content of the model file, and not only its size and time of modification
+    bool cacheHashContent;
+    // layout of the vertex data uploaded in the VBOs (see vertex_format.h)
+    VertexFormat vertexFormat;
+    // scales (sigma, in mean edge lengths) of the additional streams of smoothed normals (see multiscale_normals.h). If empty, only the one-ring smoothed normals are computed
+    vector<GLfloat> smoothingScales;
+    // if true, the simple OBJ files and the binary PLY files are read by the native parsers (see obj_loader.h and ply_loader.h),
+    // and Assimp is used only for the other files
+    bool nativeImport;
+    // reordering of the triangles and of the vertices of the meshes (see mesh_optimizer.h)
+    MeshOptimization optimization;
+    // number of levels of detail built in addition to the original mesh (0 = none), and ratio between the triangles of consecutive levels (see mesh_simplifier.h)
+    GLuint lodLevels;
+    GLfloat lodRatio;
+    // if true, the level 0 of the meshes is split in meshlets (see meshlets.h). The meshlets are not stored in the cache: they are built at each loading
+    bool meshlets;
+    // if true, the curvatures of the vertices are estimated and uploaded in the meshes (see curvature.h). They are not stored in the cache
+    bool curvatures;
+    // if true, the positions are uploaded also in a separate, tightly packed stream, read by the depth pre-pass (see Model::DrawDepth)
+    bool positionStream;
+
+    ModelOptions() : smoothingMode(SMOOTHING_DETERMINISTIC), numThreads(0), useCache(true), cacheHashContent(false), nativeImport(true), optimization(MESH_OPTIMIZATION_OVERDRAW),
+                     lodLevels(3), lodRatio(0.25f), meshlets(false), curvatures(false), positionStream(false) {}
+
+    // the options which change the content of the mesh cache
+    uint64_t ProcessingKey() const
+    {
+        return (uint64_t)this->optimization | ((uint64_t)min(this->lodLevels, 255u) << 8) |
+               ((uint64_t)(glm::clamp(this->lodRatio, 0.0f, 1.0f) * 65535.0f) << 16) | ((uint64_t)this->smoothingMode << 32);
+    }
+};
 
 /////////////////// MODEL class ///////////////////////
 class Model
@@ -71,13 +148,85 @@ public:
     // to notice that Model class is not strictly following the Rules of 5 
     // https://en.cppreference.com/w/cpp/language/rule_of_three
     // because we are not writing a user-defined destructor.
-    Model(const string& path)
+    Model(const string& path, const ModelOptions& options = ModelOptions())
+        : options(options)
     {
         this->loadModel(path);
+        for (const Mesh& mesh : this->meshes)
+            this->bounds.Merge(mesh.bounds);
+    }
+
+    // empty model: the meshes are added later (e.g., by ModelLoader, when they are ready)
+    Model(const ModelOptions& options = ModelOptions())
+        : options(options)
+    {
+    }
+
+    //////////////////////////////////////////
+    // CPU side of the loading: import (or cache reading), smoothed normals and conversion in the vertex format.
+    // It does not use OpenGL, so it can be called on a worker thread. It returns false if the model cannot be loaded
+    static bool LoadMeshData(const string& path, const ModelOptions& options, vector<MeshData>& data)
+    {
+        data.clear();
+        uint64_t cacheKey = 0;
+        bool cacheable = options.useCache && ComputeMeshCacheKey(path, MODEL_POSTPROCESS_FLAGS, options.ProcessingKey(), options.cacheHashContent, cacheKey);
+        string cachePath = path + MESH_CACHE_EXTENSION;
+        if (cacheable)
+        {
+            MeshCache cache(cachePath, cacheKey, MODEL_POSTPROCESS_FLAGS);
+            if (cache.IsValid())
+            {
+                data.resize(cache.NumMeshes());
+                for (GLuint i = 0; i < cache.NumMeshes(); i++)
+                    prepareMeshData(cache.Vertices(i), cache.NumVertices(i), cache.Indices(i), cache.NumIndices(i),
+                                    vector<MeshLod>(cache.Lods(i), cache.Lods(i) + cache.NumLods(i)), options, data[i]);
+                return true;
+            }
+        }
+
+        vector<vector<Vertex>> vertices(1);
+        vector<vector<GLuint>> indices(1);
+        vector<vector<MeshLod>> lods(1);
+        if (!importNative(path, options, vertices[0], indices[0], lods[0]))
+        {
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, MODEL_POSTPROCESS_FLAGS);
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return false;
+            }
+            vector<const aiMesh*> sceneMeshes;
+            collectMeshes(scene->mRootNode, scene, sceneMeshes);
+            vertices.assign(sceneMeshes.size(), vector<Vertex>());
+            indices.assign(sceneMeshes.size(), vector<GLuint>());
+            lods.assign(sceneMeshes.size(), vector<MeshLod>());
+            for (size_t i = 0; i < sceneMeshes.size(); i++)
+                convertMesh(sceneMeshes[i], options, vertices[i], indices[i], lods[i]);
+        }
+
+        data.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            prepareMeshData(vertices[i].data(), vertices[i].size(), indices[i].data(), indices[i].size(), lods[i], options, data[i]);
+        if (cacheable)
+            saveToCache(cachePath, cacheKey, vertices, indices, lods);
+        return true;
     }
 
     //////////////////////////////////////////
 
+    // it adds a mesh to the model (e.g., when ModelLoader completes its upload), and it updates the bounds of the model
+    void AddMesh(Mesh&& mesh)
+    {
+        this->bounds.Merge(mesh.bounds);
+        this->meshes.push_back(std::move(mesh));
+    }
+
+    // bounds of the model in object space (union of the bounds of the meshes, empty if the model has no meshes)
+    const Bounds& GetBounds() const { return this->bounds; }
+
+    //////////////////////////////////////////
+
     // model rendering: calls rendering methods of each instance of Mesh class in the vector
     void Draw()
     {
@@ -85,38 +234,291 @@ public:
             this->meshes[i].Draw();
     }
 
+    // instanced rendering: a copy of the model is rendered for each instance in the buffer (see instance_buffer.h)
+    void DrawInstanced(const InstanceBuffer& instances)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawInstanced(instances);
+    }
+
+    // rendering of the same triangles of DrawMeshlets, reading only the positions of the vertices (e.g., in a depth pre-pass)
+    void DrawDepth()
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawDepth();
+    }
+
+    // it creates the stream of the positions of the meshes which do not have it (see Mesh::BuildPositionStream)
+    void BuildPositionStreams()
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].BuildPositionStream();
+    }
+
+    // rendering of a level of detail of all the meshes, reading only the positions of the vertices, independently of the view (e.g., in a shadow map)
+    void DrawShadow(GLuint level = 0)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawShadow(level);
+    }
+
+    //////////////////////////////////////////
+
+    // selection of the level of detail of each mesh: we use the coarsest level whose geometric error, projected on the screen, is at most
+    // maxPixelError pixels. modelView transforms the model in view space, and pixelsPerUnit is the size in pixels of a unit of length at
+    // distance 1 from the camera (= viewport height / (2 tan(fov / 2)) for a perspective projection)
+    void SelectLod(const glm::mat4& modelView, GLfloat pixelsPerUnit, GLfloat maxPixelError = 1.0f)
+    {
+        // the errors are scaled by the maximum scale factor of the transformation
+        GLfloat scale = glm::max(glm::length(glm::vec3(modelView[0])), glm::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+        for (Mesh& mesh : this->meshes)
+        {
+            // we use the nearest point of the bounding sphere of the mesh (if the camera is inside the sphere, we use the level 0)
+            glm::vec3 center = glm::vec3(modelView * glm::vec4(mesh.bounds.center, 1.0f));
+            GLfloat radius = mesh.bounds.radius * scale;
+            GLfloat distance = glm::length(center) - radius;
+            GLuint lod = 0;
+            if (distance > 0.0f)
+                for (GLuint l = 1; l < mesh.NumLods(); l++)
+                    if (mesh.LodError(l) * scale * pixelsPerUnit / distance <= maxPixelError)
+                        lod = l;
+            mesh.SetLod(lod);
+        }
+    }
+
+    // number of triangles rendered with the current levels of detail
+    size_t DrawnTriangles() const
+    {
+        size_t triangles = 0;
+        for (const Mesh& mesh : this->meshes)
+            triangles += mesh.DrawnIndices() / 3;
+        return triangles;
+    }
+
+    //////////////////////////////////////////
+
+    // culling of the meshlets of the meshes (see meshlets.h), with the model-view and projection matrices of the object.
+    // It returns the number of triangles which will be rendered by DrawMeshlets
+    GLuint64 CullMeshlets(const glm::mat4& modelView, const glm::mat4& projection, ThreadPool* pool = nullptr)
+    {
+        // frustum and camera in the object space of the model
+        Frustum frustum(projection * modelView);
+        glm::vec3 camera = glm::vec3(glm::inverse(modelView)[3]);
+        GLuint64 indices = 0;
+        for (Mesh& mesh : this->meshes)
+            indices += mesh.CullMeshlets(frustum, camera, pool);
+        return indices / 3;
+    }
+
+    // rendering of the visible meshlets (the meshes without meshlets, or with a level of detail different from 0, are rendered entirely)
+    void DrawMeshlets()
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawMeshlets();
+    }
+
     //////////////////////////////////////////
 
+    // it adds the occluders of the meshes to the occlusion culling of the current frame (see occlusion.h), with the model matrix of the object.
+    // It returns the number of occluder triangles
+    size_t AddOccluders(OcclusionCuller& culler, const glm::mat4& modelMatrix) const
+    {
+        size_t triangles = 0;
+        for (const Mesh& mesh : this->meshes)
+        {
+            culler.AddOccluder(mesh.occluder, modelMatrix);
+            triangles += mesh.occluder.indices.size() / 3;
+        }
+        return triangles;
+    }
+
+    //////////////////////////////////////////
+
+    // number of scales of the smoothed normals (1 + the number of options.smoothingScales), and selection of the scale used by all the meshes
+    GLuint NumSmoothingScales() const { return this->meshes.empty() ? 1 : this->meshes[0].NumSmoothingScales(); }
+
+    void SetSmoothingScale(GLuint scale)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].SetSmoothingScale(scale);
+    }
 
 private:
 
+    // options used for the loading of the model
+    ModelOptions options;
+    // bounds of the meshes
+    Bounds bounds;
+
     //////////////////////////////////////////
     // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
     void loadModel(string path)
     {
-        // loading using Assimp
-        // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
-        // Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
-        // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
-        // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+        // if the cache of the model is valid, we create the meshes directly from the memory-mapped cache file
+        uint64_t cacheKey = 0;
+        bool cacheable = this->options.useCache && ComputeMeshCacheKey(path, MODEL_POSTPROCESS_FLAGS, this->options.ProcessingKey(), this->options.cacheHashContent, cacheKey);
+        string cachePath = path + MESH_CACHE_EXTENSION;
+        if (cacheable && this->loadFromCache(cachePath, cacheKey))
+            return;
 
-        // check for errors (see comment above)
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+        // the simple OBJ files are read by the native parser, without Assimp
+        vector<Vertex> vertices;
+        vector<GLuint> indices;
+        vector<MeshLod> lods;
+        if (importNative(path, this->options, vertices, indices, lods))
         {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            this->meshes.emplace_back(vertices, indices, this->options.vertexFormat);
+            Mesh& mesh = this->meshes.back();
+            mesh.SetLods(lods);
+            vector<vector<glm::vec3>> streams;
+            this->addSmoothingScales(mesh, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), streams);
+            this->addCurvatures(mesh, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), streams);
+            this->addPositionStream(mesh, mesh.vertices.data(), mesh.vertices.size());
+            this->addMeshlets(mesh, mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data());
+        }
+        else
+        {
+            // loading using Assimp
+            // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading (see MODEL_POSTPROCESS_FLAGS).
+            // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
+            // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, MODEL_POSTPROCESS_FLAGS);
+
+            // check for errors (see comment above)
+            if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
+
+            // we start the recursive processing of nodes in the Assimp data structure
+            this->processNode(scene->mRootNode, scene);
         }
 
-        // we start the recursive processing of nodes in the Assimp data structure
-        this->processNode(scene->mRootNode, scene);
+        // we save the processed meshes in the cache, for the next runs
+        if (cacheable)
+        {
+            vector<const vector<Vertex>*> vertices;
+            vector<const vector<GLuint>*> indices;
+            vector<const vector<MeshLod>*> lods;
+            for (auto &mesh : this->meshes)
+            {
+                vertices.push_back(&mesh.vertices);
+                indices.push_back(&mesh.indices);
+                lods.push_back(&mesh.Lods());
+            }
+            if (!MeshCache::Write(cachePath, cacheKey, MODEL_POSTPROCESS_FLAGS, vertices, indices, lods))
+                cout << "WARNING::MODEL:: UNABLE TO WRITE THE MESH CACHE " << cachePath << endl;
+        }
+    }
+
+    //////////////////////////////////////////
+
+    // creation of the meshes from the cache file. It returns false if the cache is missing or not valid
+    bool loadFromCache(const string& cachePath, uint64_t cacheKey)
+    {
+        MeshCache cache(cachePath, cacheKey, MODEL_POSTPROCESS_FLAGS);
+        if (!cache.IsValid())
+            return false;
+        for (GLuint i = 0; i < cache.NumMeshes(); i++)
+        {
+            this->meshes.emplace_back(cache.Vertices(i), cache.NumVertices(i), cache.Indices(i), cache.NumIndices(i), this->options.vertexFormat);
+            vector<vector<glm::vec3>> streams;
+            this->addSmoothingScales(this->meshes.back(), cache.Vertices(i), cache.NumVertices(i), cache.Indices(i), cache.NumIndices(i), streams);
+            this->addCurvatures(this->meshes.back(), cache.Vertices(i), cache.NumVertices(i), cache.Indices(i), cache.NumIndices(i), streams);
+            this->addPositionStream(this->meshes.back(), cache.Vertices(i), cache.NumVertices(i));
+            this->meshes.back().SetLods(vector<MeshLod>(cache.Lods(i), cache.Lods(i) + cache.NumLods(i)));
+            this->addMeshlets(this->meshes.back(), cache.Vertices(i), cache.NumVertices(i), cache.Indices(i));
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////
+
+    // it saves the processed meshes in the cache file
+    static void saveToCache(const string& cachePath, uint64_t cacheKey, const vector<vector<Vertex>>& meshVertices, const vector<vector<GLuint>>& meshIndices,
+                            const vector<vector<MeshLod>>& meshLods)
+    {
+        vector<const vector<Vertex>*> vertices;
+        vector<const vector<GLuint>*> indices;
+        vector<const vector<MeshLod>*> lods;
+        for (size_t i = 0; i < meshVertices.size(); i++)
+        {
+            vertices.push_back(&meshVertices[i]);
+            indices.push_back(&meshIndices[i]);
+            lods.push_back(&meshLods[i]);
+        }
+        if (!MeshCache::Write(cachePath, cacheKey, MODEL_POSTPROCESS_FLAGS, vertices, indices, lods))
+            cout << "WARNING::MODEL:: UNABLE TO WRITE THE MESH CACHE " << cachePath << endl;
+    }
+
+    //////////////////////////////////////////
+
+    // loading of the model with the native parsers (see obj_loader.h and ply_loader.h), with the levels of detail and the computation of the smoothed surface normals.
+    // It returns false if the format of the file is not supported by them (the model must be loaded with Assimp)
+    static bool importNative(const string& path, const ModelOptions& options, vector<Vertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods)
+    {
+        if (!options.nativeImport)
+            return false;
+        string extension = path.substr(path.find_last_of('.') + 1);
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        bool loaded = false;
+        if (extension == "obj")
+            loaded = ObjParser::Load(path, vertices, indices, options.numThreads);
+        else if (extension == "ply")
+            loaded = PlyParser::Load(path, vertices, indices, options.numThreads);
+        if (!loaded)
+            return false;
+        optimizeMesh(path, options, vertices, indices);
+        buildLods(path, options, vertices, indices, lods);
+        ComputeSmoothedNormals(vertices, indices, options.smoothingMode, options.numThreads);
+        return true;
+    }
+
+    //////////////////////////////////////////
+
+    // reordering of triangles and vertices for the vertex cache and the overdraw (see mesh_optimizer.h), with the report of the results
+    static void optimizeMesh(const string& name, const ModelOptions& options, vector<Vertex>& vertices, vector<GLuint>& indices)
+    {
+        if (options.optimization == MESH_OPTIMIZATION_NONE)
+            return;
+        VertexCacheStatistics before, after;
+        OptimizeMesh(vertices, indices, options.optimization, before, after);
+        cout << "MESH OPTIMIZER:: " << name << " (" << indices.size() / 3 << " triangles): ACMR " << before.acmr << " -> " << after.acmr
+             << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
+    }
+
+    //////////////////////////////////////////
+
+    // construction of the levels of detail (see mesh_simplifier.h), with the report of their triangles and errors.
+    // The vertices of each level are appended to the mesh, so the smoothed normals, computed after this step, are computed on the faces of each level
+    static void buildLods(const string& name, const ModelOptions& options, vector<Vertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods)
+    {
+        BuildLodChain(vertices, indices, options.lodLevels, options.lodRatio, options.optimization, lods);
+        if (lods.size() < 2)
+            return;
+        cout << "MESH SIMPLIFIER:: " << name << ":";
+        for (size_t l = 0; l < lods.size(); l++)
+            cout << " LOD " << l << " = " << lods[l].numIndices / 3 << " triangles (error " << lods[l].error << ")" << (l + 1 < lods.size() ? "," : "");
+        cout << endl;
+    }
+
+    //////////////////////////////////////////
+
+    // it collects the meshes of the nodes, in the same order of processNode
+    static void collectMeshes(const aiNode* node, const aiScene* scene, vector<const aiMesh*>& sceneMeshes)
+    {
+        for(GLuint i = 0; i < node->mNumMeshes; i++)
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+        for(GLuint i = 0; i < node->mNumChildren; i++)
+            collectMeshes(node->mChildren[i], scene, sceneMeshes);
     }
 
     //////////////////////////////////////////
 
     // Recursive processing of nodes of Assimp data structure
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(const aiNode* node, const aiScene* scene)
     {
         // we process each mesh inside the current node
         for(GLuint i = 0; i < node->mNumMeshes; i++)
@@ -143,12 +545,34 @@ private:
 
     // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
     // = we create and allocate the buffers used to send mesh data to the GPU
-    Mesh processMesh(aiMesh* mesh)
+    Mesh processMesh(const aiMesh* mesh)
     {
         // data structures for vertices and indices of vertices (for faces)
         vector<Vertex> vertices;
-        vector<Vertex> vertices2;
         vector<GLuint> indices;
+        vector<MeshLod> lods;
+        convertMesh(mesh, this->options, vertices, indices, lods);
+
+        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
+        Mesh result(vertices, indices, this->options.vertexFormat);
+        result.SetLods(lods);
+        vector<vector<glm::vec3>> streams;
+        this->addSmoothingScales(result, result.vertices.data(), result.vertices.size(), result.indices.data(), result.indices.size(), streams);
+        this->addCurvatures(result, result.vertices.data(), result.vertices.size(), result.indices.data(), result.indices.size(), streams);
+        this->addPositionStream(result, result.vertices.data(), result.vertices.size());
+        this->addMeshlets(result, result.vertices.data(), result.vertices.size(), result.indices.data());
+        return result;
+    }
+
+    //////////////////////////////////////////
+
+    // conversion of the Assimp mesh in vertices and indices, with the levels of detail and the computation of the smoothed surface normals
+    static void convertMesh(const aiMesh* mesh, const ModelOptions& options, vector<Vertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods)
+    {
+        vertices.clear();
+        indices.clear();
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve(mesh->mNumFaces * 3);
 
         for(GLuint i = 0; i < mesh->mNumVertices; i++)
         {
@@ -209,28 +633,116 @@ private:
         // To calculate smoothed surface normal I started from here: https://www.reddit.com/r/opengl/comments/6976lc/smoothing_function_for_normals/
         // For each face, I calculate the face normal and I add to the vertices' normal used by the face
         // Finally, I normalize the normal to obtain the smoothed surface normal.
-        for ( int i = 0; i < indices.size(); i += 3 )
-        {
-            // I Compute the face normal using triangleNormal method, that computes normal starting from triangle points
-            glm::vec3 faceNormal = glm::triangleNormal(
-                                        vertices[indices[i]].Position,
-                                        vertices[indices[i+1]].Position,
-                                        vertices[indices[i+2]].Position);
-            // I add face normal to each of the 3 vertex normal of the face
-            for ( int j = 0; j < 3; j++ )
-            {
-                vertices[indices[i+j]].Sm_Normal += faceNormal;
-            }
+        // The computation is split among several threads (see smoothed_normals.h)
+        optimizeMesh(mesh->mName.C_Str(), options, vertices, indices);
+        buildLods(mesh->mName.C_Str(), options, vertices, indices, lods);
+        ComputeSmoothedNormals(vertices, indices, options.smoothingMode, options.numThreads);
+    }
+
+    //////////////////////////////////////////
+
+    // it converts the vertices in the vertex format of the options, and it computes the meshlets, the curvatures, the stream of the positions
+    // and the additional streams of smoothed normals
+    static void prepareMeshData(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, const vector<MeshLod>& lods,
+                                const ModelOptions& options, MeshData& data)
+    {
+        data.format = options.vertexFormat;
+        data.numVertices = (GLsizei)numVertices;
+        data.decode[0] = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+        data.decode[1] = glm::vec4(0.0f);
+        if (data.format.IsFullLayout())
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(vertices);
+            data.vertexData.assign(bytes, bytes + numVertices * sizeof(Vertex));
         }
-        for (auto &v : vertices)
+        else
+            data.format.Pack(vertices, numVertices, data.vertexData, data.decode);
+        data.indices.assign(indices, indices + numIndices);
+        data.lods = lods;
+        data.bounds = Bounds::FromVertices(vertices, numVertices);
+        data.meshlets.clear();
+        data.meshletIndices.clear();
+        if (options.meshlets)
+            BuildMeshlets(vertices, numVertices, indices, 0, lods.empty() ? numIndices : lods[0].numIndices, data.meshlets, data.meshletIndices);
+        if (lods.empty())
+            BuildOccluder(vertices, indices, 0, (GLsizei)numIndices, data.occluder);
+        else
+            BuildOccluder(vertices, indices, lods.back().firstIndex, lods.back().numIndices, data.occluder);
+
+        data.positionData.clear();
+        if (options.positionStream)
+            data.format.PackPositions(vertices, numVertices, data.positionData, data.decode);
+
+        data.numSmoothingStreams = 0;
+        data.smoothingData.clear();
+        vector<vector<glm::vec3>> streams;
+        if (!options.smoothingScales.empty() && data.format.Has(ATTRIB_SM_NORMAL))
         {
-            // Normalizing the vectors accumulating face normals to obtain the smoothed surface normal
-            // NOTE: Sigma parameter, found in Equation 5 of 4.2.1 chapter of the reference paper 
-            // ( to control the quantity of convolution kernel used ) is implicitely 1.
-            v.Sm_Normal = glm::normalize(v.Sm_Normal);
+            ComputeMultiScaleNormals(vertices, numVertices, indices, numIndices, options.smoothingScales, streams, options.numThreads);
+            for (const vector<glm::vec3>& stream : streams)
+                data.format.PackUnitVectors(stream.data(), numVertices, data.smoothingData);
+            data.numSmoothingStreams = (GLuint)streams.size();
         }
 
-        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices);
+        // the curvatures are estimated also at the additional scales of the smoothed normals
+        data.curvatureData.clear();
+        if (options.curvatures)
+        {
+            vector<glm::vec4> curvatures;
+            ComputeVertexCurvatures(vertices, numVertices, indices, numIndices, streams, curvatures, options.numThreads);
+            PackCurvatures(curvatures, data.curvatureData);
+        }
+    }
+
+    //////////////////////////////////////////
+
+    // it computes the smoothed normals at the scales requested in the options, and it uploads them in the mesh. The streams are returned
+    // for the estimation of the curvatures (empty, if the format of the mesh does not include the smoothed normals)
+    void addSmoothingScales(Mesh& mesh, const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices, vector<vector<glm::vec3>>& streams)
+    {
+        streams.clear();
+        if (this->options.smoothingScales.empty() || !mesh.format.Has(ATTRIB_SM_NORMAL))
+            return;
+        ComputeMultiScaleNormals(vertices, numVertices, indices, numIndices, this->options.smoothingScales, streams, this->options.numThreads);
+        mesh.SetSmoothingStreams(streams);
+    }
+
+    //////////////////////////////////////////
+
+    // it computes and uploads the curvatures of the vertices, if requested in the options, at all the scales of the smoothed normals
+    void addCurvatures(Mesh& mesh, const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices,
+                       const vector<vector<glm::vec3>>& streams)
+    {
+        if (!this->options.curvatures)
+            return;
+        vector<glm::vec4> curvatures;
+        vector<GLushort> data;
+        ComputeVertexCurvatures(vertices, numVertices, indices, numIndices, streams, curvatures, this->options.numThreads);
+        PackCurvatures(curvatures, data);
+        mesh.SetCurvatureData(data.data(), data.size());
+    }
+
+    //////////////////////////////////////////
+
+    // it uploads the separate stream of the positions, if requested in the options
+    void addPositionStream(Mesh& mesh, const Vertex* vertices, size_t numVertices)
+    {
+        if (this->options.positionStream)
+            mesh.SetPositionStream(vertices, numVertices);
+    }
+
+    //////////////////////////////////////////
+
+    // it splits the level 0 of the mesh in meshlets, if requested in the options, and it extracts the occluder from the coarsest level
+    void addMeshlets(Mesh& mesh, const Vertex* vertices, size_t numVertices, const GLuint* indices)
+    {
+        const MeshLod& coarsest = mesh.Lods().back();
+        BuildOccluder(vertices, indices, coarsest.firstIndex, coarsest.numIndices, mesh.occluder);
+        if (!this->options.meshlets)
+            return;
+        vector<Meshlet> meshlets;
+        vector<GLushort> localIndices;
+        BuildMeshlets(vertices, numVertices, indices, mesh.Lods()[0].firstIndex, mesh.Lods()[0].numIndices, meshlets, localIndices);
+        mesh.SetMeshlets(meshlets, localIndices.data(), localIndices.size());
     }
 };
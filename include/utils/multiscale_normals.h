@@ -0,0 +1,207 @@
+/*
+Multi-scale smoothed normals - smoothed surface normals (Sm_Normal) at several values of sigma (Equation 5 of the reference paper)
+
+The smoothed normal of smoothed_normals.h averages the normals of the faces of the one-ring of a vertex (sigma = 1).
+Here, the normals are convolved with a Gaussian kernel over the surface, at several scales. The convolution is computed
+as a diffusion (heat equation) of the normal field on the mesh graph: at each iteration, every vertex receives the average
+of its value and of the values of its neighbours,
+
+    n'(v) = ( n(v) + sum_{u in N(v)} n(u) ) / ( |N(v)| + 1 )
+
+Repeated averaging converges to a Gaussian convolution (central limit theorem), and, since the values move only along the
+edges, the kernel follows the geodesic distance on the surface (= separate parts of the model, like the fingers of the armadillo,
+are not smoothed together, even if they are close in space). The variance of the kernel grows linearly with the iterations:
+one iteration adds, on each direction of the tangent plane, the mean of |p(u) - p(v)|^2 / (2 (|N(v)| + 1)) over the vertices.
+
+All the scales are computed in a single pass: the diffusion starts from the one-ring smoothed normals (scale 0), and the field
+is saved when the iterations reach the variance of each requested sigma. Sigma is expressed in units of the mean edge length
+of the mesh, so the same values give a similar result on meshes with different sizes and resolutions.
+Each iteration is a parallel gather on the CSR vertex-vertex adjacency (no atomics), with a cost linear in the number of edges:
+the number of iterations grows with sigma^2, so it is limited to MULTISCALE_MAX_ITERATIONS. The iterations run on a ThreadPool
+(see parallel.h), so the threads are created once, and not at each iteration.
+
+The results are uploaded by the Mesh as additional streams of smoothed normals (Mesh::SetSmoothingStreams), and the scale
+used in the rendering can be changed at runtime (Mesh::SetSmoothingScale) without reloading the model.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include <utils/smoothed_normals.h>
+#include <utils/parallel.h>
+
+// maximum number of diffusion iterations (= maximum sigma, around 18 mean edge lengths on regular meshes)
+const GLuint MULTISCALE_MAX_ITERATIONS = 512;
+
+/////////////////// VERTEX-VERTEX ADJACENCY ///////////////////////
+// CSR adjacency: the neighbours of vertex v are neighbors[offsets[v]] ... neighbors[offsets[v+1]-1], in increasing order
+struct VertexAdjacency
+{
+    vector<GLuint> offsets;
+    vector<GLuint> neighbors;
+
+    //////////////////////////////////////////
+    // it builds the adjacency from the vertex-face adjacency: the neighbours of a vertex are the other vertices of its faces
+    void Build(size_t numVertices, const GLuint* indices, size_t numIndices, unsigned int numThreads = 0)
+    {
+        VertexFaceAdjacency faces;
+        faces.Build(numVertices, indices, numIndices, numThreads);
+        unsigned int chunks = ParallelChunks(numVertices, numThreads);
+
+        // the (sorted, unique) neighbours of a vertex are collected in a temporary list
+        auto collect = [&](size_t v, vector<GLuint>& list)
+        {
+            list.clear();
+            for (GLuint k = faces.offsets[v]; k < faces.offsets[v + 1]; k++)
+            {
+                GLuint f = faces.faces[k];
+                for (int j = 0; j < 3; j++)
+                    if (indices[3*f+j] != v)
+                        list.push_back(indices[3*f+j]);
+            }
+            sort(list.begin(), list.end());
+            list.erase(unique(list.begin(), list.end()), list.end());
+        };
+
+        // Step 1: we count the neighbours of each vertex, and the prefix sum gives the offsets of the lists
+        this->offsets.assign(numVertices + 1, 0);
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            vector<GLuint> list;
+            for (size_t v = begin; v < end; v++)
+            {
+                collect(v, list);
+                this->offsets[v + 1] = (GLuint)list.size();
+            }
+        }, chunks);
+        for (size_t v = 0; v < numVertices; v++)
+            this->offsets[v + 1] += this->offsets[v];
+
+        // Step 2: we fill the lists
+        this->neighbors.resize(this->offsets[numVertices]);
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            vector<GLuint> list;
+            for (size_t v = begin; v < end; v++)
+            {
+                collect(v, list);
+                copy(list.begin(), list.end(), this->neighbors.begin() + this->offsets[v]);
+            }
+        }, chunks);
+    }
+};
+
+//////////////////////////////////////////
+// it computes the smoothed normals at the requested scales (sigma in mean edge lengths, in any order).
+// normals[k][v] is the smoothed normal of vertex v at scale scales[k]. The initial field is the Sm_Normal of the vertices.
+inline void ComputeMultiScaleNormals(const Vertex* vertices, size_t numVertices, const GLuint* indices, size_t numIndices,
+                                     const vector<GLfloat>& scales, vector<vector<glm::vec3>>& normals, unsigned int numThreads = 0)
+{
+    normals.assign(scales.size(), vector<glm::vec3>());
+    if (numVertices == 0 || scales.empty())
+        return;
+    unsigned int chunks = ParallelChunks(numVertices, numThreads);
+
+    VertexAdjacency adjacency;
+    adjacency.Build(numVertices, indices, numIndices, numThreads);
+
+    // mean edge length (unit of sigma), and variance added by an iteration of the diffusion
+    double edgeSum = 0.0, varianceSum = 0.0;
+    size_t numEdges = 0;
+    for (size_t v = 0; v < numVertices; v++)
+    {
+        GLuint degree = adjacency.offsets[v + 1] - adjacency.offsets[v];
+        double squaredSum = 0.0;
+        for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+        {
+            double length = glm::length(vertices[adjacency.neighbors[k]].Position - vertices[v].Position);
+            edgeSum += length;
+            squaredSum += length * length;
+        }
+        numEdges += degree;
+        varianceSum += squaredSum / (2.0 * (degree + 1));
+    }
+    if (numEdges == 0)
+        return;
+    double meanEdge = edgeSum / numEdges;
+    double stepVariance = varianceSum / numVertices;
+
+    // number of iterations of each scale
+    vector<GLuint> iterations(scales.size());
+    GLuint maxIterations = 0;
+    for (size_t s = 0; s < scales.size(); s++)
+    {
+        double sigma = scales[s] * meanEdge;
+        double t = stepVariance > 0.0 ? floor(sigma * sigma / stepVariance + 0.5) : 0.0;
+        if (t > MULTISCALE_MAX_ITERATIONS)
+        {
+            cout << "WARNING::MULTISCALE:: sigma = " << scales[s] << " needs " << t << " iterations, limited to " << MULTISCALE_MAX_ITERATIONS << endl;
+            t = MULTISCALE_MAX_ITERATIONS;
+        }
+        iterations[s] = (GLuint)t;
+        maxIterations = max(maxIterations, iterations[s]);
+    }
+
+    // the threads of the diffusion (with the same split in chunks of ParallelFor)
+    ThreadPool pool(chunks);
+
+    // the diffusion starts from the one-ring smoothed normals (vertices without faces have an invalid normal, and no neighbours)
+    vector<glm::vec3> current(numVertices), next(numVertices);
+    pool.ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            glm::vec3 n = vertices[v].Sm_Normal;
+            current[v] = (std::isfinite(n.x) && std::isfinite(n.y) && std::isfinite(n.z)) ? n : glm::vec3(0.0f);
+        }
+    });
+
+    // the normalized field is saved for all the scales reached after t iterations
+    auto save = [&](GLuint t)
+    {
+        for (size_t s = 0; s < scales.size(); s++)
+        {
+            if (iterations[s] != t)
+                continue;
+            vector<glm::vec3>& out = normals[s];
+            out.resize(numVertices);
+            pool.ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t v = begin; v < end; v++)
+                    out[v] = glm::normalize(current[v]);
+            });
+        }
+    };
+
+    save(0);
+    for (GLuint t = 1; t <= maxIterations; t++)
+    {
+        pool.ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                glm::vec3 sum = current[v];
+                for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+                    sum += current[adjacency.neighbors[k]];
+                next[v] = sum / (GLfloat)(adjacency.offsets[v + 1] - adjacency.offsets[v] + 1);
+            }
+        });
+        current.swap(next);
+        save(t);
+    }
+}
@@ -0,0 +1,505 @@
+/*
+OBJ loader - memory-mapped, multi-threaded parser of Wavefront OBJ files, used instead of Assimp for the common case of big scans
+
+The Assimp OBJ importer reads the file with iostreams, builds a complete aiScene, and then Model::processMesh copies everything
+again in the Vertex array. Here, the file is mapped in memory (see mapped_file.h) and parsed in parallel directly in the final arrays:
+1) the file is split in chunks (at line boundaries), and each thread counts the positions, texture coordinates, normals and
+   triangles of its chunk;
+2) the prefix sums of the counts give the position of the data of each chunk in the arrays (and the absolute value of the
+   negative, relative, indices of the faces), so each thread parses its chunk and writes its data without synchronization;
+3) the corners of the faces (v/vt/vn triplets) are converted in vertices and indices. If each corner uses the same index
+   for position, texture coordinates and normal (like in the files exported by Blender from the Stanford scans), the vertices
+   are built in parallel, one for each position; otherwise, the identical triplets are joined in a single vertex.
+
+The result is the same mesh produced by Assimp with MODEL_POSTPROCESS_FLAGS: polygons are triangulated (as fans), texture
+coordinates are flipped (v' = 1 - v), normals are generated if the file does not contain them, and tangents and bitangents
+are computed from the texture coordinates (if present).
+
+Only the "simple" files are supported: a single object (at most one o/g statement and one material), with faces only.
+For the other files (or in case of errors), ObjParser::Load returns false, and the model is loaded with Assimp.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/mapped_file.h>
+#include <utils/parallel.h>
+#include <utils/smoothed_normals.h>
+
+// minimum size of the chunks of the file parsed by different threads
+const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+
+// a corner of a face: indices (0-based) of position, texture coordinates and normal (-1 = not present)
+struct ObjCorner
+{
+    int32_t v, vt, vn;
+};
+
+//////////////////////////////////////////
+// fast number parsing: they return the pointer after the number, or nullptr if there is no valid number
+// (the numbers are in the "C" format, independently of the locale, and without the overhead of strtod)
+inline const char* ParseObjInt(const char* p, const char* end, int64_t& value)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    if (p >= end || *p < '0' || *p > '9')
+        return nullptr;
+    int64_t result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        result = result * 10 + (*p++ - '0');
+    value = negative ? -result : result;
+    return p;
+}
+
+inline const char* ParseObjFloat(const char* p, const char* end, GLfloat& value)
+{
+    // exact powers of 10 in double precision
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    // the first 19 significant digits are accumulated in an integer, the others change only the exponent
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool valid = false;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0)
+                digits++;
+        }
+        else
+            exponent++;
+        p++;
+        valid = true;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0)
+                    digits++;
+                exponent--;
+            }
+            p++;
+            valid = true;
+        }
+    }
+    if (!valid)
+        return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int64_t e;
+        const char* q = ParseObjInt(p + 1, end, e);
+        if (q)
+        {
+            exponent += (int)max((int64_t)-1000, min(e, (int64_t)1000));
+            p = q;
+        }
+    }
+    double result = (double)mantissa;
+    if (exponent < 0)
+        result = (exponent >= -22) ? result / powers[-exponent] : result * pow(10.0, (double)exponent);
+    else if (exponent > 0)
+        result = (exponent <= 22) ? result * powers[exponent] : result * pow(10.0, (double)exponent);
+    value = (GLfloat)(negative ? -result : result);
+    return p;
+}
+
+/////////////////// OBJPARSER class ///////////////////////
+class ObjParser
+{
+public:
+
+    // it loads the OBJ file in vertices and indices (triangles). It returns false if the file cannot be read,
+    // if it is not supported by the parser, or if it is not valid
+    static bool Load(const string& path, vector<Vertex>& vertices, vector<GLuint>& indices, unsigned int numThreads = 0)
+    {
+        MappedFile file(path);
+        if (!file.IsValid())
+            return false;
+        const char* data = (const char*)file.Data();
+        size_t size = file.Size();
+
+        // Step 1: the file is split in chunks starting at the beginning of a line, and we count the elements of each chunk
+        unsigned int numChunks = ParallelChunks(size, numThreads, OBJ_MIN_CHUNK_SIZE);
+        vector<Chunk> chunks(numChunks);
+        for (unsigned int c = 0; c < numChunks; c++)
+        {
+            size_t begin = (c == 0) ? 0 : lineStart(data, size, size * c / numChunks);
+            chunks[c].begin = data + begin;
+            if (c > 0)
+                chunks[c - 1].end = chunks[c].begin;
+        }
+        chunks[numChunks - 1].end = data + size;
+
+        ParallelFor(numChunks, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t c = begin; c < end; c++)
+                countChunk(chunks[c]);
+        }, numChunks);
+
+        // the offsets of the chunks in the arrays are the prefix sums of the counts
+        Counts total;
+        for (Chunk& chunk : chunks)
+        {
+            chunk.offsets = total;
+            total.Add(chunk.counts);
+        }
+        if (total.unsupported > 0 || total.objects > 1 || total.materials > 1 || total.triangles == 0)
+            return false;
+        // the normals must be present in all the corners or in none of them
+        if (total.cornersWithNormal > 0 && total.cornersWithNormal != total.corners)
+            return false;
+
+        // Step 2: each chunk is parsed in its part of the arrays
+        vector<glm::vec3> positions(total.positions), normals(total.normals);
+        vector<glm::vec2> texCoords(total.texCoords);
+        vector<ObjCorner> corners(total.triangles * 3);
+        atomic<bool> valid(true);
+        ParallelFor(numChunks, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t c = begin; c < end; c++)
+                if (!parseChunk(chunks[c], total, positions, texCoords, normals, corners))
+                    valid = false;
+        }, numChunks);
+        if (!valid)
+        {
+            cout << "WARNING::OBJ:: invalid data in " << path << endl;
+            return false;
+        }
+
+        // Step 3: conversion of the corners in vertices
+        buildVertices(positions, texCoords, normals, corners, vertices, indices, numThreads);
+        bool hasNormals = (total.cornersWithNormal > 0);
+        bool hasTexCoords = (total.cornersWithTexCoords > 0);
+        if (!hasNormals)
+            ComputeVertexNormals(vertices, indices, numThreads);
+        if (hasTexCoords)
+            ComputeTangentSpace(vertices, indices, numThreads);
+        else
+            cout << "WARNING::OBJ:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
+        return true;
+    }
+
+private:
+
+    // number of elements of a chunk (or of the whole file)
+    struct Counts
+    {
+        size_t positions, texCoords, normals, triangles;
+        size_t corners, cornersWithNormal, cornersWithTexCoords;
+        size_t objects, materials, unsupported;
+
+        Counts() : positions(0), texCoords(0), normals(0), triangles(0), corners(0), cornersWithNormal(0), cornersWithTexCoords(0),
+                   objects(0), materials(0), unsupported(0) {}
+
+        void Add(const Counts& c)
+        {
+            positions += c.positions; texCoords += c.texCoords; normals += c.normals; triangles += c.triangles;
+            corners += c.corners; cornersWithNormal += c.cornersWithNormal; cornersWithTexCoords += c.cornersWithTexCoords;
+            objects += c.objects; materials += c.materials; unsupported += c.unsupported;
+        }
+    };
+
+    struct Chunk
+    {
+        const char* begin;
+        const char* end;
+        Counts counts;
+        Counts offsets;
+    };
+
+    //////////////////////////////////////////
+    // position of the first line starting at or after position
+    static size_t lineStart(const char* data, size_t size, size_t position)
+    {
+        while (position < size && data[position - 1] != '\n')
+            position++;
+        return position;
+    }
+
+    static const char* skipSpaces(const char* p, const char* end)
+    {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        return p;
+    }
+
+    static const char* nextLine(const char* p, const char* end)
+    {
+        while (p < end && *p != '\n')
+            p++;
+        return p < end ? p + 1 : end;
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    //////////////////////////////////////////
+    // first pass on a chunk: we count the elements, and we check that the statements are supported
+    static void countChunk(Chunk& chunk)
+    {
+        Counts& counts = chunk.counts;
+        const char* end = chunk.end;
+        for (const char* p = chunk.begin; p < end; p = nextLine(p, end))
+        {
+            p = skipSpaces(p, end);
+            if (p >= end || *p == '\n' || *p == '\r' || *p == '#')
+                continue;
+            if (p[0] == 'v' && p + 1 < end && isSpace(p[1]))
+                counts.positions++;
+            else if (p[0] == 'v' && p + 2 < end && p[1] == 't' && isSpace(p[2]))
+                counts.texCoords++;
+            else if (p[0] == 'v' && p + 2 < end && p[1] == 'n' && isSpace(p[2]))
+                counts.normals++;
+            else if (p[0] == 'f' && p + 1 < end && isSpace(p[1]))
+            {
+                // we count the corners of the face, and the corners with texture coordinates and normals (v/vt/vn)
+                size_t numCorners = 0;
+                const char* q = skipSpaces(p + 1, end);
+                while (q < end && *q != '\n' && *q != '\r' && *q != '#')
+                {
+                    int slashes = 0;
+                    bool texCoords = false;
+                    while (q < end && !isSpace(*q) && *q != '\n' && *q != '\r')
+                    {
+                        if (*q == '/')
+                            slashes++;
+                        else if (slashes == 1)
+                            texCoords = true;
+                        q++;
+                    }
+                    numCorners++;
+                    if (slashes == 2)
+                        counts.cornersWithNormal++;
+                    if (texCoords)
+                        counts.cornersWithTexCoords++;
+                    q = skipSpaces(q, end);
+                }
+                counts.corners += numCorners;
+                if (numCorners >= 3)
+                    counts.triangles += numCorners - 2;
+                else
+                    counts.unsupported++;
+            }
+            else if ((p[0] == 'o' || p[0] == 'g') && p + 1 < end && isSpace(p[1]))
+                counts.objects++;
+            else if (end - p > 6 && string(p, 6) == "usemtl")
+                counts.materials++;
+            // smoothing groups and material libraries do not change the geometry
+            else if ((p[0] == 's' && p + 1 < end && isSpace(p[1])) || (end - p > 6 && string(p, 6) == "mtllib"))
+                continue;
+            // other statements (lines, points, curves, ...)
+            else
+                counts.unsupported++;
+        }
+    }
+
+    //////////////////////////////////////////
+    // it reads the n floats of a statement
+    static bool parseFloats(const char* p, const char* end, GLfloat* values, int n)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            p = ParseObjFloat(skipSpaces(p, end), end, values[i]);
+            if (!p)
+                return false;
+        }
+        return true;
+    }
+
+    // it converts an index of the file (1-based, or negative = relative to the end of the current list) to a 0-based index
+    static bool resolveIndex(int64_t index, size_t count, size_t total, int32_t& result)
+    {
+        int64_t resolved = index > 0 ? index - 1 : (int64_t)count + index;
+        if (index == 0 || resolved < 0 || resolved >= (int64_t)total)
+            return false;
+        result = (int32_t)resolved;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // second pass on a chunk: the data are parsed and written at the offsets of the chunk
+    static bool parseChunk(const Chunk& chunk, const Counts& total, vector<glm::vec3>& positions, vector<glm::vec2>& texCoords,
+                           vector<glm::vec3>& normals, vector<ObjCorner>& corners)
+    {
+        // current positions in the arrays (= number of elements before the current line, used for the relative indices)
+        size_t v = chunk.offsets.positions, vt = chunk.offsets.texCoords, vn = chunk.offsets.normals;
+        size_t t = chunk.offsets.triangles;
+        const char* end = chunk.end;
+        vector<ObjCorner> face;
+        for (const char* p = chunk.begin; p < end; p = nextLine(p, end))
+        {
+            p = skipSpaces(p, end);
+            if (p >= end || p[0] == '#' || p + 1 >= end)
+                continue;
+            if (p[0] == 'v' && isSpace(p[1]))
+            {
+                if (!parseFloats(p + 1, end, &positions[v++].x, 3))
+                    return false;
+            }
+            else if (p[0] == 'v' && p[1] == 't')
+            {
+                glm::vec2& uv = texCoords[vt++];
+                if (!parseFloats(p + 2, end, &uv.x, 2))
+                    return false;
+                // the texture coordinates are flipped (aiProcess_FlipUVs)
+                uv.y = 1.0f - uv.y;
+            }
+            else if (p[0] == 'v' && p[1] == 'n')
+            {
+                if (!parseFloats(p + 2, end, &normals[vn++].x, 3))
+                    return false;
+            }
+            else if (p[0] == 'f' && isSpace(p[1]))
+            {
+                face.clear();
+                const char* q = skipSpaces(p + 1, end);
+                while (q < end && *q != '\n' && *q != '\r' && *q != '#')
+                {
+                    ObjCorner corner = {-1, -1, -1};
+                    int64_t index;
+                    q = ParseObjInt(q, end, index);
+                    if (!q || !resolveIndex(index, v, total.positions, corner.v))
+                        return false;
+                    if (q < end && *q == '/')
+                    {
+                        q++;
+                        if (q < end && *q != '/')
+                        {
+                            q = ParseObjInt(q, end, index);
+                            if (!q || !resolveIndex(index, vt, total.texCoords, corner.vt))
+                                return false;
+                        }
+                        if (q < end && *q == '/')
+                        {
+                            q = ParseObjInt(q + 1, end, index);
+                            if (!q || !resolveIndex(index, vn, total.normals, corner.vn))
+                                return false;
+                        }
+                    }
+                    face.push_back(corner);
+                    q = skipSpaces(q, end);
+                }
+                // polygons are triangulated as fans (aiProcess_Triangulate)
+                for (size_t i = 1; i + 1 < face.size(); i++)
+                {
+                    corners[3*t] = face[0];
+                    corners[3*t+1] = face[i];
+                    corners[3*t+2] = face[i+1];
+                    t++;
+                }
+            }
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // conversion of the corners of the faces in vertices and indices
+    static void buildVertices(const vector<glm::vec3>& positions, const vector<glm::vec2>& texCoords, const vector<glm::vec3>& normals,
+                              const vector<ObjCorner>& corners, vector<Vertex>& vertices, vector<GLuint>& indices, unsigned int numThreads)
+    {
+        size_t numCorners = corners.size();
+        unsigned int chunks = ParallelChunks(numCorners, numThreads);
+        indices.resize(numCorners);
+
+        // if all the corners use the same index for all the attributes, we have a vertex for each position
+        atomic<bool> sameIndices(true);
+        ParallelFor(numCorners, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end && sameIndices; i++)
+            {
+                const ObjCorner& c = corners[i];
+                if ((c.vt >= 0 && c.vt != c.v) || (c.vn >= 0 && c.vn != c.v))
+                    sameIndices = false;
+            }
+        }, chunks);
+
+        auto makeVertex = [&](const ObjCorner& c, Vertex& vertex)
+        {
+            vertex.Position = positions[c.v];
+            vertex.Normal = c.vn >= 0 ? normals[c.vn] : glm::vec3(0.0f);
+            vertex.Sm_Normal = glm::vec3(0.0f);
+            vertex.TexCoords = c.vt >= 0 ? texCoords[c.vt] : glm::vec2(0.0f);
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        };
+
+        if (sameIndices)
+        {
+            // (the attributes of the vertices not used by the faces are taken from the arrays, if present)
+            vertices.resize(positions.size());
+            ParallelFor(positions.size(), [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t v = begin; v < end; v++)
+                {
+                    ObjCorner c = {(int32_t)v, v < texCoords.size() ? (int32_t)v : -1, v < normals.size() ? (int32_t)v : -1};
+                    makeVertex(c, vertices[v]);
+                }
+            }, ParallelChunks(positions.size(), numThreads));
+            ParallelFor(numCorners, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t i = begin; i < end; i++)
+                    indices[i] = (GLuint)corners[i].v;
+            }, chunks);
+            return;
+        }
+
+        // otherwise, the identical triplets are joined (aiProcess_JoinIdenticalVertices): the vertices created for each position
+        // are kept in a linked list, and the vertices are created in the order of their first use
+        vector<int32_t> first(positions.size(), -1), next;
+        vector<ObjCorner> keys;
+        vertices.clear();
+        for (size_t i = 0; i < numCorners; i++)
+        {
+            const ObjCorner& c = corners[i];
+            int32_t vertex = first[c.v];
+            while (vertex >= 0 && (keys[vertex].vt != c.vt || keys[vertex].vn != c.vn))
+                vertex = next[vertex];
+            if (vertex < 0)
+            {
+                vertex = (int32_t)keys.size();
+                keys.push_back(c);
+                next.push_back(first[c.v]);
+                first[c.v] = vertex;
+            }
+            indices[i] = (GLuint)vertex;
+        }
+        vertices.resize(keys.size());
+        ParallelFor(keys.size(), [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+                makeVertex(keys[v], vertices[v]);
+        }, ParallelChunks(keys.size(), numThreads));
+    }
+};
@@ -0,0 +1,350 @@
+/*
+OcclusionCuller class - software occlusion culling with a hierarchical depth buffer (HiZ) on the CPU
+
+The frustum culling (culling.h) keeps all the objects in front of the camera, also when they are completely hidden by other objects
+(e.g., a scene with many statues one behind the other). Before the draw calls, we rasterize a small set of simplified occluders in a
+low resolution depth buffer on the CPU, and we test the bounding boxes of the objects against it:
+1) the occluders are the coarsest levels of detail of the meshes (see mesh_simplifier.h), with at most OCCLUSION_MAX_OCCLUDER_TRIANGLES
+   triangles, of the nearest and biggest objects on the screen (at most maxOccluders objects for each frame);
+2) the triangles are rasterized with edge functions, 4 pixels at a time with SSE (a scalar path gives the same results without SSE).
+   Each pixel keeps the nearest depth of the occluders which cover its center, and each triangle writes its farthest depth (the maximum
+   of its vertices), so the depth buffer is never nearer than the real occluders. The rows of the buffer are split among the threads
+   of a ThreadPool: each pixel is written by a single thread, and min() does not depend on the order of the triangles, so the result
+   is deterministic;
+3) the depth pyramid stores at each level the farthest depth of 2x2 texels of the previous level;
+4) an object is occluded if the nearest point of its box is farther than the depth of all the texels covered by the box on the screen,
+   at the level of the pyramid where the box covers at most 2x2 texels (so the test reads at most 9 texels).
+Boxes which cross the near plane are always visible.
+
+N.B. 1) the coverage is sampled at the center of the pixels: a hole in the occluders thinner than a pixel of the low resolution buffer
+(e.g., between two statues) can be closed, and an object visible only through it is culled. The coarse levels of detail can also be
+slightly outside the original surface (by their geometric error). Both effects are limited to small parts of the screen.
+N.B. 2) the culler does not use OpenGL, so it can be tested on the CPU with any set of triangles and matrices.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include <utils/bounds.h>
+#include <utils/parallel.h>
+
+// default resolution of the depth buffer
+const GLuint OCCLUSION_DEFAULT_WIDTH = 256;
+const GLuint OCCLUSION_DEFAULT_HEIGHT = 128;
+// maximum number of triangles of the occluder of a mesh (if its coarsest level of detail is bigger, the mesh is not an occluder)
+const size_t OCCLUSION_MAX_OCCLUDER_TRIANGLES = 4096;
+// default maximum number of occluders rasterized at each frame
+const GLuint OCCLUSION_DEFAULT_MAX_OCCLUDERS = 16;
+// minimum number of rows rasterized by a thread
+const size_t OCCLUSION_MIN_ROWS = 16;
+// vertices with w smaller than this value are considered behind the near plane
+const GLfloat OCCLUSION_MIN_W = 1e-5f;
+
+// simplified geometry of a mesh used as occluder (positions in object space, and indices of the triangles)
+struct OccluderGeometry
+{
+    vector<glm::vec3> positions;
+    vector<GLuint> indices;
+};
+
+//////////////////////////////////////////
+// it extracts the occluder of a mesh from a level of detail (if the level has too many triangles, the occluder is empty)
+inline void BuildOccluder(const Vertex* vertices, const GLuint* indices, GLuint firstIndex, GLsizei numIndices, OccluderGeometry& occluder)
+{
+    occluder.positions.clear();
+    occluder.indices.clear();
+    if (numIndices <= 0 || (size_t)numIndices / 3 > OCCLUSION_MAX_OCCLUDER_TRIANGLES)
+        return;
+    // the vertices of a level are consecutive (see mesh_simplifier.h): we copy the positions of the range used by the indices
+    GLuint first = indices[firstIndex], last = indices[firstIndex];
+    for (GLsizei i = 0; i < numIndices; i++)
+    {
+        first = min(first, indices[firstIndex + i]);
+        last = max(last, indices[firstIndex + i]);
+    }
+    if ((size_t)(last - first) > 3 * OCCLUSION_MAX_OCCLUDER_TRIANGLES)
+        return;
+    for (GLuint v = first; v <= last; v++)
+        occluder.positions.push_back(vertices[v].Position);
+    for (GLsizei i = 0; i < numIndices; i++)
+        occluder.indices.push_back(indices[firstIndex + i] - first);
+}
+
+/////////////////// OCCLUSIONCULLER class ///////////////////////
+class OcclusionCuller
+{
+public:
+
+    OcclusionCuller(GLuint width = OCCLUSION_DEFAULT_WIDTH, GLuint height = OCCLUSION_DEFAULT_HEIGHT)
+        : numTested(0), numOccluded(0)
+    {
+        this->Resize(width, height);
+    }
+
+    // it changes the resolution of the depth buffer (e.g., to follow the aspect ratio of the viewport)
+    void Resize(GLuint width, GLuint height)
+    {
+        this->levels.clear();
+        this->widths.clear();
+        this->heights.clear();
+        width = max(width, 1u);
+        height = max(height, 1u);
+        while (true)
+        {
+            this->widths.push_back(width);
+            this->heights.push_back(height);
+            this->levels.push_back(vector<float>(width * height, 1.0f));
+            if (width == 1 && height == 1)
+                break;
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+        }
+    }
+
+    GLuint Width() const { return this->widths[0]; }
+    GLuint Height() const { return this->heights[0]; }
+
+    //////////////////////////////////////////
+    // it starts a new frame: the depth buffer will be cleared, and the occluders will be transformed with viewProjection
+    void Begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        this->triangles.clear();
+        this->numTested = 0;
+        this->numOccluded = 0;
+    }
+
+    // it adds the triangles of an occluder, with its model matrix. The triangles with a vertex behind the near plane are discarded
+    void AddOccluder(const OccluderGeometry& occluder, const glm::mat4& modelMatrix)
+    {
+        glm::mat4 matrix = this->viewProjection * modelMatrix;
+        GLfloat width = (GLfloat)this->Width(), height = (GLfloat)this->Height();
+        this->screen.resize(occluder.positions.size());
+        for (size_t i = 0; i < occluder.positions.size(); i++)
+        {
+            glm::vec4 clip = matrix * glm::vec4(occluder.positions[i], 1.0f);
+            if (clip.w < OCCLUSION_MIN_W)
+            {
+                this->screen[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+                continue;
+            }
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            this->screen[i] = glm::vec4((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f, 1.0f);
+        }
+        for (size_t t = 0; t + 2 < occluder.indices.size(); t += 3)
+        {
+            const glm::vec4& a = this->screen[occluder.indices[t]];
+            const glm::vec4& b = this->screen[occluder.indices[t + 1]];
+            const glm::vec4& c = this->screen[occluder.indices[t + 2]];
+            if (a.w < 0.0f || b.w < 0.0f || c.w < 0.0f)
+                continue;
+            this->addTriangle(a, b, c);
+        }
+    }
+
+    // it rasterizes the occluders (on the threads of the pool, if not null), and it builds the depth pyramid
+    void Rasterize(ThreadPool* pool = nullptr)
+    {
+        vector<float>& depth = this->levels[0];
+        GLuint width = this->Width();
+        auto rasterizeRows = [&](size_t begin, size_t end, unsigned int)
+        {
+            fill(depth.begin() + begin * width, depth.begin() + end * width, 1.0f);
+            for (const Triangle& triangle : this->triangles)
+                this->rasterize(triangle, (GLint)begin, (GLint)end);
+        };
+        if (pool)
+            pool->ParallelFor(this->Height(), rasterizeRows, OCCLUSION_MIN_ROWS);
+        else
+            rasterizeRows(0, this->Height(), 0);
+        this->buildPyramid();
+    }
+
+    //////////////////////////////////////////
+    // false if the box (in world coordinates) is completely behind the occluders
+    bool IsVisible(const Bounds& bounds)
+    {
+        if (bounds.IsEmpty())
+            return false;
+        this->numTested++;
+        GLfloat width = (GLfloat)this->Width(), height = (GLfloat)this->Height();
+        glm::vec2 minimum(1e30f), maximum(-1e30f);
+        GLfloat nearest = 1.0f;
+        for (int k = 0; k < 8; k++)
+        {
+            glm::vec3 corner((k & 1) ? bounds.boxMax.x : bounds.boxMin.x, (k & 2) ? bounds.boxMax.y : bounds.boxMin.y, (k & 4) ? bounds.boxMax.z : bounds.boxMin.z);
+            glm::vec4 clip = this->viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w < OCCLUSION_MIN_W)
+                return true;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            glm::vec2 pixel((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height);
+            minimum = glm::min(minimum, pixel);
+            maximum = glm::max(maximum, pixel);
+            nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        // rectangle of the covered pixels (the box is outside the screen if the rectangle is empty)
+        GLint x0 = max((GLint)floor(minimum.x), 0), y0 = max((GLint)floor(minimum.y), 0);
+        GLint x1 = min((GLint)floor(maximum.x), (GLint)this->Width() - 1), y1 = min((GLint)floor(maximum.y), (GLint)this->Height() - 1);
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        // level where the rectangle covers at most 2x2 texels
+        GLuint level = 0;
+        while (level + 1 < this->levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+            level++;
+        const vector<float>& depth = this->levels[level];
+        GLuint levelWidth = this->widths[level];
+        for (GLint y = y0 >> level; y <= (y1 >> level); y++)
+            for (GLint x = x0 >> level; x <= (x1 >> level); x++)
+                if (depth[y * levelWidth + x] >= nearest)
+                    return true;
+        this->numOccluded++;
+        return false;
+    }
+
+    //////////////////////////////////////////
+    // statistics of the current frame
+    size_t NumOccluderTriangles() const { return this->triangles.size(); }
+    GLuint NumTested() const { return this->numTested; }
+    GLuint NumOccluded() const { return this->numOccluded; }
+
+    // depth of a texel of a level of the pyramid (1 = far plane, or no occluders)
+    float Depth(GLuint level, GLuint x, GLuint y) const { return this->levels[level][y * this->widths[level] + x]; }
+    GLuint NumLevels() const { return (GLuint)this->levels.size(); }
+
+private:
+
+    // a triangle in screen coordinates (pixels), with its farthest depth, and its bounding rectangle
+    struct Triangle
+    {
+        glm::vec2 a, b, c;
+        GLfloat depth;
+        GLint x0, y0, x1, y1;
+    };
+
+    glm::mat4 viewProjection;
+    vector<Triangle> triangles;
+    // levels of the pyramid (0 = depth buffer), and their sizes
+    vector<vector<float>> levels;
+    vector<GLuint> widths, heights;
+    // vertices of the current occluder in screen coordinates (w < 0 = behind the near plane)
+    vector<glm::vec4> screen;
+    GLuint numTested, numOccluded;
+
+    //////////////////////////////////////////
+    void addTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        Triangle triangle;
+        // the vertices are ordered so that the edge functions are positive inside (degenerate triangles are discarded)
+        GLfloat area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (area == 0.0f)
+            return;
+        triangle.a = glm::vec2(a);
+        triangle.b = area > 0.0f ? glm::vec2(b) : glm::vec2(c);
+        triangle.c = area > 0.0f ? glm::vec2(c) : glm::vec2(b);
+        triangle.depth = max(a.z, max(b.z, c.z));
+        // rectangle of the pixel centers which can be inside the triangle
+        glm::vec2 minimum = glm::min(triangle.a, glm::min(triangle.b, triangle.c));
+        glm::vec2 maximum = glm::max(triangle.a, glm::max(triangle.b, triangle.c));
+        triangle.x0 = max((GLint)ceil(minimum.x - 0.5f), 0);
+        triangle.y0 = max((GLint)ceil(minimum.y - 0.5f), 0);
+        triangle.x1 = min((GLint)floor(maximum.x - 0.5f), (GLint)this->Width() - 1);
+        triangle.y1 = min((GLint)floor(maximum.y - 0.5f), (GLint)this->Height() - 1);
+        if (triangle.x0 > triangle.x1 || triangle.y0 > triangle.y1 || triangle.depth < 0.0f)
+            return;
+        this->triangles.push_back(triangle);
+    }
+
+    //////////////////////////////////////////
+    // rasterization of a triangle in the rows [rowBegin, rowEnd)
+    void rasterize(const Triangle& t, GLint rowBegin, GLint rowEnd)
+    {
+        GLint y0 = max(t.y0, rowBegin), y1 = min(t.y1, rowEnd - 1);
+        if (y0 > y1)
+            return;
+        // edge function of the edge p -> q: (q.x - p.x) * (y - p.y) - (q.y - p.y) * (x - p.x), it increases by dx along y and by -dy along x
+        const glm::vec2* p[3] = {&t.a, &t.b, &t.c};
+        const glm::vec2* q[3] = {&t.b, &t.c, &t.a};
+        GLfloat stepX[3], stepY[3], origin[3];
+        GLfloat startX = t.x0 + 0.5f, startY = y0 + 0.5f;
+        for (int e = 0; e < 3; e++)
+        {
+            stepX[e] = -(q[e]->y - p[e]->y);
+            stepY[e] = q[e]->x - p[e]->x;
+            origin[e] = stepY[e] * (startY - p[e]->y) + stepX[e] * (startX - p[e]->x);
+        }
+        vector<float>& depth = this->levels[0];
+        GLuint width = this->Width();
+        for (GLint y = y0; y <= y1; y++)
+        {
+            GLfloat row[3];
+            for (int e = 0; e < 3; e++)
+                row[e] = origin[e] + stepY[e] * (GLfloat)(y - y0);
+            float* line = &depth[y * width];
+            GLint x = t.x0;
+#ifdef OCCLUSION_SSE
+            __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            __m128 triangleDepth = _mm_set1_ps(t.depth);
+            for (; x + 3 <= t.x1; x += 4)
+            {
+                __m128 dx = _mm_add_ps(_mm_set1_ps((GLfloat)(x - t.x0)), offsets);
+                __m128 inside = _mm_set1_ps(0.0f);
+                inside = _mm_cmpeq_ps(inside, inside);
+                for (int e = 0; e < 3; e++)
+                {
+                    __m128 value = _mm_add_ps(_mm_set1_ps(row[e]), _mm_mul_ps(_mm_set1_ps(stepX[e]), dx));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(value, _mm_setzero_ps()));
+                }
+                __m128 current = _mm_loadu_ps(line + x);
+                __m128 updated = _mm_min_ps(current, triangleDepth);
+                _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, updated), _mm_andnot_ps(inside, current)));
+            }
+#endif
+            for (; x <= t.x1; x++)
+            {
+                GLfloat dx = (GLfloat)(x - t.x0);
+                if (row[0] + stepX[0] * dx >= 0.0f && row[1] + stepX[1] * dx >= 0.0f && row[2] + stepX[2] * dx >= 0.0f)
+                    line[x] = min(line[x], t.depth);
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+    // each texel of a level is the farthest depth of (up to) 2x2 texels of the previous level
+    void buildPyramid()
+    {
+        for (size_t l = 1; l < this->levels.size(); l++)
+        {
+            const vector<float>& source = this->levels[l - 1];
+            vector<float>& target = this->levels[l];
+            GLuint sourceWidth = this->widths[l - 1], sourceHeight = this->heights[l - 1];
+            for (GLuint y = 0; y < this->heights[l]; y++)
+                for (GLuint x = 0; x < this->widths[l]; x++)
+                {
+                    GLuint sx = 2 * x, sy = 2 * y;
+                    GLuint sx1 = min(sx + 1, sourceWidth - 1), sy1 = min(sy + 1, sourceHeight - 1);
+                    target[y * this->widths[l] + x] = max(max(source[sy * sourceWidth + sx], source[sy * sourceWidth + sx1]),
+                                                          max(source[sy1 * sourceWidth + sx], source[sy1 * sourceWidth + sx1]));
+                }
+        }
+    }
+};
@@ -0,0 +1,226 @@
+/*
+Offscreen rendering utilities
+- Framebuffer class: a Framebuffer Object (FBO) with color and depth renderbuffers, used to render at any resolution without a visible window
+- FrameReadback class: asynchronous readback of the rendered frames using Pixel Buffer Objects (PBO), and saving of the frames as PPM images
+
+Asynchronous readback:
+glReadPixels with a PBO bound to GL_PIXEL_PACK_BUFFER returns immediately: the copy of the pixels is queued by the driver like a draw call.
+The frames are read in a ring of PBOs: the pixels of frame i are mapped (and saved) only when frame i + N - 1 has been submitted,
+so the CPU never waits for the GPU to complete the current frame. A fence is inserted after each readback, to wait only if needed.
+
+N.B. 1) like Mesh, Framebuffer is a "move-only" class, in charge of releasing the allocated GPU resources (RAII).
+FrameReadback cannot be copied or moved, and its destructor completes the pending readbacks before releasing the PBOs.
+
+N.B. 2) PPM is the simplest image format (a short text header followed by the RGB values), which can be opened or converted by most of the image tools
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <iostream>
+
+//////////////////////////////////////////
+// it saves an image with RGBA pixels, stored from the bottom row (as returned by glReadPixels), in a binary PPM file
+inline bool WritePPM(const string& path, const unsigned char* rgba, GLsizei width, GLsizei height)
+{
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+    fprintf(out, "P6\n%d %d\n255\n", width, height);
+    vector<unsigned char> row(width * 3);
+    bool ok = true;
+    // PPM starts from the top row
+    for (GLsizei y = height - 1; y >= 0 && ok; y--)
+    {
+        const unsigned char* src = rgba + (size_t)y * width * 4;
+        for (GLsizei x = 0; x < width; x++)
+        {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        ok = fwrite(row.data(), 1, row.size(), out) == row.size();
+    }
+    return (fclose(out) == 0) && ok;
+}
+
+/////////////////// FRAMEBUFFER class ///////////////////////
+class Framebuffer
+{
+public:
+
+    GLuint FBO;
+    GLsizei width, height;
+
+    Framebuffer(GLsizei width, GLsizei height) noexcept
+        : width(width), height(height)
+    {
+        glGenFramebuffers(1, &this->FBO);
+        glGenRenderbuffers(1, &this->colorBuffer);
+        glGenRenderbuffers(1, &this->depthBuffer);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->depthBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    Framebuffer(const Framebuffer& copy) = delete;
+    Framebuffer& operator=(const Framebuffer& copy) = delete;
+
+    Framebuffer(Framebuffer&& move) noexcept
+        : FBO(move.FBO), width(move.width), height(move.height), colorBuffer(move.colorBuffer), depthBuffer(move.depthBuffer)
+    {
+        move.FBO = 0;
+    }
+
+    Framebuffer& operator=(Framebuffer&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->FBO = move.FBO;
+        this->width = move.width;
+        this->height = move.height;
+        this->colorBuffer = move.colorBuffer;
+        this->depthBuffer = move.depthBuffer;
+        move.FBO = 0;
+        return *this;
+    }
+
+    ~Framebuffer() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    // the FBO becomes the target of the rendering, and the viewport is set to its size
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glViewport(0, 0, this->width, this->height);
+    }
+
+private:
+
+    GLuint colorBuffer, depthBuffer;
+
+    void freeGPUresources()
+    {
+        if (this->FBO)
+        {
+            glDeleteFramebuffers(1, &this->FBO);
+            glDeleteRenderbuffers(1, &this->colorBuffer);
+            glDeleteRenderbuffers(1, &this->depthBuffer);
+        }
+    }
+};
+
+/////////////////// FRAMEREADBACK class ///////////////////////
+class FrameReadback
+{
+public:
+
+    FrameReadback(GLsizei width, GLsizei height, GLuint numBuffers = 3) noexcept
+        : width(width), height(height), next(0), PBOs(numBuffers > 0 ? numBuffers : 1)
+    {
+        glGenBuffers((GLsizei)this->PBOs.size(), this->PBOs.data());
+        for (GLuint pbo : this->PBOs)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    FrameReadback(const FrameReadback& copy) = delete;
+    FrameReadback& operator=(const FrameReadback& copy) = delete;
+
+    ~FrameReadback() noexcept
+    {
+        this->Finish();
+        if (!this->PBOs.empty())
+            glDeleteBuffers((GLsizei)this->PBOs.size(), this->PBOs.data());
+    }
+
+    //////////////////////////////////////////
+
+    // it queues the readback of the color buffer of the currently bound read framebuffer; the image will be saved in path
+    void Capture(const string& path)
+    {
+        // if all the PBOs are in use, we complete the oldest readback
+        if (this->pending.size() == this->PBOs.size())
+            this->completeOldest();
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->PBOs[this->next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, this->width, this->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        Readback readback;
+        readback.pbo = this->PBOs[this->next];
+        readback.path = path;
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->pending.push_back(readback);
+        this->next = (this->next + 1) % this->PBOs.size();
+    }
+
+    // it completes all the queued readbacks
+    void Finish()
+    {
+        while (!this->pending.empty())
+            this->completeOldest();
+    }
+
+private:
+
+    struct Readback
+    {
+        GLuint pbo;
+        string path;
+        GLsync fence;
+    };
+
+    GLsizei width, height;
+    size_t next;
+    vector<GLuint> PBOs;
+    deque<Readback> pending;
+
+    //////////////////////////////////////////
+    // it waits for the oldest readback (usually already completed), maps its PBO and saves the image
+    void completeOldest()
+    {
+        Readback readback = this->pending.front();
+        this->pending.pop_front();
+
+        glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+        glDeleteSync(readback.fence);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)this->width * this->height * 4, GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            if (!WritePPM(readback.path, pixels, this->width, this->height))
+                cout << "ERROR::READBACK:: unable to write " << readback.path << endl;
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+};
@@ -0,0 +1,208 @@
+/*
+Parallel utilities
+- a minimal "parallel for" built on std::thread, used by the CPU-side processing of the models (smoothed normals, etc.)
+
+The range [0, count) is split in contiguous chunks, and each chunk is processed by a different thread.
+The split depends only on the size of the range and on the number of chunks (and not on the scheduling of the threads),
+so an algorithm which writes its partial results per chunk, and then combines them in chunk order, always gives the same result.
+
+N.B.) ParallelFor creates and joins the threads at each call: it is meant for heavy, load-time processing, and not for
+fine-grained work inside the rendering loop. The work done at each frame (e.g., culling) uses a ThreadPool, whose threads
+are created once and wait for the next range to process: the split in chunks is the same of ParallelFor.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// minimum number of elements assigned to a chunk: below this size, the creation of a thread costs more than the work it does
+const size_t PARALLEL_MIN_CHUNK_SIZE = 4096;
+
+//////////////////////////////////////////
+// number of hardware threads available (at least 1)
+inline unsigned int HardwareThreads()
+{
+    unsigned int n = thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+//////////////////////////////////////////
+// number of chunks used to process count elements with (at most) numThreads threads
+// if numThreads = 0, we use all the hardware threads
+inline unsigned int ParallelChunks(size_t count, unsigned int numThreads = 0, size_t minChunkSize = PARALLEL_MIN_CHUNK_SIZE)
+{
+    if (numThreads == 0)
+        numThreads = HardwareThreads();
+    size_t maxChunks = (count + minChunkSize - 1) / minChunkSize;
+    if (maxChunks < 1)
+        maxChunks = 1;
+    return (unsigned int)(maxChunks < numThreads ? maxChunks : numThreads);
+}
+
+//////////////////////////////////////////
+// it calls body(begin, end, chunk) for each of the numChunks contiguous chunks of [0, count)
+// if numChunks = 0, the number of chunks is chosen using ParallelChunks
+// the last chunk is processed by the calling thread, the other ones by new threads
+inline void ParallelFor(size_t count, const function<void(size_t, size_t, unsigned int)>& body, unsigned int numChunks = 0)
+{
+    if (count == 0)
+        return;
+    if (numChunks == 0)
+        numChunks = ParallelChunks(count);
+
+    vector<thread> workers;
+    workers.reserve(numChunks - 1);
+    for (unsigned int c = 0; c < numChunks; c++)
+    {
+        // chunk boundaries are computed so that the sizes differ at most by 1 element
+        size_t begin = count * c / numChunks;
+        size_t end = count * (c + 1) / numChunks;
+        if (c + 1 < numChunks)
+            workers.emplace_back(body, begin, end, c);
+        else
+            body(begin, end, c);
+    }
+    for (auto &w : workers)
+        w.join();
+}
+
+/////////////////// THREADPOOL class ///////////////////////
+// persistent threads for the parallel loops executed at each frame
+class ThreadPool
+{
+public:
+    // numThreads includes the calling thread, which processes chunks too (0 = all the hardware threads)
+    ThreadPool(unsigned int numThreads = 0)
+        : stop(false), generation(0), active(0), body(nullptr), count(0), numChunks(0), nextChunk(0), pending(0)
+    {
+        if (numThreads == 0)
+            numThreads = HardwareThreads();
+        for (unsigned int i = 1; i < numThreads; i++)
+            this->workers.emplace_back(&ThreadPool::work, this);
+    }
+
+    ThreadPool(const ThreadPool& copy) = delete;
+    ThreadPool& operator=(const ThreadPool& copy) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(this->poolMutex);
+            this->stop = true;
+        }
+        this->wakeup.notify_all();
+        for (thread& worker : this->workers)
+            worker.join();
+    }
+
+    unsigned int NumThreads() const { return (unsigned int)this->workers.size() + 1; }
+
+    //////////////////////////////////////////
+    // like ParallelFor: it calls body(begin, end, chunk) for each chunk of [0, count), and it returns when all the chunks are processed.
+    // The chunks are at most NumThreads(), with at least minChunkSize elements each
+    void ParallelFor(size_t count, const function<void(size_t, size_t, unsigned int)>& body, size_t minChunkSize = PARALLEL_MIN_CHUNK_SIZE)
+    {
+        if (count == 0)
+            return;
+        unsigned int numChunks = ParallelChunks(count, this->NumThreads(), minChunkSize);
+        if (numChunks == 1)
+        {
+            body(0, count, 0);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(this->poolMutex);
+            this->body = &body;
+            this->count = count;
+            this->numChunks = numChunks;
+            this->nextChunk = 0;
+            this->pending = numChunks;
+            this->generation++;
+        }
+        this->wakeup.notify_all();
+        this->runChunks(&body, count, numChunks);
+
+        // we wait for the chunks taken by the workers, and for the workers still reading the current loop
+        unique_lock<mutex> lock(this->poolMutex);
+        this->done.wait(lock, [this] { return this->pending == 0 && this->active == 0; });
+        this->body = nullptr;
+    }
+
+private:
+
+    vector<thread> workers;
+    mutex poolMutex;
+    condition_variable wakeup;
+    condition_variable done;
+    bool stop;
+    // the current loop (protected by poolMutex), and the workers which are processing it
+    uint64_t generation;
+    unsigned int active;
+    const function<void(size_t, size_t, unsigned int)>* body;
+    size_t count;
+    unsigned int numChunks;
+    // next chunk to process, and chunks not yet completed
+    atomic<unsigned int> nextChunk;
+    atomic<unsigned int> pending;
+
+    //////////////////////////////////////////
+    void runChunks(const function<void(size_t, size_t, unsigned int)>* body, size_t count, unsigned int numChunks)
+    {
+        while (true)
+        {
+            unsigned int c = this->nextChunk.fetch_add(1);
+            if (c >= numChunks)
+                return;
+            (*body)(count * c / numChunks, count * (c + 1) / numChunks, c);
+            if (this->pending.fetch_sub(1) == 1)
+            {
+                lock_guard<mutex> lock(this->poolMutex);
+                this->done.notify_all();
+            }
+        }
+    }
+
+    // loop of the worker threads
+    void work()
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            const function<void(size_t, size_t, unsigned int)>* body;
+            size_t count;
+            unsigned int numChunks;
+            {
+                unique_lock<mutex> lock(this->poolMutex);
+                this->wakeup.wait(lock, [this, seen] { return this->stop || (this->generation != seen && this->body); });
+                if (this->stop)
+                    return;
+                seen = this->generation;
+                body = this->body;
+                count = this->count;
+                numChunks = this->numChunks;
+                this->active++;
+            }
+            this->runChunks(body, count, numChunks);
+            {
+                lock_guard<mutex> lock(this->poolMutex);
+                this->active--;
+            }
+            this->done.notify_all();
+        }
+    }
+};
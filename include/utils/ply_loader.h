@@ -0,0 +1,481 @@
+/*
+PLY loader - memory-mapped parser of binary little-endian PLY files (the format of the original Stanford scans)
+
+A binary PLY file has a text header, which describes the elements (vertex, face, ...) and the types of their properties,
+followed by the records of the elements. Since the layout of a vertex record is known from the header, the file is mapped
+in memory (see mapped_file.h) and the vertices are read without any parsing: the positions (and, if present, the normals
+and the texture coordinates) are copied with a memcpy from each record, in parallel. The faces are usually triangles
+("property list uchar int vertex_indices"), so they are records of fixed size: we check in parallel that all the faces have
+3 vertices, and then the indices are copied in the same way. Polygons with more vertices are triangulated as fans, with a
+serial pass on the faces.
+
+Like obj_loader.h, the result is the mesh produced by Assimp with MODEL_POSTPROCESS_FLAGS (normals are generated if they are
+not in the file, tangents are computed if the texture coordinates are present).
+
+The ASCII and big-endian files, and the files with list properties in elements different from the faces (e.g., the "range_grid"
+of some Stanford scans), are not supported: PlyParser::Load returns false, and the model is loaded with Assimp.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <atomic>
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/mapped_file.h>
+#include <utils/parallel.h>
+#include <utils/smoothed_normals.h>
+
+// types of the properties of a PLY element
+enum PlyType {
+    PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64
+};
+
+/////////////////// PLYPARSER class ///////////////////////
+class PlyParser
+{
+public:
+
+    // it loads the PLY file in vertices and indices (triangles). It returns false if the file cannot be read,
+    // if it is not supported by the parser, or if it is not valid
+    static bool Load(const string& path, vector<Vertex>& vertices, vector<GLuint>& indices, unsigned int numThreads = 0)
+    {
+        MappedFile file(path);
+        if (!file.IsValid())
+            return false;
+        const unsigned char* data = file.Data();
+        size_t size = file.Size();
+
+        vector<Element> elements;
+        size_t offset;
+        if (!parseHeader(data, size, elements, offset))
+            return false;
+
+        // the records of the elements follow the header, in the order of the header
+        const Element* vertexElement = nullptr;
+        const Element* faceElement = nullptr;
+        const unsigned char* vertexRecords = nullptr;
+        const unsigned char* faceRecords = nullptr;
+        bool triangles = false;
+        for (const Element& element : elements)
+        {
+            if (element.name == "vertex")
+            {
+                vertexElement = &element;
+                vertexRecords = data + offset;
+            }
+            else if (element.name == "face")
+            {
+                faceElement = &element;
+                faceRecords = data + offset;
+            }
+            size_t elementSize;
+            if (!elementBytes(element, data + offset, size - offset, elementSize, element.name == "face" ? &triangles : nullptr, numThreads))
+                return false;
+            offset += elementSize;
+        }
+        if (!vertexElement || !faceElement || vertexElement->count == 0 || faceElement->count == 0)
+            return false;
+
+        // vertices
+        VertexLayout layout;
+        if (!findVertexLayout(*vertexElement, layout))
+            return false;
+        vertices.resize(vertexElement->count);
+        readVertices(*vertexElement, layout, vertexRecords, vertices, numThreads);
+
+        // faces
+        const Property& list = faceElement->properties[faceElement->listProperty];
+        size_t numVertices = vertices.size();
+        atomic<bool> valid(true);
+        if (triangles)
+        {
+            // all the faces are triangles: the records have a fixed size, and the indices are copied directly
+            size_t countSize = typeSize(list.countType), indexSize = typeSize(list.type);
+            size_t recordSize = faceElement->recordSize + countSize + 3 * indexSize;
+            size_t listOffset = list.offset;
+            indices.resize(faceElement->count * 3);
+            ParallelFor(faceElement->count, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t f = begin; f < end; f++)
+                {
+                    const unsigned char* record = faceRecords + f * recordSize + listOffset + countSize;
+                    if (indexSize == sizeof(GLuint))
+                        memcpy(&indices[3*f], record, 3 * sizeof(GLuint));
+                    else
+                        for (int j = 0; j < 3; j++)
+                            indices[3*f+j] = (GLuint)readInteger(list.type, record + j * indexSize);
+                    for (int j = 0; j < 3; j++)
+                        if (indices[3*f+j] >= numVertices)
+                            valid = false;
+                }
+            }, ParallelChunks(faceElement->count, numThreads));
+        }
+        else
+        {
+            // polygons: the faces are read in sequence, and triangulated as fans (aiProcess_Triangulate)
+            indices.clear();
+            indices.reserve(faceElement->count * 3);
+            const unsigned char* record = faceRecords;
+            vector<GLuint> face;
+            for (size_t f = 0; f < faceElement->count && valid; f++)
+            {
+                face.clear();
+                for (size_t p = 0; p < faceElement->properties.size(); p++)
+                {
+                    const Property& property = faceElement->properties[p];
+                    if (!property.isList)
+                    {
+                        record += typeSize(property.type);
+                        continue;
+                    }
+                    size_t n = (size_t)readInteger(property.countType, record);
+                    record += typeSize(property.countType);
+                    for (size_t j = 0; j < n; j++, record += typeSize(property.type))
+                        if ((int)p == faceElement->listProperty)
+                            face.push_back((GLuint)readInteger(property.type, record));
+                }
+                for (size_t j = 1; j + 1 < face.size(); j++)
+                {
+                    indices.push_back(face[0]);
+                    indices.push_back(face[j]);
+                    indices.push_back(face[j+1]);
+                }
+                for (GLuint index : face)
+                    if (index >= numVertices)
+                        valid = false;
+            }
+        }
+        if (!valid || indices.empty())
+        {
+            cout << "WARNING::PLY:: invalid faces in " << path << endl;
+            return false;
+        }
+
+        if (layout.normal < 0)
+            ComputeVertexNormals(vertices, indices, numThreads);
+        if (layout.texCoords >= 0)
+            ComputeTangentSpace(vertices, indices, numThreads);
+        else
+            cout << "WARNING::PLY:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
+        return true;
+    }
+
+private:
+
+    // a property of an element: a scalar, or a list (with the type of the number of values, and the type of the values)
+    struct Property
+    {
+        string name;
+        PlyType type;
+        bool isList;
+        PlyType countType;
+        // offset in the record (only if all the properties of the element are scalars, or for the first list of the record)
+        size_t offset;
+    };
+
+    struct Element
+    {
+        string name;
+        size_t count;
+        vector<Property> properties;
+        // size of a record (if all the properties are scalars), and index of the list property (-1 = none)
+        size_t recordSize;
+        int listProperty;
+    };
+
+    // indices of the properties of the vertex attributes (-1 = not present): x, y, z, nx, ny, nz, and u, v
+    struct VertexLayout
+    {
+        int position[3];
+        int normal;
+        int normals[3];
+        int texCoords;
+        int uv[2];
+    };
+
+    //////////////////////////////////////////
+    static PlyType parseType(const string& name)
+    {
+        if (name == "char" || name == "int8") return PLY_INT8;
+        if (name == "uchar" || name == "uint8") return PLY_UINT8;
+        if (name == "short" || name == "int16") return PLY_INT16;
+        if (name == "ushort" || name == "uint16") return PLY_UINT16;
+        if (name == "int" || name == "int32") return PLY_INT32;
+        if (name == "uint" || name == "uint32") return PLY_UINT32;
+        if (name == "float" || name == "float32") return PLY_FLOAT32;
+        if (name == "double" || name == "float64") return PLY_FLOAT64;
+        return PLY_INVALID;
+    }
+
+    static size_t typeSize(PlyType type)
+    {
+        switch (type)
+        {
+            case PLY_INT8: case PLY_UINT8: return 1;
+            case PLY_INT16: case PLY_UINT16: return 2;
+            case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+            case PLY_FLOAT64: return 8;
+            default: return 0;
+        }
+    }
+
+    // reading of a value (the records are not aligned, so the values are copied with memcpy)
+    static int64_t readInteger(PlyType type, const unsigned char* p)
+    {
+        switch (type)
+        {
+            case PLY_INT8:   { int8_t v;   memcpy(&v, p, 1); return v; }
+            case PLY_UINT8:  { uint8_t v;  memcpy(&v, p, 1); return v; }
+            case PLY_INT16:  { int16_t v;  memcpy(&v, p, 2); return v; }
+            case PLY_UINT16: { uint16_t v; memcpy(&v, p, 2); return v; }
+            case PLY_INT32:  { int32_t v;  memcpy(&v, p, 4); return v; }
+            case PLY_UINT32: { uint32_t v; memcpy(&v, p, 4); return v; }
+            default:         return (int64_t)readFloat(type, p);
+        }
+    }
+
+    static GLfloat readFloat(PlyType type, const unsigned char* p)
+    {
+        if (type == PLY_FLOAT32) { GLfloat v; memcpy(&v, p, 4); return v; }
+        if (type == PLY_FLOAT64) { double v; memcpy(&v, p, 8); return (GLfloat)v; }
+        return (GLfloat)readInteger(type, p);
+    }
+
+    //////////////////////////////////////////
+    // it reads the header. offset receives the position of the first record
+    static bool parseHeader(const unsigned char* data, size_t size, vector<Element>& elements, size_t& offset)
+    {
+        // the header ends with the "end_header" line
+        const char* text = (const char*)data;
+        const char* marker = "end_header";
+        size_t end = 0;
+        const size_t maxHeader = min(size, (size_t)65536);
+        for (size_t i = 0; i + 10 <= maxHeader; i++)
+            if (memcmp(text + i, marker, 10) == 0 && (i == 0 || text[i-1] == '\n'))
+            {
+                end = i + 10;
+                break;
+            }
+        if (size < 4 || memcmp(text, "ply", 3) != 0 || end == 0)
+            return false;
+        while (end < size && text[end] == '\r')
+            end++;
+        if (end >= size || text[end] != '\n')
+            return false;
+        offset = end + 1;
+
+        istringstream header(string(text, end));
+        string line;
+        bool littleEndian = false;
+        while (getline(header, line))
+        {
+            istringstream words(line);
+            string keyword;
+            words >> keyword;
+            if (keyword == "format")
+            {
+                string format;
+                words >> format;
+                littleEndian = (format == "binary_little_endian");
+            }
+            else if (keyword == "element")
+            {
+                Element element;
+                words >> element.name >> element.count;
+                element.recordSize = 0;
+                element.listProperty = -1;
+                elements.push_back(element);
+            }
+            else if (keyword == "property" && !elements.empty())
+            {
+                Element& element = elements.back();
+                Property property;
+                string type;
+                words >> type;
+                property.isList = (type == "list");
+                property.countType = PLY_INVALID;
+                if (property.isList)
+                {
+                    string countType;
+                    words >> countType >> type;
+                    property.countType = parseType(countType);
+                    if (property.countType == PLY_INVALID || property.countType == PLY_FLOAT32 || property.countType == PLY_FLOAT64)
+                        return false;
+                }
+                property.type = parseType(type);
+                words >> property.name;
+                if (property.type == PLY_INVALID)
+                    return false;
+                if (property.isList)
+                {
+                    // only the faces can have a list (the indices of the vertices)
+                    if (element.name != "face" || element.listProperty >= 0 ||
+                        (property.name != "vertex_indices" && property.name != "vertex_index"))
+                        return false;
+                    element.listProperty = (int)element.properties.size();
+                }
+                property.offset = element.recordSize;
+                if (!property.isList)
+                    element.recordSize += typeSize(property.type);
+                element.properties.push_back(property);
+            }
+        }
+        // the ASCII and big-endian files are read by Assimp
+        return littleEndian;
+    }
+
+    //////////////////////////////////////////
+    // size of the records of an element. For the faces, triangles receives true if all the faces are triangles with the same
+    // record size (we check it in parallel); otherwise, the size of the faces is computed reading the number of values of the lists
+    static bool elementBytes(const Element& element, const unsigned char* records, size_t available, size_t& bytes, bool* triangles, unsigned int numThreads)
+    {
+        if (element.listProperty < 0)
+        {
+            bytes = element.count * element.recordSize;
+            return element.recordSize > 0 && bytes <= available;
+        }
+        const Property& list = element.properties[element.listProperty];
+        size_t countSize = typeSize(list.countType), indexSize = typeSize(list.type);
+
+        // hypothesis: all the faces are triangles
+        size_t recordSize = element.recordSize + countSize + 3 * indexSize;
+        if (element.count * recordSize <= available)
+        {
+            // the offset of the list in the record does not depend on the scalars after it
+            size_t listOffset = 0;
+            for (int p = 0; p < element.listProperty; p++)
+                listOffset += typeSize(element.properties[p].type);
+            atomic<bool> allTriangles(true);
+            ParallelFor(element.count, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t f = begin; f < end && allTriangles; f++)
+                    if (readInteger(list.countType, records + f * recordSize + listOffset) != 3)
+                        allTriangles = false;
+            }, ParallelChunks(element.count, numThreads));
+            if (allTriangles)
+            {
+                if (triangles)
+                    *triangles = true;
+                bytes = element.count * recordSize;
+                return true;
+            }
+        }
+
+        // variable size: we follow the records
+        size_t position = 0;
+        for (size_t f = 0; f < element.count; f++)
+            for (const Property& property : element.properties)
+            {
+                if (!property.isList)
+                    position += typeSize(property.type);
+                else
+                {
+                    if (position + countSize > available)
+                        return false;
+                    position += countSize + (size_t)readInteger(property.countType, records + position) * typeSize(property.type);
+                }
+                if (position > available)
+                    return false;
+            }
+        bytes = position;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // it finds the properties of the vertex attributes
+    static bool findVertexLayout(const Element& element, VertexLayout& layout)
+    {
+        auto find = [&](const char* a, const char* b, const char* c) -> int
+        {
+            for (size_t p = 0; p < element.properties.size(); p++)
+            {
+                const string& name = element.properties[p].name;
+                if (name == a || (b && name == b) || (c && name == c))
+                    return (int)p;
+            }
+            return -1;
+        };
+        layout.position[0] = find("x", nullptr, nullptr);
+        layout.position[1] = find("y", nullptr, nullptr);
+        layout.position[2] = find("z", nullptr, nullptr);
+        layout.normals[0] = find("nx", nullptr, nullptr);
+        layout.normals[1] = find("ny", nullptr, nullptr);
+        layout.normals[2] = find("nz", nullptr, nullptr);
+        layout.uv[0] = find("u", "s", "texture_u");
+        layout.uv[1] = find("v", "t", "texture_v");
+        layout.normal = (layout.normals[0] >= 0 && layout.normals[1] >= 0 && layout.normals[2] >= 0) ? 0 : -1;
+        layout.texCoords = (layout.uv[0] >= 0 && layout.uv[1] >= 0) ? 0 : -1;
+        return layout.position[0] >= 0 && layout.position[1] >= 0 && layout.position[2] >= 0;
+    }
+
+    // true if the 3 properties are consecutive floats (so they can be copied as a glm::vec3)
+    static bool packedFloats(const Element& element, const int* properties, int n)
+    {
+        for (int i = 0; i < n; i++)
+            if (element.properties[properties[i]].type != PLY_FLOAT32 ||
+                element.properties[properties[i]].offset != element.properties[properties[0]].offset + i * sizeof(GLfloat))
+                return false;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // the vertices are copied from the records, in parallel
+    static void readVertices(const Element& element, const VertexLayout& layout, const unsigned char* records,
+                             vector<Vertex>& vertices, unsigned int numThreads)
+    {
+        const vector<Property>& properties = element.properties;
+        size_t recordSize = element.recordSize;
+        bool packedPosition = packedFloats(element, layout.position, 3);
+        bool packedNormal = layout.normal >= 0 && packedFloats(element, layout.normals, 3);
+        auto readVector = [&](const unsigned char* record, const int* indices, int n, bool packed, GLfloat* out)
+        {
+            if (packed)
+                memcpy(out, record + properties[indices[0]].offset, n * sizeof(GLfloat));
+            else
+                for (int i = 0; i < n; i++)
+                    out[i] = readFloat(properties[indices[i]].type, record + properties[indices[i]].offset);
+        };
+
+        ParallelFor(vertices.size(), [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                const unsigned char* record = records + v * recordSize;
+                Vertex& vertex = vertices[v];
+                readVector(record, layout.position, 3, packedPosition, &vertex.Position.x);
+                if (layout.normal >= 0)
+                    readVector(record, layout.normals, 3, packedNormal, &vertex.Normal.x);
+                else
+                    vertex.Normal = glm::vec3(0.0f);
+                if (layout.texCoords >= 0)
+                {
+                    readVector(record, layout.uv, 2, false, &vertex.TexCoords.x);
+                    // the texture coordinates are flipped (aiProcess_FlipUVs)
+                    vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+                }
+                else
+                    vertex.TexCoords = glm::vec2(0.0f);
+                vertex.Sm_Normal = glm::vec3(0.0f);
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+            }
+        }, ParallelChunks(vertices.size(), numThreads));
+    }
+};
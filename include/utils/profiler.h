@@ -0,0 +1,527 @@
+/*
+Profiler class
+- CPU time of the frames and of the rendering passes (std::chrono)
+- GPU time of the rendering passes (timer queries with GL_TIME_ELAPSED)
+- counters of draw calls, triangles, uniform uploads, culled and occluded objects per frame
+- named counters of the samples which pass the depth test (occlusion queries with GL_SAMPLES_PASSED), e.g. to measure the fragments shaded in a pass
+- rolling percentiles (p50/p95/p99) over the last frames, and export of a trace in the Chrome trace format
+
+A pass is the code between BeginPass(name) and EndPass() (e.g., the rendering of a model): the CPU time measures the submission
+of the commands, while the GPU time measures their execution. The comparison of the two shows if the application is limited by
+the CPU (e.g., the rendering loop) or by the GPU (e.g., the cost of a shader subroutine).
+
+GPU timers:
+the result of a query is available only when the GPU has executed the commands, some frames after their submission.
+To avoid waiting for the GPU, the queries of each frame are stored in a ring of PROFILER_LATENCY frames, and the results of a frame
+are read when its slot is reused (= PROFILER_LATENCY frames later). The results of the last frames are read by Finish().
+
+Chrome trace:
+WriteTrace() saves a JSON file which can be opened in chrome://tracing or https://ui.perfetto.dev. The CPU passes are on thread 0,
+the GPU passes on thread 1, aligned to the submission of the corresponding CPU pass (GL_TIME_ELAPSED measures durations only).
+
+Sample counters:
+the samples of the draw calls between BeginSamples(name) and EndSamples() are added to the counter with that name; the sums of the frame
+are read with the same latency of the timer queries. The GL_SAMPLES_PASSED queries are independent from the timer queries, so they can be
+used inside and across the passes.
+
+N.B. 1) GL_TIME_ELAPSED queries cannot be nested: passes must not overlap (and the same holds for the sample counters).
+N.B. 2) the queries are created at the first pass, so the Profiler can be created before the OpenGL context. If the profiler is
+disabled, all the methods return immediately.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+// number of frames between the submission of a timer query and the reading of its result
+const GLuint PROFILER_LATENCY = 4;
+// number of frames considered by the rolling percentiles
+const size_t PROFILER_WINDOW = 240;
+// maximum number of frames saved in the trace
+const size_t PROFILER_MAX_TRACE_FRAMES = 2000;
+
+//////////////////////////////////////////
+// the last values of a measure (in a circular buffer), and their percentiles
+class RollingStats
+{
+public:
+
+    RollingStats(size_t window = PROFILER_WINDOW) : window(window), next(0) {}
+
+    void Add(double value)
+    {
+        if (this->values.size() < this->window)
+            this->values.push_back(value);
+        else
+            this->values[this->next] = value;
+        this->next = (this->next + 1) % this->window;
+    }
+
+    // p in [0, 100]
+    double Percentile(double p) const
+    {
+        if (this->values.empty())
+            return 0.0;
+        vector<double> sorted(this->values);
+        size_t k = min(sorted.size() - 1, (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5));
+        nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+        return sorted[k];
+    }
+
+    double Mean() const
+    {
+        double sum = 0.0;
+        for (double v : this->values)
+            sum += v;
+        return this->values.empty() ? 0.0 : sum / this->values.size();
+    }
+
+    size_t Count() const { return this->values.size(); }
+
+private:
+    size_t window;
+    size_t next;
+    vector<double> values;
+};
+
+/////////////////// PROFILER class ///////////////////////
+class Profiler
+{
+public:
+
+    // counters of the current frame
+    struct Counters
+    {
+        GLuint drawCalls;
+        GLuint64 triangles;
+        GLuint uniformUploads;
+        GLuint culledObjects;
+        GLuint occludedObjects;
+    };
+
+    Profiler(bool enabled = true) noexcept
+        : enabled(enabled), trace(false), frameIndex(0), inFrame(false), currentPass(-1), countingSamples(false)
+    {
+        this->epoch = Clock::now();
+        this->resetCounters();
+    }
+
+    Profiler(const Profiler& copy) = delete;
+    Profiler& operator=(const Profiler& copy) = delete;
+
+    ~Profiler() noexcept
+    {
+        for (FrameSlot& slot : this->slots)
+        {
+            if (!slot.queries.empty())
+                glDeleteQueries((GLsizei)slot.queries.size(), slot.queries.data());
+            if (!slot.sampleQueries.empty())
+                glDeleteQueries((GLsizei)slot.sampleQueries.size(), slot.sampleQueries.data());
+        }
+    }
+
+    bool IsEnabled() const { return this->enabled; }
+    void SetEnabled(bool enabled) { this->enabled = enabled; }
+
+    // if enabled, the passes are saved for WriteTrace() (up to PROFILER_MAX_TRACE_FRAMES frames)
+    void EnableTrace(bool enabled) { this->trace = enabled; }
+
+    //////////////////////////////////////////
+
+    void BeginFrame()
+    {
+        if (!this->enabled)
+            return;
+        if (this->slots.empty())
+            this->slots.resize(PROFILER_LATENCY);
+        // we read the results of the frame which used this slot PROFILER_LATENCY frames ago
+        FrameSlot& slot = this->slots[this->frameIndex % PROFILER_LATENCY];
+        this->collect(slot);
+        slot.passes.clear();
+        slot.samples.clear();
+        slot.frame = this->frameIndex;
+        this->resetCounters();
+        this->frameStart = Clock::now();
+        this->inFrame = true;
+    }
+
+    void EndFrame()
+    {
+        if (!this->enabled || !this->inFrame)
+            return;
+        double cpuMs = this->elapsedMs(this->frameStart, Clock::now());
+        this->frameCpu.Add(cpuMs);
+        this->drawCalls.Add(this->counters.drawCalls);
+        this->triangles.Add((double)this->counters.triangles);
+        this->uniformUploads.Add(this->counters.uniformUploads);
+        this->culledObjects.Add(this->counters.culledObjects);
+        this->occludedObjects.Add(this->counters.occludedObjects);
+        if (this->tracing())
+        {
+            this->addTraceEvent("frame", 0, this->microseconds(this->frameStart), cpuMs * 1000.0);
+            this->addTraceCounters(this->microseconds(this->frameStart));
+        }
+        this->inFrame = false;
+        this->frameIndex++;
+    }
+
+    //////////////////////////////////////////
+
+    void BeginPass(const string& name)
+    {
+        if (!this->enabled || !this->inFrame)
+            return;
+        FrameSlot& slot = this->slots[this->frameIndex % PROFILER_LATENCY];
+        // we create the query objects when a frame has more passes than the previous ones
+        if (slot.passes.size() == slot.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        PassRecord pass;
+        pass.stat = this->passIndex(name);
+        pass.query = slot.queries[slot.passes.size()];
+        pass.cpuStart = Clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, pass.query);
+        slot.passes.push_back(pass);
+        this->currentPass = (int)slot.passes.size() - 1;
+    }
+
+    void EndPass()
+    {
+        if (!this->enabled || this->currentPass < 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        PassRecord& pass = this->slots[this->frameIndex % PROFILER_LATENCY].passes[this->currentPass];
+        pass.cpuMs = this->elapsedMs(pass.cpuStart, Clock::now());
+        this->passes[pass.stat].cpu.Add(pass.cpuMs);
+        this->currentPass = -1;
+    }
+
+    //////////////////////////////////////////
+    // samples which pass the depth test between BeginSamples and EndSamples, added to the counter with the given name
+
+    void BeginSamples(const string& name)
+    {
+        if (!this->enabled || !this->inFrame)
+            return;
+        FrameSlot& slot = this->slots[this->frameIndex % PROFILER_LATENCY];
+        if (slot.samples.size() == slot.sampleQueries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.sampleQueries.push_back(query);
+        }
+        SampleRecord record;
+        record.stat = this->sampleIndex(name);
+        record.query = slot.sampleQueries[slot.samples.size()];
+        glBeginQuery(GL_SAMPLES_PASSED, record.query);
+        slot.samples.push_back(record);
+        this->countingSamples = true;
+    }
+
+    void EndSamples()
+    {
+        if (!this->enabled || !this->countingSamples)
+            return;
+        glEndQuery(GL_SAMPLES_PASSED);
+        this->countingSamples = false;
+    }
+
+    //////////////////////////////////////////
+    // counters of the current frame
+
+    void CountDraw(GLuint drawCalls, GLuint64 triangles)
+    {
+        this->counters.drawCalls += drawCalls;
+        this->counters.triangles += triangles;
+    }
+
+    void CountUniformUploads(GLuint uploads) { this->counters.uniformUploads += uploads; }
+
+    // objects not rendered because they are outside the view frustum
+    void CountCulled(GLuint objects) { this->counters.culledObjects += objects; }
+
+    // objects not rendered because they are hidden by the occluders (see occlusion.h)
+    void CountOccluded(GLuint objects) { this->counters.occludedObjects += objects; }
+
+    //////////////////////////////////////////
+
+    // it reads the results of all the pending queries (e.g., before printing the final report)
+    void Finish()
+    {
+        for (GLuint i = 0; i < this->slots.size(); i++)
+            this->collect(this->slots[(this->frameIndex + i) % PROFILER_LATENCY]);
+    }
+
+    // it prints the percentiles of the frame time, of the passes, and the mean values of the counters
+    void Print(ostream& out = cout) const
+    {
+        if (this->frameCpu.Count() == 0)
+            return;
+        out << fixed << setprecision(3);
+        out << "---- Profiler: last " << this->frameCpu.Count() << " frames (ms: p50 / p95 / p99) ----" << endl;
+        this->printStats(out, "frame (CPU)", this->frameCpu);
+        for (const PassStats& pass : this->passes)
+        {
+            this->printStats(out, pass.name + " (CPU)", pass.cpu);
+            this->printStats(out, pass.name + " (GPU)", pass.gpu);
+        }
+        out << setprecision(0);
+        out << "draw calls/frame: " << this->drawCalls.Mean() << " - triangles/frame: " << this->triangles.Mean()
+            << " - uniform uploads/frame: " << this->uniformUploads.Mean() << " - culled objects/frame: " << this->culledObjects.Mean()
+            << " - occluded objects/frame: " << this->occludedObjects.Mean() << endl;
+        for (const SampleStats& samples : this->sampleCounters)
+            out << "samples/frame (" << samples.name << "): " << samples.samples.Mean() << endl;
+        out.unsetf(ios_base::floatfield);
+        out << setprecision(6);
+    }
+
+    // it saves the trace of the recorded frames in the Chrome trace format
+    bool WriteTrace(const string& path) const
+    {
+        ofstream out(path);
+        if (!out)
+        {
+            cout << "ERROR::PROFILER:: unable to write " << path << endl;
+            return false;
+        }
+        out << "{\"traceEvents\":[\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        out << fixed << setprecision(3);
+        for (const TraceEvent& event : this->events)
+        {
+            out << ",\n{\"name\":\"" << event.name << "\",\"pid\":0,\"tid\":" << event.tid << ",\"ts\":" << event.ts;
+            if (event.counter)
+                out << ",\"ph\":\"C\",\"args\":{\"draw calls\":" << event.drawCalls << ",\"triangles\":" << event.triangles
+                    << ",\"uniform uploads\":" << event.uniformUploads << "}}";
+            else
+                out << ",\"ph\":\"X\",\"dur\":" << event.dur << "}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        return true;
+    }
+
+    // statistics of the frames and of a pass (e.g., for the benchmarks)
+    const RollingStats& FrameCpu() const { return this->frameCpu; }
+
+    const RollingStats* PassGpu(const string& name) const
+    {
+        for (const PassStats& pass : this->passes)
+            if (pass.name == name)
+                return &pass.gpu;
+        return nullptr;
+    }
+
+    // samples per frame of a counter (null if the counter has never been used)
+    const RollingStats* Samples(const string& name) const
+    {
+        for (const SampleStats& samples : this->sampleCounters)
+            if (samples.name == name)
+                return &samples.samples;
+        return nullptr;
+    }
+
+    const Counters& FrameCounters() const { return this->counters; }
+
+private:
+
+    typedef chrono::steady_clock Clock;
+
+    // statistics of all the passes with the same name
+    struct PassStats
+    {
+        string name;
+        RollingStats cpu, gpu;
+    };
+
+    // a pass of a frame, waiting for the result of its query
+    struct PassRecord
+    {
+        size_t stat;
+        GLuint query;
+        Clock::time_point cpuStart;
+        double cpuMs;
+    };
+
+    // samples per frame of all the ranges with the same name
+    struct SampleStats
+    {
+        string name;
+        RollingStats samples;
+    };
+
+    // a range of draw calls of a frame, waiting for the result of its occlusion query
+    struct SampleRecord
+    {
+        size_t stat;
+        GLuint query;
+    };
+
+    // passes, sample ranges and queries of a frame in the ring
+    struct FrameSlot
+    {
+        GLuint64 frame;
+        vector<PassRecord> passes;
+        vector<GLuint> queries;
+        vector<SampleRecord> samples;
+        vector<GLuint> sampleQueries;
+    };
+
+    struct TraceEvent
+    {
+        string name;
+        int tid;
+        double ts, dur;
+        bool counter;
+        GLuint drawCalls, uniformUploads;
+        GLuint64 triangles;
+    };
+
+    bool enabled, trace;
+    GLuint64 frameIndex;
+    bool inFrame;
+    int currentPass;
+    bool countingSamples;
+    Clock::time_point epoch, frameStart;
+    vector<FrameSlot> slots;
+    vector<PassStats> passes;
+    vector<SampleStats> sampleCounters;
+    RollingStats frameCpu, drawCalls, triangles, uniformUploads, culledObjects, occludedObjects;
+    Counters counters;
+    vector<TraceEvent> events;
+
+    //////////////////////////////////////////
+
+    bool tracing() const { return this->trace && this->frameIndex < PROFILER_MAX_TRACE_FRAMES; }
+
+    void resetCounters()
+    {
+        this->counters.drawCalls = 0;
+        this->counters.triangles = 0;
+        this->counters.uniformUploads = 0;
+        this->counters.culledObjects = 0;
+        this->counters.occludedObjects = 0;
+    }
+
+    double elapsedMs(Clock::time_point start, Clock::time_point end) const
+    {
+        return chrono::duration<double, milli>(end - start).count();
+    }
+
+    double microseconds(Clock::time_point t) const
+    {
+        return chrono::duration<double, micro>(t - this->epoch).count();
+    }
+
+    size_t passIndex(const string& name)
+    {
+        for (size_t i = 0; i < this->passes.size(); i++)
+            if (this->passes[i].name == name)
+                return i;
+        PassStats pass;
+        pass.name = name;
+        this->passes.push_back(pass);
+        return this->passes.size() - 1;
+    }
+
+    size_t sampleIndex(const string& name)
+    {
+        for (size_t i = 0; i < this->sampleCounters.size(); i++)
+            if (this->sampleCounters[i].name == name)
+                return i;
+        SampleStats samples;
+        samples.name = name;
+        this->sampleCounters.push_back(samples);
+        return this->sampleCounters.size() - 1;
+    }
+
+    //////////////////////////////////////////
+    // it reads the GPU times of the passes of a frame, and the sums of its sample counters (usually, the results are already available)
+    void collect(FrameSlot& slot)
+    {
+        bool traced = this->trace && slot.frame < PROFILER_MAX_TRACE_FRAMES;
+        for (const PassRecord& pass : slot.passes)
+        {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(pass.query, GL_QUERY_RESULT, &ns);
+            double gpuMs = ns / 1.0e6;
+            this->passes[pass.stat].gpu.Add(gpuMs);
+            if (traced)
+            {
+                double ts = this->microseconds(pass.cpuStart);
+                this->addTraceEvent(this->passes[pass.stat].name, 0, ts, pass.cpuMs * 1000.0);
+                this->addTraceEvent(this->passes[pass.stat].name, 1, ts, gpuMs * 1000.0);
+            }
+        }
+        slot.passes.clear();
+
+        if (slot.samples.empty())
+            return;
+        vector<GLuint64> sums(this->sampleCounters.size(), 0);
+        vector<bool> used(this->sampleCounters.size(), false);
+        for (const SampleRecord& record : slot.samples)
+        {
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(record.query, GL_QUERY_RESULT, &samples);
+            sums[record.stat] += samples;
+            used[record.stat] = true;
+        }
+        for (size_t i = 0; i < sums.size(); i++)
+            if (used[i])
+                this->sampleCounters[i].samples.Add((double)sums[i]);
+        slot.samples.clear();
+    }
+
+    void addTraceEvent(const string& name, int tid, double ts, double dur)
+    {
+        TraceEvent event;
+        event.name = name;
+        event.tid = tid;
+        event.ts = ts;
+        event.dur = dur;
+        event.counter = false;
+        event.drawCalls = event.uniformUploads = 0;
+        event.triangles = 0;
+        this->events.push_back(event);
+    }
+
+    void addTraceCounters(double ts)
+    {
+        TraceEvent event;
+        event.name = "counters";
+        event.tid = 0;
+        event.ts = ts;
+        event.dur = 0.0;
+        event.counter = true;
+        event.drawCalls = this->counters.drawCalls;
+        event.triangles = this->counters.triangles;
+        event.uniformUploads = this->counters.uniformUploads;
+        this->events.push_back(event);
+    }
+
+    void printStats(ostream& out, const string& name, const RollingStats& stats) const
+    {
+        if (stats.Count() == 0)
+            return;
+        out << "  " << left << setw(28) << name << right << setw(9) << stats.Percentile(50.0) << " / "
+            << setw(9) << stats.Percentile(95.0) << " / " << setw(9) << stats.Percentile(99.0) << endl;
+    }
+};
@@ -0,0 +1,144 @@
+/*
+Program Cache - binary cache of a linked Shader Program
+
+The first time a Shader Program is created, the binary produced by the driver after linking (glGetProgramBinary) is saved in a file
+(e.g., "illumination_models_modified_fr.frag.programcache"). In the following runs, the binary is loaded with glProgramBinary,
+skipping the compilation and the linking of the GLSL sources, which can be a noticeable part of the startup time
+(especially with big shaders with many subroutines, and with software rasterizers).
+
+File layout:
+- ProgramCacheHeader
+- the binary of the program, in the format returned by the driver
+
+The cache is used only if:
+- the magic number and the format version match
+- the key stored in the header matches the hash of the GLSL sources plus the vendor, renderer and version strings of the driver:
+  a binary is valid only for the driver which produced it
+- the driver accepts the binary (glProgramBinary may reject it anyway, e.g. after an update of the driver with the same version string):
+  in all the other cases, the Shader Program is compiled from the sources, and the cache is written again
+
+N.B.) like the mesh cache, the file is written in a temporary file, which is then renamed.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <utils/mapped_file.h>
+#include <utils/hash.h>
+
+// magic number and version of the format
+const char PROGRAM_CACHE_MAGIC[8] = {'R','T','G','P','P','R','G','\0'};
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+// extension added to the path of the cache
+const string PROGRAM_CACHE_EXTENSION = ".programcache";
+
+// header of the cache file
+struct ProgramCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    // format of the binary, returned by glGetProgramBinary
+    uint32_t binaryFormat;
+    // hash of the sources and of the driver strings
+    uint64_t key;
+    uint64_t binarySize;
+};
+
+//////////////////////////////////////////
+// key of the cache of a Shader Program: hash of its sources, combined with the vendor, renderer and version strings of the
+// current context. The size of each string is hashed too, so moving text between two sources changes the key
+inline uint64_t ComputeProgramCacheKey(const vector<string>& sources)
+{
+    vector<string> strings(sources);
+    const GLenum names[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : names)
+    {
+        const GLubyte* value = glGetString(name);
+        strings.push_back(value ? string((const char*)value) : string());
+    }
+    uint64_t key = HashBytes(nullptr, 0);
+    for (const string& s : strings)
+    {
+        uint64_t size = s.size();
+        key = HashBytes((const unsigned char*)&size, sizeof(size), key);
+        key = HashBytes((const unsigned char*)s.data(), s.size(), key);
+    }
+    return key;
+}
+
+//////////////////////////////////////////
+// it loads the binary of the cache in the program. It returns false if the cache is not valid or if the driver rejects it
+// (in this case, the program must be deleted, and created again from the sources)
+inline bool LoadProgramBinary(const string& cachePath, uint64_t key, GLuint program)
+{
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    if (numFormats <= 0)
+        return false;
+    MappedFile file(cachePath);
+    if (!file.IsValid() || file.Size() < sizeof(ProgramCacheHeader))
+        return false;
+    ProgramCacheHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if (memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != PROGRAM_CACHE_VERSION ||
+        header.key != key || header.binarySize == 0 || header.binarySize != file.Size() - sizeof(ProgramCacheHeader))
+        return false;
+    glProgramBinary(program, (GLenum)header.binaryFormat, file.Data() + sizeof(ProgramCacheHeader), (GLsizei)header.binarySize);
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success == GL_TRUE;
+}
+
+//////////////////////////////////////////
+// it saves the binary of a linked program (the program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT)
+inline bool SaveProgramBinary(const string& cachePath, uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    vector<unsigned char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return false;
+
+    ProgramCacheHeader header;
+    memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.binaryFormat = format;
+    header.key = key;
+    header.binarySize = (uint64_t)written;
+
+    string tmpPath = cachePath + ".tmp";
+    FILE* out = fopen(tmpPath.c_str(), "wb");
+    if (!out)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = ok && fwrite(binary.data(), 1, (size_t)written, out) == (size_t)written;
+    ok = (fclose(out) == 0) && ok;
+    if (ok)
+    {
+        // rename fails on Windows if the destination exists
+        remove(cachePath.c_str());
+        ok = rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+    }
+    if (!ok)
+        remove(tmpPath.c_str());
+    return ok;
+}
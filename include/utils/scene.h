@@ -0,0 +1,100 @@
+/*
+Scene description
+- SceneObject structure: a model of the scene, with its transformation and its role in the rendering
+- LoadScene function: it reads the list of objects from a text file
+- DefaultScene function: the scene of the application (the plane and the three scanned models)
+
+The scene file has one object for each line (lines starting with # are comments):
+
+    # name     model                              px py pz     sx sy sz      spinning ground
+    plane      ../../models/plane.obj             0  0  0      10 1  10      0        1
+    armadillo  ../../models/armadillo.obj         0  1  0      1  1  1       1        0
+
+- "spinning" objects are rotated around the Y axis by the animated rotation of the application
+- "ground" objects are rendered with the Lambert model and the color of the plane, while the other objects are rendered
+  with the shader subroutine currently selected (the paths of the models are relative to the working directory)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// an object of the scene
+struct SceneObject
+{
+    string name;
+    string modelPath;
+    glm::vec3 position;
+    glm::vec3 scale;
+    bool spinning;
+    bool ground;
+
+    // model matrix of the object, given the current angle (in degrees) of the animated rotation around the Y axis
+    glm::mat4 ModelMatrix(GLfloat orientationY) const
+    {
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), this->position);
+        if (this->spinning)
+            modelMatrix = glm::rotate(modelMatrix, glm::radians(orientationY), glm::vec3(0.0f, 1.0f, 0.0f));
+        return glm::scale(modelMatrix, this->scale);
+    }
+};
+
+//////////////////////////////////////////
+// it reads the objects of the scene from a text file. It returns false if the file cannot be read or if it does not contain objects
+inline bool LoadScene(const string& path, vector<SceneObject>& objects)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "ERROR::SCENE:: unable to open " << path << endl;
+        return false;
+    }
+    objects.clear();
+    string line;
+    while (getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        istringstream values(line);
+        SceneObject object;
+        int spinning, ground;
+        if (values >> object.name >> object.modelPath
+                   >> object.position.x >> object.position.y >> object.position.z
+                   >> object.scale.x >> object.scale.y >> object.scale.z >> spinning >> ground)
+        {
+            object.spinning = (spinning != 0);
+            object.ground = (ground != 0);
+            objects.push_back(object);
+        }
+        else
+            cout << "WARNING::SCENE:: invalid line in " << path << ": " << line << endl;
+    }
+    return !objects.empty();
+}
+
+//////////////////////////////////////////
+// the scene of the application: a plane under the armadillo, the bunny and the dragon
+inline vector<SceneObject> DefaultScene(const string& modelsPath = "../../models/")
+{
+    SceneObject plane     = {"plane",     modelsPath + "plane.obj",           glm::vec3(0.0f, 0.0f, 0.0f),  glm::vec3(10.0f, 1.0f, 10.0f), false, true};
+    SceneObject armadillo = {"armadillo", modelsPath + "armadillo.obj",       glm::vec3(0.0f, 1.0f, 0.0f),  glm::vec3(1.0f),               true,  false};
+    SceneObject bunny     = {"bunny",     modelsPath + "stanford-bunny.obj",  glm::vec3(-4.0f, 1.5f, 0.0f), glm::vec3(0.006f),             true,  false};
+    SceneObject dragon    = {"dragon",    modelsPath + "stanford-dragon.obj", glm::vec3(4.0f, 0.0f, 0.0f),  glm::vec3(0.3f),               true,  false};
+    return vector<SceneObject>{plane, armadillo, bunny, dragon};
+}
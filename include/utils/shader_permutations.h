@@ -0,0 +1,92 @@
+/*
+ShaderPermutations class - a specialized Shader Program for each value of a selector macro
+
+The illumination models of MyProject are selected with a subroutine uniform: the call through the subroutine is indirect, so the
+driver usually cannot inline the selected model, and it cannot fold the parameters or remove the code which is not used.
+Here, the same sources are compiled once for each model, with the macro selector defined as the name of the model
+(e.g., "#define ILLUMINATION_MODEL BlinnPhong", see N.B. 4 in illumination_models_modified_fr.frag): each program calls a single
+function directly, and the application switches model by switching program (glUseProgram) instead of calling glUniformSubroutinesuiv.
+The common macros (e.g., the parameters declared as constants, see MaterialParameterConstants) are added to all the programs.
+
+With a binary cache, each program has its own cache file (the prefix followed by the value of the selector), so the compilation
+of all the permutations is paid only at the first run.
+
+N.B.) the uniforms are part of the state of each program: their locations, and the values set by the application, are different for
+each permutation.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+
+#include <utils/shader_v1.h>
+#include <utils/program_cache.h>
+
+/////////////////// SHADERPERMUTATIONS class ///////////////////////
+class ShaderPermutations
+{
+public:
+
+    //////////////////////////////////////////
+    // it compiles a program for each value of the selector macro, with the common macros ("NAME VALUE", see Shader).
+    // If cachePrefix is not empty, the binary of the program of value v is cached in cachePrefix + "." + v + PROGRAM_CACHE_EXTENSION
+    ShaderPermutations(const GLchar* vertexPath, const GLchar* fragmentPath, const string& selector, const vector<string>& values,
+                       const vector<string>& defines = vector<string>(), const string& cachePrefix = "")
+        : values(values)
+    {
+        this->programs.reserve(values.size());
+        for (const string& value : values)
+        {
+            vector<string> permutation(defines);
+            permutation.push_back(selector + " " + value);
+            string cachePath = cachePrefix.empty() ? string() : cachePrefix + "." + value + PROGRAM_CACHE_EXTENSION;
+            this->programs.emplace_back(vertexPath, fragmentPath, cachePath, permutation);
+        }
+    }
+
+    // number of programs, and program of a value (in the order of the values passed to the constructor)
+    size_t Size() const { return this->programs.size(); }
+    Shader& operator[](size_t i) { return this->programs[i]; }
+    const Shader& operator[](size_t i) const { return this->programs[i]; }
+    const string& Value(size_t i) const { return this->values[i]; }
+
+    // index of the program of a value (-1 if not present)
+    GLint Find(const string& value) const
+    {
+        for (size_t i = 0; i < this->values.size(); i++)
+            if (this->values[i] == value)
+                return (GLint)i;
+        return -1;
+    }
+
+    // number of programs loaded from the binary cache
+    size_t NumLoadedFromCache() const
+    {
+        size_t count = 0;
+        for (const Shader& program : this->programs)
+            count += program.LoadedFromCache() ? 1 : 0;
+        return count;
+    }
+
+    // like Shader, the programs are deleted explicitly
+    void Delete()
+    {
+        for (Shader& program : this->programs)
+            program.Delete();
+    }
+
+private:
+
+    vector<string> values;
+    vector<Shader> programs;
+};
@@ -2,7 +2,18 @@
 Shader class - v1
 - loading Shader source code, Shader Program creation
 
-N.B. ) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/shader.h
+N.B. 1) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/shader.h
+
+N.B. 2) after linking, the locations of all the active uniforms and the indices of all the subroutines are retrieved once,
+and stored in the class. In the rendering loop, the application should read them once (e.g., before the loop)
+instead of calling glGetUniformLocation/glGetSubroutineIndex at every frame.
+
+N.B. 3) if the path of a cache file is given, the binary of the linked Shader Program is saved in it, and it is loaded in the following
+runs instead of compiling the sources (see program_cache.h). If the cache is missing or not valid (different sources or driver),
+the Shader Program is compiled from the sources as usual.
+
+N.B. 4) a list of macros can be defined in both the shaders: each element "NAME VALUE" (or "NAME") is inserted as "#define NAME VALUE"
+after the #version directive. This allows to compile specialized versions of the same sources (see shader_permutations.h).
 
 author: Davide Gadia
 
@@ -20,6 +31,10 @@ using namespace std;
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include <utils/program_cache.h>
 
 /////////////////// SHADER class ///////////////////////
 class Shader
@@ -29,8 +44,9 @@ public:
 
     //////////////////////////////////////////
 
-    //constructor
-    Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
+    //constructor (cachePath is the binary cache of the Shader Program: if empty, the cache is not used; defines are the macros added to the sources)
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const string& cachePath = "", const vector<string>& defines = vector<string>())
+        : fromCache(false)
     {
         // Step 1: we retrieve shaders source code from provided filepaths
         string vertexCode;
@@ -61,12 +77,34 @@ public:
         {
             cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
         }
+        // the macros are part of the sources, so they are part of the key of the cache too
+        if (!defines.empty())
+        {
+            vertexCode = injectDefines(vertexCode, defines);
+            fragmentCode = injectDefines(fragmentCode, defines);
+        }
+
+        // Step 2: if available, we load the binary of the Shader Program saved by a previous run
+        uint64_t cacheKey = 0;
+        if (!cachePath.empty())
+        {
+            cacheKey = ComputeProgramCacheKey({ vertexCode, fragmentCode });
+            this->Program = glCreateProgram();
+            this->fromCache = LoadProgramBinary(cachePath, cacheKey, this->Program);
+            if (this->fromCache)
+            {
+                this->introspect();
+                return;
+            }
+            // a program rejected by glProgramBinary is created again from the sources
+            glDeleteProgram(this->Program);
+        }
 
         // Convert strings to char pointers
         const GLchar* vShaderCode = vertexCode.c_str();
         const GLchar * fShaderCode = fragmentCode.c_str();
 
-        // Step 2: we compile the shaders
+        // Step 3: we compile the shaders
         GLuint vertex, fragment;
 
         // Vertex Shader
@@ -83,28 +121,137 @@ public:
         // check compilation errors
         checkCompileErrors(fragment, "FRAGMENT");
 
-        // Step 3: Shader Program creation
+        // Step 4: Shader Program creation
         this->Program = glCreateProgram();
         glAttachShader(this->Program, vertex);
         glAttachShader(this->Program, fragment);
+        // the binary of the program must be requested before linking
+        if (!cachePath.empty())
+            glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(this->Program);
         // check linking errors
         checkCompileErrors(this->Program, "PROGRAM");
 
-        // Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
+        // Step 5: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        // Step 6: we save the binary of the program in the cache (only if the linking was successful)
+        GLint linked = GL_FALSE;
+        glGetProgramiv(this->Program, GL_LINK_STATUS, &linked);
+        if (!cachePath.empty() && linked == GL_TRUE && !SaveProgramBinary(cachePath, cacheKey, this->Program))
+            cout << "WARNING::SHADER::PROGRAM_CACHE_NOT_SAVED: " << cachePath << endl;
+
+        // Step 7: we retrieve the locations of the uniforms and the indices of the subroutines
+        this->introspect();
     }
 
     //////////////////////////////////////////
 
+    // true if the Shader Program has been loaded from the binary cache
+    bool LoadedFromCache() const { return this->fromCache; }
+
     // We activate the Shader Program as part of the current rendering process
     void Use() { glUseProgram(this->Program); }
 
     // We delete the Shader Program when application closes
     void Delete() { glDeleteProgram(this->Program); }
 
+    //////////////////////////////////////////
+
+    // location of an active uniform (-1 if the uniform is not used by the Shader Program, or if it is inside a uniform block)
+    GLint UniformLocation(const string& name) const
+    {
+        auto it = this->uniformLocations.find(name);
+        return it != this->uniformLocations.end() ? it->second : -1;
+    }
+
+    // index of a subroutine in a shader stage (GL_INVALID_INDEX if not present)
+    GLuint SubroutineIndex(GLenum stage, const string& name) const
+    {
+        const unordered_map<string, GLuint>& indices = (stage == GL_VERTEX_SHADER) ? this->vertexSubroutines : this->fragmentSubroutines;
+        auto it = indices.find(name);
+        return it != indices.end() ? it->second : GL_INVALID_INDEX;
+    }
+
+    // it connects a uniform block of the Shader Program to a binding point (where a uniform buffer is bound, see uniform_buffer.h)
+    // it returns the size of the block in bytes (0 if the block is not present)
+    GLint BindUniformBlock(const string& blockName, GLuint bindingPoint) const
+    {
+        GLuint blockIndex = glGetUniformBlockIndex(this->Program, blockName.c_str());
+        if (blockIndex == GL_INVALID_INDEX)
+            return 0;
+        glUniformBlockBinding(this->Program, blockIndex, bindingPoint);
+        GLint size = 0;
+        glGetActiveUniformBlockiv(this->Program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        return size;
+    }
+
 private:
+
+    bool fromCache;
+
+    // locations of the active uniforms and indices of the subroutines, retrieved after linking
+    unordered_map<string, GLint> uniformLocations;
+    unordered_map<string, GLuint> vertexSubroutines;
+    unordered_map<string, GLuint> fragmentSubroutines;
+
+    //////////////////////////////////////////
+
+    // it retrieves the locations of all the active uniforms, and the indices of all the subroutines of the vertex and fragment shaders
+    void introspect()
+    {
+        GLint count = 0;
+        GLchar name[256];
+        GLsizei length;
+
+        glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(this->Program, i, 256, &length, &size, &type, name);
+            GLint location = glGetUniformLocation(this->Program, name);
+            // uniforms inside a block have no location
+            if (location < 0)
+                continue;
+            string uniformName(name, length);
+            this->uniformLocations[uniformName] = location;
+            // arrays are reported as "name[0]": we store also "name"
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+                this->uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+        }
+
+        const GLenum stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+        for (GLenum stage : stages)
+        {
+            unordered_map<string, GLuint>& indices = (stage == GL_VERTEX_SHADER) ? this->vertexSubroutines : this->fragmentSubroutines;
+            glGetProgramStageiv(this->Program, stage, GL_ACTIVE_SUBROUTINES, &count);
+            for (GLint i = 0; i < count; i++)
+            {
+                glGetActiveSubroutineName(this->Program, stage, i, 256, &length, name);
+                indices[string(name, length)] = (GLuint)i;
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+
+    // it inserts the macros after the line of the #version directive (which must be the first directive of a GLSL source)
+    static string injectDefines(const string& code, const vector<string>& defines)
+    {
+        string lines;
+        for (const string& define : defines)
+            lines += "#define " + define + "\n";
+        size_t version = code.find("#version");
+        while (version != string::npos && version > 0 && code[version - 1] != '\n')
+            version = code.find("#version", version + 1);
+        size_t end = version == string::npos ? string::npos : code.find('\n', version);
+        if (end == string::npos)
+            return code + "\n" + lines;
+        return code.substr(0, end + 1) + lines + code.substr(end + 1);
+    }
+
     //////////////////////////////////////////
 
     // Check compilation and linking errors
@@ -0,0 +1,335 @@
+/*
+ShadowCache class - cube shadow map of a point light, with a cache of the static casters
+
+The shadow map of a point light is a cube map: each face is rendered with a 90 degrees perspective projection from the position
+of the light, and it stores the distance of the nearest caster from the light (divided by the far plane, so in [0, 1]).
+Most of the casters of the scene do not move, so rendering all of them in the 6 faces at each frame would double the cost of the geometry.
+We keep two cube maps:
+- the static cache, with only the static casters: a face is rendered again only when it is invalidated, because the light has moved
+  (SetLight: all the faces) or because a static object inside the face has changed (Invalidate: the faces whose frustum intersects its bounds)
+- the shadow map read by the shaders: at each frame, the faces which contain a dynamic caster (e.g., a spinning object) are copied from
+  the static cache (glBlitFramebuffer of the depth), and the dynamic casters are rendered on top of them, with the depth test.
+  The faces which do not contain dynamic casters, now or in the previous frame, are not touched
+So the cost of a frame is the copy and the dynamic casters of the faces they touch, and the static casters are rendered only after
+an invalidation. The rendering of the casters is done by the application (the callbacks of Update), which knows the objects and the program.
+
+The shadow map is sampled with a samplerCubeShadow: the comparison with the distance of the fragment is done by the texture unit, and with
+linear filtering the results of the 4 nearest texels are interpolated (percentage-closer filtering).
+
+Statistics: the number of frames (Update), the frames in which the static cache has been invalidated (so the rate of invalidation is
+the fraction of frames which had to render the static casters), and the faces rendered with the static and with the dynamic casters.
+
+N.B. 1) the faces use the orientation of the cube map faces of OpenGL, so the direction from the light to a point is the lookup vector
+
+N.B. 2) Update saves and restores the framebuffer, the viewport and the polygon mode (the shadow map is always rendered filled)
+
+N.B. 3) the cube maps are created at the first Update, so the object can be created before the OpenGL context, and it does not allocate
+the cube maps if the shadows are never activated. Like Mesh, ShadowCache is a "move-only" class, in charge of releasing the allocated
+GPU resources (RAII)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <iostream>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <utils/bounds.h>
+#include <utils/frustum.h>
+
+// default size in pixels of the faces, and distances of the near and far planes from the light
+const GLsizei SHADOW_MAP_DEFAULT_SIZE = 1024;
+const GLfloat SHADOW_MAP_DEFAULT_NEAR = 0.1f;
+const GLfloat SHADOW_MAP_DEFAULT_FAR = 50.0f;
+// texture unit of the shadow map (after the texture buffers of the clustered lights, see light_clusters.h)
+const GLuint SHADOW_TEXTURE_UNIT = 11;
+// mask of the 6 faces
+const GLuint SHADOW_ALL_FACES = 0x3F;
+
+/////////////////// SHADOWCACHE class ///////////////////////
+class ShadowCache
+{
+public:
+
+    ShadowCache(GLsizei size = SHADOW_MAP_DEFAULT_SIZE, GLfloat near = SHADOW_MAP_DEFAULT_NEAR, GLfloat far = SHADOW_MAP_DEFAULT_FAR) noexcept
+        : size(size), near(near), far(far), light(0.0f), staticDirty(SHADOW_ALL_FACES), dynamicFaces(SHADOW_ALL_FACES),
+          frames(0), invalidatedFrames(0), staticFaces(0), dynamicFacesRendered(0)
+    {
+        this->cubeMaps[0] = this->cubeMaps[1] = 0;
+        this->FBOs[0] = this->FBOs[1] = 0;
+        this->computeFaces();
+    }
+
+    ShadowCache(const ShadowCache& copy) = delete;
+    ShadowCache& operator=(const ShadowCache& copy) = delete;
+
+    ShadowCache(ShadowCache&& move) noexcept
+        : ShadowCache(move.size, move.near, move.far)
+    {
+        *this = std::move(move);
+    }
+
+    ShadowCache& operator=(ShadowCache&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->size = move.size;
+        this->near = move.near;
+        this->far = move.far;
+        this->light = move.light;
+        for (GLuint i = 0; i < 2; i++)
+        {
+            this->cubeMaps[i] = move.cubeMaps[i];
+            this->FBOs[i] = move.FBOs[i];
+            move.cubeMaps[i] = move.FBOs[i] = 0;
+        }
+        for (GLuint face = 0; face < 6; face++)
+        {
+            this->faceMatrices[face] = move.faceMatrices[face];
+            this->faceFrustums[face] = move.faceFrustums[face];
+        }
+        this->staticDirty = move.staticDirty;
+        this->dynamicFaces = move.dynamicFaces;
+        this->frames = move.frames;
+        this->invalidatedFrames = move.invalidatedFrames;
+        this->staticFaces = move.staticFaces;
+        this->dynamicFacesRendered = move.dynamicFacesRendered;
+        return *this;
+    }
+
+    ~ShadowCache() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // position of the light (in world coordinates): if it has changed, the static cache is invalidated
+    void SetLight(const glm::vec3& position)
+    {
+        if (position == this->light)
+            return;
+        this->light = position;
+        this->computeFaces();
+        this->InvalidateAll();
+    }
+
+    // the faces which see the bounds (in world coordinates) of a static object that has changed are rendered again at the next Update
+    void Invalidate(const Bounds& bounds)
+    {
+        if (bounds.radius < 0.0f)
+            return;
+        this->staticDirty |= this->facesOf(bounds);
+    }
+
+    void InvalidateAll()
+    {
+        this->staticDirty = SHADOW_ALL_FACES;
+    }
+
+    //////////////////////////////////////////
+    // it updates the shadow map: the invalidated faces of the static cache are rendered with renderStatic, and the faces which see
+    // the bounds of a dynamic caster are composited from the static cache and renderDynamic. The callbacks are called with the face,
+    // the matrix (projection * view) and the frustum of the face, with the framebuffer of the face bound and cleared (or copied)
+    template <typename StaticRenderer, typename DynamicRenderer>
+    void Update(const vector<Bounds>& dynamicCasters, StaticRenderer renderStatic, DynamicRenderer renderDynamic)
+    {
+        if (!this->FBOs[0])
+            this->createMaps();
+        GLint framebuffer, viewport[4], polygonMode[2];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+        glViewport(0, 0, this->size, this->size);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        // static cache
+        this->frames++;
+        if (this->staticDirty)
+            this->invalidatedFrames++;
+        for (GLuint face = 0; face < 6; face++)
+        {
+            if (!(this->staticDirty & (1u << face)))
+                continue;
+            this->bindFace(0, face);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            renderStatic(face, this->faceMatrices[face], this->faceFrustums[face]);
+            this->staticFaces++;
+        }
+
+        // the faces changed in the static cache, and the faces with a dynamic caster now or in the previous frame, are copied in the shadow map
+        GLuint dynamic = 0;
+        for (const Bounds& bounds : dynamicCasters)
+            if (bounds.radius >= 0.0f)
+                dynamic |= this->facesOf(bounds);
+        GLuint refresh = this->staticDirty | dynamic | this->dynamicFaces;
+        for (GLuint face = 0; face < 6; face++)
+        {
+            if (!(refresh & (1u << face)))
+                continue;
+            this->bindFace(0, face);
+            this->bindFace(1, face);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, this->FBOs[0]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBOs[1]);
+            glBlitFramebuffer(0, 0, this->size, this->size, 0, 0, this->size, this->size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            if (dynamic & (1u << face))
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, this->FBOs[1]);
+                renderDynamic(face, this->faceMatrices[face], this->faceFrustums[face]);
+                this->dynamicFacesRendered++;
+            }
+        }
+        this->staticDirty = 0;
+        this->dynamicFaces = dynamic;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+    }
+
+    // the shadow map is bound to its texture unit
+    void Bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubeMaps[1]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // it sets in a Shader Program the texture unit of the shadow map and its far plane (the program is left in use)
+    // N.B.) the samplers of different types must be on different texture units, so the unit must be set also if the shadows are not used
+    void SetupProgram(GLuint program) const
+    {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "shadowMap"), SHADOW_TEXTURE_UNIT);
+        glUniform1f(glGetUniformLocation(program, "shadowFar"), this->far);
+    }
+
+    //////////////////////////////////////////
+
+    const glm::vec3& Light() const { return this->light; }
+    GLfloat Far() const { return this->far; }
+
+    // statistics: frames, frames with an invalidation of the static cache, and faces rendered with the static and the dynamic casters
+    size_t Frames() const { return this->frames; }
+    size_t InvalidatedFrames() const { return this->invalidatedFrames; }
+    size_t StaticFacesRendered() const { return this->staticFaces; }
+    size_t DynamicFacesRendered() const { return this->dynamicFacesRendered; }
+    double InvalidationRate() const { return this->frames > 0 ? (double)this->invalidatedFrames / this->frames : 0.0; }
+
+    void Print(ostream& out = cout) const
+    {
+        double frames = (double)max(this->frames, (size_t)1);
+        out << "shadow cache: invalidated in " << this->invalidatedFrames << " of " << this->frames << " frames ("
+            << 100.0 * this->InvalidationRate() << "%), faces/frame: static " << this->staticFaces / frames
+            << ", dynamic " << this->dynamicFacesRendered / frames << endl;
+    }
+
+private:
+
+    GLsizei size;
+    GLfloat near, far;
+    glm::vec3 light;
+    // static cache (0) and shadow map (1), and their framebuffers
+    GLuint cubeMaps[2];
+    GLuint FBOs[2];
+    // projection * view of the faces, and their frustums
+    glm::mat4 faceMatrices[6];
+    Frustum faceFrustums[6];
+    // faces to render again in the static cache, and faces with dynamic casters in the last Update
+    GLuint staticDirty;
+    GLuint dynamicFaces;
+    // statistics
+    size_t frames, invalidatedFrames, staticFaces, dynamicFacesRendered;
+
+    //////////////////////////////////////////
+
+    // matrices and frustums of the faces, in the order and with the orientation of the faces of the cube maps
+    void computeFaces()
+    {
+        const glm::vec3 directions[6] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                          glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+        const glm::vec3 ups[6] = { glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                                   glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, this->near, this->far);
+        for (GLuint face = 0; face < 6; face++)
+        {
+            this->faceMatrices[face] = projection * glm::lookAt(this->light, this->light + directions[face], ups[face]);
+            this->faceFrustums[face] = Frustum(this->faceMatrices[face]);
+        }
+    }
+
+    // mask of the faces whose frustum intersects the bounds
+    GLuint facesOf(const Bounds& bounds) const
+    {
+        GLuint faces = 0;
+        for (GLuint face = 0; face < 6; face++)
+            if (this->faceFrustums[face].IntersectsSphere(bounds.center, bounds.radius) &&
+                this->faceFrustums[face].IntersectsBox(bounds.boxMin, bounds.boxMax))
+                faces |= 1u << face;
+        return faces;
+    }
+
+    void createMaps()
+    {
+        // the static cache is read only by the copies; the shadow map is read with comparison and linear filtering
+        glGenTextures(2, this->cubeMaps);
+        for (GLuint map = 0; map < 2; map++)
+        {
+            glBindTexture(GL_TEXTURE_CUBE_MAP, this->cubeMaps[map]);
+            for (GLuint face = 0; face < 6; face++)
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, map == 0 ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, map == 0 ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            if (map == 1)
+            {
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+                glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+            }
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        // the filtering does not cross the edges of the faces
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        // depth-only framebuffers: a face of a cube map is attached before each use
+        glGenFramebuffers(2, this->FBOs);
+        for (GLuint map = 0; map < 2; map++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, this->FBOs[map]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X, this->cubeMaps[map], 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                cout << "ERROR::SHADOWCACHE:: Framebuffer is not complete!" << endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // a face of a cube map is attached to its framebuffer, which is bound
+    void bindFace(GLuint map, GLuint face)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBOs[map]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, this->cubeMaps[map], 0);
+    }
+
+    void freeGPUresources()
+    {
+        if (this->FBOs[0])
+        {
+            glDeleteFramebuffers(2, this->FBOs);
+            glDeleteTextures(2, this->cubeMaps);
+        }
+    }
+};
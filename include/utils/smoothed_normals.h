@@ -0,0 +1,246 @@
+/*
+Smoothed Normals - multi-threaded computation of the smoothed surface normal (Sm_Normal) of the vertices of a mesh
+
+The smoothed surface normal of a vertex is the normalized sum of the normals of the faces using that vertex
+(Section 4.2.1 of the reference paper, with sigma = 1).
+
+Two strategies are available:
+- SMOOTHING_DETERMINISTIC: face normals are computed in parallel, then each vertex "gathers" the normals of its faces,
+  using a CSR (Compressed Sparse Row) vertex-to-face adjacency. The faces of each vertex are visited in increasing order,
+  so the sums are performed in the same order of the original serial loop, and the result is bit-for-bit identical to it,
+  independently of the number of threads.
+- SMOOTHING_FACE_RANGES: each thread "scatters" the normals of a range of faces in its own accumulator, and the accumulators
+  are then summed per vertex. It does not need the adjacency, but the order of the sums is different from the serial one,
+  so the result can differ in the last bits.
+
+N.B.) the CSR adjacency is built with a counting sort: first we count the faces of each vertex, then a prefix sum gives the
+offset of the list of each vertex, and finally we fill the lists.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/normal.hpp>
+
+#include <utils/mesh_v1.h>
+#include <utils/parallel.h>
+
+// strategy used to compute the smoothed normals
+enum SmoothingMode {
+    SMOOTHING_DETERMINISTIC,
+    SMOOTHING_FACE_RANGES
+};
+
+/////////////////// VERTEX-FACE ADJACENCY ///////////////////////
+// CSR adjacency: the faces using vertex v are faces[offsets[v]] ... faces[offsets[v+1]-1], in increasing order
+// (a face using the same vertex in more corners appears more times)
+struct VertexFaceAdjacency
+{
+    vector<GLuint> offsets;
+    vector<GLuint> faces;
+
+    //////////////////////////////////////////
+    // it builds the adjacency of a triangle mesh
+    void Build(size_t numVertices, const GLuint* indices, size_t numIndices, unsigned int numThreads = 0)
+    {
+        size_t numFaces = numIndices / 3;
+        unsigned int chunks = ParallelChunks(numFaces, numThreads);
+
+        // Step 1: we count the faces of each vertex
+        vector<atomic<GLuint>> counts(numVertices);
+        for (auto &c : counts)
+            c.store(0, memory_order_relaxed);
+        ParallelFor(numFaces * 3, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                counts[indices[i]].fetch_add(1, memory_order_relaxed);
+        }, chunks);
+
+        // Step 2: the prefix sum of the counts gives the offset of the list of each vertex
+        this->offsets.resize(numVertices + 1);
+        this->offsets[0] = 0;
+        for (size_t v = 0; v < numVertices; v++)
+            this->offsets[v + 1] = this->offsets[v] + counts[v].load(memory_order_relaxed);
+
+        // Step 3: we fill the lists. We reuse the counts as "cursors" inside each list.
+        // The threads fill the lists concurrently, so the faces inside a list can be in any order...
+        for (size_t v = 0; v < numVertices; v++)
+            counts[v].store(this->offsets[v], memory_order_relaxed);
+        this->faces.resize(numFaces * 3);
+        ParallelFor(numFaces * 3, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                this->faces[counts[indices[i]].fetch_add(1, memory_order_relaxed)] = (GLuint)(i / 3);
+        }, chunks);
+
+        // ... and thus we sort each list (they are short, usually around 6 faces), to have a deterministic order
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+                sort(this->faces.begin() + this->offsets[v], this->faces.begin() + this->offsets[v + 1]);
+        }, ParallelChunks(numVertices, numThreads));
+    }
+};
+
+//////////////////////////////////////////
+// it computes the normals of all the faces of a triangle mesh
+inline void ComputeFaceNormals(const Vertex* vertices, const GLuint* indices, size_t numIndices, vector<glm::vec3>& faceNormals, unsigned int numThreads = 0)
+{
+    size_t numFaces = numIndices / 3;
+    faceNormals.resize(numFaces);
+    ParallelFor(numFaces, [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t f = begin; f < end; f++)
+        {
+            // I Compute the face normal using triangleNormal method, that computes normal starting from triangle points
+            faceNormals[f] = glm::triangleNormal(
+                                vertices[indices[3*f]].Position,
+                                vertices[indices[3*f+1]].Position,
+                                vertices[indices[3*f+2]].Position);
+        }
+    }, ParallelChunks(numFaces, numThreads));
+}
+
+//////////////////////////////////////////
+// it computes the smoothed surface normal of each vertex, and it stores it in the Sm_Normal field
+// if numThreads = 0, all the hardware threads are used
+inline void ComputeSmoothedNormals(vector<Vertex>& vertices, const vector<GLuint>& indices, SmoothingMode mode = SMOOTHING_DETERMINISTIC, unsigned int numThreads = 0)
+{
+    size_t numVertices = vertices.size();
+    size_t numFaces = indices.size() / 3;
+    if (numVertices == 0)
+        return;
+
+    vector<glm::vec3> faceNormals;
+    ComputeFaceNormals(vertices.data(), indices.data(), indices.size(), faceNormals, numThreads);
+
+    if (mode == SMOOTHING_DETERMINISTIC)
+    {
+        VertexFaceAdjacency adjacency;
+        adjacency.Build(numVertices, indices.data(), indices.size(), numThreads);
+
+        // each vertex gathers the normals of its faces, starting from the zero vector as in the serial version
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                glm::vec3 sum = glm::vec3();
+                for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+                    sum += faceNormals[adjacency.faces[k]];
+                // NOTE: Sigma parameter, found in Equation 5 of 4.2.1 chapter of the reference paper
+                // ( to control the quantity of convolution kernel used ) is implicitely 1.
+                vertices[v].Sm_Normal = glm::normalize(sum);
+            }
+        }, ParallelChunks(numVertices, numThreads));
+    }
+    else
+    {
+        // each chunk of faces scatters its normals in its own accumulator
+        unsigned int chunks = ParallelChunks(numFaces, numThreads);
+        vector<vector<glm::vec3>> accumulators(chunks);
+        ParallelFor(numFaces, [&](size_t begin, size_t end, unsigned int chunk)
+        {
+            vector<glm::vec3>& acc = accumulators[chunk];
+            acc.assign(numVertices, glm::vec3());
+            for (size_t f = begin; f < end; f++)
+                for (int j = 0; j < 3; j++)
+                    acc[indices[3*f+j]] += faceNormals[f];
+        }, chunks);
+
+        // the accumulators are summed (always in chunk order) and normalized
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t v = begin; v < end; v++)
+            {
+                glm::vec3 sum = glm::vec3();
+                for (unsigned int c = 0; c < chunks; c++)
+                    sum += accumulators[c][v];
+                vertices[v].Sm_Normal = glm::normalize(sum);
+            }
+        }, ParallelChunks(numVertices, numThreads));
+    }
+}
+
+//////////////////////////////////////////
+// it computes the Normal of each vertex as the normalized sum of the normals of its faces, like aiProcess_GenSmoothNormals
+// (used by the native parsers, for the files without normals)
+inline void ComputeVertexNormals(vector<Vertex>& vertices, const vector<GLuint>& indices, unsigned int numThreads = 0)
+{
+    vector<glm::vec3> faceNormals;
+    ComputeFaceNormals(vertices.data(), indices.data(), indices.size(), faceNormals, numThreads);
+    VertexFaceAdjacency adjacency;
+    adjacency.Build(vertices.size(), indices.data(), indices.size(), numThreads);
+    ParallelFor(vertices.size(), [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            glm::vec3 sum = glm::vec3(0.0f);
+            for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+                sum += faceNormals[adjacency.faces[k]];
+            vertices[v].Normal = glm::length(sum) > 0.0f ? glm::normalize(sum) : glm::vec3(0.0f);
+        }
+    }, ParallelChunks(vertices.size(), numThreads));
+}
+
+//////////////////////////////////////////
+// it computes tangents and bitangents from the texture coordinates, like aiProcess_CalcTangentSpace: each vertex sums the
+// directions of its faces, and the sums are made orthogonal to the normal
+inline void ComputeTangentSpace(vector<Vertex>& vertices, const vector<GLuint>& indices, unsigned int numThreads = 0)
+{
+    size_t numFaces = indices.size() / 3;
+    vector<glm::vec3> faceTangents(numFaces), faceBitangents(numFaces);
+    ParallelFor(numFaces, [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t f = begin; f < end; f++)
+        {
+            const Vertex& a = vertices[indices[3*f]];
+            const Vertex& b = vertices[indices[3*f+1]];
+            const Vertex& c = vertices[indices[3*f+2]];
+            glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+            glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+            GLfloat det = d1.x * d2.y - d2.x * d1.y;
+            if (fabs(det) < 1e-12f)
+            {
+                faceTangents[f] = faceBitangents[f] = glm::vec3(0.0f);
+                continue;
+            }
+            GLfloat r = 1.0f / det;
+            faceTangents[f] = (e1 * d2.y - e2 * d1.y) * r;
+            faceBitangents[f] = (e2 * d1.x - e1 * d2.x) * r;
+        }
+    }, ParallelChunks(numFaces, numThreads));
+
+    VertexFaceAdjacency adjacency;
+    adjacency.Build(vertices.size(), indices.data(), indices.size(), numThreads);
+    ParallelFor(vertices.size(), [&](size_t begin, size_t end, unsigned int)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            for (GLuint k = adjacency.offsets[v]; k < adjacency.offsets[v + 1]; k++)
+            {
+                tangent += faceTangents[adjacency.faces[k]];
+                bitangent += faceBitangents[adjacency.faces[k]];
+            }
+            glm::vec3 n = vertices[v].Normal;
+            tangent -= n * glm::dot(n, tangent);
+            bitangent -= n * glm::dot(n, bitangent);
+            vertices[v].Tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(0.0f);
+            vertices[v].Bitangent = glm::length(bitangent) > 0.0f ? glm::normalize(bitangent) : glm::vec3(0.0f);
+        }
+    }, ParallelChunks(vertices.size(), numThreads));
+}
@@ -0,0 +1,102 @@
+/*
+UniformBuffer class
+- a Uniform Buffer Object (UBO) containing a C++ structure, shared by the Shader Programs which declare a corresponding uniform block
+
+The structure must follow the std140 layout rules of the block declared in the shaders (https://www.khronos.org/opengl/wiki/Interface_Block_(GLSL)#Memory_layout):
+the simplest way is to declare each vec3 followed by a float, so that every group of 16 bytes is aligned to 16 bytes.
+
+The class keeps a copy of the last uploaded data: Update() compares the new data with it, and it calls glBufferSubData only if something changed.
+In this way, the application can call Update() at each frame, but the data are sent to the GPU only when a parameter is modified.
+
+N.B.) like Mesh, UniformBuffer is a "move-only" class, in charge of releasing the allocated GPU buffer (RAII)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <cstring>
+
+/////////////////// UNIFORMBUFFER class ///////////////////////
+template <typename T>
+class UniformBuffer
+{
+public:
+
+    // it creates the buffer and binds it to a binding point (the same used in Shader::BindUniformBlock)
+    UniformBuffer(GLuint bindingPoint) noexcept
+        : bindingPoint(bindingPoint), uploaded(false)
+    {
+        glGenBuffers(1, &this->UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        this->Bind();
+    }
+
+    UniformBuffer(const UniformBuffer& copy) = delete;
+    UniformBuffer& operator=(const UniformBuffer& copy) = delete;
+
+    UniformBuffer(UniformBuffer&& move) noexcept
+        : UBO(move.UBO), bindingPoint(move.bindingPoint), data(move.data), uploaded(move.uploaded)
+    {
+        move.UBO = 0;
+    }
+
+    UniformBuffer& operator=(UniformBuffer&& move) noexcept
+    {
+        this->freeGPUresources();
+        this->UBO = move.UBO;
+        this->bindingPoint = move.bindingPoint;
+        this->data = move.data;
+        this->uploaded = move.uploaded;
+        move.UBO = 0;
+        return *this;
+    }
+
+    ~UniformBuffer() noexcept
+    {
+        this->freeGPUresources();
+    }
+
+    //////////////////////////////////////////
+
+    // it binds the buffer to its binding point
+    void Bind() const { glBindBufferBase(GL_UNIFORM_BUFFER, this->bindingPoint, this->UBO); }
+
+    // it uploads the data only if they are different from the last uploaded ones. It returns true if an upload happened
+    bool Update(const T& newData)
+    {
+        if (this->uploaded && memcmp(&this->data, &newData, sizeof(T)) == 0)
+            return false;
+        this->data = newData;
+        this->uploaded = true;
+        glBindBuffer(GL_UNIFORM_BUFFER, this->UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &this->data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        return true;
+    }
+
+    const T& Data() const { return this->data; }
+
+private:
+
+    GLuint UBO;
+    GLuint bindingPoint;
+    // copy of the last uploaded data
+    T data;
+    bool uploaded;
+
+    void freeGPUresources()
+    {
+        if (this->UBO)
+            glDeleteBuffers(1, &this->UBO);
+    }
+};
@@ -0,0 +1,413 @@
+/*
+VertexFormat - configurable layout of the vertex data uploaded in the VBO of a Mesh
+
+The Vertex structure (mesh_v1.h) stores all the attributes as 32 bit floats (68 bytes per vertex), but the shaders usually
+read only some of them. A VertexFormat describes:
+- which attributes are uploaded (e.g., only the ones used by a Shader Program, see AttributesUsedBy)
+- how positions are stored: 32 bit floats, half floats, or 16 bit unsigned normalized integers relative to the bounding box of the mesh
+- how normals, smoothed normals, tangents and bitangents are stored: 32 bit floats, or octahedral-encoded in 2 x 16 bit signed normalized integers
+  (see "A Survey of Efficient Representations for Independent Unit Vectors", Cigolle et al., JCGT 2014)
+
+Attributes keep the same locations of the full layout (0 = position, 1 = normal, 2 = smoothed normal, ...), and they are
+interleaved in a single VBO. With the compact format (UNORM16 positions, octahedral normals), a vertex with position,
+normal and smoothed normal takes 16 bytes instead of 68.
+
+The data needed to decode the attributes in the vertex shader (scale and offset of the positions, and a flag for the octahedral
+normals) are stored in the VAO of each mesh, as two "constant" attributes (locations 6 and 7): they are read from a small buffer,
+with a divisor higher than any instance count, so every vertex of every instance reads the same value.
+In this way, the meshes with different formats can be rendered with the same shaders, without setting any uniform.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <utils/parallel.h>
+
+// attributes of the Vertex structure. The bit position is also the location of the attribute in the shaders
+enum VertexAttribute {
+    ATTRIB_POSITION  = 1 << 0,
+    ATTRIB_NORMAL    = 1 << 1,
+    ATTRIB_SM_NORMAL = 1 << 2,
+    ATTRIB_TEXCOORDS = 1 << 3,
+    ATTRIB_TANGENT   = 1 << 4,
+    ATTRIB_BITANGENT = 1 << 5,
+    ATTRIB_ALL       = (1 << 6) - 1
+};
+const GLuint NUM_VERTEX_ATTRIBUTES = 6;
+
+// locations of the attributes with the decoding parameters
+const GLuint DECODE_SCALE_LOCATION = 6;
+const GLuint DECODE_OFFSET_LOCATION = 7;
+// location of the per-vertex curvatures (in a separate buffer, see curvature.h)
+const GLuint CURVATURE_LOCATION = 15;
+
+// encodings of the positions
+enum PositionEncoding {
+    POSITION_FLOAT32,
+    POSITION_HALF,
+    POSITION_UNORM16
+};
+
+// encodings of the unit vectors (normal, smoothed normal, tangent, bitangent)
+enum NormalEncoding {
+    NORMAL_FLOAT32,
+    NORMAL_OCT16
+};
+
+/////////////////// VERTEXFORMAT class ///////////////////////
+struct VertexFormat
+{
+    // bitmask of VertexAttribute values
+    GLuint attributes;
+    PositionEncoding positionEncoding;
+    NormalEncoding normalEncoding;
+
+    // default format: all the attributes, as 32 bit floats (= the Vertex structure)
+    VertexFormat() : attributes(ATTRIB_ALL), positionEncoding(POSITION_FLOAT32), normalEncoding(NORMAL_FLOAT32) {}
+
+    VertexFormat(GLuint attributes, PositionEncoding positionEncoding, NormalEncoding normalEncoding)
+        : attributes(attributes | ATTRIB_POSITION), positionEncoding(positionEncoding), normalEncoding(normalEncoding) {}
+
+    // compact format: 16 bit normalized positions and octahedral normals
+    static VertexFormat Compact(GLuint attributes = ATTRIB_POSITION | ATTRIB_NORMAL | ATTRIB_SM_NORMAL)
+    {
+        return VertexFormat(attributes, POSITION_UNORM16, NORMAL_OCT16);
+    }
+
+    bool operator==(const VertexFormat& other) const
+    {
+        return this->attributes == other.attributes && this->positionEncoding == other.positionEncoding && this->normalEncoding == other.normalEncoding;
+    }
+    bool operator!=(const VertexFormat& other) const { return !(*this == other); }
+
+    // true if the format is exactly the layout of the Vertex structure (the data can be uploaded without conversions)
+    bool IsFullLayout() const { return *this == VertexFormat(); }
+
+    bool Has(VertexAttribute attribute) const { return (this->attributes & attribute) != 0; }
+
+    //////////////////////////////////////////
+    // size in bytes of each attribute in the VBO (0 if the attribute is not present)
+    GLsizei AttributeSize(GLuint location) const
+    {
+        if (!(this->attributes & (1u << location)))
+            return 0;
+        switch (location)
+        {
+            // 16 bit positions are padded to 4 components, to keep the attributes aligned to 4 bytes
+            case 0: return this->positionEncoding == POSITION_FLOAT32 ? 3 * sizeof(GLfloat) : 4 * sizeof(GLushort);
+            case 3: return 2 * sizeof(GLfloat);
+            default: return this->normalEncoding == NORMAL_FLOAT32 ? 3 * sizeof(GLfloat) : 2 * sizeof(GLshort);
+        }
+    }
+
+    // offset in bytes of an attribute inside the vertex
+    GLsizei AttributeOffset(GLuint location) const
+    {
+        if (this->IsFullLayout())
+            return fullLayoutOffset(location);
+        GLsizei offset = 0;
+        for (GLuint i = 0; i < location; i++)
+            offset += this->AttributeSize(i);
+        return offset;
+    }
+
+    // size in bytes of a vertex
+    GLsizei Stride() const
+    {
+        if (this->IsFullLayout())
+            return sizeof(Vertex);
+        return this->AttributeOffset(NUM_VERTEX_ATTRIBUTES);
+    }
+
+    //////////////////////////////////////////
+    // it sets the pointers to the attributes in the currently bound VAO (the VBO must be bound to GL_ARRAY_BUFFER)
+    void SetupAttributes() const
+    {
+        for (GLuint location = 0; location < NUM_VERTEX_ATTRIBUTES; location++)
+        {
+            if (!(this->attributes & (1u << location)))
+            {
+                glDisableVertexAttribArray(location);
+                continue;
+            }
+            this->SetupAttribute(location, this->Stride(), this->AttributeOffset(location));
+        }
+    }
+
+    // it sets the pointer to an attribute in the currently bound VAO, reading from the buffer bound to GL_ARRAY_BUFFER
+    // with the given stride and offset (e.g., from a separate stream with only that attribute, where stride = AttributeSize)
+    void SetupAttribute(GLuint location, GLsizei stride, GLintptr offset) const
+    {
+        glEnableVertexAttribArray(location);
+        if (location == 0)
+        {
+            if (this->positionEncoding == POSITION_FLOAT32)
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+            else if (this->positionEncoding == POSITION_HALF)
+                glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+            else
+                glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offset);
+        }
+        else if (location == 3)
+            glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+        else if (this->normalEncoding == NORMAL_FLOAT32)
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+        else
+            // the shader receives vec3(x, y, 0), and it decodes the octahedral coordinates
+            glVertexAttribPointer(location, 2, GL_SHORT, GL_TRUE, stride, (GLvoid*)offset);
+    }
+
+    //////////////////////////////////////////
+    // it uploads the decoding parameters in a buffer, and it sets them as "constant" attributes of the currently bound VAO:
+    // the divisor is higher than any instance count, so all the vertices of all the instances read the first element
+    static void SetupDecodeAttributes(GLuint buffer, const glm::vec4 decode[2])
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(glm::vec4), decode, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(DECODE_SCALE_LOCATION);
+        glVertexAttribPointer(DECODE_SCALE_LOCATION, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+        glVertexAttribDivisor(DECODE_SCALE_LOCATION, 0xFFFFFFFFu);
+        glEnableVertexAttribArray(DECODE_OFFSET_LOCATION);
+        glVertexAttribPointer(DECODE_OFFSET_LOCATION, 4, GL_FLOAT, GL_FALSE, 0, (GLvoid*)sizeof(glm::vec4));
+        glVertexAttribDivisor(DECODE_OFFSET_LOCATION, 0xFFFFFFFFu);
+    }
+
+    //////////////////////////////////////////
+    // it converts the vertices to this format. decode[0] and decode[1] receive the values of the decoding attributes:
+    // decode[0] = (scale of the positions, 1 if normals are octahedral), decode[1] = (offset of the positions, 0)
+    void Pack(const Vertex* vertices, size_t numVertices, vector<unsigned char>& data, glm::vec4 decode[2]) const
+    {
+        // bounding box of the positions, used by the normalized encoding
+        glm::vec3 minPos(0.0f), maxPos(0.0f);
+        if (numVertices > 0)
+            minPos = maxPos = vertices[0].Position;
+        for (size_t i = 1; i < numVertices; i++)
+        {
+            minPos = glm::min(minPos, vertices[i].Position);
+            maxPos = glm::max(maxPos, vertices[i].Position);
+        }
+        glm::vec3 scale(1.0f), offset(0.0f);
+        if (this->positionEncoding == POSITION_UNORM16)
+        {
+            scale = maxPos - minPos;
+            offset = minPos;
+        }
+        decode[0] = glm::vec4(scale, this->normalEncoding == NORMAL_OCT16 ? 1.0f : 0.0f);
+        decode[1] = glm::vec4(offset, 0.0f);
+
+        GLsizei stride = this->Stride();
+        data.resize(numVertices * stride);
+        GLsizei offsets[NUM_VERTEX_ATTRIBUTES];
+        for (GLuint l = 0; l < NUM_VERTEX_ATTRIBUTES; l++)
+            offsets[l] = this->AttributeOffset(l);
+
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned char* out = &data[i * stride];
+                const Vertex& v = vertices[i];
+                this->packPosition(v.Position, scale, offset, out + offsets[0]);
+                if (this->Has(ATTRIB_NORMAL))    this->packUnitVector(v.Normal, out + offsets[1]);
+                if (this->Has(ATTRIB_SM_NORMAL)) this->packUnitVector(v.Sm_Normal, out + offsets[2]);
+                if (this->Has(ATTRIB_TEXCOORDS)) memcpy(out + offsets[3], &v.TexCoords, sizeof(glm::vec2));
+                if (this->Has(ATTRIB_TANGENT))   this->packUnitVector(v.Tangent, out + offsets[4]);
+                if (this->Has(ATTRIB_BITANGENT)) this->packUnitVector(v.Bitangent, out + offsets[5]);
+            }
+        });
+    }
+
+    // it converts the positions of the vertices to the encoding of this format, with the decoding parameters computed by Pack, and it stores
+    // them tightly packed (AttributeSize(0) bytes for each vertex, e.g. for a separate stream read only by a depth pre-pass). The values are
+    // identical to the positions written by Pack, so the two streams produce the same depth
+    void PackPositions(const Vertex* vertices, size_t numVertices, vector<unsigned char>& data, const glm::vec4 decode[2]) const
+    {
+        GLsizei size = this->positionEncoding == POSITION_FLOAT32 ? 3 * sizeof(GLfloat) : 4 * sizeof(GLushort);
+        glm::vec3 scale(decode[0]), offset(decode[1]);
+        data.resize(numVertices * size);
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                this->packPosition(vertices[i].Position, scale, offset, &data[i * size]);
+        });
+    }
+
+    // it converts an array of unit vectors (e.g., a stream of smoothed normals) to the encoding of the normals of this format,
+    // and it appends them to data (with the size of a normal in this format: 12 bytes, or 4 bytes if octahedral)
+    void PackUnitVectors(const glm::vec3* vectors, size_t count, vector<unsigned char>& data) const
+    {
+        GLsizei size = this->normalEncoding == NORMAL_FLOAT32 ? 3 * sizeof(GLfloat) : 2 * sizeof(GLshort);
+        size_t start = data.size();
+        data.resize(start + count * size);
+        ParallelFor(count, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+                this->packUnitVector(vectors[i], &data[start + i * size]);
+        });
+    }
+
+    //////////////////////////////////////////
+    // inverse conversions of Pack, for a vertex of the data (e.g., read back from the VBO): position, with the decoding parameters of Pack,
+    // and unit vector of an attribute
+    glm::vec3 UnpackPosition(const unsigned char* vertex, const glm::vec4 decode[2]) const
+    {
+        glm::vec3 p;
+        if (this->positionEncoding == POSITION_FLOAT32)
+            memcpy(&p, vertex + this->AttributeOffset(0), sizeof(glm::vec3));
+        else
+        {
+            GLushort q[4];
+            memcpy(q, vertex + this->AttributeOffset(0), sizeof(q));
+            for (int c = 0; c < 3; c++)
+                p[c] = this->positionEncoding == POSITION_HALF ? glm::unpackHalf1x16(q[c]) : glm::unpackUnorm1x16(q[c]);
+        }
+        return glm::vec3(decode[1]) + glm::vec3(decode[0]) * p;
+    }
+
+    glm::vec3 UnpackUnitVector(const unsigned char* vertex, GLuint location) const
+    {
+        glm::vec3 n;
+        if (this->normalEncoding == NORMAL_FLOAT32)
+        {
+            memcpy(&n, vertex + this->AttributeOffset(location), sizeof(glm::vec3));
+            return n;
+        }
+        GLshort q[2];
+        memcpy(q, vertex + this->AttributeOffset(location), sizeof(q));
+        return OctDecode(glm::vec2(glm::unpackSnorm1x16((GLushort)q[0]), glm::unpackSnorm1x16((GLushort)q[1])));
+    }
+
+    // it re-encodes in place the positions of vertices in this format (e.g., read back from a VBO), from the decoding parameters "from"
+    // to the parameters "to" (e.g., to share the same parameters among meshes with different bounding boxes, see mesh_batch.h).
+    // Only the UNORM16 positions depend on the parameters: with the other encodings the data are not changed
+    void RequantizePositions(unsigned char* data, size_t numVertices, const glm::vec4 from[2], const glm::vec4 to[2]) const
+    {
+        if (this->positionEncoding != POSITION_UNORM16)
+            return;
+        GLsizei stride = this->Stride();
+        GLsizei position = this->AttributeOffset(0);
+        glm::vec3 scale(to[0]), offset(to[1]);
+        ParallelFor(numVertices, [&](size_t begin, size_t end, unsigned int)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                unsigned char* vertex = data + i * stride;
+                this->packPosition(this->UnpackPosition(vertex, from), scale, offset, vertex + position);
+            }
+        });
+    }
+
+    //////////////////////////////////////////
+    // bitmask of the attributes read by a Shader Program (the attributes must use the locations of the Vertex attributes)
+    static GLuint AttributesUsedBy(GLuint program)
+    {
+        GLint count = 0;
+        GLchar name[256];
+        GLuint attributes = ATTRIB_POSITION;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size;
+            GLenum type;
+            glGetActiveAttrib(program, i, 256, NULL, &size, &type, name);
+            GLint location = glGetAttribLocation(program, name);
+            if (location >= 0 && location < (GLint)NUM_VERTEX_ATTRIBUTES)
+                attributes |= 1u << location;
+        }
+        return attributes;
+    }
+
+    //////////////////////////////////////////
+    // octahedral encoding of a unit vector, in [-1,1]^2
+    static glm::vec2 OctEncode(glm::vec3 n)
+    {
+        // vertices without faces have a NaN smoothed normal: we encode a valid vector
+        if (!(std::isfinite(n.x) && std::isfinite(n.y) && std::isfinite(n.z)) || (n.x == 0.0f && n.y == 0.0f && n.z == 0.0f))
+            n = glm::vec3(0.0f, 0.0f, 1.0f);
+        // projection on the octahedron |x| + |y| + |z| = 1
+        n /= (fabs(n.x) + fabs(n.y) + fabs(n.z));
+        glm::vec2 p(n.x, n.y);
+        // the lower hemisphere is "folded" on the corners of the square
+        if (n.z < 0.0f)
+        {
+            p = glm::vec2((1.0f - fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                          (1.0f - fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return p;
+    }
+
+    // inverse of OctEncode (the same decoding of the vertex shader)
+    static glm::vec3 OctDecode(glm::vec2 p)
+    {
+        glm::vec3 v(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+        GLfloat t = max(-v.z, 0.0f);
+        v.x += v.x >= 0.0f ? -t : t;
+        v.y += v.y >= 0.0f ? -t : t;
+        return glm::normalize(v);
+    }
+
+private:
+
+    // offsets of the attributes in the Vertex structure
+    static GLsizei fullLayoutOffset(GLuint location)
+    {
+        switch (location)
+        {
+            case 0: return offsetof(Vertex, Position);
+            case 1: return offsetof(Vertex, Normal);
+            case 2: return offsetof(Vertex, Sm_Normal);
+            case 3: return offsetof(Vertex, TexCoords);
+            case 4: return offsetof(Vertex, Tangent);
+            case 5: return offsetof(Vertex, Bitangent);
+            default: return sizeof(Vertex);
+        }
+    }
+
+    void packPosition(const glm::vec3& p, const glm::vec3& scale, const glm::vec3& offset, unsigned char* out) const
+    {
+        if (this->positionEncoding == POSITION_FLOAT32)
+        {
+            memcpy(out, &p, sizeof(glm::vec3));
+            return;
+        }
+        GLushort q[4] = {0, 0, 0, 0};
+        for (int c = 0; c < 3; c++)
+        {
+            if (this->positionEncoding == POSITION_HALF)
+                q[c] = glm::packHalf1x16(p[c]);
+            else
+                q[c] = scale[c] > 0.0f ? glm::packUnorm1x16((p[c] - offset[c]) / scale[c]) : 0;
+        }
+        memcpy(out, q, sizeof(q));
+    }
+
+    void packUnitVector(const glm::vec3& n, unsigned char* out) const
+    {
+        if (this->normalEncoding == NORMAL_FLOAT32)
+        {
+            memcpy(out, &n, sizeof(glm::vec3));
+            return;
+        }
+        glm::vec2 p = OctEncode(n);
+        GLshort q[2] = { (GLshort)glm::packSnorm1x16(p.x), (GLshort)glm::packSnorm1x16(p.y) };
+        memcpy(out, q, sizeof(q));
+    }
+};
@@ -0,0 +1,468 @@
+/*
+Benchmark of the illumination models of MyProject
+
+For each mesh, each resolution and each shader subroutine of the Shader Program of MyProject, the mesh is rendered offscreen
+along a fixed camera path (an orbit around the mesh, or the keyframes of a file), and the application measures:
+- the GPU time of the frames (GL_TIME_ELAPSED queries, see include/utils/profiler.h), as p50/p95/p99 in milliseconds
+- the CPU time of the frames, as p50 in milliseconds
+- the number of fragments which passed the depth test (GL_SAMPLES_PASSED query), and the fragments shaded per second
+
+The results are appended to a CSV file (one line for each run), so that the cost of the shaders can be compared
+across versions of the code, and across machines (the name of the renderer is saved in each line).
+
+Usage (from the source/Benchmark folder):
+
+    ./benchmark.out --resolutions 640x480,1920x1080 --frames 240 --output results.csv
+
+Optional arguments:
+--scene <file>          meshes to render, in the format of include/utils/scene.h (the ground objects are ignored; the position is
+                        used only for the height of the mesh). The default meshes are the armadillo, the bunny and the dragon,
+                        which have different triangle counts.
+--subroutines <a,b,..>  subset of the subroutines (default: all the subroutines found in the Shader Program)
+--camera-path <file>    keyframes of the camera (see include/utils/camera_path.h)
+--warmup <n>            frames rendered before the measured ones (default: 30)
+--instances <n>         the mesh is rendered n times with a single instanced draw call per mesh (default: 1)
+--egl                   the context is created with EGL (see MyProject)
+--permutations          each subroutine is measured also with the specialized Shader Program of the same illumination model
+                        (see include/utils/shader_permutations.h), and the speedup of the specialized program is printed.
+                        The column "path" of the CSV file is "subroutine" or "permutation"
+
+N.B. 1) the frames are rendered in a Framebuffer Object, so the measures do not depend on the vertical synchronization of the display.
+At the end of each run, the application waits for the GPU (glFinish), so the runs do not overlap.
+
+N.B. 2) the number of fragments counts only the samples which passed the depth test: fragments discarded by the early depth test are not
+shaded, and fragments overwritten later by closer surfaces are counted (and shaded) anyway.
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+*/
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <cmath>
+#include <algorithm>
+
+#ifdef _WIN32
+    #define APIENTRY __stdcall
+#endif
+
+#include <glad/glad.h>
+
+// GLFW library to create the (hidden) window and the context
+#include <glfw/glfw3.h>
+
+#ifdef _WINDOWS_
+    #error windows.h was included!
+#endif
+
+// classes developed for MyProject
+#include <utils/shader_v1.h>
+#include <utils/model_modified.h>
+#include <utils/camera.h>
+#include <utils/uniform_buffer.h>
+#include <utils/material_parameters.h>
+#include <utils/offscreen.h>
+#include <utils/scene.h>
+#include <utils/camera_path.h>
+#include <utils/profiler.h>
+#include <utils/shader_permutations.h>
+#include <utils/light_clusters.h>
+#include <utils/shadow_cache.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// the shaders of MyProject
+const char* VERTEX_SHADER_PATH = "../MyProject/illumination_models_modified_vt.vert";
+const char* FRAGMENT_SHADER_PATH = "../MyProject/illumination_models_modified_fr.frag";
+
+// options of the benchmark, set by the command line arguments
+struct BenchmarkOptions
+{
+    string scenePath;
+    string cameraPath;
+    vector<string> subroutines;
+    vector<glm::uvec2> resolutions;
+    GLuint frames = 120;
+    GLuint warmup = 30;
+    GLuint instances = 1;
+    string output = "benchmark.csv";
+    bool egl = false;
+    // if true, the specialized programs of the illumination models are measured too
+    bool permutations = false;
+};
+
+// the results of a run
+struct RunResult
+{
+    double cpuP50, gpuP50, gpuP95, gpuP99;
+    GLuint64 fragments;
+    double fragmentsPerSecond;
+};
+
+// it reads the options from the command line arguments. It returns false if an argument is not valid
+bool ParseArguments(int argc, char* argv[], BenchmarkOptions& options);
+
+// it returns the names and the indices of the subroutines of the fragment shader, in the order of SetupShader in MyProject
+vector<pair<string, GLuint>> FragmentSubroutines(GLuint program);
+
+// it places n instances of the mesh on a square grid centered in the origin, and it returns the half size of the grid
+GLfloat InstanceGrid(const SceneObject& object, GLuint n, vector<InstanceData>& instances);
+
+/////////////////// MAIN function ///////////////////////
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+    if (!ParseArguments(argc, argv, options))
+        return -1;
+
+    // we create an OpenGL 4.1 Core context, with a window which is never shown
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    if (options.egl)
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "Benchmark", nullptr, nullptr);
+    if (!window)
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
+    {
+        std::cout << "Failed to initialize OpenGL context" << std::endl;
+        return -1;
+    }
+    string renderer = (const char*)glGetString(GL_RENDERER);
+    std::cout << "Renderer: " << renderer << " - OpenGL " << glGetString(GL_VERSION) << std::endl;
+
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.26f, 0.46f, 0.98f, 1.0f);
+
+    // the Shader Program of MyProject, with the uniform buffer of the material parameters (with the default values of the application)
+    Shader illumination_shader(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH);
+    UniformBuffer<MaterialParameters> materialBuffer(MATERIAL_BINDING_POINT);
+    illumination_shader.BindUniformBlock("MaterialParameters", MATERIAL_BINDING_POINT);
+    materialBuffer.Update(DefaultMaterialParameters());
+
+    const glm::vec3 lightPos0(5.0f, 10.0f, 10.0f);
+    const GLfloat diffuseColor[] = {1.0f, 0.8f, 0.2f};
+
+    // the subroutines to measure
+    vector<pair<string, GLuint>> subroutines = FragmentSubroutines(illumination_shader.Program);
+    if (!options.subroutines.empty())
+    {
+        vector<pair<string, GLuint>> selected;
+        for (const string& name : options.subroutines)
+        {
+            GLuint index = illumination_shader.SubroutineIndex(GL_FRAGMENT_SHADER, name);
+            if (index == GL_INVALID_INDEX)
+                std::cout << "WARNING: subroutine " << name << " not found in the Shader Program" << std::endl;
+            else
+                selected.push_back(make_pair(name, index));
+        }
+        subroutines = selected;
+    }
+
+    // the specialized programs of the measured subroutines, with the default material parameters as constants
+    // (the benchmark does not load the curvatures of the vertices, so vertexCurvature is false as in the program with the subroutines)
+    vector<string> names;
+    for (const pair<string, GLuint>& subroutine : subroutines)
+        names.push_back(subroutine.first);
+    vector<string> defines;
+    defines.push_back("VERTEX_CURVATURE false");
+    defines.push_back("STATIC_PARAMETERS " + MaterialParameterConstants(DefaultMaterialParameters()));
+    ShaderPermutations permutations(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH, "ILLUMINATION_MODEL", options.permutations ? names : vector<string>(), defines);
+
+    // the meshes to measure (the ground objects of the scene are ignored)
+    vector<SceneObject> objects = DefaultScene();
+    if (!options.scenePath.empty() && !LoadScene(options.scenePath, objects))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    objects.erase(std::remove_if(objects.begin(), objects.end(), [](const SceneObject& o) { return o.ground; }), objects.end());
+
+    // the keyframes of the camera are loaded once, before any measure: a missing or empty file stops the benchmark
+    CameraPath keyframes;
+    if (!options.cameraPath.empty() && !keyframes.Load(options.cameraPath))
+    {
+        std::cout << "ERROR: no keyframes in the camera path " << options.cameraPath << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    // we open the CSV file: if it is new, we write the header
+    bool newFile = !ifstream(options.output).good();
+    ofstream csv(options.output, ios::app);
+    if (!csv)
+    {
+        std::cout << "ERROR: unable to write " << options.output << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    if (newFile)
+        csv << "date,renderer,mesh,triangles,instances,width,height,subroutine,frames,cpu_ms_p50,gpu_ms_p50,gpu_ms_p95,gpu_ms_p99,fragments,fragments_per_sec,path" << endl;
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    ModelOptions modelOptions;
+    modelOptions.vertexFormat = VertexFormat::Compact(VertexFormat::AttributesUsedBy(illumination_shader.Program));
+
+    GLuint samplesQuery;
+    glGenQueries(1, &samplesQuery);
+    Camera camera(glm::vec3(0.0f), GL_FALSE);
+
+    for (const SceneObject& object : objects)
+    {
+        Model model(object.modelPath, modelOptions);
+        GLuint64 triangles = model.DrawnTriangles();
+
+        // the instances are placed on a grid around the origin (a single instance is placed in the origin)
+        vector<InstanceData> instanceData;
+        GLfloat gridSize = InstanceGrid(object, options.instances, instanceData);
+        InstanceBuffer instances;
+        instances.Update(instanceData);
+
+        // the camera path: an orbit around the mesh (or the grid), or the keyframes of the file
+        CameraPath cameraPath = keyframes;
+        if (options.cameraPath.empty())
+            cameraPath.Orbit(glm::vec3(0.0f, object.position.y, 0.0f), 5.0f + gridSize, 1.0f);
+
+        for (const glm::uvec2& resolution : options.resolutions)
+        {
+            Framebuffer framebuffer(resolution.x, resolution.y);
+            glm::mat4 projection = glm::perspective(45.0f, (float)resolution.x / (float)resolution.y, 0.1f, 100.0f);
+            double subroutineGpuP50 = 0.0;
+
+            for (size_t k = 0; k < subroutines.size(); k++)
+            for (GLuint path = 0; path < (options.permutations ? 2u : 1u); path++)
+            {
+                const pair<string, GLuint>& subroutine = subroutines[k];
+                // path 0: the program with the subroutines, path 1: the specialized program of the subroutine
+                Shader& program = (path == 0) ? illumination_shader : permutations[k];
+                GLint projectionMatrixLocation = program.UniformLocation("projectionMatrix");
+                GLint viewMatrixLocation = program.UniformLocation("viewMatrix");
+                GLint modelMatrixLocation = program.UniformLocation("modelMatrix");
+                GLint normalMatrixLocation = program.UniformLocation("normalMatrix");
+                GLint pointLightLocation = program.UniformLocation("pointLightPosition");
+                GLint matDiffuseLocation = program.UniformLocation("diffuseColor");
+                GLint instancedLocation = program.UniformLocation("instanced");
+                Profiler profiler;
+                GLuint64 fragments = 0;
+
+                framebuffer.Bind();
+                program.Use();
+                glUniformMatrix4fv(projectionMatrixLocation, 1, GL_FALSE, glm::value_ptr(projection));
+                glUniform3fv(pointLightLocation, 1, glm::value_ptr(lightPos0));
+                glUniform3fv(matDiffuseLocation, 1, diffuseColor);
+                glUniform1i(instancedLocation, options.instances > 1);
+                // the benchmark measures only the main light, without shadows: the clustered lights and the shadows are disabled,
+                // but their samplers need their texture units
+                LightClusters().SetupProgram(program.Program);
+                ShadowCache().SetupProgram(program.Program);
+
+                // the same frames of the camera path are rendered by each run: the first ones are not measured
+                GLuint totalFrames = options.warmup + options.frames;
+                for (GLuint frame = 0; frame < totalFrames; frame++)
+                {
+                    bool measured = (frame >= options.warmup);
+                    if (measured)
+                    {
+                        if (frame == options.warmup)
+                            glBeginQuery(GL_SAMPLES_PASSED, samplesQuery);
+                        profiler.BeginFrame();
+                    }
+
+                    CameraPose pose = cameraPath.Pose(measured ? frame - options.warmup : frame % options.frames, options.frames);
+                    camera.SetPose(pose.position, pose.yaw, pose.pitch);
+                    glm::mat4 view = camera.GetViewMatrix();
+
+                    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                    profiler.BeginPass("draw");
+                    // the subroutine state is reset by glUseProgram and by other state changes, so we set it at each frame
+                    if (path == 0)
+                        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subroutine.second);
+                    glUniformMatrix4fv(viewMatrixLocation, 1, GL_FALSE, glm::value_ptr(view));
+                    if (options.instances > 1)
+                        model.DrawInstanced(instances);
+                    else
+                    {
+                        glm::mat4 modelMatrix = instanceData[0].modelMatrix;
+                        glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(view * modelMatrix));
+                        glUniformMatrix4fv(modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+                        glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+                        model.Draw();
+                    }
+                    profiler.EndPass();
+
+                    if (measured)
+                        profiler.EndFrame();
+                }
+                glEndQuery(GL_SAMPLES_PASSED);
+                glFinish();
+
+                profiler.Finish();
+                glGetQueryObjectui64v(samplesQuery, GL_QUERY_RESULT, &fragments);
+
+                RunResult result;
+                const RollingStats* gpu = profiler.PassGpu("draw");
+                result.cpuP50 = profiler.FrameCpu().Percentile(50.0);
+                result.gpuP50 = gpu ? gpu->Percentile(50.0) : 0.0;
+                result.gpuP95 = gpu ? gpu->Percentile(95.0) : 0.0;
+                result.gpuP99 = gpu ? gpu->Percentile(99.0) : 0.0;
+                result.fragments = fragments;
+                double gpuSeconds = gpu ? gpu->Mean() * options.frames / 1000.0 : 0.0;
+                result.fragmentsPerSecond = gpuSeconds > 0.0 ? fragments / gpuSeconds : 0.0;
+
+                std::cout << object.name << " (" << triangles << " triangles x " << options.instances << ") " << resolution.x << "x" << resolution.y
+                          << " " << subroutine.first << (path == 0 ? "" : " (specialized)") << ": " << result.gpuP50 << " ms/frame (GPU p50), "
+                          << result.fragmentsPerSecond / 1.0e6 << " Mfragments/s";
+                // the speedup of the specialized program with respect to the subroutine (measured just before)
+                if (path == 1 && result.gpuP50 > 0.0)
+                    std::cout << " - speedup " << subroutineGpuP50 / result.gpuP50 << "x";
+                std::cout << std::endl;
+                subroutineGpuP50 = result.gpuP50;
+
+                csv << date << ",\"" << renderer << "\"," << object.name << "," << triangles << "," << options.instances << ","
+                    << resolution.x << "," << resolution.y << "," << subroutine.first << "," << options.frames << ","
+                    << result.cpuP50 << "," << result.gpuP50 << "," << result.gpuP95 << "," << result.gpuP99 << ","
+                    << result.fragments << "," << result.fragmentsPerSecond << "," << (path == 0 ? "subroutine" : "permutation") << endl;
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    glDeleteQueries(1, &samplesQuery);
+    illumination_shader.Delete();
+    permutations.Delete();
+    glfwTerminate();
+    return 0;
+}
+
+//////////////////////////////////////////
+// the subroutines are listed as in SetupShader of MyProject, using the compatible subroutines of the (only) subroutine uniform
+vector<pair<string, GLuint>> FragmentSubroutines(GLuint program)
+{
+    vector<pair<string, GLuint>> subroutines;
+    GLint countActiveSU = 0;
+    glGetProgramStageiv(program, GL_FRAGMENT_SHADER, GL_ACTIVE_SUBROUTINE_UNIFORMS, &countActiveSU);
+    for (GLint i = 0; i < countActiveSU; i++)
+    {
+        GLint numCompS = 0;
+        glGetActiveSubroutineUniformiv(program, GL_FRAGMENT_SHADER, i, GL_NUM_COMPATIBLE_SUBROUTINES, &numCompS);
+        vector<GLint> s(numCompS);
+        glGetActiveSubroutineUniformiv(program, GL_FRAGMENT_SHADER, i, GL_COMPATIBLE_SUBROUTINES, s.data());
+        for (GLint j = 0; j < numCompS; j++)
+        {
+            GLchar name[256];
+            GLsizei len;
+            glGetActiveSubroutineName(program, GL_FRAGMENT_SHADER, s[j], 256, &len, name);
+            subroutines.push_back(make_pair(string(name, len), (GLuint)s[j]));
+        }
+    }
+    return subroutines;
+}
+
+//////////////////////////////////////////
+// the instances are placed on a square grid with a step of 3 units, at the height of the object
+GLfloat InstanceGrid(const SceneObject& object, GLuint n, vector<InstanceData>& instances)
+{
+    const GLfloat step = 3.0f;
+    GLuint side = (GLuint)ceil(sqrt((double)n));
+    GLfloat half = (side - 1) * step * 0.5f;
+    for (GLuint i = 0; i < n; i++)
+    {
+        glm::vec3 position(-half + (i % side) * step, object.position.y, -half + (i / side) * step);
+        glm::mat4 modelMatrix = glm::scale(glm::translate(glm::mat4(1.0f), position), object.scale);
+        instances.push_back(InstanceData(modelMatrix));
+    }
+    return half;
+}
+
+//////////////////////////////////////////
+// we read the options from the command line arguments
+bool ParseArguments(int argc, char* argv[], BenchmarkOptions& options)
+{
+    // it splits a list of values separated by commas
+    auto split = [](const string& list) -> vector<string> {
+        vector<string> values;
+        stringstream stream(list);
+        string value;
+        while (getline(stream, value, ','))
+            if (!value.empty())
+                values.push_back(value);
+        return values;
+    };
+
+    string resolutions = "640x480,1280x720,1920x1080";
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--egl")
+            options.egl = true;
+        else if (arg == "--scene" && hasValue)
+            options.scenePath = argv[++i];
+        else if (arg == "--camera-path" && hasValue)
+            options.cameraPath = argv[++i];
+        else if (arg == "--subroutines" && hasValue)
+            options.subroutines = split(argv[++i]);
+        else if (arg == "--resolutions" && hasValue)
+            resolutions = argv[++i];
+        else if (arg == "--frames" && hasValue)
+            options.frames = (GLuint)atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            options.warmup = (GLuint)atoi(argv[++i]);
+        else if (arg == "--instances" && hasValue)
+            options.instances = (GLuint)atoi(argv[++i]);
+        else if (arg == "--output" && hasValue)
+            options.output = argv[++i];
+        else if (arg == "--permutations")
+            options.permutations = true;
+        else
+        {
+            std::cout << "Unknown or incomplete argument: " << arg << std::endl;
+            std::cout << "Usage: " << argv[0] << " [--scene file] [--camera-path file] [--subroutines a,b,...] [--resolutions WxH,...]"
+                      << " [--frames n] [--warmup n] [--instances n] [--output file.csv] [--egl] [--permutations]" << std::endl;
+            return false;
+        }
+    }
+
+    for (const string& resolution : split(resolutions))
+    {
+        unsigned int w = 0, h = 0;
+        if (sscanf(resolution.c_str(), "%ux%u", &w, &h) != 2 || w == 0 || h == 0)
+        {
+            std::cout << "Invalid resolution: " << resolution << std::endl;
+            return false;
+        }
+        options.resolutions.push_back(glm::uvec2(w, h));
+    }
+    if (options.frames == 0 || options.instances == 0)
+    {
+        std::cout << "The number of frames and of instances must be greater than 0" << std::endl;
+        return false;
+    }
+    if (options.frames > PROFILER_WINDOW)
+        std::cout << "WARNING: the percentiles are computed on the last " << PROFILER_WINDOW << " frames" << std::endl;
+    return true;
+}
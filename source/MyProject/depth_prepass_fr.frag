@@ -0,0 +1,22 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+depth_prepass_fr.frag: Fragment shader of the depth pre-pass
+It writes only the depth (the color writes are disabled by the application): the fragments can be discarded by the early depth test,
+and the depth buffer then contains only the visible surfaces, so the shading pass evaluates the illumination model once per pixel
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+void main(void)
+{
+}
@@ -0,0 +1,51 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+depth_prepass_vt.vert: Vertex shader of the depth pre-pass
+It reads only the positions (location 0, from the separate stream of the meshes, see N.B. 10 in mesh_v1.h) and the decoding attributes,
+and it computes gl_Position exactly like illumination_models_modified_vt.vert: the shading pass compares the depths with GL_EQUAL,
+so the two shaders must produce the same values
+
+N.B.) gl_Position is declared invariant in both shaders: without it, the compiler could evaluate the same expression in a different
+way in the two programs (e.g., with a different order of the operations), and some fragments of the shading pass would fail the test
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+// vertex position in object coordinates
+layout (location = 0) in vec3 position;
+
+// parameters to decode the vertex format of the mesh (see vertex_format.h)
+layout (location = 6) in vec4 decodeScale;
+layout (location = 7) in vec4 decodeOffset;
+
+// per-instance model matrix, used by instanced rendering (see instance_buffer.h)
+layout (location = 8) in mat4 instanceModelMatrix;
+
+// if true, the per-instance matrix is used instead of modelMatrix
+uniform bool instanced;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+invariant gl_Position;
+
+void main(){
+
+  // the same operations of illumination_models_modified_vt.vert
+  vec3 decodedPosition = decodeOffset.xyz + decodeScale.xyz * position;
+  mat4 model = instanced ? instanceModelMatrix : modelMatrix;
+  vec4 mvPosition = viewMatrix * model * vec4( decodedPosition, 1.0 );
+  gl_Position = projectionMatrix * mvPosition;
+
+}
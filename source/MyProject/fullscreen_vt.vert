@@ -0,0 +1,26 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+fullscreen_vt.vert: Vertex shader of the full-screen pass of the deferred shading
+It generates, without vertex attributes, a single triangle which covers the whole viewport (see GBuffer::DrawFullscreen):
+a triangle avoids the diagonal of a quad, where the fragments of the two triangles would be shaded twice in the 2x2 quads
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+void main(){
+
+  // vertices (-1, -1), (3, -1), (-1, 3): the part outside the viewport is clipped
+  vec2 position = vec2((gl_VertexID == 1) ? 3.0 : -1.0, (gl_VertexID == 2) ? 3.0 : -1.0);
+  gl_Position = vec4(position, 0.0, 1.0);
+
+}
@@ -0,0 +1,57 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+gbuffer_fr.frag: Fragment shader of the geometry pass of the deferred shading (see include/utils/gbuffer.h)
+It writes in the G-buffer the attributes of the visible surface, which are read by the full-screen pass
+(illumination_models_modified_fr.frag compiled with DEFERRED defined)
+
+N.B. 1)  "illumination_models_modified_vt.vert" must be used as vertex shader
+
+N.B. 2)  the locations of the outputs are the attachments of the G-buffer (GBufferTarget)
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+// normal and smoothed normal (octahedral encoding, mapped to [0, 1])
+layout (location = 0) out vec4 gNormals;
+// linear depth
+layout (location = 1) out float gDepth;
+// identifiers of the object and of the material
+layout (location = 2) out uvec2 gIDs;
+
+// the transformed normal and smoothed normal (in view coordinates)
+in vec3 vNormal;
+in vec3 vSMNormal;
+// vector from fragment to camera (in view coordinates)
+in vec3 vViewPosition;
+
+// identifier of the object (> 0) and of its material, set by the application for each object
+uniform uint objectID;
+uniform uint materialID;
+
+// octahedral encoding of a unit vector, mapped to [0, 1] to be stored in a normalized texture
+vec2 encodeNormal(vec3 n)
+{
+  n /= abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e = n.xy;
+  if (n.z < 0.0)
+    e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+  return e * 0.5 + 0.5;
+}
+
+void main(void)
+{
+  gNormals = vec4(encodeNormal(normalize(vNormal)), encodeNormal(normalize(vSMNormal)));
+  // the camera looks along -z, and vViewPosition is the negated position in view coordinates
+  gDepth = vViewPosition.z;
+  gIDs = uvec2(objectID, materialID);
+}
@@ -10,6 +10,28 @@ N.B. 1)  "illumination_models_modified_vt.vert" must be used as vertex shader
 
 N.B. 2)  the different illumination models are implemented using Shaders Subroutines
 
+N.B. 3)  the curvature used by the Enhanced Blinn-Phong model and by the curvature visualizers is read from the vertex attribute
+computed at loading (if vertexCurvature is true), or estimated per fragment from the screen-space derivatives of the normal
+
+N.B. 4)  the same sources can be compiled as a specialized program for a single illumination model (see include/utils/shader_permutations.h):
+if ILLUMINATION_MODEL is defined (as the name of a model), the model is called directly instead of through the subroutine uniform;
+if STATIC_PARAMETERS is defined (as the declarations of the material parameters as constants), the uniform block is not used, and the
+compiler can fold the parameters; if VERTEX_CURVATURE is defined (true or false), vertexCurvature is a constant too
+
+N.B. 5)  if DEFERRED is defined, the shader is the full-screen pass of the deferred shading ("fullscreen_vt.vert" must be used as vertex
+shader): the inputs of the illumination models are reconstructed from the G-buffer written by "gbuffer_fr.frag" (see include/utils/gbuffer.h),
+so each model is evaluated once per pixel. The curvature is always estimated in screen space, but with a wider stencil of pixels
+of the G-buffer (CURVATURE_RADIUS pixels on each side), which does not cross the silhouettes of the objects
+
+N.B. 6)  besides the point light in pointLightPosition, the models are lit by the clustered point lights (see include/utils/light_clusters.h):
+each fragment finds its cluster from its position in the viewport and its linear depth, and it loops only over the lights of the cluster
+(at most clusterMaxLights). In the Gooch and Toon models, the tone is given by the main light, and the other lights add
+a warm diffuse term and a specular term (Gooch) or their intensity before the quantization (Toon). The visualizers ignore them
+
+N.B. 7)  if shadows is true, the point light in pointLightPosition is occluded by the casters in its cube shadow map (see include/utils/shadow_cache.h).
+The shadowed part of the surface has no diffuse and specular components of the light (rho_d = rho_s = 0 in the enhanced models), while
+in the Gooch and Toon models it is shaded as if it was facing away from the light (lambertian coefficient <= 0)
+
 author: Davide Gadia
 refined by: Francesco Brischetto  mat. 958022
 
@@ -24,6 +46,41 @@ Universita' degli Studi di Milano
 // output shader variable
 out vec4 colorFrag;
 
+#ifdef DEFERRED
+// in the deferred shading, the same variables are reconstructed from the G-buffer at the beginning of main
+vec3 lightDir;
+vec3 vNormal;
+vec3 vSMNormal;
+vec3 vViewPosition;
+// the curvatures of the vertices are not stored in the G-buffer
+const vec2 vCurvature = vec2(0.0);
+
+// the diffusive component is selected by the identifier of the material written in the G-buffer
+const uint GROUND_MATERIAL = 0u;
+uniform vec3 materialDiffuseColor[2];
+vec3 diffuseColor;
+
+// attachments of the G-buffer
+uniform sampler2D gBufferNormals;
+uniform sampler2D gBufferDepth;
+uniform usampler2D gBufferIDs;
+// view matrix and position of the point light (in world coordinates), to compute the light incidence direction
+uniform mat4 viewMatrix;
+uniform vec3 pointLightPosition;
+// 1 / projectionMatrix[0][0] and 1 / projectionMatrix[1][1], to reconstruct the position in view coordinates from the linear depth
+uniform vec2 inverseProjectionScale;
+
+// pixels on each side of the stencil used to estimate the curvature, and maximum difference of linear depth (relative to the depth
+// of the fragment, for each pixel of distance) of the pixels of the same surface
+#ifndef CURVATURE_RADIUS
+#define CURVATURE_RADIUS 2
+#endif
+const float CURVATURE_DEPTH_TOLERANCE = 0.02;
+// pixel of the fragment, with the identifier of its object and its linear depth
+ivec2 gPixel;
+uint gObject;
+float gLinearDepth;
+#else
 // light incidence direction (calculated in vertex shader, interpolated by rasterization)
 in vec3 lightDir;
 // the transformed normal has been calculated per-vertex in the vertex shader
@@ -32,58 +89,113 @@ in vec3 vNormal;
 in vec3 vSMNormal;
 // vector from fragment to camera (in view coordinate)
 in vec3 vViewPosition;
+// mean curvatures of the normal and of the smoothed normal (interpolated from the vertices)
+in vec2 vCurvature;
 
-// uniforms for Blinn-Phong model
-// ambient, diffusive and specular components (passed from the application)
-uniform vec3 ambientColor;
+// diffusive component (passed from the application): it is different for the plane and for the objects, so it is a standard uniform
 uniform vec3 diffuseColor;
-uniform vec3 specularColor;
-// weight of the components
-// in this case, we can pass separate values from the main application even if Ka+Kd+Ks>1. In more "realistic" situations, I have to set this sum = 1, or at least Kd+Ks = 1, by passing Kd as uniform, and then setting Ks = 1.0-Kd
-uniform float Ka;
-uniform float Kd;
-uniform float Ks;
-// shininess coefficients (passed from the application)
-uniform float shininess;
-
-// uniforms used as control parameters for all the functions defined in the reference paper
-// Equation 8 chapter 5.1 and Equation 6 chapter 4.2.2 reference paper
-uniform float lambda;
-// Equation 8 chapter 5.1 reference paper
-uniform float alpha;
-// Equation 13 chapter 6.2 reference paper
-uniform float r;
-// Equation 13 chapter 6.2 reference paper
-uniform float Ql;
-
-// uniforms defined by me to compose the three components in final result of Ehnaced Toon Shading and Enhanced Gooch Shading. 
-// This was not specified in the reference paper
-uniform float myWeightA;
-uniform float myWeightD;
-
-// uniforms for Toon Shading Model
-uniform vec3 shinestColor;
-uniform vec3 shinyColor;
-uniform vec3 darkColor;
-uniform vec3 gloomyColor;
-
-// uniforms for Gooch Shading model
-uniform vec3  SurfaceColor;
-uniform vec3  WarmColor;
-uniform vec3  CoolColor;
-uniform float DiffuseWarm;
-uniform float DiffuseCool;
-
-// uniforms for depth linearization
-uniform float near;
-uniform float far;
+// view matrix (the same uniform of the vertex shader), to find the direction from the light in world coordinates for the shadow map
+uniform mat4 viewMatrix;
+#endif
+
+// if true, the curvature is read from the vertices, and multiplied by curvatureScale to have the same range of the screen-space estimate
+#if defined(DEFERRED)
+const bool vertexCurvature = false;
+#elif defined(VERTEX_CURVATURE)
+const bool vertexCurvature = VERTEX_CURVATURE;
+#else
+uniform bool vertexCurvature;
+#endif
+uniform float curvatureScale;
+
+// clustered point lights (see include/utils/light_clusters.h), in texture buffers: the lights (2 texels for each light: position in view
+// coordinates and radius, color multiplied by the intensity), the (first, count) of the lights of each cluster in the list of indices,
+// and the list of the indices of the lights of all the clusters
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+// number of clusters along x, y and depth (x = 0 if there are no clustered lights), size of a tile in pixels, scale and bias
+// from the logarithm of the linear depth to the slice, and maximum number of lights shaded for each fragment
+uniform ivec3 clusterGrid;
+uniform vec2 clusterTileSize;
+uniform vec2 clusterDepthScale;
+uniform int clusterMaxLights;
+
+// cube shadow map of the point light (distances from the light divided by shadowFar, see include/utils/shadow_cache.h), and its activation
+uniform samplerCubeShadow shadowMap;
+uniform float shadowFar;
+uniform bool shadows;
+// offset (in world units) of the distance compared with the shadow map, at normal incidence of the light: it avoids the self-shadowing
+// of the surfaces caused by the resolution of the shadow map ("shadow acne"), and it grows at grazing angles
+const float SHADOW_BIAS = 0.03;
+
+// material and paper parameters: they are the same for all the objects, and they are stored in a uniform buffer (std140 layout),
+// updated by the application only when a value changes. The members are ordered so that each vec3 is followed by a float
+// N.B.) the order and layout of the members must match the MaterialParameters structure in include/utils/material_parameters.h
+// In a specialized program, the same names are declared as constants by STATIC_PARAMETERS (see MaterialParameterConstants)
+#ifdef STATIC_PARAMETERS
+STATIC_PARAMETERS
+#else
+layout (std140) uniform MaterialParameters
+{
+  // uniforms for Blinn-Phong model
+  // ambient and specular components (passed from the application)
+  vec3 ambientColor;
+  // weight of the components
+  // in this case, we can pass separate values from the main application even if Ka+Kd+Ks>1. In more "realistic" situations, I have to set this sum = 1, or at least Kd+Ks = 1, by passing Kd as uniform, and then setting Ks = 1.0-Kd
+  float Ka;
+  vec3 specularColor;
+  float Ks;
+
+  // uniforms for Toon Shading Model
+  vec3 shinestColor;
+  // shininess coefficients (passed from the application)
+  float shininess;
+  vec3 shinyColor;
+  // uniforms used as control parameters for all the functions defined in the reference paper
+  // Equation 8 chapter 5.1 and Equation 6 chapter 4.2.2 reference paper
+  float lambda;
+  vec3 darkColor;
+  // Equation 8 chapter 5.1 reference paper
+  float alpha;
+  vec3 gloomyColor;
+  // Equation 13 chapter 6.2 reference paper
+  float r;
+
+  // uniforms for Gooch Shading model
+  vec3 SurfaceColor;
+  // Equation 13 chapter 6.2 reference paper
+  float Ql;
+  vec3 WarmColor;
+  float DiffuseWarm;
+  vec3 CoolColor;
+  float DiffuseCool;
+
+  float Kd;
+  // uniforms defined by me to compose the three components in final result of Ehnaced Toon Shading and Enhanced Gooch Shading. 
+  // This was not specified in the reference paper
+  float myWeightA;
+  float myWeightD;
+
+  // uniforms for depth linearization
+  float near;
+  float far;
+};
+#endif
 
 ////////////////////////////////////////////////////////////////////
 
+#ifdef ILLUMINATION_MODEL
+// in a specialized program, the illumination models are plain functions, and ILLUMINATION_SUBROUTINE is empty
+#define ILLUMINATION_SUBROUTINE
+#else
 // the "type" of the Subroutine
 subroutine vec3 ill_model();
 // Subroutine Uniform (it is conceptually similar to a C pointer function)
 subroutine uniform ill_model Illumination_Model;
+// qualifier of the functions which implement the subroutine type
+#define ILLUMINATION_SUBROUTINE subroutine(ill_model)
+#endif
 
 ////////////////////////////////////////////////////////////////////
 
@@ -109,40 +221,179 @@ float Lr(float curvature_value, float delta)
   return G;
 }
 
+#ifdef DEFERRED
+//////////////////////////////////////////
+// decoding of a unit vector stored with octahedral encoding, mapped to [0, 1] (see gbuffer_fr.frag)
+vec3 decodeNormal(vec2 e)
+{
+  e = e * 2.0 - 1.0;
+  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-v.z, 0.0);
+  v.x += (v.x >= 0.0) ? -t : t;
+  v.y += (v.y >= 0.0) ? -t : t;
+  return normalize(v);
+}
+
+//////////////////////////////////////////
+// normal of a pixel of the G-buffer, enhanced with weight "enhancement" (0 = the normal)
+vec3 gBufferNormal(ivec2 pixel, float enhancement)
+{
+  vec4 normals = texelFetch(gBufferNormals, pixel, 0);
+  vec3 N = decodeNormal(normals.xy);
+  return normalize(N + enhancement * (N - decodeNormal(normals.zw)));
+}
+
+//////////////////////////////////////////
+// a pixel at the given distance from the fragment is used by the stencil only if it is inside the viewport, it belongs to the same object,
+// and its depth is close to the depth of the fragment
+bool sameSurface(ivec2 pixel, int distance)
+{
+  if (any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, textureSize(gBufferDepth, 0))))
+    return false;
+  if (texelFetch(gBufferIDs, pixel, 0).x != gObject)
+    return false;
+  return abs(texelFetch(gBufferDepth, pixel, 0).r - gLinearDepth) < CURVATURE_DEPTH_TOLERANCE * float(distance) * gLinearDepth;
+}
+
+//////////////////////////////////////////
+// variation per pixel of the enhanced normal along a direction of the screen: least squares fit of the differences from the pixels
+// of the same surface at distance 1 .. CURVATURE_RADIUS on both sides (near a silhouette, only the pixels on the side of the object are used)
+vec3 gBufferDerivative(vec3 N_I, ivec2 direction, float enhancement)
+{
+  vec3 sum = vec3(0.0);
+  float weights = 0.0;
+  for (int k = 1; k <= CURVATURE_RADIUS; k++)
+    for (int side = -1; side <= 1; side += 2)
+    {
+      ivec2 pixel = gPixel + side * k * direction;
+      if (!sameSurface(pixel, k))
+        continue;
+      float t = float(side * k);
+      sum += t * (gBufferNormal(pixel, enhancement) - N_I);
+      weights += t * t;
+    }
+  return weights > 0.0 ? sum / weights : vec3(0.0);
+}
+#endif
+
 //////////////////////////////////////////
 // My proposed method for calculating curvature (used by Enhanced Blinn-Phong model)
 // Based on: https://madebyevan.com/shaders/curvature/
-float curvature(vec3 N_I)
+// N_I is the normal enhanced with weight "enhancement": in the deferred shading, the normals of the other pixels of the stencil are
+// enhanced with the same weight
+float curvature(vec3 N_I, float enhancement)
 {
+#ifdef DEFERRED
+  // We compute curvature from the variation of the Enhanced Surface Normal in the G-buffer
+  vec3 dx = gBufferDerivative(N_I, ivec2(1, 0), enhancement);
+  vec3 dy = gBufferDerivative(N_I, ivec2(0, 1), enhancement);
+  float depth = gLinearDepth;
+#else
   // We compute curvature exploiting partial derivatives of the Enhanced Surface Normal
   vec3 dx = dFdx(N_I);
   vec3 dy = dFdy(N_I);
   float depth = LinearizeDepth(gl_FragCoord.z);
+#endif
   float curvature_value = (cross(N_I - dx, N_I + dx).y - cross(N_I - dy, N_I + dy).x) * 4.0 / depth;
   return curvature_value;
   //  return clamp(curvature_value, -1, 1);
 }
+
+//////////////////////////////////////////
+// Curvature of the normal field enhanced with weight "enhancement" (0 = the normal), from the curvatures of the vertices.
+// The enhanced normal is N + enhancement * (N - N_sm), so, at first order, its curvature is the same combination of the curvatures
+// of the normal and of the smoothed normal. No derivatives are needed, and the value does not depend on the view
+float vertex_curvature(float enhancement)
+{
+  float curvature_value = vCurvature.x + enhancement * (vCurvature.x - vCurvature.y);
+  return curvature_value * curvatureScale;
+}
+
+//////////////////////////////////////////
+// range of the clustered lights of the cluster of the fragment: the tile is given by the position in the viewport,
+// the slice by the linear depth (vViewPosition.z)
+void clusterRange(out int first, out int count)
+{
+  first = 0;
+  count = 0;
+  if (clusterGrid.x == 0)
+    return;
+  ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), clusterGrid.xy - 1);
+  int slice = clamp(int(log(vViewPosition.z) * clusterDepthScale.x + clusterDepthScale.y), 0, clusterGrid.z - 1);
+  uvec2 range = texelFetch(clusterRanges, (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).xy;
+  first = int(range.x);
+  count = min(int(range.y), clusterMaxLights);
+}
+
+//////////////////////////////////////////
+// normalized light incidence direction and radiance at the fragment of the i-th light in the list of indices: the intensity decreases
+// with the squared distance, and it is smoothly faded to 0 at the radius of the light (window (1 - (d / radius)^4)^2)
+void clusterLight(int i, out vec3 L, out vec3 radiance)
+{
+  int light = int(texelFetch(clusterIndices, i).r);
+  vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+  // vViewPosition is the negated position of the fragment
+  vec3 toLight = positionRadius.xyz + vViewPosition;
+  float distance2 = dot(toLight, toLight);
+  float ratio2 = distance2 / (positionRadius.w * positionRadius.w);
+  float window = clamp(1.0 - ratio2 * ratio2, 0.0, 1.0);
+  L = toLight * inversesqrt(max(distance2, 1e-8));
+  radiance = texelFetch(clusterLights, 2 * light + 1).rgb * (window * window / (1.0 + distance2));
+}
+
+//////////////////////////////////////////
+// visibility of the point light in pointLightPosition from the fragment (1 = lit, 0 = in shadow): the distance of the fragment from
+// the light is compared by the texture unit with the distances of the shadow map in the direction from the light (with linear filtering,
+// the results of the 4 nearest texels are interpolated)
+float shadow()
+{
+  if (!shadows)
+    return 1.0;
+  float distance = length(lightDir);
+  float cosine = max(dot(normalize(vNormal), lightDir / distance), 0.0);
+  float bias = SHADOW_BIAS * (1.0 + 4.0 * (1.0 - cosine));
+  // lightDir goes from the fragment to the light, in view coordinates: the view matrix is rigid, so its inverse rotation is its transpose
+  vec3 direction = transpose(mat3(viewMatrix)) * -lightDir;
+  return texture(shadowMap, vec4(direction, (distance - bias) / shadowFar));
+}
+
+//////////////////////////////////////////
+// luminance of a radiance, used by the Toon models to add the intensity of the clustered lights
+float luminance(vec3 radiance)
+{
+  return dot(radiance, vec3(0.2126, 0.7152, 0.0722));
+}
 //////////////////////////////////////////
 
 ///////////////////ILLUMINATION MODELS///////////////////////
 // a subroutine for the Lambert model
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 Lambert() // this name is the one which is detected by the SetupShaders() function in the main application, and the one used to swap subroutines
 {
     // normalization of the per-fragment normal
     vec3 N = normalize(vNormal);
     // normalization of the per-fragment light incidence direction
     vec3 L = normalize(lightDir.xyz);
-    // Lambert coefficient
-    float lambertian = max(dot(L,N), 0.0);
+    // Lambert coefficient (0 in the shadow of the light)
+    float lambertian = max(dot(L,N), 0.0) * shadow();
     // Lambert illumination model  
-    return vec3(Kd * lambertian * diffuseColor);
+    vec3 color = vec3(Kd * lambertian * diffuseColor);
+    // contribution of the clustered lights
+    int first, count;
+    clusterRange(first, count);
+    for (int i = first; i < first + count; i++)
+    {
+      vec3 L_i, radiance;
+      clusterLight(i, L_i, radiance);
+      color += radiance * Kd * max(dot(L_i, N), 0.0) * diffuseColor;
+    }
+    return color;
 }
 //////////////////////////////////////////
 
 //////////////////////////////////////////
 // a subroutine to visualize Enhanced Normal vector
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 VisualizeEnhancedNormal()
 {
     // Computing the mask for Unsharp Masking
@@ -158,7 +409,7 @@ vec3 VisualizeEnhancedNormal()
 
 //////////////////////////////////////////
 // a subroutine to visualize Normal vector
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 VisualizeNormal()
 {
     // normalization of the per-fragment normal
@@ -169,7 +420,7 @@ vec3 VisualizeNormal()
 
 //////////////////////////////////////////
 // a subroutine to visualize Enhanced Curvature
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 VisualizeEnhancedCurvature()
 {
     // Computing the mask for Unsharp Masking
@@ -180,7 +431,7 @@ vec3 VisualizeEnhancedCurvature()
     // normalization of the per-fragment enhanced normal 
     vec3 N_I = normalize(eNormal);
     // calculating curvature value using enhanced normal
-    float curvature_value = curvature(N_I);
+    float curvature_value = vertexCurvature ? vertex_curvature(lambda) : curvature(N_I, lambda);
     vec3 ambient = vec3(curvature_value + 0.5);
     return ambient;
     
@@ -189,13 +440,13 @@ vec3 VisualizeEnhancedCurvature()
 
 //////////////////////////////////////////
 // a subroutine to visualize Curvature
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 VisualizeCurvature()
 {
     // normalization of the per-fragment normal
     vec3 N = normalize(vNormal);
     // calculating curvature value using normal vector
-    float curvature_value = curvature(N);
+    float curvature_value = vertexCurvature ? vertex_curvature(0.0) : curvature(N, 0.0);
     vec3 ambient = vec3(curvature_value + 0.5);
     return ambient;
     
@@ -204,7 +455,7 @@ vec3 VisualizeCurvature()
 
 //////////////////////////////////////////
 // a subroutine for the Gooch Shading model using Shape Depiction Enhancement based on local Geometry 
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 EnhancedGoochShading(){
   // normalization of the per-fragment light incidence direction
   vec3 L = normalize(lightDir.xyz);
@@ -220,7 +471,9 @@ vec3 EnhancedGoochShading(){
   // Equation 14 of the Chapter 6.3 of the reference paper applied only to diffuse and ambient components 
   float deltaA = (1 + rhoA) * 0.5;
   // NOTE: Reference paper use the lambertian coefficient as rho_d for diffuse
-  float rhoD = max(dot(L,N_I), 0.0);
+  // (in the shadow of the light, rho_d and rho_s are 0)
+  float visibility = shadow();
+  float rhoD = max(dot(L,N_I), 0.0) * visibility;
   // Equation 14 of the Chapter 6.3 of the reference paper applied only to diffuse and ambient components 
   float deltaD = (1 + rhoD) * 0.5;
   // Calculation of specular component, specified as in the reference paper, using the same as Phong model
@@ -228,7 +481,7 @@ vec3 EnhancedGoochShading(){
   vec3 V = normalize( vViewPosition );
   float specAngle = max(dot(R, V), 0.0);
   // shininess application to the specular component
-  float rhoS = pow(specAngle, shininess);
+  float rhoS = pow(specAngle, shininess) * visibility;
   // Diffuse component of standard gooch shading 
   //but using our previously calculated delta as weight, for diffuse and ambient component
   vec3 kCool = min(CoolColor + DiffuseCool * SurfaceColor, 1.0);
@@ -238,20 +491,33 @@ vec3 EnhancedGoochShading(){
   // Composition of the final color.
   // NOTE: In the paper is not specified how the three components are composed.
   //       This is my solution that considers only Ambient and Diffuse components, while maintaning full specular component
-  return  myWeightA * kFinalA + myWeightD * kFinalD + vec3(1) * rhoS;
+  vec3 color = myWeightA * kFinalA + myWeightD * kFinalD + vec3(1) * rhoS;
+  // the clustered lights add a warm diffuse component and their specular component
+  int first, count;
+  clusterRange(first, count);
+  for (int i = first; i < first + count; i++)
+  {
+    vec3 L_i, radiance;
+    clusterLight(i, L_i, radiance);
+    float rhoD_i = max(dot(L_i, N_I), 0.0);
+    float rhoS_i = pow(max(dot(normalize(reflect(-L_i, N_I)), V), 0.0), shininess);
+    color += radiance * (myWeightD * rhoD_i * kWarm + vec3(rhoS_i));
+  }
+  return color;
 }
 //////////////////////////////////////////
 
 //////////////////////////////////////////
 // a subroutine for the Gooch Shading model
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 GoochShading(){
   // normalization of the per-fragment light incidence direction
   vec3 L = normalize(lightDir.xyz);
   // normalization of the per-fragment normal
   vec3 N = normalize(vNormal);
-  // Lambert coefficient
-  float lambertian = dot(L, N);
+  // Lambert coefficient (in the shadow of the light, the surface is shaded as if it was facing away from the light)
+  float visibility = shadow();
+  float lambertian = mix(min(dot(L, N), 0.0), dot(L, N), visibility);
   // weight used in standard gooch shading
   float weight = ( lambertian + 1.0 ) * 0.5;
   // Diffuse component of standard gooch shading
@@ -263,15 +529,27 @@ vec3 GoochShading(){
   vec3 V = normalize( vViewPosition );
   float specAngle = max(dot(R, V), 0.0);
   // shininess application to the specular component
-  float specular = pow(specAngle, shininess);
+  float specular = pow(specAngle, shininess) * visibility;
   // Final color composition of the standard gooch shading
-  return vec3(kFinal + vec3(1) * specular);
+  vec3 color = vec3(kFinal + vec3(1) * specular);
+  // the clustered lights add a warm diffuse component and their specular component
+  int first, count;
+  clusterRange(first, count);
+  for (int i = first; i < first + count; i++)
+  {
+    vec3 L_i, radiance;
+    clusterLight(i, L_i, radiance);
+    float lambertian_i = max(dot(L_i, N), 0.0);
+    float specular_i = pow(max(dot(normalize(reflect(-L_i, N)), V), 0.0), shininess);
+    color += radiance * (lambertian_i * kWarm + vec3(specular_i));
+  }
+  return color;
 }
 //////////////////////////////////////////
 
 //////////////////////////////////////////
 // a subroutine for the Enhanced Cartoon/Cel Shading model using Shape Depiction Enhancement based on local Geometry 
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 EnhancedToonShading(){
   // normalization of the per-fragment light incidence direction
   vec3 L = normalize(lightDir.xyz);
@@ -288,7 +566,9 @@ vec3 EnhancedToonShading(){
   // Equation 13 of the Chapter 6.2 of the reference paper applied only to diffuse and ambient components 
   float deltaA = floor(0.5 + (Ql * pow(rhoA, r))) / Ql;
   // NOTE: Reference paper use the lambertian coefficient as rho_d for diffuse
-	float rhoD = max(dot(L,N_I), 0.0);
+  // (in the shadow of the light, rho_d and rho_s are 0)
+  float visibility = shadow();
+	float rhoD = max(dot(L,N_I), 0.0) * visibility;
   // Intensity parameter used in standard toon/cel shading, but using our enhanced normal, for the diffuse component
   // Equation 13 of the Chapter 6.2 of the reference paper applied only to diffuse and ambient components 
   float deltaD = floor(0.5 + (Ql * pow(rhoD, r))) / Ql;
@@ -298,11 +578,22 @@ vec3 EnhancedToonShading(){
   float specAngle = max(dot(R, V), 0.0);
   // shininess application to the specular component
   // NOTE: Reference paper use the lambertian coefficient as rho_s for specular
-  float deltaS = pow(specAngle, shininess);
+  float deltaS = pow(specAngle, shininess) * visibility;
   // Composition of the final intensity to apply, then, the color choice.
   // NOTE: In the paper is not specified how the three components are composed.
   //       This is my solution that considers only Ambient and Diffuse components, while maintaning full specular component
   float intensity = myWeightA * deltaA + myWeightD * deltaD + deltaS;
+  // the clustered lights add their (quantized) diffuse and specular intensities, weighted by their luminance
+  int first, count;
+  clusterRange(first, count);
+  for (int i = first; i < first + count; i++)
+  {
+    vec3 L_i, radiance;
+    clusterLight(i, L_i, radiance);
+    float deltaD_i = floor(0.5 + (Ql * pow(max(dot(L_i, N_I), 0.0), r))) / Ql;
+    float deltaS_i = pow(max(dot(normalize(reflect(-L_i, N_I)), V), 0.0), shininess);
+    intensity += luminance(radiance) * (myWeightD * deltaD_i + deltaS_i);
+  }
   // Color choice based on intensity parameter
 	if (intensity > 0.95)       return shinestColor;
 	else if (intensity > 0.5)   return shinyColor;
@@ -313,14 +604,23 @@ vec3 EnhancedToonShading(){
 
 //////////////////////////////////////////
 // a subroutine for the Cartoon/Cel Shading model
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 ToonShading(){
   // normalization of the per-fragment light incidence direction
   vec3 L = normalize(lightDir.xyz);
   // normalization of the per-fragment normal
   vec3 N = normalize(vNormal);
-  // Intensity parameter used in standard toon/cel shading
-	float intensity = dot(L,N);
+  // Intensity parameter used in standard toon/cel shading (in the shadow of the light, the surface is shaded as if it was facing away from the light)
+	float intensity = mix(min(dot(L,N), 0.0), dot(L,N), shadow());
+  // the clustered lights add their intensities, weighted by their luminance
+  int first, count;
+  clusterRange(first, count);
+  for (int i = first; i < first + count; i++)
+  {
+    vec3 L_i, radiance;
+    clusterLight(i, L_i, radiance);
+    intensity += luminance(radiance) * max(dot(L_i, N), 0.0);
+  }
   // Color choice based on intensity parameter
 	if (intensity > 0.95)       return shinestColor;
 	else if (intensity > 0.5)   return shinyColor;
@@ -331,7 +631,7 @@ vec3 ToonShading(){
 
 //////////////////////////////////////////
 // a subroutine for the Enhanced Blinn-Phong model using Shape Depiction Enhancement based on local Geometry 
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 EnhancedBlinnPhong()
 {
   // Computing the mask for Unsharp Masking
@@ -342,7 +642,7 @@ vec3 EnhancedBlinnPhong()
   // normalization of the per-fragment enhanced normal 
   vec3 N_I = normalize(eNormal);
   // calculating curvature value using enhanced normal
-  float curvature_value = curvature(N_I);
+  float curvature_value = vertexCurvature ? vertex_curvature(lambda) : curvature(N_I, lambda);
   // Implementing equation 12 of chapter 6.1 of the reference paper
   // I calculate the Curvature-Based Reflectance Scaling factor for each of the Blinn-Phong components
   // NOTE: Reference paper use the costant 1 as rho_a component for ambient
@@ -352,8 +652,9 @@ vec3 EnhancedBlinnPhong()
   vec3 color = Ka * G_a * ambientColor;
   // normalization of the per-fragment light incidence direction
   vec3 L = normalize(lightDir.xyz);
-  // Lambert coefficient
-  float rhoD = max(dot(L,N_I), 0.0);
+  // Lambert coefficient (in the shadow of the light, rho_d and rho_s are 0)
+  float visibility = shadow();
+  float rhoD = max(dot(L,N_I), 0.0) * visibility;
   // if the lambert coefficient is positive, then I can calculate the specular component
   if(rhoD > 0.0)
   {
@@ -367,7 +668,7 @@ vec3 EnhancedBlinnPhong()
     // we use H to calculate the specular component
     float specAngle = max(dot(H, N_I), 0.0);
     // shininess application to the specular component
-    float rhoS = pow(specAngle, shininess);
+    float rhoS = pow(specAngle, shininess) * visibility;
     // This is the Curvature-Based Reflectance Scaling factor for the specular component
     // NOTE: Reference paper use the lambertian coefficient as rho_s for specular
     float G_s = Lr(curvature_value, rhoS);
@@ -375,13 +676,29 @@ vec3 EnhancedBlinnPhong()
     color += vec3( Kd * G_d * diffuseColor +
                    Ks * G_s * specularColor);
   }
+  // the clustered lights are scaled by the same Curvature-Based factors
+  int first, count;
+  clusterRange(first, count);
+  vec3 V_c = normalize( vViewPosition );
+  for (int i = first; i < first + count; i++)
+  {
+    vec3 L_i, radiance;
+    clusterLight(i, L_i, radiance);
+    float rhoD_i = max(dot(L_i, N_I), 0.0);
+    if (rhoD_i > 0.0)
+    {
+      float rhoS_i = pow(max(dot(normalize(L_i + V_c), N_I), 0.0), shininess);
+      color += radiance * ( Kd * Lr(curvature_value, rhoD_i) * diffuseColor +
+                            Ks * Lr(curvature_value, rhoS_i) * specularColor);
+    }
+  }
   return color;
 }
 //////////////////////////////////////////
 
 //////////////////////////////////////////
 // a subroutine for the Blinn-Phong model
-subroutine(ill_model)
+ILLUMINATION_SUBROUTINE
 vec3 BlinnPhong() // this name is the one which is detected by the SetupShaders() function in the main application, and the one used to swap subroutines
 {
     // ambient component can be calculated at the beginning
@@ -390,8 +707,9 @@ vec3 BlinnPhong() // this name is the one which is detected by the SetupShaders(
     vec3 N = normalize(vNormal);
     // normalization of the per-fragment light incidence direction
     vec3 L = normalize(lightDir.xyz);
-    // Lambert coefficient
-    float lambertian = max(dot(L,N), 0.0);
+    // Lambert coefficient (0 in the shadow of the light)
+    float visibility = shadow();
+    float lambertian = max(dot(L,N), 0.0) * visibility;
     // if the lambert coefficient is positive, then I can calculate the specular component
     if(lambertian > 0.0)
     {
@@ -402,12 +720,28 @@ vec3 BlinnPhong() // this name is the one which is detected by the SetupShaders(
       // we use H to calculate the specular component
       float specAngle = max(dot(H, N), 0.0);
       // shininess application to the specular component
-      float specular = pow(specAngle, shininess);
+      float specular = pow(specAngle, shininess) * visibility;
       // We add diffusive and specular components to the final color
       // N.B. ): in this implementation, the sum of the components can be different than 1
       color += vec3( Kd * lambertian * diffuseColor +
                      Ks * specular * specularColor);
     }
+    // contribution of the clustered lights
+    int first, count;
+    clusterRange(first, count);
+    vec3 V_c = normalize( vViewPosition );
+    for (int i = first; i < first + count; i++)
+    {
+      vec3 L_i, radiance;
+      clusterLight(i, L_i, radiance);
+      float lambertian_i = max(dot(L_i, N), 0.0);
+      if (lambertian_i > 0.0)
+      {
+        float specular_i = pow(max(dot(normalize(L_i + V_c), N), 0.0), shininess);
+        color += radiance * ( Kd * lambertian_i * diffuseColor +
+                              Ks * specular_i * specularColor);
+      }
+    }
     return color;
 }
 //////////////////////////////////////////
@@ -416,8 +750,37 @@ vec3 BlinnPhong() // this name is the one which is detected by the SetupShaders(
 // main
 void main(void)
 {
+#ifdef DEFERRED
+    // the attributes of the visible surface are read from the G-buffer (the pixels without objects keep the clear color)
+    gPixel = ivec2(gl_FragCoord.xy);
+    uvec2 ids = texelFetch(gBufferIDs, gPixel, 0).xy;
+    if (ids.x == 0u)
+        discard;
+    gObject = ids.x;
+    gLinearDepth = texelFetch(gBufferDepth, gPixel, 0).r;
+    vec4 normals = texelFetch(gBufferNormals, gPixel, 0);
+    vNormal = decodeNormal(normals.xy);
+    vSMNormal = decodeNormal(normals.zw);
+    // position in view coordinates, from the center of the pixel in normalized device coordinates and the linear depth
+    vec2 ndc = (vec2(gPixel) + 0.5) / vec2(textureSize(gBufferDepth, 0)) * 2.0 - 1.0;
+    vec3 viewPosition = vec3(ndc * inverseProjectionScale * gLinearDepth, -gLinearDepth);
+    vViewPosition = -viewPosition;
+    lightDir = (viewMatrix * vec4(pointLightPosition, 1.0)).xyz - viewPosition;
+    diffuseColor = materialDiffuseColor[min(ids.y, 1u)];
+    // the ground is always rendered with the Lambert model, like in the forward shading
+    if (ids.y == GROUND_MATERIAL)
+    {
+        colorFrag = vec4(Lambert(), 1.0);
+        return;
+    }
+#endif
+#ifdef ILLUMINATION_MODEL
+    // in a specialized program, the model is called directly, so the compiler can inline it
+    vec3 color = ILLUMINATION_MODEL();
+#else
     // we call the pointer function Illumination_Model():
     // the subroutine selected in the main application will be called and executed
   	vec3 color = Illumination_Model(); 
+#endif
     colorFrag = vec4(color, 1.0);
 }
@@ -30,6 +30,23 @@ layout (location = 2) in vec3 sm_normal;
 // the numbers used for the location in the layout qualifier are the positions of the vertex attribute
 // as defined in the Mesh class
 
+// parameters to decode the vertex format of the mesh (see vertex_format.h), constant for all the vertices of a mesh
+// xyz = scale of the positions, w = 1 if the normals are octahedral-encoded
+layout (location = 6) in vec4 decodeScale;
+// xyz = offset of the positions
+layout (location = 7) in vec4 decodeOffset;
+
+// per-instance model matrix and normals transformation matrix (in world coordinates), used by instanced rendering (see instance_buffer.h)
+layout (location = 8) in mat4 instanceModelMatrix;
+layout (location = 12) in mat3 instanceNormalMatrix;
+
+// curvatures of the vertex, estimated at loading (see curvature.h): k1, k2, mean curvature, mean curvature of the smoothed normals
+// (the meshes without curvatures leave the attribute disabled, so it is (0, 0, 0, 1))
+layout (location = 15) in vec4 curvature;
+
+// if true, the per-instance matrices are used instead of modelMatrix and normalMatrix
+uniform bool instanced;
+
 // model matrix
 uniform mat4 modelMatrix;
 // view matrix
@@ -55,20 +72,46 @@ out vec3 vSMNormal;
 // we need to calculate also the reflection vector for each fragment
 // to do this, we need to calculate in the vertex shader the view direction (in view coordinates) for each vertex, and to have it interpolated for each fragment by the rasterization stage
 out vec3 vViewPosition;
-
+// mean curvatures of the normal and of the smoothed normal, in world units
+out vec2 vCurvature;
+
+// with the depth pre-pass, the depths of the shading pass are compared with GL_EQUAL to the ones of depth_prepass_vt.vert,
+// which computes gl_Position with the same operations: the invariant qualifier guarantees the same result in the two programs
+invariant gl_Position;
+
+// decoding of a unit vector stored with octahedral encoding
+// the mesh provides only 2 components, so the attribute is received as vec3(x, y, 0)
+vec3 decodeNormal(vec3 n)
+{
+  if (decodeScale.w < 0.5)
+    return n;
+  vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+  float t = max(-v.z, 0.0);
+  v.x += (v.x >= 0.0) ? -t : t;
+  v.y += (v.y >= 0.0) ? -t : t;
+  return normalize(v);
+}
 
 void main(){
 
   // vertex position in ModelView coordinate (see the last line for the application of projection)
   // when I need to use coordinates in camera coordinates, I need to split the application of model and view transformations from the projection transformations
-  vec4 mvPosition = viewMatrix * modelMatrix * vec4( position, 1.0 );
+  // positions stored as normalized integers are mapped back to the bounding box of the mesh
+  vec3 decodedPosition = decodeOffset.xyz + decodeScale.xyz * position;
+  mat4 model = instanced ? instanceModelMatrix : modelMatrix;
+  // with instanced rendering, the normals transformation matrix is in world coordinates: we apply the rotation of the view matrix
+  mat3 normalMat = instanced ? mat3(viewMatrix) * instanceNormalMatrix : normalMatrix;
+  vec4 mvPosition = viewMatrix * model * vec4( decodedPosition, 1.0 );
   
   // view direction, negated to have vector from the vertex to the camera
   vViewPosition = -mvPosition.xyz;
 
   // transformations are applied to the normal and smoothed normal
-  vNormal = normalize( normalMatrix * normal );
-  vSMNormal = normalize( normalMatrix * sm_normal );
+  vNormal = normalize( normalMat * decodeNormal(normal) );
+  vSMNormal = normalize( normalMat * decodeNormal(sm_normal) );
+  // the curvatures are in object units: the scale of the model matrix converts them in world units
+  vCurvature = curvature.zw / length(model[0].xyz);
+
   // light incidence direction (in view coordinate)
   vec4 lightPos = viewMatrix  * vec4(pointLightPosition, 1.0);
   lightDir = lightPos.xyz - mvPosition.xyz;
@@ -20,6 +20,98 @@ N.B. 3) no texturing in this version of the classes
 
 N.B. 4) to test different parameters of the shaders, it is convenient to use some GUI library, like e.g. Dear ImGui (https://github.com/ocornut/imgui)
 
+N.B. 5) the application can run in a headless mode, to render a sequence of frames without user input (e.g., on a machine without GPU,
+using the software rasterizer of Mesa, or in automated tests of the shaders):
+
+    ./myproject.out --headless --subroutine GoochShading --width 1920 --height 1080 --frames 120 --output frames/gooch
+
+The frames are rendered in a Framebuffer Object, and saved as PPM images (frames/gooch_0000.ppm, ...) using an asynchronous readback.
+Optional arguments: --scene <file> (see include/utils/scene.h), --camera-path <file> (see include/utils/camera_path.h;
+the default is an orbit around the scene), --egl (the context is created with EGL instead of GLX, e.g. with
+LIBGL_ALWAYS_SOFTWARE=1 on a machine without display server, if GLFW has been built with EGL support).
+A window is always created by GLFW (but never shown): on a machine without display server, the application can be run with xvfb-run.
+
+N.B. 6) with --profile, the CPU and GPU times of the frames and of the rendering of each object are measured (include/utils/profiler.h),
+and their percentiles are printed on console (every 2 seconds, and at the end). With --trace <file>, a trace of the frames is saved
+in the Chrome trace format.
+
+N.B. 7) with --smoothing-scales 2,4,8, the smoothed normals are precomputed also with a Gaussian kernel of sigma = 2, 4, 8 mean edge lengths
+(include/utils/multiscale_normals.h). The N key switches among the scales at runtime (scale 0 = one-ring smoothed normals, as in the paper
+with sigma = 1); --smoothing-scale <k> selects the initial scale.
+
+N.B. 8) the models are loaded asynchronously (include/utils/model_loader.h): the window is responsive from the first frame, and the meshes
+appear as they are ready. --upload-budget <MB> sets the maximum amount of data copied in the GPU buffers at each frame (default 8 MB).
+
+N.B. 9) at loading, the triangles and the vertices of the meshes are reordered for the vertex cache and the overdraw (include/utils/mesh_optimizer.h),
+and the ACMR/ATVR before and after the optimization are printed on console. --mesh-optimization none|cache|overdraw selects the steps.
+
+N.B. 10) at loading, a chain of simplified levels of detail is built for each mesh (include/utils/mesh_simplifier.h), each one with its own
+smoothed normals. At each frame, every object is rendered with the coarsest level whose geometric error is smaller than --lod-error <pixels>
+on the screen (default 1 pixel, 0 = always the original meshes); --lod-levels <n> sets the number of levels (default 3, 0 = no simplification).
+
+N.B. 11) with --meshlets, the meshes are split in clusters of about 124 triangles (include/utils/meshlets.h), and at each frame the clusters
+outside the view frustum or facing away from the camera are discarded on the CPU (on a pool of threads) before the draw calls.
+With --profile, the number of triangles of each pass counts only the submitted clusters.
+
+N.B. 12) the objects outside the view frustum are skipped entirely (no uniform uploads and no draw calls): their world-space bounding spheres
+are tested with SIMD instructions on a pool of threads (include/utils/culling.h), and the boxes of the visible ones refine the result.
+With --profile, the culled objects are counted for each frame.
+
+N.B. 13) with --occlusion-culling, the coarsest levels of detail of the biggest objects on the screen are rasterized on the CPU in a small
+depth buffer (include/utils/occlusion.h), and the objects hidden behind them are skipped like the ones outside the frustum.
+With --profile, the occluded objects are counted for each frame.
+
+N.B. 14) the curvatures of the vertices are estimated at loading (include/utils/curvature.h), and the Enhanced Blinn-Phong model and the
+curvature visualizers read them from a vertex attribute, instead of the screen-space derivatives of the normal. --screen-space-curvature
+uses the previous per-fragment estimate. The curvature of the smoothed normals is estimated at each scale, so the N key changes it with
+the normals.
+
+N.B. 15) with --gpu-smoothing n, the smoothed normals of the meshes are computed again on the GPU (include/utils/gpu_smoothing.h), with n
+iterations of diffusion after the one-ring average, and written in place in the VBOs: the G key doubles the iterations (0, 1, 2, ..., 256, 0)
+and selects the scale 0 of the smoothed normals. The compute shaders are used with OpenGL 4.3, otherwise (or with --gpu-smoothing-fallback)
+the transform feedback. In headless mode, --gpu-smoothing-check compares each mesh with the CPU implementation, and prints the maximum angle.
+The curvatures of the vertices (N.B. 14) are estimated from the smoothed normals of the CPU: while the scale 0 reads the normals computed
+on the GPU, the curvature is estimated in screen space.
+
+N.B. 16) the binary of the Shader Program is saved next to the fragment shader (include/utils/program_cache.h), and it is loaded in the
+following runs instead of compiling the sources, until the sources or the driver change. --no-program-cache always compiles the sources.
+
+N.B. 17) with --shader-permutations, a specialized Shader Program is compiled for each illumination model (include/utils/shader_permutations.h):
+the model is called directly, and the material parameters are constants, so the compiler can inline and fold them (vertexCurvature is a
+constant only if it is false, since the GPU smoothing disables it at runtime, see N.B. 15).
+The number keys switch program instead of subroutine, and the ground is rendered with the program of the Lambert model.
+The Benchmark application compares the two paths with --permutations.
+
+N.B. 18) with --deferred (or pressing the F key), the objects are rendered in a G-buffer (include/utils/gbuffer.h, gbuffer_fr.frag), and the
+illumination model is evaluated once per pixel by a full-screen pass (illumination_models_modified_fr.frag with DEFERRED defined), so the
+cost of the shading does not depend on the fragments hidden by other objects. In the deferred shading, the curvature is always estimated
+in screen space, with a wider stencil of pixels of the G-buffer, and the subroutines are used also with --shader-permutations.
+
+N.B. 19) with --depth-prepass (or pressing the Z key), the forward shading starts with a depth pre-pass: all the objects are rendered with a
+minimal program (depth_prepass_vt.vert, depth_prepass_fr.frag), which reads only a separate stream of tightly packed positions (see N.B. 10
+in include/utils/mesh_v1.h), without color writes. Then the objects are shaded with the GL_EQUAL depth test and without depth writes, so
+the illumination model is evaluated only for the visible fragments. With --profile, the samples which pass the depth test in the pre-pass
+(= the fragments which would be shaded without it) and in the shading pass are counted, and their difference is printed as the saved
+fragment shader invocations. The pre-pass is not used with the deferred shading, whose geometry pass already has a cheap fragment shader.
+The stream of the positions is uploaded with the models only with --depth-prepass or --shadows: if the pre-pass or the shadows are
+activated at runtime, the stream is created from the VBOs of the meshes, the first time.
+
+N.B. 20) with --lights n, n colored point lights are scattered over the plane, besides the main light. At each frame, they are assigned
+on a pool of threads to the clusters of the view frustum (include/utils/light_clusters.h), and each fragment is lit only by the lights
+of its cluster (at most CLUSTER_MAX_LIGHTS), in the forward and in the deferred shading. With --profile, the statistics of the clusters
+are printed with the times of the frames.
+
+N.B. 21) with --shadows (or pressing the H key), the main point light casts shadows, with a cube shadow map (include/utils/shadow_cache.h,
+shadow_vt.vert, shadow_fr.frag). The objects which do not move are rendered in a cached cube map only when it is invalidated (at the
+beginning, when a model is loaded or moved, or when the rotation of the spinning objects is stopped or started), and at each frame
+the spinning objects are rendered on a copy of the cached faces which contain them. The ground does not cast shadows.
+With --profile, the fraction of the frames which invalidated the cache is printed with the times of the frames.
+
+N.B. 22) when the models are loaded, the meshes of each model with more than one mesh are packed in shared buffers (include/utils/mesh_batch.h),
+and the object is rendered with a single glMultiDrawElementsBaseVertex call, with the levels of detail selected for its meshes. The objects
+with meshlets, or with a scale of the smoothed normals different from 0, are rendered mesh by mesh. The batches are built again after the
+smoothed normals are computed on the GPU.
+
 author: Davide Gadia
 refined by: Francesco Brischetto mat. 958022
 
@@ -47,6 +139,13 @@ positive Z axis points "outside" the screen
 
 // Std. Includes
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <memory>
 
 // Loader for OpenGL extensions
 // http://glad.dav1d.de/
@@ -72,6 +171,21 @@ positive Z axis points "outside" the screen
 #include <utils/shader_v1.h>
 #include <utils/model_modified.h>
 #include <utils/camera.h>
+#include <utils/uniform_buffer.h>
+#include <utils/material_parameters.h>
+#include <utils/offscreen.h>
+#include <utils/scene.h>
+#include <utils/camera_path.h>
+#include <utils/profiler.h>
+#include <utils/model_loader.h>
+#include <utils/culling.h>
+#include <utils/occlusion.h>
+#include <utils/gpu_smoothing.h>
+#include <utils/shader_permutations.h>
+#include <utils/gbuffer.h>
+#include <utils/light_clusters.h>
+#include <utils/shadow_cache.h>
+#include <utils/mesh_batch.h>
 
 // we load the GLM classes used in the application
 #include <glm/glm.hpp>
@@ -82,6 +196,66 @@ positive Z axis points "outside" the screen
 // dimensions of application's window
 GLuint screenWidth = 800, screenHeight = 600;
 
+// options of the application, set by the command line arguments
+struct RenderOptions
+{
+    // if true, the frames are rendered offscreen along a camera path, and saved as images
+    bool headless = false;
+    // if true, the context is created with EGL
+    bool egl = false;
+    // file with the objects of the scene (if empty, the default scene is used)
+    string scenePath;
+    // file with the keyframes of the camera (if empty, an orbit around the scene is used)
+    string cameraPath;
+    // name of the shader subroutine applied to the objects (if empty, the first one)
+    string subroutine;
+    // prefix of the saved images
+    string output = "frame";
+    GLuint width = 800, height = 600;
+    GLuint frames = 60;
+    // if true, the times of the frames and of the passes are measured and printed
+    bool profile = false;
+    // file of the Chrome trace (if empty, the trace is not saved)
+    string trace;
+    // sigma of the additional scales of the smoothed normals, and scale used at the beginning (0 = one-ring)
+    vector<GLfloat> smoothingScales;
+    GLuint smoothingScale = 0;
+    // maximum number of bytes of the models copied in the GPU buffers at each frame
+    size_t uploadBudget = MODEL_LOADER_DEFAULT_BUDGET;
+    // reordering of the triangles and of the vertices of the meshes at loading
+    MeshOptimization optimization = MESH_OPTIMIZATION_OVERDRAW;
+    // number of levels of detail of the meshes, and maximum error on the screen (in pixels) of the level used for rendering
+    GLuint lodLevels = 3;
+    GLfloat lodError = 1.0f;
+    // if true, the meshes are split in meshlets, culled at each frame
+    bool meshlets = false;
+    // if true, the objects hidden by the occluders are culled at each frame
+    bool occlusionCulling = false;
+    // if true, the curvature is read from the vertices (estimated at loading), otherwise it is estimated per fragment
+    bool vertexCurvature = true;
+    // iterations of the diffusion of the smoothed normals computed on the GPU (-1 = the normals computed at loading are kept)
+    GLint gpuSmoothing = -1;
+    // if true, the smoothed normals computed on the GPU are compared with the CPU implementation (headless mode)
+    bool gpuSmoothingCheck = false;
+    // if true, the smoothed normals are computed with transform feedback also with OpenGL 4.3
+    bool gpuSmoothingFallback = false;
+    // if true, the binary of the Shader Program is loaded from (and saved to) a cache file
+    bool programCache = true;
+    // if true, the illumination models are rendered with a specialized Shader Program for each model, instead of the subroutines
+    bool permutations = false;
+    // if true, the illumination models are evaluated by a full-screen pass on the G-buffer
+    bool deferred = false;
+    // if true, the forward shading is preceded by a depth pre-pass
+    bool depthPrepass = false;
+    // number of the clustered point lights scattered over the plane
+    GLuint lights = 0;
+    // if true, the main point light casts shadows
+    bool shadows = false;
+};
+
+// it reads the options from the command line arguments. It returns false if an argument is not valid
+bool ParseArguments(int argc, char* argv[], RenderOptions& options);
+
 // callback functions for keyboard events
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -92,6 +266,8 @@ void apply_camera_movements();
 GLuint current_subroutine = 0;
 // a vector for all the shader subroutines names used and swapped in the application
 vector<std::string> shaders;
+// the indices of the subroutines in the Shader Program (in the same order of the shaders vector)
+vector<GLuint> subroutine_indices;
 
 // the name of the subroutines are searched in the shaders, and placed in the shaders vector (to allow shaders swapping)
 void SetupShader(int shader_program);
@@ -111,6 +287,8 @@ bool firstMouse = true;
 // parameters for time calculation (for animations)
 GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
+// in headless mode, time advances by a fixed step at each frame, so the sequence of frames does not depend on the rendering speed
+const GLfloat HEADLESS_TIME_STEP = 1.0f / 30.0f;
 
 // rotation angle on Y axis
 GLfloat orientationY = 0.0f;
@@ -122,12 +300,37 @@ GLboolean spinning = GL_TRUE;
 // boolean to activate/deactivate wireframe rendering
 GLboolean wireframe = GL_FALSE;
 
+// scale of the smoothed normals selected with the N key, and number of available scales
+GLuint smoothing_scale = 0;
+GLuint num_smoothing_scales = 1;
+// iterations of the smoothed normals computed on the GPU, selected with the G key (-1 = the normals computed at loading)
+GLint gpu_smoothing_iterations = -1;
+
+// selection of the levels of detail: maximum error on the screen (in pixels), and size in pixels of a unit of length at distance 1 from the camera
+GLfloat lod_max_error = 1.0f;
+GLfloat lod_pixels_per_unit = 1.0f;
+
+// view frustum culling of the objects (the bounding spheres are updated at each frame)
+FrustumCuller object_culler;
+// software occlusion culling of the objects, and its activation
+OcclusionCuller occlusion_culler;
+bool occlusion_culling = false;
+
+// boolean to activate/deactivate the deferred shading
+bool deferred_shading = false;
+// boolean to activate/deactivate the depth pre-pass of the forward shading
+bool depth_prepass = false;
+// boolean to activate/deactivate the shadows of the main point light
+bool shadow_mapping = false;
+
 // we create a camera. We pass the initial position as a parameter to the constructor. The last boolean tells that we want a camera "anchored" to the ground
 Camera camera(glm::vec3(0.0f, 1.0f, 9.0f), GL_TRUE);
 
 // Uniforms to pass to shaders
 // position of a pointlight
 glm::vec3 lightPos0 = glm::vec3(5.0f, 10.0f, 10.0f);
+// it returns the clustered point lights scattered over the plane (the same lights for the same count)
+vector<PointLight> SceneLights(GLuint count);
 //GLfloat lightColor[] = {1.0f,1.0f,1.0f};
 
 // diffusive, specular and ambient components
@@ -175,11 +378,109 @@ GLfloat far = 100.0f;
 
 // color to be passed as uniform to the shader of the plane
 GLfloat planeMaterial[] = {0.1f,1.0f,0.1f};
+// identifiers of the materials written in the G-buffer by the deferred shading (the ground is rendered with the Lambert model)
+const GLuint GROUND_MATERIAL = 0;
+const GLuint OBJECT_MATERIAL = 1;
+
+// it collects the current values of the parameters in the structure sent to the shaders (see include/utils/material_parameters.h)
+MaterialParameters CurrentMaterialParameters();
+
+// locations of the uniforms and index of the subroutine used for the ground, retrieved once after the creation of the Shader Program
+struct ShaderLocations
+{
+    GLint projectionMatrix;
+    GLint viewMatrix;
+    GLint modelMatrix;
+    GLint normalMatrix;
+    GLint pointLight;
+    GLint matDiffuse;
+    GLint shadows;
+    GLuint lambertIndex;
+};
+
+// it retrieves the locations of the uniforms of a Shader Program (the Shader class has cached them after linking)
+ShaderLocations GetShaderLocations(const Shader& shader);
+
+// programs and G-buffer of the deferred shading, created the first time the deferred shading is activated
+struct DeferredShading
+{
+    // geometry pass (it writes the G-buffer) and full-screen pass (it evaluates the illumination model with the subroutines)
+    Shader geometry;
+    Shader resolve;
+    GBuffer gbuffer;
+    ShaderLocations geometryLocations;
+    GLint objectID, materialID;
+    ShaderLocations resolveLocations;
+    // indices of the subroutines in the full-screen pass (in the same order of the shaders vector)
+    vector<GLuint> resolveIndices;
+
+    DeferredShading(const GLchar* fragmentPath, GLsizei width, GLsizei height, const glm::mat4& projection, const LightClusters& lightClusters,
+                    const ShadowCache& shadowCache, bool programCache);
+};
+
+// program of the depth pre-pass, created the first time the pre-pass is activated
+struct DepthPrepass
+{
+    Shader program;
+    ShaderLocations locations;
+
+    DepthPrepass(bool programCache);
+};
+
+// shadow map of the main point light: the program of the casters, the cube maps, and the state of the objects in the static cache
+struct ShadowMapping
+{
+    Shader program;
+    GLint modelMatrix, lightSpaceMatrix, lightPosition;
+    ShadowCache cache;
+
+    // an object is in the static cache with its model matrix and its number of meshes (the models are loaded incrementally):
+    // if they change, or if it becomes a dynamic caster, the faces which contain its old and new bounds are invalidated
+    struct CachedCaster
+    {
+        bool cached = false;
+        glm::mat4 modelMatrix;
+        size_t meshes = 0;
+        Bounds bounds;
+    };
+    vector<CachedCaster> casters;
+
+    ShadowMapping(bool programCache);
+};
+
+// it updates the shadow map of the main point light: the spinning objects are the dynamic casters (if the rotation is active),
+// the other objects are cached (the ground objects do not cast shadows)
+void UpdateShadowMap(ShadowMapping& shadows, const vector<SceneObject>& objects, vector<Model>& models, const vector<glm::mat4>& modelMatrices,
+                     const vector<Bounds>& worldBounds, Profiler& profiler);
+
+// names of the sample counters of the depth pre-pass and of the forward shading (see include/utils/profiler.h)
+const string PREPASS_SAMPLES = "depth pre-pass";
+const string SHADING_SAMPLES = "forward shading";
+
+// it prints the fragment shader invocations saved by the depth pre-pass, from the sample counters of the profiler
+void PrintPrepassSavings(const Profiler& profiler);
+
+// it renders all the objects of the scene in the currently bound framebuffer. If permutations is not null, each object is rendered
+// with the specialized program of its illumination model (with the locations in permutationLocations), instead of the subroutines of shader.
+// If deferred is not null, the objects are rendered in its G-buffer, and the illumination model is evaluated by its full-screen pass.
+// Otherwise, if prepass is not null, the forward shading is preceded by a depth pre-pass. The clustered lights are assigned to the clusters of the view.
+// If shadows is not null, the shadow map of the main light is updated and used by the illumination models.
+// The objects with a batch of their meshes (see N.B. 22) are rendered with it
+void RenderScene(Shader& shader, const ShaderLocations& locations, ShaderPermutations* permutations, const vector<ShaderLocations>& permutationLocations,
+                 DeferredShading* deferred, DepthPrepass* prepass, UniformBuffer<MaterialParameters>& materialBuffer, LightClusters& lightClusters,
+                 ShadowMapping* shadows,
+                 const vector<SceneObject>& objects, vector<Model>& models, vector<MeshBatch>& batches, const glm::mat4& projection, const glm::mat4& view,
+                 Profiler& profiler, ThreadPool& cullingPool);
 
 
 /////////////////// MAIN function ///////////////////////
-int main()
+int main(int argc, char* argv[])
 {
+  // we read the command line arguments
+  RenderOptions options;
+  if (!ParseArguments(argc, argv, options))
+      return -1;
+
   // Initialization of OpenGL context using GLFW
   glfwInit();
   // We set OpenGL specifications required for this application
@@ -193,6 +494,11 @@ int main()
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   // we set if the window is resizable
   glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  // in headless mode, the window is used only to create the context, and it is never shown
+  if (options.headless)
+      glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  if (options.egl)
+      glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
 
   // we create the application's window
     GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "MyProject", nullptr, nullptr);
@@ -204,12 +510,15 @@ int main()
     }
     glfwMakeContextCurrent(window);
 
-    // we put in relation the window and the callbacks
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
+    if (!options.headless)
+    {
+        // we put in relation the window and the callbacks
+        glfwSetKeyCallback(window, key_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
 
-    // we disable the mouse cursor
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // we disable the mouse cursor
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // GLAD tries to load the context set by GLFW
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress))
@@ -217,6 +526,7 @@ int main()
         std::cout << "Failed to initialize OpenGL context" << std::endl;
         return -1;
     }
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << " - OpenGL " << glGetString(GL_VERSION) << std::endl;
 
     // we define the viewport dimensions
     int width, height;
@@ -230,42 +540,321 @@ int main()
     glClearColor(0.26f, 0.46f, 0.98f, 1.0f);
 
     // we create the Shader Program used for objects (which presents different subroutines we can switch)
-    Shader illumination_shader = Shader("illumination_models_modified_vt.vert", "illumination_models_modified_fr.frag");
+    // (with the cache, the binary of the program linked in a previous run is loaded instead of compiling the sources)
+    std::chrono::steady_clock::time_point shaderStart = std::chrono::steady_clock::now();
+    const GLchar* fragmentPath = "illumination_models_modified_fr.frag";
+    Shader illumination_shader = Shader("illumination_models_modified_vt.vert", fragmentPath,
+                                        options.programCache ? string(fragmentPath) + PROGRAM_CACHE_EXTENSION : string());
+    std::cout << "Shader Program " << (illumination_shader.LoadedFromCache() ? "loaded from the binary cache" : "compiled") << " in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count() << " ms" << std::endl;
     // we parse the Shader Program to search for the number and names of the subroutines.
     // the names are placed in the shaders vector
     SetupShader(illumination_shader.Program);
+    // if a subroutine has been requested by name, we search it in the shaders vector
+    if (!options.subroutine.empty())
+    {
+        vector<std::string>::iterator it = std::find(shaders.begin(), shaders.end(), options.subroutine);
+        if (it == shaders.end())
+        {
+            std::cout << "ERROR: subroutine " << options.subroutine << " not found in the Shader Program" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        current_subroutine = (GLuint)(it - shaders.begin());
+    }
     // we print on console the name of the first subroutine used
     PrintCurrentShader(current_subroutine);
 
-    // we load the model(s) (code of Model class is in include/utils/model_v1.h)
-    Model armadilloModel("../../models/armadillo.obj");
-    Model bunnyModel("../../models/stanford-bunny.obj");
-    Model dragonModel("../../models/stanford-dragon.obj");
-    Model planeModel("../../models/plane.obj");
+    // we retrieve once the locations of the uniforms and the index of the subroutine used for the plane
+    // (the Shader class has cached them after linking), so that in the rendering loop we do not need to search them by name
+    ShaderLocations locations = GetShaderLocations(illumination_shader);
+
+    // we create the uniform buffer for the material parameters, and we connect it to the uniform block of the Shader Program
+    UniformBuffer<MaterialParameters> materialBuffer(MATERIAL_BINDING_POINT);
+    GLint materialBlockSize = illumination_shader.BindUniformBlock("MaterialParameters", MATERIAL_BINDING_POINT);
+    if (materialBlockSize != (GLint)sizeof(MaterialParameters))
+        std::cout << "WARNING: MaterialParameters block size (" << materialBlockSize << ") differs from the C++ structure (" << sizeof(MaterialParameters) << ")" << std::endl;
+
+    // we upload in the VBOs only the vertex attributes read by the Shader Program, using the compact vertex format
+    // (16 bit positions and octahedral normals, see include/utils/vertex_format.h)
+    ModelOptions modelOptions;
+    modelOptions.vertexFormat = VertexFormat::Compact(VertexFormat::AttributesUsedBy(illumination_shader.Program));
+    // the smoothed normals at the additional scales are computed once, at loading
+    modelOptions.smoothingScales = options.smoothingScales;
+    modelOptions.optimization = options.optimization;
+    modelOptions.lodLevels = options.lodLevels;
+    modelOptions.meshlets = options.meshlets;
+    modelOptions.curvatures = options.vertexCurvature;
+    // the stream of the positions read by the depth pre-pass and by the shadows is uploaded only if one of them is active at the beginning
+    // (if they are activated at runtime, the stream is created from the VBOs, see buildPositionStreams)
+    modelOptions.positionStream = options.depthPrepass || options.shadows;
+
+    // we read the objects of the scene (the default one is the plane with the armadillo, the bunny and the dragon)
+    vector<SceneObject> objects = DefaultScene();
+    if (!options.scenePath.empty() && !LoadScene(options.scenePath, objects))
+    {
+        glfwTerminate();
+        return -1;
+    }
+
+    // we load the model(s) (code of Model class is in include/utils/model_modified.h) on the worker threads of the loader:
+    // the models are empty at the beginning, and their meshes are added by loader.Update when they are uploaded
+    // (the memory of the vector is reserved, so the models are not moved while they are loading)
+    ModelLoader loader;
+    // threads for the culling of the objects and of the meshlets
+    ThreadPool cullingPool;
+    vector<Model> models;
+    models.reserve(objects.size());
+    for (const SceneObject& object : objects)
+    {
+        models.emplace_back(modelOptions);
+        loader.Load(object.modelPath, modelOptions, &models.back());
+    }
+    num_smoothing_scales = (GLuint)options.smoothingScales.size() + 1;
+    smoothing_scale = glm::min(options.smoothingScale, num_smoothing_scales - 1);
+    GLuint applied_smoothing_scale = 0;
 
     // Projection matrix: FOV angle, aspect ratio, near and far planes
-    glm::mat4 projection = glm::perspective(45.0f, (float)screenWidth/(float)screenHeight, near, far);
+    GLuint frameWidth = options.headless ? options.width : screenWidth;
+    GLuint frameHeight = options.headless ? options.height : screenHeight;
+    glm::mat4 projection = glm::perspective(45.0f, (float)frameWidth/(float)frameHeight, near, far);
+    // projection[1][1] = 1 / tan(fov / 2)
+    lod_pixels_per_unit = 0.5f * frameHeight * projection[1][1];
+    lod_max_error = options.lodError;
+    // the curvatures of the vertices (in world units) are scaled to the range of the screen-space estimate of the shader,
+    // which is about 32 tan(fov / 2) / (viewport height) times the mean curvature
+    illumination_shader.Use();
+    glUniform1i(illumination_shader.UniformLocation("vertexCurvature"), options.vertexCurvature);
+    glUniform1f(illumination_shader.UniformLocation("curvatureScale"), 32.0f / (projection[1][1] * frameHeight));
+
+    // the clustered point lights: the tiles of the clusters are in pixels of the framebuffer, and the texture units and the parameters
+    // of the clusters are set in each program which uses the illumination models
+    LightClusters lightClusters;
+    lightClusters.SetLights(SceneLights(options.lights));
+    lightClusters.SetProjection(projection, near, far, options.headless ? options.width : width, options.headless ? options.height : height);
+    lightClusters.SetupProgram(illumination_shader.Program);
+    // the shadow map of the main light (the cube maps are created the first time the shadows are activated)
+    ShadowMapping shadowMapping(options.programCache);
+    shadowMapping.cache.SetupProgram(illumination_shader.Program);
+    shadow_mapping = options.shadows;
+
+    // the specialized programs of the illumination models, in the same order of the subroutines (the material parameters are
+    // constants, with their values at this point, and so is vertexCurvature if it is false)
+    unique_ptr<ShaderPermutations> permutations;
+    vector<ShaderLocations> permutation_locations;
+    if (options.permutations)
+    {
+        shaderStart = std::chrono::steady_clock::now();
+        vector<string> defines;
+        if (!options.vertexCurvature)
+            defines.push_back("VERTEX_CURVATURE false");
+        defines.push_back("STATIC_PARAMETERS " + MaterialParameterConstants(CurrentMaterialParameters()));
+        permutations.reset(new ShaderPermutations("illumination_models_modified_vt.vert", fragmentPath, "ILLUMINATION_MODEL", shaders, defines,
+                                                  options.programCache ? string(fragmentPath) : string()));
+        std::cout << permutations->Size() << " specialized Shader Programs (" << permutations->NumLoadedFromCache() << " from the binary cache) in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count() << " ms" << std::endl;
+        for (size_t i = 0; i < permutations->Size(); i++)
+        {
+            permutation_locations.push_back(GetShaderLocations((*permutations)[i]));
+            (*permutations)[i].Use();
+            glUniform1i((*permutations)[i].UniformLocation("vertexCurvature"), options.vertexCurvature);
+            glUniform1f((*permutations)[i].UniformLocation("curvatureScale"), 32.0f / (projection[1][1] * frameHeight));
+            lightClusters.SetupProgram((*permutations)[i].Program);
+            shadowMapping.cache.SetupProgram((*permutations)[i].Program);
+        }
+    }
+    // the depth buffer of the occlusion culling has the aspect ratio of the frame
+    occlusion_culling = options.occlusionCulling;
+    occlusion_culler.Resize(OCCLUSION_DEFAULT_WIDTH, glm::max(OCCLUSION_DEFAULT_WIDTH * frameHeight / frameWidth, 1u));
+
+    // the batches of the meshes of the models with more than one mesh (see N.B. 22): they are built when the loading is complete
+    // (the models with meshlets are rendered mesh by mesh)
+    vector<MeshBatch> batches(models.size());
+    auto buildBatches = [&]()
+    {
+        if (!loader.Idle())
+            return;
+        for (size_t i = 0; i < models.size(); i++)
+            if (batches[i].NumMeshes() == 0 && models[i].meshes.size() > 1 && models[i].meshes[0].NumMeshlets() == 0)
+            {
+                batches[i].Add(models[i]);
+                batches[i].Build();
+            }
+    };
+
+    // smoothed normals computed on the GPU: the adjacency of each mesh is uploaded the first time it is smoothed, and the iterations
+    // applied to each mesh are recorded (-1 = not smoothed on the GPU), so only the meshes with different iterations are smoothed
+    // (e.g., the meshes uploaded after the last change of the iterations)
+    GpuNormalSmoother gpu_smoother(options.gpuSmoothingFallback);
+    vector<vector<GpuSmoothingTopology>> gpu_topologies(models.size());
+    vector<vector<GLint>> gpu_smoothed(models.size());
+    gpu_smoothing_iterations = options.gpuSmoothing;
+    GLint applied_gpu_smoothing = -1;
+    auto applyGpuSmoothing = [&](GLuint iterations, bool verify)
+    {
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            bool smoothed = false;
+            for (size_t m = 0; m < models[i].meshes.size(); m++)
+            {
+                if (m == gpu_topologies[i].size())
+                {
+                    gpu_topologies[i].emplace_back(models[i].meshes[m]);
+                    gpu_smoothed[i].push_back(-1);
+                }
+                if (gpu_smoothed[i][m] == (GLint)iterations)
+                    continue;
+                gpu_smoothed[i][m] = (GLint)iterations;
+                smoothed = true;
+                if (!verify)
+                {
+                    gpu_smoother.Smooth(models[i].meshes[m], gpu_topologies[i][m], iterations);
+                    continue;
+                }
+                GLfloat error = gpu_smoother.Verify(models[i].meshes[m], gpu_topologies[i][m], iterations);
+                std::cout << "GPU smoothed normals (" << (gpu_smoother.UsesCompute() ? "compute" : "transform feedback") << ", "
+                          << iterations << " iterations) of " << objects[i].modelPath << ", mesh " << m << ": ";
+                if (error < 0.0f)
+                    std::cout << "not available" << std::endl;
+                else
+                    std::cout << "maximum difference from the CPU " << error << " degrees" << std::endl;
+            }
+            // the batch copied the previous smoothed normals of the VBOs
+            if (smoothed)
+                batches[i] = MeshBatch();
+        }
+    };
+    // the curvatures of the vertices match the smoothed normals of the CPU: while the scale 0 reads the smoothed normals computed
+    // on the GPU, the programs estimate the curvature in screen space
+    bool applied_vertex_curvature = options.vertexCurvature;
+    auto updateVertexCurvature = [&]()
+    {
+        bool vertexCurvature = options.vertexCurvature && (applied_gpu_smoothing < 0 || smoothing_scale != 0);
+        if (vertexCurvature == applied_vertex_curvature)
+            return;
+        illumination_shader.Use();
+        glUniform1i(illumination_shader.UniformLocation("vertexCurvature"), vertexCurvature);
+        for (size_t i = 0; permutations && i < permutations->Size(); i++)
+        {
+            (*permutations)[i].Use();
+            glUniform1i((*permutations)[i].UniformLocation("vertexCurvature"), vertexCurvature);
+        }
+        applied_vertex_curvature = vertexCurvature;
+    };
+    // the G-buffer of the deferred shading has the size of the framebuffer (in the window, it can be bigger than the window on high DPI screens)
+    unique_ptr<DeferredShading> deferred;
+    deferred_shading = options.deferred;
+    auto deferredShading = [&]() -> DeferredShading*
+    {
+        if (!deferred_shading)
+            return nullptr;
+        if (!deferred)
+            deferred.reset(new DeferredShading(fragmentPath, options.headless ? options.width : width, options.headless ? options.height : height,
+                                               projection, lightClusters, shadowMapping.cache, options.programCache));
+        return deferred.get();
+    };
+    unique_ptr<DepthPrepass> prepass;
+    depth_prepass = options.depthPrepass;
+    auto depthPrepass = [&]() -> DepthPrepass*
+    {
+        if (!depth_prepass)
+            return nullptr;
+        if (!prepass)
+            prepass.reset(new DepthPrepass(options.programCache));
+        return prepass.get();
+    };
+    // the streams of the positions are created from the VBOs of the meshes which do not have them, when the depth pre-pass or the
+    // shadows are active (the first time one of them is activated at runtime, and then for the meshes loaded later)
+    auto buildPositionStreams = [&]()
+    {
+        if ((!depth_prepass || deferred_shading) && !shadow_mapping)
+            return;
+        for (Model& model : models)
+            model.BuildPositionStreams();
+    };
+
     // View matrix: the camera moves, so we just set to indentity now
     glm::mat4 view = glm::mat4(1.0f);
 
-    // Model and Normal transformation matrices for the objects in the scene: we set to identity
-    glm::mat4 armadilloModelMatrix = glm::mat4(1.0f);
-    glm::mat3 armadilloNormalMatrix = glm::mat3(1.0f);
-    glm::mat4 dragonModelMatrix = glm::mat4(1.0f);
-    glm::mat3 dragonNormalMatrix = glm::mat3(1.0f);
-    glm::mat4 bunnyModelMatrix = glm::mat4(1.0f);
-    glm::mat3 bunnyNormalMatrix = glm::mat3(1.0f);
-    glm::mat4 planeModelMatrix = glm::mat4(1.0f);
-    glm::mat3 planeNormalMatrix = glm::mat3(1.0f);
+    // we create the profiler (if not enabled, its methods do nothing)
+    Profiler profiler(options.profile || !options.trace.empty());
+    profiler.EnableTrace(!options.trace.empty());
+    GLfloat lastReport = 0.0f;
+
+    if (options.headless)
+    {
+        // we render in a Framebuffer Object with the requested resolution, and we read back the frames asynchronously
+        Framebuffer framebuffer(options.width, options.height);
+        FrameReadback readback(options.width, options.height);
+
+        // the camera follows the keyframes of the file, or an orbit around the scene, starting from the initial position of the interactive camera
+        CameraPath cameraPath;
+        if (options.cameraPath.empty())
+            cameraPath.Orbit(glm::vec3(0.0f, 1.0f, 0.0f), 9.0f, 0.0f);
+        else if (!cameraPath.Load(options.cameraPath))
+        {
+            illumination_shader.Delete();
+            glfwTerminate();
+            return -1;
+        }
+
+        // all the frames must show the complete scene, so we wait for the loading of the models
+        loader.Finish();
+        if (gpu_smoothing_iterations >= 0)
+        {
+            applyGpuSmoothing((GLuint)gpu_smoothing_iterations, options.gpuSmoothingCheck);
+            applied_gpu_smoothing = gpu_smoothing_iterations;
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (GLuint frame = 0; frame < options.frames; frame++)
+        {
+            profiler.BeginFrame();
+            CameraPose pose = cameraPath.Pose(frame, options.frames);
+            camera.SetPose(pose.position, pose.yaw, pose.pitch);
+            view = camera.GetViewMatrix();
+
+            if (smoothing_scale != applied_smoothing_scale)
+            {
+                for (Model& model : models)
+                    model.SetSmoothingScale(smoothing_scale);
+                applied_smoothing_scale = smoothing_scale;
+            }
+
+            buildBatches();
+            buildPositionStreams();
+            updateVertexCurvature();
+            framebuffer.Bind();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            RenderScene(illumination_shader, locations, permutations.get(), permutation_locations, deferredShading(), depthPrepass(), materialBuffer, lightClusters,
+                        shadow_mapping ? &shadowMapping : nullptr, objects, models, batches, projection, view, profiler, cullingPool);
+
+            // the readback of the frame is queued, and the image is saved when the GPU has completed it
+            char path[1024];
+            snprintf(path, sizeof(path), "%s_%04u.ppm", options.output.c_str(), frame);
+            readback.Capture(path);
+
+            // the animated rotation advances by a fixed time step
+            if (spinning)
+                orientationY += HEADLESS_TIME_STEP*spin_speed;
+            profiler.EndFrame();
+        }
+        readback.Finish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << options.frames << " frames (" << options.width << "x" << options.height << ") saved in " << seconds
+                  << " s (" << (seconds * 1000.0 / glm::max(options.frames, 1u)) << " ms/frame)" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
     // Rendering loop: this code is executed at each frame
-    while(!glfwWindowShouldClose(window))
+    while(!options.headless && !glfwWindowShouldClose(window))
     {
         // we determine the time passed from the beginning
         // and we calculate time difference between current frame rendering and the previous one
         GLfloat currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        profiler.BeginFrame();
 
         // Check is an I/O event is happening
         glfwPollEvents();
@@ -274,6 +863,33 @@ int main()
         // View matrix (=camera): position, view direction, camera "up" vector
         view = camera.GetViewMatrix();
 
+        // we upload a part of the models being loaded. The new meshes use scale 0 of the smoothed normals, so the current scale is applied again
+        // (and the smoothed normals computed on the GPU, if any, are computed for the new meshes only)
+        if (loader.Update(options.uploadBudget) > 0)
+        {
+            applied_smoothing_scale = 0;
+            if (applied_gpu_smoothing >= 0)
+                applyGpuSmoothing((GLuint)applied_gpu_smoothing, false);
+        }
+
+        // if the iterations of the smoothed normals computed on the GPU have been changed, the VBOs are updated
+        if (gpu_smoothing_iterations != applied_gpu_smoothing)
+        {
+            applyGpuSmoothing((GLuint)gpu_smoothing_iterations, false);
+            applied_gpu_smoothing = gpu_smoothing_iterations;
+        }
+
+        // if the scale of the smoothed normals has been changed, the meshes read the corresponding stream
+        if (smoothing_scale != applied_smoothing_scale)
+        {
+            for (Model& model : models)
+                model.SetSmoothingScale(smoothing_scale);
+            applied_smoothing_scale = smoothing_scale;
+        }
+        buildBatches();
+        buildPositionStreams();
+        updateVertexCurvature();
+
         // we "clear" the frame and z buffer
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -288,155 +904,594 @@ int main()
         if (spinning)
             orientationY+=(deltaTime*spin_speed);
 
-        /////////////////// PLANE ////////////////////////////////////////////////
-        // We render a plane under the objects. We apply the Lambert model to the plane, and we do not apply the rotation applied to the other objects.
-        illumination_shader.Use();
-        // for the plane, we use only Lambert model.
-        // Thus, we search inside the Shader Program the name of the subroutine, and we get the numerical index
-        GLuint index = glGetSubroutineIndex(illumination_shader.Program, GL_FRAGMENT_SHADER, "Lambert");
-        // we activate the subroutine using the index
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-
-        // we pass projection and view matrices to the Shader Program of the plane
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-
-        // we determine the position in the Shader Program of the uniform variables
-        GLint pointLightLocation = glGetUniformLocation(illumination_shader.Program, "pointLightPosition");
-        GLint matDiffuseLocation = glGetUniformLocation(illumination_shader.Program, "diffuseColor");
-        GLint kdLocation = glGetUniformLocation(illumination_shader.Program, "Kd");
-
-        // we assign the value to the uniform variables
-        glUniform3fv(pointLightLocation, 1, glm::value_ptr(lightPos0));
-        glUniform3fv(matDiffuseLocation, 1, planeMaterial);
-        glUniform1f(kdLocation, Kd);
-
-        // we create the transformation matrix
-        // we reset to identity at each frame
-        planeModelMatrix = glm::mat4(1.0f);
-        planeNormalMatrix = glm::mat3(1.0f);
-        planeModelMatrix = glm::translate(planeModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-        planeModelMatrix = glm::scale(planeModelMatrix, glm::vec3(10.0f, 1.0f, 10.0f));
-        planeNormalMatrix = glm::inverseTranspose(glm::mat3(view*planeModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(planeModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(illumination_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(planeNormalMatrix));
-
-        // we render the plane
-        planeModel.Draw();
-
-        /////////////////// OBJECTS ////////////////////////////////////////////////
-        // We use the same Shader Program for the objects, but in this case we will do shaders swapping
-        // we search inside the Shader Program the name of the subroutine currently selected, and we get the numerical index
-        index = glGetSubroutineIndex(illumination_shader.Program, GL_FRAGMENT_SHADER, shaders[current_subroutine].c_str());
-        // we activate the subroutine using the index (this is where shaders swapping happens)
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-
-        // we determine the position in the Shader Program of the uniform variables
-        GLint nearLocation = glGetUniformLocation(illumination_shader.Program, "near");
-        GLint farLocation = glGetUniformLocation(illumination_shader.Program, "far");
-        GLint matAmbientLocation = glGetUniformLocation(illumination_shader.Program, "ambientColor");
-        GLint matSpecularLocation = glGetUniformLocation(illumination_shader.Program, "specularColor");
-        GLint kaLocation = glGetUniformLocation(illumination_shader.Program, "Ka");
-        GLint ksLocation = glGetUniformLocation(illumination_shader.Program, "Ks");
-        GLint shineLocation = glGetUniformLocation(illumination_shader.Program, "shininess");
-        GLint lambdaLocation = glGetUniformLocation(illumination_shader.Program, "lambda");
-        GLint alphaLocation = glGetUniformLocation(illumination_shader.Program, "alpha");
-        GLint rLocation = glGetUniformLocation(illumination_shader.Program, "r");
-        GLint QlLocation = glGetUniformLocation(illumination_shader.Program, "Ql");
-        GLint myWeightALocation = glGetUniformLocation(illumination_shader.Program, "myWeightA");
-        GLint myWeightDLocation = glGetUniformLocation(illumination_shader.Program, "myWeightD");
-        GLint shinestColorLocation = glGetUniformLocation(illumination_shader.Program, "shinestColor");
-        GLint shinyColorLocation = glGetUniformLocation(illumination_shader.Program, "shinyColor");
-        GLint darkColorLocation = glGetUniformLocation(illumination_shader.Program, "darkColor");
-        GLint gloomyColorLocation = glGetUniformLocation(illumination_shader.Program, "gloomyColor");
-        GLint SurfaceColorLocation = glGetUniformLocation(illumination_shader.Program, "SurfaceColor");
-        GLint WarmColorLocation = glGetUniformLocation(illumination_shader.Program, "WarmColor");
-        GLint CoolColorLocation = glGetUniformLocation(illumination_shader.Program, "CoolColor");
-        GLint DiffuseWarmLocation = glGetUniformLocation(illumination_shader.Program, "DiffuseWarm");
-        GLint DiffuseCoolLocation = glGetUniformLocation(illumination_shader.Program, "DiffuseCool");
-
-        // we assign the value to the uniform variables
-        glUniform1f(nearLocation, near);
-        glUniform1f(farLocation, far);
-        glUniform3fv(matDiffuseLocation, 1, diffuseColor);
-        glUniform3fv(matAmbientLocation, 1, ambientColor);
-        glUniform3fv(matSpecularLocation, 1, specularColor);
-        glUniform1f(kaLocation, Ka);
-        glUniform1f(ksLocation, Ks);
-        glUniform1f(shineLocation, shininess);
-        glUniform1f(lambdaLocation, lambda);
-        glUniform1f(alphaLocation, alpha);
-        glUniform1f(rLocation, r);
-        glUniform1f(QlLocation, Ql);
-        glUniform1f(myWeightALocation, myWeightA);
-        glUniform1f(myWeightDLocation, myWeightD);
-        glUniform3fv(shinestColorLocation, 1, shinestColor);
-        glUniform3fv(shinyColorLocation, 1, shinyColor);
-        glUniform3fv(darkColorLocation, 1, darkColor);
-        glUniform3fv(gloomyColorLocation, 1, gloomyColor);
-        glUniform3fv(SurfaceColorLocation, 1, SurfaceColor);
-        glUniform3fv(WarmColorLocation, 1, WarmColor);
-        glUniform3fv(CoolColorLocation, 1, CoolColor);
-        glUniform1f(DiffuseWarmLocation, DiffuseWarm);
-        glUniform1f(DiffuseCoolLocation, DiffuseCool);
-
-        //ARMADILLO
-        // we create the transformation matrix and the normals transformation matrix
-        // we reset to identity at each frame
-        armadilloModelMatrix = glm::mat4(1.0f);
-        armadilloNormalMatrix = glm::mat3(1.0f);
-        armadilloModelMatrix = glm::translate(armadilloModelMatrix, glm::vec3(0.0f, 1.0f, 0.0f));
-        armadilloModelMatrix = glm::rotate(armadilloModelMatrix, glm::radians(orientationY), glm::vec3(0.0f, 1.0f, 0.0f));
-        armadilloModelMatrix = glm::scale(armadilloModelMatrix, glm::vec3(1.0f, 1.0f, 1.0f));
-        armadilloNormalMatrix = glm::inverseTranspose(glm::mat3(view*armadilloModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(armadilloModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(illumination_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(armadilloNormalMatrix));
-
-        // we render the armadillo
-        armadilloModel.Draw();
-
-        //BUNNY
-        // we create the transformation matrix and the normals transformation matrix
-        // we reset to identity at each frame
-        bunnyModelMatrix = glm::mat4(1.0f);
-        bunnyNormalMatrix = glm::mat3(1.0f);
-        bunnyModelMatrix = glm::translate(bunnyModelMatrix, glm::vec3(-4.0f, 1.5f, 0.0f));
-        bunnyModelMatrix = glm::rotate(bunnyModelMatrix, glm::radians(orientationY), glm::vec3(0.0f, 1.0f, 0.0f));
-        bunnyModelMatrix = glm::scale(bunnyModelMatrix, glm::vec3(0.006f, 0.006f, 0.006f));
-        bunnyNormalMatrix = glm::inverseTranspose(glm::mat3(view*bunnyModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(bunnyModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(illumination_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(bunnyNormalMatrix));
-
-        // we render the bunny
-        bunnyModel.Draw();
-
-        //DRAGON
-        // we create the transformation matrix and the normals transformation matrix
-        // we reset to identity at each frame
-        dragonModelMatrix = glm::mat4(1.0f);
-        dragonNormalMatrix = glm::mat3(1.0f);
-        dragonModelMatrix = glm::translate(dragonModelMatrix, glm::vec3(4.0f, 0.0f, 0.0f));
-        dragonModelMatrix = glm::rotate(dragonModelMatrix, glm::radians(orientationY), glm::vec3(0.0f, 1.0f, 0.0f));
-        dragonModelMatrix = glm::scale(dragonModelMatrix, glm::vec3(0.3f, 0.3f, 0.3f));
-        dragonNormalMatrix = glm::inverseTranspose(glm::mat3(view*dragonModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(dragonModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(illumination_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(dragonNormalMatrix));
-
-        // we render the dragon
-        dragonModel.Draw();
+        // we render the objects of the scene
+        RenderScene(illumination_shader, locations, permutations.get(), permutation_locations, deferredShading(), depthPrepass(), materialBuffer, lightClusters,
+                        shadow_mapping ? &shadowMapping : nullptr, objects, models, batches, projection, view, profiler, cullingPool);
 
         // Swapping back and front buffers
         glfwSwapBuffers(window);
+        profiler.EndFrame();
+
+        // every 2 seconds, we print the times of the last frames
+        if (profiler.IsEnabled() && currentFrame - lastReport > 2.0f)
+        {
+            profiler.Print();
+            PrintPrepassSavings(profiler);
+            if (options.lights > 0)
+                lightClusters.Print();
+            if (shadowMapping.cache.Frames() > 0)
+                shadowMapping.cache.Print();
+            lastReport = currentFrame;
+        }
+    }
+
+    // we print the final report and we save the trace
+    if (profiler.IsEnabled())
+    {
+        profiler.Finish();
+        profiler.Print();
+        PrintPrepassSavings(profiler);
+        if (options.lights > 0)
+            lightClusters.Print();
+        if (shadowMapping.cache.Frames() > 0)
+            shadowMapping.cache.Print();
+        if (!options.trace.empty())
+            profiler.WriteTrace(options.trace);
     }
 
     // when I exit from the graphics loop, it is because the application is closing
+    // we delete the models, and the meshes still being uploaded (their GPU buffers must be released while the context exists)
+    loader.Stop();
+    batches.clear();
+    models.clear();
     // we delete the Shader Program
     illumination_shader.Delete();
+    if (permutations)
+        permutations->Delete();
+    if (deferred)
+    {
+        deferred->geometry.Delete();
+        deferred->resolve.Delete();
+        deferred.reset();
+    }
+    if (prepass)
+        prepass->program.Delete();
+    // the buffers of the clustered lights and the cube maps of the shadows are released while the context exists
+    lightClusters = LightClusters();
+    shadowMapping.program.Delete();
+    shadowMapping.cache = ShadowCache();
     // we close and delete the created context
     glfwTerminate();
     return 0;
 }
 
+//////////////////////////////////////////
+// The function renders all the objects of the scene.
+// The ground objects (= the plane) are rendered with the Lambert model, and they are not rotated.
+// For the other objects, we use the same Shader Program, but we do shaders swapping using the subroutine currently selected
+// (or, with the permutations, the specialized program of the selected model).
+// With the deferred shading, all the objects are rendered with the same program in the G-buffer, and the models are applied at the end.
+// With the depth pre-pass, the objects are rendered first with the program of the pre-pass, and then shaded with the GL_EQUAL depth test.
+void RenderScene(Shader& shader, const ShaderLocations& locations, ShaderPermutations* permutations, const vector<ShaderLocations>& permutationLocations,
+                 DeferredShading* deferred, DepthPrepass* prepass, UniformBuffer<MaterialParameters>& materialBuffer, LightClusters& lightClusters,
+                 ShadowMapping* shadows, const vector<SceneObject>& objects, vector<Model>& models, vector<MeshBatch>& batches, const glm::mat4& projection,
+                 const glm::mat4& view, Profiler& profiler, ThreadPool& cullingPool)
+{
+    // the material parameters are sent to the GPU only if they have changed since the last frame
+    if (materialBuffer.Update(CurrentMaterialParameters()))
+        profiler.CountUniformUploads(1);
+
+    // the clustered lights are assigned to the clusters of the current view (on the threads of the culling), and their buffers
+    // are bound to the texture units read by all the programs of the illumination models
+    profiler.BeginPass("light clustering");
+    lightClusters.Update(view, &cullingPool);
+    lightClusters.Bind();
+    profiler.EndPass();
+
+    // we activate a Shader Program, and we pass projection and view matrices and the position of the light
+    // (the other parameters are in the uniform buffer). The uniforms are part of the state of each program, so, with the
+    // permutations, they are set again every time the program changes
+    // (-1 = the program with the subroutines, -2 = no program yet)
+    GLint boundProgram = -2;
+    auto useProgram = [&](GLint permutation)
+    {
+        if (permutation == boundProgram)
+            return;
+        const ShaderLocations& l = permutation < 0 ? locations : permutationLocations[permutation];
+        if (permutation < 0)
+            shader.Use();
+        else
+            (*permutations)[permutation].Use();
+        glUniformMatrix4fv(l.projectionMatrix, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(l.viewMatrix, 1, GL_FALSE, glm::value_ptr(view));
+        glUniform3fv(l.pointLight, 1, glm::value_ptr(lightPos0));
+        glUniform1i(l.shadows, shadows != nullptr);
+        profiler.CountUniformUploads(4);
+        boundProgram = permutation;
+    };
+    // view frustum culling: the world-space bounding spheres of the objects are tested together (the models still loading have empty bounds)
+    Frustum frustum(projection * view);
+    vector<glm::mat4> modelMatrices(objects.size());
+    vector<Bounds> worldBounds(objects.size());
+    object_culler.Resize(objects.size());
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        modelMatrices[i] = objects[i].ModelMatrix(orientationY);
+        worldBounds[i] = models[i].GetBounds().Transform(modelMatrices[i]);
+        object_culler.Set(i, worldBounds[i].center, worldBounds[i].radius);
+    }
+    object_culler.Cull(frustum, &cullingPool);
+    vector<bool> inFrustum(objects.size());
+    for (size_t i = 0; i < objects.size(); i++)
+        inFrustum[i] = object_culler.IsVisible(i) && frustum.IntersectsBox(worldBounds[i].boxMin, worldBounds[i].boxMax);
+
+    // shadow map of the main light: the casters are not culled with the view frustum, because they can cast shadows inside it
+    if (shadows)
+    {
+        profiler.BeginPass("shadow map");
+        UpdateShadowMap(*shadows, objects, models, modelMatrices, worldBounds, profiler);
+        shadows->cache.Bind();
+        profiler.EndPass();
+    }
+
+    // occlusion culling: the occluders of the visible objects with the biggest projected spheres are rasterized in the depth buffer
+    if (occlusion_culling)
+    {
+        vector<pair<GLfloat, size_t>> occluders;
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            if (!inFrustum[i])
+                continue;
+            GLfloat distance = glm::length(glm::vec3(view * glm::vec4(worldBounds[i].center, 1.0f))) - worldBounds[i].radius;
+            occluders.push_back(make_pair(distance > 0.0f ? worldBounds[i].radius / distance : 1e30f, i));
+        }
+        // the objects with the same size are ordered by index, so the selection is deterministic
+        sort(occluders.begin(), occluders.end(), [](const pair<GLfloat, size_t>& a, const pair<GLfloat, size_t>& b)
+             { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+        occlusion_culler.Begin(projection * view);
+        for (size_t k = 0; k < occluders.size() && k < OCCLUSION_DEFAULT_MAX_OCCLUDERS; k++)
+            models[occluders[k].second].AddOccluders(occlusion_culler, modelMatrices[occluders[k].second]);
+        occlusion_culler.Rasterize(&cullingPool);
+    }
+
+    // the objects outside the frustum, or hidden by the occluders, are skipped before any OpenGL call (the boxes refine the test of the spheres).
+    // For the visible ones, we choose the levels of detail from the projected error, and, with the meshlets, only the clusters inside the frustum
+    // and facing the camera are submitted (the meshes without meshlets are rendered entirely): the selection is made once, so the depth
+    // pre-pass and the shading pass render the same triangles
+    vector<size_t> visible;
+    vector<GLuint64> triangles(objects.size(), 0);
+    vector<MeshBatch*> objectBatches(objects.size(), nullptr);
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        if (!inFrustum[i])
+        {
+            profiler.CountCulled(1);
+            continue;
+        }
+        if (occlusion_culling && !occlusion_culler.IsVisible(worldBounds[i]))
+        {
+            profiler.CountOccluded(1);
+            continue;
+        }
+        if (lod_max_error > 0.0f)
+            models[i].SelectLod(view * modelMatrices[i], lod_pixels_per_unit, lod_max_error);
+        triangles[i] = models[i].CullMeshlets(view * modelMatrices[i], projection, &cullingPool);
+        // the batch renders the levels selected for the meshes, if they read the smoothed normals in their VBOs
+        if (batches[i].NumMeshes() > 0 && batches[i].NumMeshes() == models[i].meshes.size() && models[i].meshes[0].SmoothingScale() == 0)
+        {
+            objectBatches[i] = &batches[i];
+            for (size_t m = 0; m < models[i].meshes.size(); m++)
+                batches[i].SetLod(m, models[i].meshes[m].Lod());
+        }
+        visible.push_back(i);
+    }
+
+    // depth pre-pass: the visible objects write only the depth, reading only the stream of the positions. The samples which pass the
+    // depth test are the fragments which the shading pass would shade without the pre-pass
+    if (prepass && !deferred)
+    {
+        profiler.BeginPass("depth pre-pass");
+        profiler.BeginSamples(PREPASS_SAMPLES);
+        prepass->program.Use();
+        glUniformMatrix4fv(prepass->locations.projectionMatrix, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(prepass->locations.viewMatrix, 1, GL_FALSE, glm::value_ptr(view));
+        profiler.CountUniformUploads(2);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        for (size_t i : visible)
+        {
+            glUniformMatrix4fv(prepass->locations.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrices[i]));
+            // the batch has its own quantization of the positions, so the depth of its objects is written by the batch itself
+            if (objectBatches[i])
+                objectBatches[i]->Draw();
+            else
+                models[i].DrawDepth();
+            profiler.CountUniformUploads(1);
+            if (profiler.IsEnabled())
+                profiler.CountDraw(objectBatches[i] ? (GLuint)objectBatches[i]->NumDrawCalls() : (GLuint)models[i].meshes.size(), triangles[i]);
+        }
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        profiler.EndSamples();
+        profiler.EndPass();
+        // the shading pass keeps only the fragments at the depth of the visible surfaces, and the depth buffer is already complete
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    // (if there is no Lambert model, the ground uses the first program)
+    GLint lambertPermutation = permutations ? glm::max(permutations->Find("Lambert"), 0) : -1;
+    // with the deferred shading, the geometry pass renders in the G-buffer, and the full-screen pass in the current framebuffer
+    GLint targetFramebuffer = 0;
+    if (deferred)
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFramebuffer);
+        deferred->gbuffer.Bind();
+        deferred->geometry.Use();
+        glUniformMatrix4fv(deferred->geometryLocations.projectionMatrix, 1, GL_FALSE, glm::value_ptr(projection));
+        glUniformMatrix4fv(deferred->geometryLocations.viewMatrix, 1, GL_FALSE, glm::value_ptr(view));
+        profiler.CountUniformUploads(2);
+    }
+    else if (!permutations)
+        useProgram(-1);
+
+    // in the forward shading, the samples which pass the depth test are the fragments shaded by the illumination model
+    if (!deferred)
+        profiler.BeginSamples(SHADING_SAMPLES);
+    for (size_t i : visible)
+    {
+        const SceneObject& object = objects[i];
+
+        // each object is measured as a separate pass
+        profiler.BeginPass(object.name);
+
+        // with the deferred shading, the object writes its identifiers in the G-buffer (0 = no object, so the first object is 1)
+        if (deferred)
+        {
+            glUniform1ui(deferred->objectID, (GLuint)(i % 65535) + 1);
+            glUniform1ui(deferred->materialID, object.ground ? GROUND_MATERIAL : OBJECT_MATERIAL);
+        }
+        // with the permutations, we activate the program of the model (this is where shaders swapping happens)
+        else if (permutations)
+        {
+            useProgram(object.ground ? lambertPermutation : (GLint)current_subroutine);
+            glUniform3fv(permutationLocations[boundProgram].matDiffuse, 1, object.ground ? planeMaterial : diffuseColor);
+        }
+        // otherwise, we activate the subroutine using its index (this is where shaders swapping happens)
+        // N.B.) the subroutine state is not part of the program state, so we set it for every object
+        else if (object.ground)
+        {
+            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &locations.lambertIndex);
+            glUniform3fv(locations.matDiffuse, 1, planeMaterial);
+        }
+        else
+        {
+            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &subroutine_indices[current_subroutine]);
+            glUniform3fv(locations.matDiffuse, 1, diffuseColor);
+        }
+
+        // we create the transformation matrix and the normals transformation matrix
+        const ShaderLocations& l = deferred ? deferred->geometryLocations : (boundProgram < 0 ? locations : permutationLocations[boundProgram]);
+        const glm::mat4& modelMatrix = modelMatrices[i];
+        glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(view*modelMatrix));
+        glUniformMatrix4fv(l.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+        glUniformMatrix3fv(l.normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+
+        // we render the object, with the levels of detail and the meshlets selected above
+        if (objectBatches[i])
+            objectBatches[i]->Draw();
+        else
+            models[i].DrawMeshlets();
+
+        // subroutine (or program, or identifiers), color, model and normal matrices
+        profiler.CountUniformUploads(4);
+        if (profiler.IsEnabled())
+            profiler.CountDraw(objectBatches[i] ? (GLuint)objectBatches[i]->NumDrawCalls() : (GLuint)models[i].meshes.size(), triangles[i]);
+        profiler.EndPass();
+    }
+    if (!deferred)
+        profiler.EndSamples();
+    // the default depth test is restored
+    if (prepass && !deferred)
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    // full-screen pass of the deferred shading: the selected model is evaluated once for each pixel covered by an object
+    // (the other pixels keep the clear color, and the depth test is not needed)
+    if (deferred)
+    {
+        profiler.BeginPass("deferred shading");
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+        deferred->resolve.Use();
+        glUniformMatrix4fv(deferred->resolveLocations.viewMatrix, 1, GL_FALSE, glm::value_ptr(view));
+        glUniform3fv(deferred->resolveLocations.pointLight, 1, glm::value_ptr(lightPos0));
+        glUniform1i(deferred->resolveLocations.shadows, shadows != nullptr);
+        glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &deferred->resolveIndices[current_subroutine]);
+        profiler.CountUniformUploads(4);
+        deferred->gbuffer.BindTextures();
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        deferred->gbuffer.DrawFullscreen();
+        glEnable(GL_DEPTH_TEST);
+        profiler.CountDraw(1, 1);
+        profiler.EndPass();
+    }
+}
+
+//////////////////////////////////////////
+// we create the programs of the deferred shading, and we set the uniforms which do not change during the rendering
+DeferredShading::DeferredShading(const GLchar* fragmentPath, GLsizei width, GLsizei height, const glm::mat4& projection, const LightClusters& lightClusters,
+                                 const ShadowCache& shadowCache, bool programCache)
+    : geometry("illumination_models_modified_vt.vert", "gbuffer_fr.frag", programCache ? string("gbuffer_fr.frag") + PROGRAM_CACHE_EXTENSION : string()),
+      resolve("fullscreen_vt.vert", fragmentPath, programCache ? string(fragmentPath) + ".deferred" + PROGRAM_CACHE_EXTENSION : string(),
+              vector<string>(1, "DEFERRED")),
+      gbuffer(width, height)
+{
+    this->geometryLocations = GetShaderLocations(this->geometry);
+    this->objectID = this->geometry.UniformLocation("objectID");
+    this->materialID = this->geometry.UniformLocation("materialID");
+    this->resolveLocations = GetShaderLocations(this->resolve);
+    // the indices of the subroutines of the full-screen pass are searched by name once, since they can differ from the ones
+    // of the forward program
+    for (const string& name : shaders)
+        this->resolveIndices.push_back(this->resolve.SubroutineIndex(GL_FRAGMENT_SHADER, name));
+
+    this->resolve.BindUniformBlock("MaterialParameters", MATERIAL_BINDING_POINT);
+    this->resolve.Use();
+    glUniform1i(this->resolve.UniformLocation("gBufferNormals"), GBUFFER_NORMALS);
+    glUniform1i(this->resolve.UniformLocation("gBufferDepth"), GBUFFER_DEPTH);
+    glUniform1i(this->resolve.UniformLocation("gBufferIDs"), GBUFFER_IDS);
+    // diffusive components of the materials, in the order of the identifiers
+    GLfloat materialDiffuseColors[6];
+    memcpy(materialDiffuseColors + 3 * GROUND_MATERIAL, planeMaterial, 3 * sizeof(GLfloat));
+    memcpy(materialDiffuseColors + 3 * OBJECT_MATERIAL, diffuseColor, 3 * sizeof(GLfloat));
+    glUniform3fv(this->resolve.UniformLocation("materialDiffuseColor"), 2, materialDiffuseColors);
+    glUniform2f(this->resolve.UniformLocation("inverseProjectionScale"), 1.0f / projection[0][0], 1.0f / projection[1][1]);
+    lightClusters.SetupProgram(this->resolve.Program);
+    shadowCache.SetupProgram(this->resolve.Program);
+    std::cout << "Deferred shading: G-buffer " << width << "x" << height << " (" << GBUFFER_BYTES_PER_PIXEL << " bytes per pixel), programs "
+              << ((this->geometry.LoadedFromCache() && this->resolve.LoadedFromCache()) ? "loaded from the binary cache" : "compiled") << std::endl;
+}
+
+//////////////////////////////////////////
+// we create the program of the depth pre-pass (it has only the projection, view and model matrices)
+DepthPrepass::DepthPrepass(bool programCache)
+    : program("depth_prepass_vt.vert", "depth_prepass_fr.frag", programCache ? string("depth_prepass_fr.frag") + PROGRAM_CACHE_EXTENSION : string())
+{
+    this->locations = GetShaderLocations(this->program);
+    std::cout << "Depth pre-pass: program " << (this->program.LoadedFromCache() ? "loaded from the binary cache" : "compiled") << std::endl;
+}
+
+//////////////////////////////////////////
+// we create the program of the casters of the shadow map (it reads only the stream of the positions, like the depth pre-pass)
+ShadowMapping::ShadowMapping(bool programCache)
+    : program("shadow_vt.vert", "shadow_fr.frag", programCache ? string("shadow_fr.frag") + PROGRAM_CACHE_EXTENSION : string())
+{
+    this->modelMatrix = this->program.UniformLocation("modelMatrix");
+    this->lightSpaceMatrix = this->program.UniformLocation("lightSpaceMatrix");
+    this->lightPosition = this->program.UniformLocation("pointLightPosition");
+    this->cache.SetupProgram(this->program.Program);
+}
+
+//////////////////////////////////////////
+// the state of each object is compared with the one in the static cache, and the faces of the changed objects are invalidated;
+// then the cube maps are updated, rendering in each face the casters whose bounds intersect its frustum
+void UpdateShadowMap(ShadowMapping& shadows, const vector<SceneObject>& objects, vector<Model>& models, const vector<glm::mat4>& modelMatrices,
+                     const vector<Bounds>& worldBounds, Profiler& profiler)
+{
+    ShadowCache& cache = shadows.cache;
+    cache.SetLight(lightPos0);
+    shadows.casters.resize(objects.size());
+    vector<bool> dynamic(objects.size(), false);
+    vector<Bounds> dynamicBounds;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        if (objects[i].ground)
+            continue;
+        dynamic[i] = objects[i].spinning && spinning;
+        if (dynamic[i])
+            dynamicBounds.push_back(worldBounds[i]);
+        ShadowMapping::CachedCaster& caster = shadows.casters[i];
+        bool cached = !dynamic[i];
+        if (cached == caster.cached && (!cached || (caster.modelMatrix == modelMatrices[i] && caster.meshes == models[i].meshes.size())))
+            continue;
+        if (caster.cached)
+            cache.Invalidate(caster.bounds);
+        if (cached)
+            cache.Invalidate(worldBounds[i]);
+        caster.cached = cached;
+        caster.modelMatrix = modelMatrices[i];
+        caster.meshes = models[i].meshes.size();
+        caster.bounds = worldBounds[i];
+    }
+
+    shadows.program.Use();
+    glUniform3fv(shadows.lightPosition, 1, glm::value_ptr(lightPos0));
+    profiler.CountUniformUploads(1);
+    // the casters of a face: the static ones in the cache, the dynamic ones in the shadow map
+    auto drawCasters = [&](bool dynamicCasters, const glm::mat4& lightSpaceMatrix, const Frustum& frustum)
+    {
+        glUniformMatrix4fv(shadows.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+        profiler.CountUniformUploads(1);
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            if (objects[i].ground || dynamic[i] != dynamicCasters || worldBounds[i].radius < 0.0f ||
+                !frustum.IntersectsSphere(worldBounds[i].center, worldBounds[i].radius))
+                continue;
+            glUniformMatrix4fv(shadows.modelMatrix, 1, GL_FALSE, glm::value_ptr(modelMatrices[i]));
+            models[i].DrawShadow();
+            profiler.CountUniformUploads(1);
+            profiler.CountDraw((GLuint)models[i].meshes.size(), 0);
+        }
+    };
+    cache.Update(dynamicBounds,
+                 [&](GLuint, const glm::mat4& lightSpaceMatrix, const Frustum& frustum) { drawCasters(false, lightSpaceMatrix, frustum); },
+                 [&](GLuint, const glm::mat4& lightSpaceMatrix, const Frustum& frustum) { drawCasters(true, lightSpaceMatrix, frustum); });
+}
+
+//////////////////////////////////////////
+// the samples of the pre-pass are the fragments which pass the depth test when the objects are rendered in order (= the invocations of
+// the fragment shader without the pre-pass, with the early depth test), and the samples of the shading pass are the actual invocations
+void PrintPrepassSavings(const Profiler& profiler)
+{
+    const RollingStats* prepassSamples = profiler.Samples(PREPASS_SAMPLES);
+    const RollingStats* shadingSamples = profiler.Samples(SHADING_SAMPLES);
+    if (!prepassSamples || !shadingSamples || prepassSamples->Count() == 0)
+        return;
+    double saved = prepassSamples->Mean() - shadingSamples->Mean();
+    std::cout << "depth pre-pass: saved fragment shader invocations/frame: " << (GLuint64)glm::max(saved, 0.0) << " ("
+              << (prepassSamples->Mean() > 0.0 ? 100.0 * saved / prepassSamples->Mean() : 0.0) << "%)" << std::endl;
+}
+
+//////////////////////////////////////////
+// the lights are placed on a spiral over the plane (golden angle between consecutive lights), at different heights,
+// with saturated colors along the hue circle: the layout is deterministic, so the frames of the headless mode can be compared
+vector<PointLight> SceneLights(GLuint count)
+{
+    vector<PointLight> lights(count);
+    for (GLuint i = 0; i < count; i++)
+    {
+        GLfloat t = (i + 0.5f) / count;
+        GLfloat angle = i * 2.39996323f;
+        GLfloat distance = 9.0f * sqrt(t);
+        lights[i].position = glm::vec3(distance * cos(angle), 0.3f + 2.2f * glm::fract(i * 0.618034f), distance * sin(angle));
+        lights[i].radius = 1.5f + 1.5f * glm::fract(i * 0.381966f);
+        // hue to RGB
+        GLfloat hue = glm::fract(i * 0.137f) * 6.0f;
+        lights[i].color = glm::clamp(glm::vec3(fabs(hue - 3.0f) - 1.0f, 2.0f - fabs(hue - 2.0f), 2.0f - fabs(hue - 4.0f)), 0.0f, 1.0f);
+        lights[i].intensity = 1.5f;
+    }
+    return lights;
+}
+
+//////////////////////////////////////////
+// we retrieve the locations of the uniforms and the index of the subroutine used for the plane
+// (GL_INVALID_INDEX in the specialized programs, which have no subroutines)
+ShaderLocations GetShaderLocations(const Shader& shader)
+{
+    ShaderLocations locations;
+    locations.projectionMatrix = shader.UniformLocation("projectionMatrix");
+    locations.viewMatrix = shader.UniformLocation("viewMatrix");
+    locations.modelMatrix = shader.UniformLocation("modelMatrix");
+    locations.normalMatrix = shader.UniformLocation("normalMatrix");
+    locations.pointLight = shader.UniformLocation("pointLightPosition");
+    locations.matDiffuse = shader.UniformLocation("diffuseColor");
+    locations.shadows = shader.UniformLocation("shadows");
+    locations.lambertIndex = shader.SubroutineIndex(GL_FRAGMENT_SHADER, "Lambert");
+    return locations;
+}
+
+//////////////////////////////////////////
+// we read the options from the command line arguments
+bool ParseArguments(int argc, char* argv[], RenderOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        // the options with a value need another argument
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--headless")
+            options.headless = true;
+        else if (arg == "--egl")
+            options.egl = true;
+        else if (arg == "--scene" && hasValue)
+            options.scenePath = argv[++i];
+        else if (arg == "--camera-path" && hasValue)
+            options.cameraPath = argv[++i];
+        else if (arg == "--subroutine" && hasValue)
+            options.subroutine = argv[++i];
+        else if (arg == "--output" && hasValue)
+            options.output = argv[++i];
+        else if (arg == "--width" && hasValue)
+            options.width = (GLuint)atoi(argv[++i]);
+        else if (arg == "--height" && hasValue)
+            options.height = (GLuint)atoi(argv[++i]);
+        else if (arg == "--frames" && hasValue)
+            options.frames = (GLuint)atoi(argv[++i]);
+        else if (arg == "--profile")
+            options.profile = true;
+        else if (arg == "--trace" && hasValue)
+            options.trace = argv[++i];
+        else if (arg == "--smoothing-scales" && hasValue)
+        {
+            // list of values separated by commas
+            stringstream list(argv[++i]);
+            string value;
+            while (getline(list, value, ','))
+                if (!value.empty())
+                    options.smoothingScales.push_back((GLfloat)atof(value.c_str()));
+        }
+        else if (arg == "--smoothing-scale" && hasValue)
+            options.smoothingScale = (GLuint)atoi(argv[++i]);
+        else if (arg == "--upload-budget" && hasValue)
+            options.uploadBudget = (size_t)(atof(argv[++i]) * 1024.0 * 1024.0);
+        else if (arg == "--mesh-optimization" && hasValue)
+        {
+            string value = argv[++i];
+            if (value == "none")
+                options.optimization = MESH_OPTIMIZATION_NONE;
+            else if (value == "cache")
+                options.optimization = MESH_OPTIMIZATION_VERTEX_CACHE;
+            else if (value == "overdraw")
+                options.optimization = MESH_OPTIMIZATION_OVERDRAW;
+            else
+            {
+                std::cout << "Invalid mesh optimization: " << value << " (none, cache, overdraw)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--lod-levels" && hasValue)
+            options.lodLevels = (GLuint)atoi(argv[++i]);
+        else if (arg == "--lod-error" && hasValue)
+            options.lodError = (GLfloat)atof(argv[++i]);
+        else if (arg == "--meshlets")
+            options.meshlets = true;
+        else if (arg == "--occlusion-culling")
+            options.occlusionCulling = true;
+        else if (arg == "--screen-space-curvature")
+            options.vertexCurvature = false;
+        else if (arg == "--gpu-smoothing" && hasValue)
+            options.gpuSmoothing = glm::clamp(atoi(argv[++i]), 0, (int)MULTISCALE_MAX_ITERATIONS);
+        else if (arg == "--gpu-smoothing-check")
+        {
+            options.gpuSmoothingCheck = true;
+            options.gpuSmoothing = glm::max(options.gpuSmoothing, 0);
+        }
+        else if (arg == "--gpu-smoothing-fallback")
+            options.gpuSmoothingFallback = true;
+        else if (arg == "--no-program-cache")
+            options.programCache = false;
+        else if (arg == "--shader-permutations")
+            options.permutations = true;
+        else if (arg == "--deferred")
+            options.deferred = true;
+        else if (arg == "--depth-prepass")
+            options.depthPrepass = true;
+        else if (arg == "--shadows")
+            options.shadows = true;
+        else if (arg == "--lights" && hasValue)
+            options.lights = (GLuint)glm::clamp(atoi(argv[++i]), 0, (int)CLUSTER_MAX_TOTAL_LIGHTS);
+        else
+        {
+            std::cout << "Unknown or incomplete argument: " << arg << std::endl;
+            std::cout << "Usage: " << argv[0] << " [--headless] [--egl] [--scene file] [--camera-path file] [--subroutine name]"
+                      << " [--width w] [--height h] [--frames n] [--output prefix] [--profile] [--trace file]"
+                      << " [--smoothing-scales s1,s2,...] [--smoothing-scale k] [--upload-budget MB]"
+                      << " [--mesh-optimization none|cache|overdraw] [--lod-levels n] [--lod-error pixels] [--meshlets]"
+                      << " [--occlusion-culling] [--screen-space-curvature] [--gpu-smoothing iterations] [--gpu-smoothing-check]"
+                      << " [--gpu-smoothing-fallback] [--no-program-cache] [--shader-permutations] [--deferred]"
+                      << " [--depth-prepass] [--lights n] [--shadows]" << std::endl;
+            return false;
+        }
+    }
+    if (options.width == 0 || options.height == 0)
+    {
+        std::cout << "Invalid resolution: " << options.width << "x" << options.height << std::endl;
+        return false;
+    }
+    return true;
+}
+
 ///////////////////////////////////////////
 // The function parses the content of the Shader Program, searches for the Subroutine type names,
 // the subroutines implemented for each type, print the names of the subroutines on the terminal, and add the names of
@@ -477,6 +1532,7 @@ void SetupShader(int program)
             glGetActiveSubroutineName(program, GL_FRAGMENT_SHADER, s[j], 256, &len, name);
             std::cout << "\t" << s[j] << " - " << name << "\n";
             shaders.push_back(name);
+            subroutine_indices.push_back(s[j]);
         }
         std::cout << std::endl;
 
@@ -484,6 +1540,29 @@ void SetupShader(int program)
     }
 }
 
+//////////////////////////////////////////
+// we collect the current values of the material and paper parameters in the structure sent to the uniform buffer
+MaterialParameters CurrentMaterialParameters()
+{
+    MaterialParameters m;
+    m.ambientColor = glm::make_vec3(ambientColor);  m.Ka = Ka;
+    m.specularColor = glm::make_vec3(specularColor); m.Ks = Ks;
+    m.shinestColor = glm::make_vec3(shinestColor);  m.shininess = shininess;
+    m.shinyColor = glm::make_vec3(shinyColor);      m.lambda = lambda;
+    m.darkColor = glm::make_vec3(darkColor);        m.alpha = alpha;
+    m.gloomyColor = glm::make_vec3(gloomyColor);    m.r = r;
+    m.SurfaceColor = glm::make_vec3(SurfaceColor);  m.Ql = Ql;
+    m.WarmColor = glm::make_vec3(WarmColor);        m.DiffuseWarm = DiffuseWarm;
+    m.CoolColor = glm::make_vec3(CoolColor);        m.DiffuseCool = DiffuseCool;
+    m.Kd = Kd;
+    m.myWeightA = myWeightA;
+    m.myWeightD = myWeightD;
+    m.near = near;
+    m.far = far;
+    m.padding[0] = m.padding[1] = m.padding[2] = 0.0f;
+    return m;
+}
+
 //////////////////////////////////////////
 // we print on console the name of the currently used shader subroutine
 void PrintCurrentShader(int subroutine)
@@ -510,6 +1589,43 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if(key == GLFW_KEY_L && action == GLFW_PRESS)
         wireframe=!wireframe;
 
+    // if N is pressed, we switch to the next scale of the smoothed normals
+    if(key == GLFW_KEY_N && action == GLFW_PRESS && num_smoothing_scales > 1)
+    {
+        smoothing_scale = (smoothing_scale + 1) % num_smoothing_scales;
+        std::cout << "Smoothed normals scale: " << smoothing_scale << std::endl;
+    }
+
+    // if G is pressed, the smoothed normals are computed on the GPU with twice the iterations of diffusion (0, 1, 2, ..., 256, 0),
+    // and the scale 0 of the smoothed normals (the one in the VBOs) is selected
+    if(key == GLFW_KEY_G && action == GLFW_PRESS)
+    {
+        gpu_smoothing_iterations = gpu_smoothing_iterations <= 0 ? gpu_smoothing_iterations + 1 : (gpu_smoothing_iterations >= 256 ? 0 : 2 * gpu_smoothing_iterations);
+        smoothing_scale = 0;
+        std::cout << "GPU smoothed normals iterations: " << gpu_smoothing_iterations << std::endl;
+    }
+
+    // if F is pressed, we switch between the forward and the deferred shading
+    if(key == GLFW_KEY_F && action == GLFW_PRESS)
+    {
+        deferred_shading = !deferred_shading;
+        std::cout << (deferred_shading ? "Deferred" : "Forward") << " shading" << std::endl;
+    }
+
+    // if H is pressed, we activate/deactivate the shadows of the main point light
+    if(key == GLFW_KEY_H && action == GLFW_PRESS)
+    {
+        shadow_mapping = !shadow_mapping;
+        std::cout << "Shadows " << (shadow_mapping ? "on" : "off") << std::endl;
+    }
+
+    // if Z is pressed, we activate/deactivate the depth pre-pass of the forward shading
+    if(key == GLFW_KEY_Z && action == GLFW_PRESS)
+    {
+        depth_prepass = !depth_prepass;
+        std::cout << "Depth pre-pass " << (depth_prepass ? "on" : "off") << std::endl;
+    }
+
     // pressing a key number, we change the shader applied to the models
     // if the key is between 1 and 9, we proceed and check if the pressed key corresponds to
     // a valid subroutine
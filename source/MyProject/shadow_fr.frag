@@ -0,0 +1,32 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+shadow_fr.frag: Fragment shader of the faces of the cube shadow map of the point light (see include/utils/shadow_cache.h)
+The depth is replaced by the distance from the light, divided by the far plane: the same value is computed by the illumination models
+for the comparison, with the direction from the light as lookup vector of the cube map
+
+N.B.) "shadow_vt.vert" must be used as vertex shader
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+// position in world coordinates
+in vec3 worldPosition;
+
+// position of the light (in world coordinates) and far plane of the shadow map
+uniform vec3 pointLightPosition;
+uniform float shadowFar;
+
+void main(void)
+{
+  gl_FragDepth = length(worldPosition - pointLightPosition) / shadowFar;
+}
@@ -0,0 +1,41 @@
+/*
+Project of Francesco Brischetto: This project is based based on "Geometry-based shading for shape depiction enhancement".
+                                 It applies an NPR effect to the illumination model that enhances object shape
+                                 based on object local geometry
+
+shadow_vt.vert: Vertex shader of the faces of the cube shadow map of the point light (see include/utils/shadow_cache.h)
+It reads only the positions (location 0, from the separate stream of the meshes, see N.B. 10 in mesh_v1.h) and the decoding attributes,
+and it passes the position in world coordinates to the fragment shader, which writes the distance from the light
+
+author: Francesco Brischetto  mat. 958022
+
+Real-Time Graphics Programming - a.a. 2020/2021
+Master degree in Computer Science
+Universita' degli Studi di Milano
+
+*/
+
+#version 410 core
+
+// vertex position in object coordinates
+layout (location = 0) in vec3 position;
+
+// parameters to decode the vertex format of the mesh (see vertex_format.h)
+layout (location = 6) in vec4 decodeScale;
+layout (location = 7) in vec4 decodeOffset;
+
+uniform mat4 modelMatrix;
+// projection * view of the face of the cube map
+uniform mat4 lightSpaceMatrix;
+
+// position in world coordinates
+out vec3 worldPosition;
+
+void main(){
+
+  vec3 decodedPosition = decodeOffset.xyz + decodeScale.xyz * position;
+  vec4 world = modelMatrix * vec4( decodedPosition, 1.0 );
+  worldPosition = world.xyz;
+  gl_Position = lightSpaceMatrix * world;
+
+}